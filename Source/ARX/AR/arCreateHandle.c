@@ -49,6 +49,8 @@
 #include <ARX/AR/ar.h>
 #include <stdio.h>
 #include <math.h>
+#include "arParallel.h"
+#include "arLabelingSub/arLabelingPrivate.h"
 
 ARHandle *arCreateHandle(ARParamLT *paramLT)
 {
@@ -56,6 +58,8 @@ ARHandle *arCreateHandle(ARParamLT *paramLT)
 
     arMalloc(handle, ARHandle, 1);
 
+    arLabelingSubSIMDInit(); // Here rather than lazily, as labeling may run on several threads.
+
     handle->arDebug                 = AR_DEBUG_DISABLE;
 #if !AR_DISABLE_LABELING_DEBUG_MODE
     handle->labelInfo.bwImage       = NULL;
@@ -70,6 +74,8 @@ ARHandle *arCreateHandle(ARParamLT *paramLT)
     handle->arMarkerExtractionMode  = AR_DEFAULT_MARKER_EXTRACTION_MODE;
     handle->pattRatio               = AR_PATT_RATIO;
     handle->matrixCodeType          = AR_MATRIX_CODE_TYPE_DEFAULT;
+    handle->parallel                = NULL;
+    handle->bracket                 = NULL;
 
     handle->arParamLT           = paramLT;
     handle->xsize               = paramLT->param.xsize;
@@ -89,6 +95,14 @@ ARHandle *arCreateHandle(ARParamLT *paramLT)
     handle->arLabelingThreshMode = -1;
     arSetLabelingThreshMode(handle, AR_LABELING_THRESH_MODE_DEFAULT);
     arSetLabelingThreshModeAutoInterval(handle, AR_LABELING_THRESH_AUTO_INTERVAL_DEFAULT);
+    arSetLabelingThreshModeAdaptiveHalfRes(handle, AR_LABELING_THRESH_ADAPTIVE_HALF_RES_DEFAULT);
+    handle->arDetectionROINum = 0;
+    handle->arDetectionROIMarkerNum = 0;
+    arSetDetectionROIMode(handle, AR_DETECTION_ROI_MODE_DEFAULT);
+    arSetDetectionROIFullScanInterval(handle, AR_DETECTION_ROI_FULL_SCAN_INTERVAL_DEFAULT);
+    handle->arDetectionDownsampleImage = NULL;
+    arSetDetectionDownsample(handle, AR_DETECTION_DOWNSAMPLE_DEFAULT);
+    arSetDetectionThreadNum(handle, AR_DETECTION_THREAD_NUM_DEFAULT);
     
     return handle;
 }
@@ -102,6 +116,9 @@ int arDeleteHandle(ARHandle *handle)
         handle->arImageProcInfo = NULL;
     }
     
+    arParallelFinal(&(handle->parallel));
+    arBracketFinal(&(handle->bracket));
+    free(handle->arDetectionDownsampleImage);
     //if(handle->arParamLT != NULL) arParamLTFree(&handle->arParamLT);
     free(handle->labelInfo.labelImage);
 #if !AR_DISABLE_LABELING_DEBUG_MODE
@@ -239,6 +256,69 @@ int arGetLabelingThreshModeAutoInterval(const ARHandle *handle)
     return (handle->arLabelingThreshAutoInterval);
 }
 
+void arSetLabelingThreshModeAdaptiveHalfRes(ARHandle *handle, const int halfRes)
+{
+    if (!handle) return;
+
+    handle->arLabelingThreshAdaptiveHalfRes = (halfRes ? TRUE : FALSE);
+}
+
+int arGetLabelingThreshModeAdaptiveHalfRes(const ARHandle *handle)
+{
+    if (!handle) return (AR_LABELING_THRESH_ADAPTIVE_HALF_RES_DEFAULT);
+
+    return (handle->arLabelingThreshAdaptiveHalfRes);
+}
+
+void arSetDetectionROIMode(ARHandle *handle, const int mode)
+{
+    if (!handle) return;
+
+    handle->arDetectionROIMode = (mode ? TRUE : FALSE);
+    handle->arDetectionROIFullScanTTL = 0;
+}
+
+int arGetDetectionROIMode(const ARHandle *handle)
+{
+    if (!handle) return (AR_DETECTION_ROI_MODE_DEFAULT);
+
+    return (handle->arDetectionROIMode);
+}
+
+void arSetDetectionROIFullScanInterval(ARHandle *handle, const int interval)
+{
+    if (!handle) return;
+
+    handle->arDetectionROIFullScanInterval = interval;
+    handle->arDetectionROIFullScanTTL = 0;
+}
+
+int arGetDetectionROIFullScanInterval(const ARHandle *handle)
+{
+    if (!handle) return (AR_DETECTION_ROI_FULL_SCAN_INTERVAL_DEFAULT);
+
+    return (handle->arDetectionROIFullScanInterval);
+}
+
+int arSetDetectionDownsample(ARHandle *handle, const int factor)
+{
+    if (!handle) return (-1);
+    if (factor != 1 && factor != 2 && factor != 4) {
+        ARLOGe("Error: unsupported detection downsample factor %d.\n", factor);
+        return (-1);
+    }
+
+    handle->arDetectionDownsample = factor;
+    return (0);
+}
+
+int arGetDetectionDownsample(const ARHandle *handle)
+{
+    if (!handle) return (AR_DETECTION_DOWNSAMPLE_DEFAULT);
+
+    return (handle->arDetectionDownsample);
+}
+
 void arSetImageProcMode(ARHandle *handle, int mode)
 {
     if (!handle) return;
@@ -353,6 +433,24 @@ ARdouble arGetPattRatio(ARHandle *handle)
     return (handle->pattRatio);
 }
 
+void arSetDetectionThreadNum(ARHandle *handle, int threadNum)
+{
+    if (!handle) return;
+
+    arParallelFinal(&(handle->parallel));
+    if (threadNum != 1) {
+        handle->parallel = arParallelInit(threadNum);
+        if (arParallelGetThreadNum(handle->parallel) == 1) arParallelFinal(&(handle->parallel));
+    }
+}
+
+int arGetDetectionThreadNum(ARHandle *handle)
+{
+    if (!handle) return (AR_DETECTION_THREAD_NUM_DEFAULT);
+
+    return (arParallelGetThreadNum(handle->parallel));
+}
+
 void arSetPixelFormat(ARHandle *handle, AR_PIXEL_FORMAT pixFormat)
 {
     int monoFormat;
@@ -37,8 +37,12 @@
  */
 
 #include <stdio.h>
+#include <string.h> // memcpy()
+#include <float.h> // FLT_MAX
 #include <ARX/AR/ar.h>
 #include <ARX/AR/arImageProc.h>
+#include "arParallel.h"
+#include "arPattBank.h"
 
 #if DEBUG_PATT_GETID
 extern int cnt;
@@ -58,8 +62,191 @@ const char *arMarkerInfoCutoffPhaseDescriptions[AR_MARKER_INFO_CUTOFF_PHASE_DESC
 };
 
 static void confidenceCutoff(ARHandle *arHandle);
+static int detectMarker(ARHandle *arHandle, AR2VideoBufferT *frame, int roiNum, int *detectedNum_p);
+static void detectionROIUpdate(ARHandle *arHandle, int fullScan, int detectedNum);
 
-int arDetectMarker(ARHandle *arHandle, AR2VideoBufferT *frame)
+// Merges overlapping rectangles {x0, x1, y0, y1} into their bounding boxes, returning the new count.
+static int roiMerge(int roi[][4], int roiNum)
+{
+    int i, j, merged;
+
+    do {
+        merged = 0;
+        for (i = 0; i < roiNum; i++) {
+            for (j = i + 1; j < roiNum; j++) {
+                if (roi[i][0] >= roi[j][1] || roi[j][0] >= roi[i][1] || roi[i][2] >= roi[j][3] || roi[j][2] >= roi[i][3]) continue;
+                if (roi[j][0] < roi[i][0]) roi[i][0] = roi[j][0];
+                if (roi[j][1] > roi[i][1]) roi[i][1] = roi[j][1];
+                if (roi[j][2] < roi[i][2]) roi[i][2] = roi[j][2];
+                if (roi[j][3] > roi[i][3]) roi[i][3] = roi[j][3];
+                roiNum--;
+                if (j != roiNum) memcpy(roi[j], roi[roiNum], sizeof(roi[0]));
+                merged = 1;
+                j = i; // Recheck i against all others, since it has grown.
+            }
+        }
+    } while (merged);
+
+    return (roiNum);
+}
+
+// Returns the image downsampled by factor 2 (level 1) or 4 (level 2), with its dimensions.
+// The buffer holds both levels of the luma image, followed by both levels of the threshold image.
+static ARUint8 *downsampleImageGet(ARHandle *arHandle, int isThresh, int level, int *xsizeDown, int *ysizeDown)
+{
+    int x1 = (arHandle->xsize + 1)/2, y1 = (arHandle->ysize + 1)/2;
+    int x2 = (x1 + 1)/2, y2 = (y1 + 1)/2;
+
+    if (!arHandle->arDetectionDownsampleImage) arMalloc(arHandle->arDetectionDownsampleImage, ARUint8, 2*(x1*y1 + x2*y2));
+    if (xsizeDown) *xsizeDown = (level == 1 ? x1 : x2);
+    if (ysizeDown) *ysizeDown = (level == 1 ? y1 : y2);
+    return (arHandle->arDetectionDownsampleImage + isThresh*(x1*y1 + x2*y2) + (level == 1 ? 0 : x1*y1));
+}
+
+static void downsampleImage(ARHandle *arHandle, const ARUint8 *image, int isThresh)
+{
+    int      x1, y1;
+    ARUint8 *image1 = downsampleImageGet(arHandle, isThresh, 1, &x1, &y1);
+
+    arImageProcDownsampleHalf(image, arHandle->xsize, arHandle->ysize, image1);
+    if (arHandle->arDetectionDownsample == 4) arImageProcDownsampleHalf(image1, x1, y1, downsampleImageGet(arHandle, isThresh, 2, NULL, NULL));
+}
+
+// Labels the frame at a single threshold. If regions of interest are supplied, only those are labelled.
+// Otherwise, in coarse-to-fine mode, candidate squares are found in the downsampled image (which must
+// already have been made), and the full-resolution image is labelled only around them.
+static int labelFrame(ARHandle *arHandle, ARParallelT *parallel, AR2VideoBufferT *frame, int thresh, ARUint8 *imageThresh, int roiNum,
+                      ARLabelInfo *labelInfo, ARMarkerInfo2 *markerInfo2)
+{
+    int      roi[AR_SQUARE_MAX][4];
+    int      f, margin, xsizeDown, ysizeDown, marker2_num;
+    int      i, j, minX, maxX, minY, maxY;
+    ARUint8 *lumaDown;
+
+    if (roiNum > 0) {
+        return arLabelingROI(frame->buffLuma, arHandle->xsize, arHandle->ysize, arHandle->arDebug, arHandle->arLabelingMode, thresh,
+                             labelInfo, imageThresh, (const int (*)[4])arHandle->arDetectionROI, roiNum);
+    }
+
+    f = arHandle->arDetectionDownsample;
+    if (f == 1 || arHandle->arImageProcMode != AR_IMAGE_PROC_FRAME_IMAGE) {
+        // Adaptive thresholding always labels the frame image.
+        return arLabelingParallel(parallel, frame->buffLuma, arHandle->xsize, arHandle->ysize, arHandle->arDebug, arHandle->arLabelingMode,
+                                  thresh, (imageThresh ? AR_IMAGE_PROC_FRAME_IMAGE : arHandle->arImageProcMode), labelInfo, imageThresh);
+    }
+
+    // Coarse pass. The label and square buffers are only scratch here; the fine pass overwrites them.
+    lumaDown = downsampleImageGet(arHandle, 0, (f == 2 ? 1 : 2), &xsizeDown, &ysizeDown);
+    if (arLabelingParallel(parallel, lumaDown, xsizeDown, ysizeDown, AR_DEBUG_DISABLE, arHandle->arLabelingMode, thresh, AR_IMAGE_PROC_FRAME_IMAGE,
+                           labelInfo, (imageThresh ? downsampleImageGet(arHandle, 1, (f == 2 ? 1 : 2), NULL, NULL) : NULL)) < 0) return -1;
+    if (arDetectMarker2Parallel(parallel, xsizeDown, ysizeDown, labelInfo, AR_IMAGE_PROC_FRAME_IMAGE,
+                                AR_AREA_MAX/(f*f), AR_AREA_MIN/(f*f), AR_SQUARE_FIT_THRESH, markerInfo2, &marker2_num) < 0) return -1;
+
+    // Fine pass, in a rectangle around the contour of each candidate.
+    margin = AR_DETECTION_DOWNSAMPLE_MARGIN*f;
+    for (i = 0; i < marker2_num; i++) {
+        minX = maxX = markerInfo2[i].x_coord[0];
+        minY = maxY = markerInfo2[i].y_coord[0];
+        for (j = 1; j < markerInfo2[i].coord_num; j++) {
+            if (markerInfo2[i].x_coord[j] < minX) minX = markerInfo2[i].x_coord[j];
+            else if (markerInfo2[i].x_coord[j] > maxX) maxX = markerInfo2[i].x_coord[j];
+            if (markerInfo2[i].y_coord[j] < minY) minY = markerInfo2[i].y_coord[j];
+            else if (markerInfo2[i].y_coord[j] > maxY) maxY = markerInfo2[i].y_coord[j];
+        }
+        roi[i][0] = (minX*f - margin < 0 ? 0 : minX*f - margin);
+        roi[i][1] = ((maxX + 1)*f + margin > arHandle->xsize ? arHandle->xsize : (maxX + 1)*f + margin);
+        roi[i][2] = (minY*f - margin < 0 ? 0 : minY*f - margin);
+        roi[i][3] = ((maxY + 1)*f + margin > arHandle->ysize ? arHandle->ysize : (maxY + 1)*f + margin);
+    }
+    roiNum = roiMerge(roi, marker2_num);
+
+    return arLabelingROI(frame->buffLuma, arHandle->xsize, arHandle->ysize, arHandle->arDebug, arHandle->arLabelingMode, thresh,
+                         labelInfo, imageThresh, (const int (*)[4])roi, roiNum);
+}
+
+// Runs labeling, square detection and pattern identification at a single threshold.
+static int detectAtThresh(ARHandle *arHandle, AR2VideoBufferT *frame, int thresh, ARParallelT *parallel,
+                          ARLabelInfo *labelInfo, ARMarkerInfo2 *markerInfo2, int *marker2_num, ARMarkerInfo *markerInfo, int *marker_num)
+{
+    if (labelFrame(arHandle, parallel, frame, thresh, NULL, 0, labelInfo, markerInfo2) < 0) return -1;
+    if (arDetectMarker2Parallel(parallel, arHandle->xsize, arHandle->ysize, labelInfo, arHandle->arImageProcMode, AR_AREA_MAX, AR_AREA_MIN, AR_SQUARE_FIT_THRESH, markerInfo2, marker2_num) < 0) return -1;
+    if (arGetMarkerInfoParallel(parallel, frame->buff, arHandle->xsize, arHandle->ysize, arHandle->arPixelFormat, markerInfo2, *marker2_num, arHandle->pattHandle, arHandle->arImageProcMode, arHandle->arPatternDetectionMode, &(arHandle->arParamLT->paramLTf), arHandle->pattRatio, markerInfo, marker_num, arHandle->matrixCodeType) < 0) return -1;
+    return 0;
+}
+
+typedef struct {
+    ARHandle        *arHandle;
+    AR2VideoBufferT *frame;
+    int             *thresholds;
+    int             *marker_nums;
+    int              ret[3];
+} ARBracketArgT;
+
+// Bracketing thresholds 0 and 1 detect into the ARHandle's bracket scratch, and threshold 2 into the ARHandle.
+static void bracketJob(void *arg, int index, int count)
+{
+    ARBracketArgT    *a = (ARBracketArgT *)arg;
+    ARHandle         *arHandle = a->arHandle;
+    ARBracketResultT *result;
+    int               i;
+
+    for (i = index; i < 3; i += count) {
+        if (i < 2) {
+            result = &(arHandle->bracket->result[i]);
+            a->ret[i] = detectAtThresh(arHandle, a->frame, a->thresholds[i], NULL, &(result->labelInfo),
+                                       result->markerInfo2, &(result->marker2_num), result->markerInfo, &(result->marker_num));
+            a->marker_nums[i] = result->marker_num;
+        } else {
+            a->ret[i] = detectAtThresh(arHandle, a->frame, a->thresholds[i], NULL, &(arHandle->labelInfo),
+                                       arHandle->markerInfo2, &(arHandle->marker2_num), arHandle->markerInfo, &(arHandle->marker_num));
+            a->marker_nums[i] = arHandle->marker_num;
+        }
+    }
+}
+
+// Makes the results for a bracketing threshold the ARHandle's current results.
+static void bracketResultSwap(ARHandle *arHandle, ARBracketResultT *result)
+{
+    ARLabelInfo            *labelInfo = &(arHandle->labelInfo);
+    AR_LABELING_LABEL_TYPE *labelImage;
+#if !AR_DISABLE_LABELING_DEBUG_MODE
+    ARUint8                *bwImage;
+#endif
+    int                     i;
+
+    labelImage = labelInfo->labelImage;
+    labelInfo->labelImage = result->labelInfo.labelImage;
+    result->labelInfo.labelImage = labelImage;
+#if !AR_DISABLE_LABELING_DEBUG_MODE
+    if (arHandle->arDebug == AR_DEBUG_ENABLE) {
+        bwImage = labelInfo->bwImage;
+        labelInfo->bwImage = result->labelInfo.bwImage;
+        result->labelInfo.bwImage = bwImage;
+    }
+#endif
+    labelInfo->label_num = result->labelInfo.label_num;
+    memcpy(labelInfo->area, result->labelInfo.area, labelInfo->label_num*sizeof(labelInfo->area[0]));
+    memcpy(labelInfo->clip, result->labelInfo.clip, labelInfo->label_num*sizeof(labelInfo->clip[0]));
+    memcpy(labelInfo->pos,  result->labelInfo.pos,  labelInfo->label_num*sizeof(labelInfo->pos[0]));
+    memcpy(labelInfo->work, result->labelInfo.work, sizeof(labelInfo->work));
+
+    arHandle->marker2_num = result->marker2_num;
+    for (i = 0; i < result->marker2_num; i++) {
+        ARMarkerInfo2 *dst = &(arHandle->markerInfo2[i]);
+        ARMarkerInfo2 *src = &(result->markerInfo2[i]);
+        dst->area      = src->area;
+        dst->pos[0]    = src->pos[0];
+        dst->pos[1]    = src->pos[1];
+        dst->coord_num = src->coord_num;
+        memcpy(dst->x_coord, src->x_coord, src->coord_num*sizeof(int));
+        memcpy(dst->y_coord, src->y_coord, src->coord_num*sizeof(int));
+        memcpy(dst->vertex, src->vertex, sizeof(dst->vertex));
+    }
+    arHandle->marker_num = result->marker_num;
+    memcpy(arHandle->markerInfo, result->markerInfo, result->marker_num*sizeof(ARMarkerInfo));
+}
+
+static int detectMarker(ARHandle *arHandle, AR2VideoBufferT *frame, int roiNum, int *detectedNum_p)
 {
     ARdouble    rarea, rlen, rlenmin;
     ARdouble    diff, diffmin;
@@ -67,6 +254,7 @@ int arDetectMarker(ARHandle *arHandle, AR2VideoBufferT *frame)
     int         i, j, k;
     int         detectionIsDone = 0;
     int         threshDiff;
+    int         downsample;
 
 #if DEBUG_PATT_GETID
 cnt = 0;
@@ -76,12 +264,16 @@ cnt = 0;
     
     arHandle->marker_num = 0;
     
+    downsample = (roiNum == 0 && arHandle->arDetectionDownsample > 1 && arHandle->arImageProcMode == AR_IMAGE_PROC_FRAME_IMAGE);
+    if (downsample) downsampleImage(arHandle, frame->buffLuma, 0);
+    
     if (arHandle->arLabelingThreshMode == AR_LABELING_THRESH_MODE_AUTO_BRACKETING) {
         if (arHandle->arLabelingThreshAutoIntervalTTL > 0) {
             arHandle->arLabelingThreshAutoIntervalTTL--;
         } else {
             int thresholds[3];
             int marker_nums[3];
+            int bracketInParallel = (arParallelGetThreadNum(arHandle->parallel) > 1);
             
             thresholds[0] = arHandle->arLabelingThresh + arHandle->arLabelingThreshAutoBracketOver;
             if (thresholds[0] > 255) thresholds[0] = 255;
@@ -89,11 +281,28 @@ cnt = 0;
             if (thresholds[1] < 0) thresholds[1] = 0;
             thresholds[2] = arHandle->arLabelingThresh;
             
-            for (i = 0; i < 3; i++) {
-                if (arLabeling(frame->buffLuma, arHandle->xsize, arHandle->ysize, arHandle->arDebug, arHandle->arLabelingMode, thresholds[i], arHandle->arImageProcMode, &(arHandle->labelInfo), NULL) < 0) return -1;
-                if (arDetectMarker2(arHandle->xsize, arHandle->ysize, &(arHandle->labelInfo), arHandle->arImageProcMode, AR_AREA_MAX, AR_AREA_MIN, AR_SQUARE_FIT_THRESH, arHandle->markerInfo2, &(arHandle->marker2_num)) < 0) return -1;
-                if (arGetMarkerInfo(frame->buff, arHandle->xsize, arHandle->ysize, arHandle->arPixelFormat, arHandle->markerInfo2, arHandle->marker2_num, arHandle->pattHandle, arHandle->arImageProcMode, arHandle->arPatternDetectionMode, &(arHandle->arParamLT->paramLTf), arHandle->pattRatio, arHandle->markerInfo, &(arHandle->marker_num), arHandle->matrixCodeType) < 0) return -1;
-                marker_nums[i] = arHandle->marker_num;
+            if (bracketInParallel) {
+                // Detect at all three thresholds concurrently.
+                ARBracketArgT arg;
+                if (!arHandle->bracket) arHandle->bracket = arBracketInit(arHandle->xsize, arHandle->ysize);
+#if !AR_DISABLE_LABELING_DEBUG_MODE
+                if (arHandle->arDebug == AR_DEBUG_ENABLE) {
+                    for (i = 0; i < 2; i++) {
+                        if (!arHandle->bracket->result[i].labelInfo.bwImage) arMalloc(arHandle->bracket->result[i].labelInfo.bwImage, ARUint8, arHandle->xsize * arHandle->ysize);
+                    }
+                }
+#endif
+                arg.arHandle = arHandle;
+                arg.frame = frame;
+                arg.thresholds = thresholds;
+                arg.marker_nums = marker_nums;
+                arParallelRun(arHandle->parallel, bracketJob, &arg, 3);
+                if (arg.ret[0] < 0 || arg.ret[1] < 0 || arg.ret[2] < 0) return -1;
+            } else {
+                for (i = 0; i < 3; i++) {
+                    if (detectAtThresh(arHandle, frame, thresholds[i], arHandle->parallel, &(arHandle->labelInfo), arHandle->markerInfo2, &(arHandle->marker2_num), arHandle->markerInfo, &(arHandle->marker_num)) < 0) return -1;
+                    marker_nums[i] = arHandle->marker_num;
+                }
             }
 
             if (arHandle->arDebug == AR_DEBUG_ENABLE) ARLOGe("Auto threshold (bracket) marker counts -[%3d: %3d] [%3d: %3d] [%3d: %3d]+.\n", thresholds[1], marker_nums[1], thresholds[2], marker_nums[2], thresholds[0], marker_nums[0]);
@@ -122,6 +331,11 @@ cnt = 0;
                     arHandle->arLabelingThreshAutoBracketUnder = -threshDiff;
                 }
                 if (arHandle->arDebug == AR_DEBUG_ENABLE) ARLOGe("Auto threshold (bracket) adjusted threshold to %d.\n", arHandle->arLabelingThresh);
+                // Results for the new threshold are already available, so use them rather than detecting again.
+                if (bracketInParallel) {
+                    bracketResultSwap(arHandle, &(arHandle->bracket->result[marker_nums[0] >= marker_nums[1] ? 0 : 1]));
+                    detectionIsDone = 1;
+                }
             }
             arHandle->arLabelingThreshAutoIntervalTTL = arHandle->arLabelingThreshAutoInterval;
         }
@@ -132,13 +346,13 @@ cnt = 0;
         if (arHandle->arLabelingThreshMode == AR_LABELING_THRESH_MODE_AUTO_ADAPTIVE) {
             
             int ret;
-            ret = arImageProcLumaHistAndBoxFilterWithBias(arHandle->arImageProcInfo, frame->buffLuma,  AR_LABELING_THRESH_ADAPTIVE_KERNEL_SIZE_DEFAULT, AR_LABELING_THRESH_ADAPTIVE_BIAS_DEFAULT);
+            if (arHandle->arLabelingThreshAdaptiveHalfRes) ret = arImageProcLumaHistAndBoxFilterWithBiasHalfRes(arHandle->arImageProcInfo, frame->buffLuma,  AR_LABELING_THRESH_ADAPTIVE_KERNEL_SIZE_DEFAULT, AR_LABELING_THRESH_ADAPTIVE_BIAS_DEFAULT);
+            else ret = arImageProcLumaHistAndBoxFilterWithBias(arHandle->arImageProcInfo, frame->buffLuma,  AR_LABELING_THRESH_ADAPTIVE_KERNEL_SIZE_DEFAULT, AR_LABELING_THRESH_ADAPTIVE_BIAS_DEFAULT);
             if (ret < 0) return (ret);
             
-            ret = arLabeling(frame->buffLuma, arHandle->arImageProcInfo->imageX, arHandle->arImageProcInfo->imageY,
-                             arHandle->arDebug, arHandle->arLabelingMode,
-                             0, AR_IMAGE_PROC_FRAME_IMAGE,
-                             &(arHandle->labelInfo), arHandle->arImageProcInfo->image2);
+            if (downsample) downsampleImage(arHandle, arHandle->arImageProcInfo->image2, 1);
+            ret = labelFrame(arHandle, arHandle->parallel, frame, 0, arHandle->arImageProcInfo->image2, roiNum,
+                             &(arHandle->labelInfo), arHandle->markerInfo2);
             if (ret < 0) return (ret);
             
         } else { // !adaptive
@@ -160,10 +374,8 @@ cnt = 0;
                 }
             }
             
-            if( arLabeling(frame->buffLuma, arHandle->xsize, arHandle->ysize,
-                           arHandle->arDebug, arHandle->arLabelingMode,
-                           arHandle->arLabelingThresh, arHandle->arImageProcMode,
-                           &(arHandle->labelInfo), NULL) < 0 ) {
+            if( labelFrame(arHandle, arHandle->parallel, frame, arHandle->arLabelingThresh, NULL, roiNum,
+                           &(arHandle->labelInfo), arHandle->markerInfo2) < 0 ) {
                 return -1;
             }
             
@@ -171,14 +383,14 @@ cnt = 0;
         }
 #endif
         
-        if( arDetectMarker2( arHandle->xsize, arHandle->ysize,
+        if( arDetectMarker2Parallel( arHandle->parallel, arHandle->xsize, arHandle->ysize,
                             &(arHandle->labelInfo), arHandle->arImageProcMode,
                             AR_AREA_MAX, AR_AREA_MIN, AR_SQUARE_FIT_THRESH,
                             arHandle->markerInfo2, &(arHandle->marker2_num) ) < 0 ) {
             return -1;
         }
         
-        if( arGetMarkerInfo(frame->buff, arHandle->xsize, arHandle->ysize, arHandle->arPixelFormat,
+        if( arGetMarkerInfoParallel(arHandle->parallel, frame->buff, arHandle->xsize, arHandle->ysize, arHandle->arPixelFormat,
                             arHandle->markerInfo2, arHandle->marker2_num,
                             arHandle->pattHandle, arHandle->arImageProcMode,
                             arHandle->arPatternDetectionMode, &(arHandle->arParamLT->paramLTf), arHandle->pattRatio,
@@ -187,6 +399,7 @@ cnt = 0;
             return -1;
         }
     } // !detectionIsDone
+    *detectedNum_p = arHandle->marker_num; // Markers appended from history below were not seen in this frame.
     
     // If history mode is not enabled, just perform a basic confidence cutoff.
     if (arHandle->arMarkerExtractionMode == AR_NOUSE_TRACKING_HISTORY) {
@@ -332,6 +545,88 @@ cnt = 0;
     return 0;
 }
 
+int arDetectMarker(ARHandle *arHandle, AR2VideoBufferT *frame)
+{
+    int roiNum = 0;
+    int detectedNum = 0;
+    
+    if (!arHandle || !frame) return (-1);
+    
+    // Patterns loaded or changed since the last frame are prepared for matching here, before any threads start.
+    if (arHandle->pattHandle) arPattBankPrepare(arHandle->pattHandle);
+    
+    // Label only around previously identified markers, unless a full-frame scan is due.
+    if (arHandle->arDetectionROIMode && arHandle->arDetectionROIFullScanTTL > 0 && arHandle->arDetectionROINum > 0
+        && arHandle->arLabelingThreshMode != AR_LABELING_THRESH_MODE_AUTO_BRACKETING
+        && arHandle->arImageProcMode == AR_IMAGE_PROC_FRAME_IMAGE) {
+        roiNum = arHandle->arDetectionROINum;
+        arHandle->arDetectionROIFullScanTTL--;
+    }
+    
+    if (detectMarker(arHandle, frame, roiNum, &detectedNum) < 0) return (-1);
+    
+    if (arHandle->arDetectionROIMode) {
+        if (roiNum == 0) arHandle->arDetectionROIFullScanTTL = arHandle->arDetectionROIFullScanInterval;
+        detectionROIUpdate(arHandle, roiNum == 0, detectedNum);
+    } else {
+        arHandle->arDetectionROINum = 0;
+    }
+    
+    return (0);
+}
+
+// Build the regions of interest for the next frame from the markers identified in this one, including
+// any carried over from history. Only the first detectedNum markers, those actually detected in this
+// frame, count towards deciding whether markers have been lost.
+static void detectionROIUpdate(ARHandle *arHandle, int fullScan, int detectedNum)
+{
+    int     roi[AR_SQUARE_MAX][4];
+    int     roiNum, markerNum;
+    int     i, k;
+    float   ox, oy, minX, maxX, minY, maxY, margin;
+    
+    roiNum = markerNum = 0;
+    for (i = 0; i < arHandle->marker_num; i++) {
+        if (arHandle->markerInfo[i].id < 0) continue;
+        if (i < detectedNum) markerNum++;
+        if (roiNum == AR_SQUARE_MAX) continue;
+        
+        // Marker vertices are in ideal coordinates; labelling works in observed (distorted) coordinates.
+        minX = minY = FLT_MAX;
+        maxX = maxY = -FLT_MAX;
+        for (k = 0; k < 4; k++) {
+            if (arParamIdeal2ObservLTf(&(arHandle->arParamLT->paramLTf), (float)arHandle->markerInfo[i].vertex[k][0], (float)arHandle->markerInfo[i].vertex[k][1], &ox, &oy) < 0) break;
+            if (ox < minX) minX = ox;
+            if (ox > maxX) maxX = ox;
+            if (oy < minY) minY = oy;
+            if (oy > maxY) maxY = oy;
+        }
+        if (k < 4) {
+            // Vertex outside the lookup table, so we can't bound this marker. Fall back to a full-frame scan.
+            arHandle->arDetectionROIFullScanTTL = 0;
+            continue;
+        }
+        margin = (maxX - minX > maxY - minY ? maxX - minX : maxY - minY) * AR_DETECTION_ROI_MARGIN;
+        if (margin < AR_DETECTION_ROI_MARGIN_MIN) margin = AR_DETECTION_ROI_MARGIN_MIN;
+        roi[roiNum][0] = (minX - margin < 0.0f ? 0 : (int)(minX - margin));
+        roi[roiNum][1] = (maxX + margin + 1.0f >= (float)arHandle->xsize ? arHandle->xsize : (int)(maxX + margin + 1.0f));
+        roi[roiNum][2] = (minY - margin < 0.0f ? 0 : (int)(minY - margin));
+        roi[roiNum][3] = (maxY + margin + 1.0f >= (float)arHandle->ysize ? arHandle->ysize : (int)(maxY + margin + 1.0f));
+        if (roi[roiNum][0] >= roi[roiNum][1] || roi[roiNum][2] >= roi[roiNum][3]) continue;
+        roiNum++;
+    }
+    
+    // Labelling requires non-overlapping regions.
+    roiNum = roiMerge(roi, roiNum);
+    
+    // If markers have been lost since the last full-frame scan, rescan the whole frame to find them again.
+    if (fullScan) arHandle->arDetectionROIMarkerNum = markerNum;
+    else if (markerNum < arHandle->arDetectionROIMarkerNum) arHandle->arDetectionROIFullScanTTL = 0;
+    
+    arHandle->arDetectionROINum = roiNum;
+    if (roiNum > 0) memcpy(arHandle->arDetectionROI, roi, roiNum*sizeof(roi[0]));
+}
+
 static void confidenceCutoff(ARHandle *arHandle)
 {
     int i, cfOK;
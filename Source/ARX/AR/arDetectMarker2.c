@@ -46,47 +46,43 @@
  *
  ******************************************************/
 
+#include <stdlib.h>
 #include <ARX/AR/ar.h>
+#include "arParallel.h"
 
 static int check_square( int area, ARMarkerInfo2 *marker_info2, ARdouble factor );
 
 static int get_vertex( int x_coord[], int y_coord[], int st, int ed,
                        ARdouble thresh, int vertex[], int *vnum );
 
-int arDetectMarker2( int xsize, int ysize, ARLabelInfo *labelInfo, int imageProcMode,
-                     int areaMax, int areaMin, ARdouble squareFitThresh,
-                     ARMarkerInfo2 *markerInfo2, int *marker2_num )
+static int check_label( int xsize, int ysize, ARLabelInfo *labelInfo, int i, int areaMax, int areaMin )
 {
-    ARMarkerInfo2     *pm;
-    int               i, j, ret;
-    ARdouble            d;
-
-    if( imageProcMode == AR_IMAGE_PROC_FIELD_IMAGE ) {
-        areaMin /= 4;
-        areaMax /= 4;
-        xsize /=  2;
-        ysize /=  2;
-    }
+    if( labelInfo->area[i] < areaMin || labelInfo->area[i] > areaMax ) return -1;
+    if( labelInfo->clip[i][0] == 1 || labelInfo->clip[i][1] == xsize-2 ) return -1;
+    if( labelInfo->clip[i][2] == 1 || labelInfo->clip[i][3] == ysize-2 ) return -1;
+    return 0;
+}
 
-    *marker2_num = 0;
-    for( i = 0; i < labelInfo->label_num; i++ ) {
-        if( labelInfo->area[i] < areaMin || labelInfo->area[i] > areaMax ) continue;
-        if( labelInfo->clip[i][0] == 1 || labelInfo->clip[i][1] == xsize-2 ) continue;
-        if( labelInfo->clip[i][2] == 1 || labelInfo->clip[i][3] == ysize-2 ) continue;
+static int get_square( int xsize, int ysize, ARLabelInfo *labelInfo, int i, ARdouble squareFitThresh,
+                       ARMarkerInfo2 *marker_info2 )
+{
+    if( arGetContour( labelInfo->labelImage, xsize, ysize, labelInfo->work, i+1,
+                      labelInfo->clip[i], marker_info2) < 0 ) return -1;
 
-        ret = arGetContour( labelInfo->labelImage, xsize, ysize, labelInfo->work, i+1,
-                            labelInfo->clip[i], &(markerInfo2[*marker2_num]));
-        if( ret < 0 ) continue;
+    if( check_square( labelInfo->area[i], marker_info2, squareFitThresh ) < 0 ) return -1;
 
-        ret = check_square( labelInfo->area[i], &(markerInfo2[*marker2_num]), squareFitThresh );
-        if( ret < 0 ) continue;
+    marker_info2->area   = labelInfo->area[i];
+    marker_info2->pos[0] = labelInfo->pos[i][0];
+    marker_info2->pos[1] = labelInfo->pos[i][1];
+    return 0;
+}
 
-        markerInfo2[*marker2_num].area   = labelInfo->area[i];
-        markerInfo2[*marker2_num].pos[0] = labelInfo->pos[i][0];
-        markerInfo2[*marker2_num].pos[1] = labelInfo->pos[i][1];
-        (*marker2_num)++;
-        if( *marker2_num == AR_SQUARE_MAX ) break;
-    }
+// Removes squares nested within larger squares, and rescales field image results.
+static void square_post( int imageProcMode, ARMarkerInfo2 *markerInfo2, int *marker2_num )
+{
+    ARMarkerInfo2     *pm;
+    int               i, j;
+    ARdouble            d;
 
     for( i = 0; i < *marker2_num; i++ ) {
         for( j = i+1; j < *marker2_num; j++ ) {
@@ -128,6 +124,129 @@ int arDetectMarker2( int xsize, int ysize, ARLabelInfo *labelInfo, int imageProc
             pm++;
         }
     }
+}
+
+int arDetectMarker2( int xsize, int ysize, ARLabelInfo *labelInfo, int imageProcMode,
+                     int areaMax, int areaMin, ARdouble squareFitThresh,
+                     ARMarkerInfo2 *markerInfo2, int *marker2_num )
+{
+    int               i;
+
+    if( imageProcMode == AR_IMAGE_PROC_FIELD_IMAGE ) {
+        areaMin /= 4;
+        areaMax /= 4;
+        xsize /=  2;
+        ysize /=  2;
+    }
+
+    *marker2_num = 0;
+    for( i = 0; i < labelInfo->label_num; i++ ) {
+        if( check_label( xsize, ysize, labelInfo, i, areaMax, areaMin ) < 0 ) continue;
+        if( get_square( xsize, ysize, labelInfo, i, squareFitThresh, &(markerInfo2[*marker2_num]) ) < 0 ) continue;
+        (*marker2_num)++;
+        if( *marker2_num == AR_SQUARE_MAX ) break;
+    }
+
+    square_post( imageProcMode, markerInfo2, marker2_num );
+
+    return 0;
+}
+
+#define AR_DETECTION_SQUARE_BATCH 4  // Candidates tested per thread between checks for AR_SQUARE_MAX squares found.
+
+typedef struct {
+    int            xsize;
+    int            ysize;
+    ARLabelInfo   *labelInfo;
+    ARdouble       squareFitThresh;
+    int           *cand;        // Labels (0-based) passing the area and clip tests.
+    int            candStart;   // Range of candidates to test in this batch.
+    int            candEnd;
+    char          *ok;          // Per candidate, whether a square was found.
+    ARMarkerInfo2 *markerInfo2;
+    int            marker2_num;
+} ARDetectMarker2ArgT;
+
+// Test a batch of candidates, tracing each into its own slot of markerInfo2 after the squares already found.
+static void test_square_job( void *arg, int index, int count )
+{
+    ARDetectMarker2ArgT *a = (ARDetectMarker2ArgT *)arg;
+    int                  i;
+
+    for( i = a->candStart + index; i < a->candEnd; i += count ) {
+        a->ok[i] = (get_square( a->xsize, a->ysize, a->labelInfo, a->cand[i], a->squareFitThresh,
+                                &(a->markerInfo2[a->marker2_num + i - a->candStart]) ) == 0);
+    }
+}
+
+// Copies only the used part of the contour.
+static void copy_square( ARMarkerInfo2 *dst, const ARMarkerInfo2 *src )
+{
+    int i;
+
+    dst->area      = src->area;
+    dst->pos[0]    = src->pos[0];
+    dst->pos[1]    = src->pos[1];
+    dst->coord_num = src->coord_num;
+    for( i = 0; i < src->coord_num; i++ ) {
+        dst->x_coord[i] = src->x_coord[i];
+        dst->y_coord[i] = src->y_coord[i];
+    }
+    for( i = 0; i < 5; i++ ) dst->vertex[i] = src->vertex[i];
+}
+
+int arDetectMarker2Parallel( ARParallelT *parallel, int xsize, int ysize, ARLabelInfo *labelInfo, int imageProcMode,
+                             int areaMax, int areaMin, ARdouble squareFitThresh,
+                             ARMarkerInfo2 *markerInfo2, int *marker2_num )
+{
+    ARDetectMarker2ArgT  arg;
+    int                  candNum, batchSize, found;
+    int                  i;
+
+    if( arParallelGetThreadNum(parallel) == 1 || labelInfo->label_num <= 1 ) {
+        return arDetectMarker2( xsize, ysize, labelInfo, imageProcMode, areaMax, areaMin, squareFitThresh, markerInfo2, marker2_num );
+    }
+
+    if( imageProcMode == AR_IMAGE_PROC_FIELD_IMAGE ) {
+        areaMin /= 4;
+        areaMax /= 4;
+        xsize /=  2;
+        ysize /=  2;
+    }
+
+    arMalloc( arg.cand, int, labelInfo->label_num );
+    arMalloc( arg.ok, char, labelInfo->label_num );
+    arg.xsize = xsize;
+    arg.ysize = ysize;
+    arg.labelInfo = labelInfo;
+    arg.squareFitThresh = squareFitThresh;
+    arg.markerInfo2 = markerInfo2;
+    candNum = 0;
+    for( i = 0; i < labelInfo->label_num; i++ ) {
+        if( check_label( xsize, ysize, labelInfo, i, areaMax, areaMin ) == 0 ) arg.cand[candNum++] = i;
+    }
+
+    // Test candidates in batches no larger than the free slots, so that every candidate is traced
+    // only once, straight into markerInfo2. The squares found are then compacted down in label order.
+    batchSize = arParallelGetThreadNum(parallel) * AR_DETECTION_SQUARE_BATCH;
+    arg.marker2_num = 0;
+    for( arg.candStart = 0; arg.candStart < candNum && arg.marker2_num < AR_SQUARE_MAX; arg.candStart = arg.candEnd ) {
+        arg.candEnd = arg.candStart + (batchSize < AR_SQUARE_MAX - arg.marker2_num ? batchSize : AR_SQUARE_MAX - arg.marker2_num);
+        if( arg.candEnd > candNum ) arg.candEnd = candNum;
+        arParallelRun( parallel, test_square_job, &arg, arg.candEnd - arg.candStart );
+        found = arg.marker2_num;
+        for( i = arg.candStart; i < arg.candEnd; i++ ) {
+            if( !arg.ok[i] ) continue;
+            if( arg.marker2_num + i - arg.candStart != found ) copy_square( &(markerInfo2[found]), &(markerInfo2[arg.marker2_num + i - arg.candStart]) );
+            found++;
+        }
+        arg.marker2_num = found;
+    }
+    *marker2_num = arg.marker2_num;
+    free(arg.cand);
+    free(arg.ok);
+
+    square_post( imageProcMode, markerInfo2, marker2_num );
 
     return 0;
 }
@@ -46,63 +46,165 @@
  *
  *******************************************************/
 
+#include <stdlib.h>
 #include <ARX/AR/ar.h>
+#include "arParallel.h"
 
-int arGetMarkerInfo( ARUint8 *image, int xsize, int ysize, int pixelFormat, ARMarkerInfo2 *markerInfo2, int marker2_num,
-                     ARPattHandle *pattHandle, int imageProcMode, int pattDetectMode, ARParamLTf *arParamLTf, ARdouble pattRatio,
-                     ARMarkerInfo *markerInfo, int *marker_num,
-                     const AR_MATRIX_CODE_TYPE matrixCodeType )
+typedef struct {
+    ARUint8            *image;
+    int                 xsize;
+    int                 ysize;
+    int                 pixelFormat;
+    ARPattHandle       *pattHandle;
+    int                 imageProcMode;
+    int                 pattDetectMode;
+    ARParamLTf         *arParamLTf;
+    ARdouble            pattRatio;
+    AR_MATRIX_CODE_TYPE matrixCodeType;
+    ARMarkerInfo2      *markerInfo2;
+    int                 marker2_num;
+    ARMarkerInfo       *markerInfo;
+    char               *ok;
+} ARGetMarkerInfoArgT;
+
+// Marker position and lines, and vertices from their intersections.
+static int get_marker_info( ARGetMarkerInfoArgT *a, ARMarkerInfo2 *markerInfo2, ARMarkerInfo *markerInfo )
 {
-    int            i, j, result;
 #ifndef ARDOUBLE_IS_FLOAT
     float pos0, pos1;
 #endif
 
-    for( i = j = 0; i < marker2_num; i++ ) {
-        markerInfo[j].area   = markerInfo2[i].area;
+    markerInfo->area   = markerInfo2->area;
 #ifdef ARDOUBLE_IS_FLOAT
-        if (arParamObserv2IdealLTf(arParamLTf, markerInfo2[i].pos[0], markerInfo2[i].pos[1],
-                                   &(markerInfo[j].pos[0]), &(markerInfo[j].pos[1]) ) < 0) continue;
+    if (arParamObserv2IdealLTf(a->arParamLTf, markerInfo2->pos[0], markerInfo2->pos[1],
+                               &(markerInfo->pos[0]), &(markerInfo->pos[1]) ) < 0) return -1;
 #else
-        if (arParamObserv2IdealLTf(arParamLTf, (float)markerInfo2[i].pos[0], (float)markerInfo2[i].pos[1], &pos0, &pos1) < 0) continue;
-        markerInfo[j].pos[0] = (ARdouble)pos0;
-        markerInfo[j].pos[1] = (ARdouble)pos1;
+    if (arParamObserv2IdealLTf(a->arParamLTf, (float)markerInfo2->pos[0], (float)markerInfo2->pos[1], &pos0, &pos1) < 0) return -1;
+    markerInfo->pos[0] = (ARdouble)pos0;
+    markerInfo->pos[1] = (ARdouble)pos1;
 #endif
-        //arParamObserv2Ideal( dist_factor, markerInfo2[i].pos[0], markerInfo2[i].pos[1],
-        //                     &(markerInfo[j].pos[0]), &(markerInfo[j].pos[1]), dist_function_version );
-
-        if( arGetLine(markerInfo2[i].x_coord, markerInfo2[i].y_coord, markerInfo2[i].coord_num,
-                      markerInfo2[i].vertex, arParamLTf,
-                      markerInfo[j].line, markerInfo[j].vertex) < 0 ) continue;
-
-        result = arPattGetIDGlobal( pattHandle, imageProcMode, pattDetectMode, image, xsize, ysize, pixelFormat, arParamLTf, markerInfo[j].vertex, pattRatio, 
-                     &markerInfo[j].idPatt, &markerInfo[j].dirPatt, &markerInfo[j].cfPatt,
-                     &markerInfo[j].idMatrix, &markerInfo[j].dirMatrix, &markerInfo[j].cfMatrix,
-                      matrixCodeType, &markerInfo[j].errorCorrected, &markerInfo[j].globalID );
-
-        if      (result == 0)  markerInfo[j].cutoffPhase = AR_MARKER_INFO_CUTOFF_PHASE_NONE;
-        else if (result == -1) markerInfo[j].cutoffPhase = AR_MARKER_INFO_CUTOFF_PHASE_MATCH_GENERIC;
-        else if (result == -2) markerInfo[j].cutoffPhase = AR_MARKER_INFO_CUTOFF_PHASE_MATCH_CONTRAST;
-        else if (result == -3) markerInfo[j].cutoffPhase = AR_MARKER_INFO_CUTOFF_PHASE_MATCH_BARCODE_NOT_FOUND;
-        else if (result == -4) markerInfo[j].cutoffPhase = AR_MARKER_INFO_CUTOFF_PHASE_MATCH_BARCODE_EDC_FAIL;
-        else if (result == -5) markerInfo[j].cutoffPhase = AR_MARKER_INFO_CUTOFF_PHASE_HEURISTIC_TROUBLESOME_MATRIX_CODES;
-        else if (result == -6) markerInfo[j].cutoffPhase = AR_MARKER_INFO_CUTOFF_PHASE_PATTERN_EXTRACTION;
-  
-        // If not mixing template matching and matrix code detection, then copy id, dir and cf
-        // from values in appropriate type.
-        if (pattDetectMode == AR_TEMPLATE_MATCHING_COLOR || pattDetectMode == AR_TEMPLATE_MATCHING_MONO) {
-            markerInfo[j].id  = markerInfo[j].idPatt;
-            markerInfo[j].dir = markerInfo[j].dirPatt;
-            markerInfo[j].cf  = markerInfo[j].cfPatt;
-        } else if( pattDetectMode == AR_MATRIX_CODE_DETECTION ) {
-            markerInfo[j].id  = markerInfo[j].idMatrix;
-            markerInfo[j].dir = markerInfo[j].dirMatrix;
-            markerInfo[j].cf  = markerInfo[j].cfMatrix;
-        }
+    //arParamObserv2Ideal( dist_factor, markerInfo2->pos[0], markerInfo2->pos[1],
+    //                     &(markerInfo->pos[0]), &(markerInfo->pos[1]), dist_function_version );
+
+    if( arGetLine(markerInfo2->x_coord, markerInfo2->y_coord, markerInfo2->coord_num,
+                  markerInfo2->vertex, a->arParamLTf,
+                  markerInfo->line, markerInfo->vertex) < 0 ) return -1;
+
+    return 0;
+}
+
+// Pattern identification is done for all markers at once by arPattGetIDGlobalBatch(). This
+// fills in the remaining fields from its result.
+static void get_marker_info_id( ARGetMarkerInfoArgT *a, ARMarkerInfo *markerInfo, int result )
+{
+    if      (result == 0)  markerInfo->cutoffPhase = AR_MARKER_INFO_CUTOFF_PHASE_NONE;
+    else if (result == -1) markerInfo->cutoffPhase = AR_MARKER_INFO_CUTOFF_PHASE_MATCH_GENERIC;
+    else if (result == -2) markerInfo->cutoffPhase = AR_MARKER_INFO_CUTOFF_PHASE_MATCH_CONTRAST;
+    else if (result == -3) markerInfo->cutoffPhase = AR_MARKER_INFO_CUTOFF_PHASE_MATCH_BARCODE_NOT_FOUND;
+    else if (result == -4) markerInfo->cutoffPhase = AR_MARKER_INFO_CUTOFF_PHASE_MATCH_BARCODE_EDC_FAIL;
+    else if (result == -5) markerInfo->cutoffPhase = AR_MARKER_INFO_CUTOFF_PHASE_HEURISTIC_TROUBLESOME_MATRIX_CODES;
+    else if (result == -6) markerInfo->cutoffPhase = AR_MARKER_INFO_CUTOFF_PHASE_PATTERN_EXTRACTION;
+
+    // If not mixing template matching and matrix code detection, then copy id, dir and cf
+    // from values in appropriate type.
+    if (a->pattDetectMode == AR_TEMPLATE_MATCHING_COLOR || a->pattDetectMode == AR_TEMPLATE_MATCHING_MONO) {
+        markerInfo->id  = markerInfo->idPatt;
+        markerInfo->dir = markerInfo->dirPatt;
+        markerInfo->cf  = markerInfo->cfPatt;
+    } else if( a->pattDetectMode == AR_MATRIX_CODE_DETECTION ) {
+        markerInfo->id  = markerInfo->idMatrix;
+        markerInfo->dir = markerInfo->dirMatrix;
+        markerInfo->cf  = markerInfo->cfMatrix;
+    }
+}
+
+static void get_marker_info_init( ARGetMarkerInfoArgT *a, ARUint8 *image, int xsize, int ysize, int pixelFormat, ARMarkerInfo2 *markerInfo2, int marker2_num,
+                                  ARPattHandle *pattHandle, int imageProcMode, int pattDetectMode, ARParamLTf *arParamLTf, ARdouble pattRatio,
+                                  ARMarkerInfo *markerInfo, const AR_MATRIX_CODE_TYPE matrixCodeType )
+{
+    a->image          = image;
+    a->xsize          = xsize;
+    a->ysize          = ysize;
+    a->pixelFormat    = pixelFormat;
+    a->pattHandle     = pattHandle;
+    a->imageProcMode  = imageProcMode;
+    a->pattDetectMode = pattDetectMode;
+    a->arParamLTf     = arParamLTf;
+    a->pattRatio      = pattRatio;
+    a->matrixCodeType = matrixCodeType;
+    a->markerInfo2    = markerInfo2;
+    a->marker2_num    = marker2_num;
+    a->markerInfo     = markerInfo;
+    a->ok             = NULL;
+}
+
+int arGetMarkerInfo( ARUint8 *image, int xsize, int ysize, int pixelFormat, ARMarkerInfo2 *markerInfo2, int marker2_num,
+                     ARPattHandle *pattHandle, int imageProcMode, int pattDetectMode, ARParamLTf *arParamLTf, ARdouble pattRatio,
+                     ARMarkerInfo *markerInfo, int *marker_num,
+                     const AR_MATRIX_CODE_TYPE matrixCodeType )
+{
+    ARGetMarkerInfoArgT arg;
+    int                 result[AR_SQUARE_MAX];
+    int                 i, j;
+
+    get_marker_info_init( &arg, image, xsize, ysize, pixelFormat, markerInfo2, marker2_num, pattHandle, imageProcMode, pattDetectMode,
+                          arParamLTf, pattRatio, markerInfo, matrixCodeType );
 
+    for( i = j = 0; i < marker2_num; i++ ) {
+        if( get_marker_info( &arg, &(markerInfo2[i]), &(markerInfo[j]) ) < 0 ) continue;
         j++;
     }
     *marker_num = j;
 
+    if( arPattGetIDGlobalBatch( pattHandle, imageProcMode, pattDetectMode, image, xsize, ysize, pixelFormat, arParamLTf, pattRatio,
+                                matrixCodeType, markerInfo, j, result ) < 0 ) return -1;
+    for( i = 0; i < j; i++ ) get_marker_info_id( &arg, &(markerInfo[i]), result[i] );
+
+    return 0;
+}
+
+static void get_marker_info_job( void *arg, int index, int count )
+{
+    ARGetMarkerInfoArgT *a = (ARGetMarkerInfoArgT *)arg;
+    int                  i;
+
+    for( i = index; i < a->marker2_num; i += count ) {
+        a->ok[i] = (get_marker_info( a, &(a->markerInfo2[i]), &(a->markerInfo[i]) ) == 0);
+    }
+}
+
+int arGetMarkerInfoParallel( ARParallelT *parallel, ARUint8 *image, int xsize, int ysize, int pixelFormat, ARMarkerInfo2 *markerInfo2, int marker2_num,
+                             ARPattHandle *pattHandle, int imageProcMode, int pattDetectMode, ARParamLTf *arParamLTf, ARdouble pattRatio,
+                             ARMarkerInfo *markerInfo, int *marker_num,
+                             const AR_MATRIX_CODE_TYPE matrixCodeType )
+{
+    ARGetMarkerInfoArgT arg;
+    char                ok[AR_SQUARE_MAX];
+    int                 result[AR_SQUARE_MAX];
+    int                 i, j;
+
+    if( arParallelGetThreadNum(parallel) == 1 || marker2_num <= 1 ) {
+        return arGetMarkerInfo( image, xsize, ysize, pixelFormat, markerInfo2, marker2_num, pattHandle, imageProcMode, pattDetectMode,
+                                arParamLTf, pattRatio, markerInfo, marker_num, matrixCodeType );
+    }
+
+    get_marker_info_init( &arg, image, xsize, ysize, pixelFormat, markerInfo2, marker2_num, pattHandle, imageProcMode, pattDetectMode,
+                          arParamLTf, pattRatio, markerInfo, matrixCodeType );
+    arg.ok = ok;
+
+    // Each candidate's geometry is processed into the slot with its own index, then successful results are compacted in order
+    // and identified together.
+    arParallelRun( parallel, get_marker_info_job, &arg, marker2_num );
+    for( i = j = 0; i < marker2_num; i++ ) {
+        if( !ok[i] ) continue;
+        if( j != i ) markerInfo[j] = markerInfo[i];
+        j++;
+    }
+    *marker_num = j;
+
+    if( arPattGetIDGlobalBatchParallel( parallel, pattHandle, imageProcMode, pattDetectMode, image, xsize, ysize, pixelFormat, arParamLTf, pattRatio,
+                                        matrixCodeType, markerInfo, j, result ) < 0 ) return -1;
+    for( i = 0; i < j; i++ ) get_marker_info_id( &arg, &(markerInfo[i]), result[i] );
+
     return 0;
 }
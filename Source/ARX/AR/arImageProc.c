@@ -37,10 +37,16 @@
  */
 
 #include <string.h> // memset(), memcpy()
+#include <stdint.h>
 #include <ARX/AR/arImageProc.h>
 #if AR_IMAGEPROC_USE_VIMAGE
 #  include <Accelerate/Accelerate.h>
 #endif
+#if HAVE_ARM_NEON || HAVE_ARM64_NEON
+#  include <arm_neon.h>
+#elif HAVE_INTEL_SIMD
+#  include <emmintrin.h> // SSE2.
+#endif
 
 ARImageProcInfo *arImageProcInit(const int xsize, const int ysize)
 {
@@ -49,6 +55,7 @@ ARImageProcInfo *arImageProcInit(const int xsize, const int ysize)
         ipi->image2 = NULL;
         ipi->imageX = xsize;
         ipi->imageY = ysize;
+        ipi->boxFilterBuffer = NULL;
 #if AR_IMAGEPROC_USE_VIMAGE
         ipi->tempBuffer = NULL;
 #endif
@@ -60,6 +67,7 @@ void arImageProcFinal(ARImageProcInfo *ipi)
 {
     if (!ipi) return;
     if (ipi->image2) free (ipi->image2);
+    if (ipi->boxFilterBuffer) free (ipi->boxFilterBuffer);
 #if AR_IMAGEPROC_USE_VIMAGE
     if (ipi->tempBuffer) free (ipi->tempBuffer);
 #endif
@@ -78,9 +86,20 @@ int arImageProcLumaHist(ARImageProcInfo *ipi, const ARUint8 *__restrict dataPtr)
         return (-1);
     }
 #else
-    unsigned char *__restrict p;
-    memset(ipi->histBins, 0, sizeof(ipi->histBins));
-    for (p = (unsigned char *__restrict)dataPtr; p < dataPtr + ipi->imageX*ipi->imageY; p++) ipi->histBins[*p]++;
+    // Count into four interleaved histograms, so that runs of equal pixel values don't serialise on a single counter.
+    unsigned int bins[4][256];
+    const unsigned char *__restrict p = dataPtr;
+    const int n = ipi->imageX*ipi->imageY;
+    int i;
+    memset(bins, 0, sizeof(bins));
+    for (i = 0; i + 4 <= n; i += 4) { // Index, not pointer, comparison, so that images under 4 pixels don't form a pointer before dataPtr.
+        bins[0][p[i]]++;
+        bins[1][p[i + 1]]++;
+        bins[2][p[i + 2]]++;
+        bins[3][p[i + 3]]++;
+    }
+    for (; i < n; i++) bins[0][p[i]]++;
+    for (i = 0; i < 256; i++) ipi->histBins[i] = (unsigned long)bins[0][i] + bins[1][i] + bins[2][i] + bins[3][i];
 #endif // AR_IMAGEPROC_USE_VIMAGE
     
     return (0);
@@ -199,12 +218,215 @@ int arImageProcLumaHistAndOtsu(ARImageProcInfo *ipi, const ARUint8 *__restrict d
     return (0);
 }
 
+// Downsample by averaging 2x2 blocks. Odd final rows and columns are averaged with themselves.
+void arImageProcDownsampleHalf(const ARUint8 *__restrict src, const int xsize, const int ysize, ARUint8 *__restrict dst)
+{
+    int i, j, xsizeHalf, ysizeHalf;
+
+    xsizeHalf = (xsize + 1)/2;
+    ysizeHalf = (ysize + 1)/2;
+    for (j = 0; j < ysizeHalf; j++) {
+        const ARUint8 *p0 = src + (2*j)*xsize;
+        const ARUint8 *p1 = (2*j + 1 < ysize ? p0 + xsize : p0);
+        ARUint8 *q = dst + j*xsizeHalf;
+        i = 0;
+#if HAVE_ARM_NEON || HAVE_ARM64_NEON
+        for (; i <= xsize/2 - 8; i += 8) {
+            uint16x8_t s = vaddq_u16(vpaddlq_u8(vld1q_u8(p0 + 2*i)), vpaddlq_u8(vld1q_u8(p1 + 2*i)));
+            vst1_u8(q + i, vrshrn_n_u16(s, 2));
+        }
+#elif HAVE_INTEL_SIMD
+        {
+            const __m128i lo = _mm_set1_epi16(0x00ff);
+            const __m128i two = _mm_set1_epi16(2);
+            for (; i <= xsize/2 - 16; i += 16) {
+                __m128i a0 = _mm_loadu_si128((const __m128i *)(p0 + 2*i));
+                __m128i a1 = _mm_loadu_si128((const __m128i *)(p0 + 2*i + 16));
+                __m128i b0 = _mm_loadu_si128((const __m128i *)(p1 + 2*i));
+                __m128i b1 = _mm_loadu_si128((const __m128i *)(p1 + 2*i + 16));
+                __m128i s0 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a0, lo), _mm_srli_epi16(a0, 8)), _mm_add_epi16(_mm_and_si128(b0, lo), _mm_srli_epi16(b0, 8)));
+                __m128i s1 = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a1, lo), _mm_srli_epi16(a1, 8)), _mm_add_epi16(_mm_and_si128(b1, lo), _mm_srli_epi16(b1, 8)));
+                s0 = _mm_srli_epi16(_mm_add_epi16(s0, two), 2);
+                s1 = _mm_srli_epi16(_mm_add_epi16(s1, two), 2);
+                _mm_storeu_si128((__m128i *)(q + i), _mm_packus_epi16(s0, s1));
+            }
+        }
+#endif
+        for (; i < xsize/2; i++) {
+            q[i] = (ARUint8)((p0[2*i] + p0[2*i + 1] + p1[2*i] + p1[2*i + 1] + 2) >> 2);
+        }
+        if (i < xsizeHalf) q[i] = (ARUint8)((p0[2*i] + p1[2*i] + 1) >> 1);
+    }
+}
+
 #if !AR_DISABLE_THRESH_MODE_AUTO_ADAPTIVE
+
+// Box filtering by running sums. For each output row, a vertical pass updates the
+// sum of each column over the rows inside the kernel, by adding the row entering the
+// kernel and subtracting the row leaving it. A horizontal running sum over these
+// column sums then gives the box sum for each pixel, and dividing by the number of
+// pixels inside the (edge-truncated) kernel gives the mean. Cost per pixel is
+// independent of kernel size. Results are identical to a direct box convolution
+// with truncated kernel and truncating integer division.
+
+// Largest pixel count for which the float reciprocal division below is exact.
+#define BOX_FILTER_RECIP_COUNT_MAX 16384
+// Largest box size for which 16-bit column sums cannot overflow.
+#define BOX_FILTER_SIZE_MAX 257
+
+static void boxFilterColumnSumUpdate(uint16_t *colSum, const ARUint8 *addRow, const ARUint8 *subRow, const int n)
+{
+    int i = 0;
+#if HAVE_ARM_NEON || HAVE_ARM64_NEON
+    for (; i <= n - 8; i += 8) {
+        uint16x8_t c = vld1q_u16(colSum + i);
+        if (addRow) c = vaddw_u8(c, vld1_u8(addRow + i));
+        if (subRow) c = vsubw_u8(c, vld1_u8(subRow + i));
+        vst1q_u16(colSum + i, c);
+    }
+#elif HAVE_INTEL_SIMD
+    const __m128i zero = _mm_setzero_si128();
+    for (; i <= n - 16; i += 16) {
+        __m128i c0 = _mm_loadu_si128((const __m128i *)(colSum + i));
+        __m128i c1 = _mm_loadu_si128((const __m128i *)(colSum + i + 8));
+        if (addRow) {
+            __m128i p = _mm_loadu_si128((const __m128i *)(addRow + i));
+            c0 = _mm_add_epi16(c0, _mm_unpacklo_epi8(p, zero));
+            c1 = _mm_add_epi16(c1, _mm_unpackhi_epi8(p, zero));
+        }
+        if (subRow) {
+            __m128i p = _mm_loadu_si128((const __m128i *)(subRow + i));
+            c0 = _mm_sub_epi16(c0, _mm_unpacklo_epi8(p, zero));
+            c1 = _mm_sub_epi16(c1, _mm_unpackhi_epi8(p, zero));
+        }
+        _mm_storeu_si128((__m128i *)(colSum + i), c0);
+        _mm_storeu_si128((__m128i *)(colSum + i + 8), c1);
+    }
+#endif
+    for (; i < n; i++) {
+        if (addRow) colSum[i] += addRow[i];
+        if (subRow) colSum[i] -= subRow[i];
+    }
+}
+
+// out[i] = (ARUint8)(boxSum[i]/count + bias) for i in [i0, i1), where count <= BOX_FILTER_RECIP_COUNT_MAX.
+// The fractional part of boxSum/count is a multiple of 1/count, so offsetting boxSum by 0.5 keeps the
+// rounding error of the float product well clear of integer boundaries.
+static void boxFilterDivide(const uint32_t *boxSum, int i0, const int i1, const int count, const int bias, ARUint8 *out)
+{
+    const float recip = 1.0f / (float)count;
+#if HAVE_ARM_NEON || HAVE_ARM64_NEON
+    const float32x4_t r = vdupq_n_f32(recip);
+    const float32x4_t half = vdupq_n_f32(0.5f);
+    const int32x4_t b = vdupq_n_s32(bias);
+    for (; i0 <= i1 - 8; i0 += 8) {
+        int32x4_t q0 = vcvtq_s32_f32(vmulq_f32(vaddq_f32(vcvtq_f32_u32(vld1q_u32(boxSum + i0)), half), r));
+        int32x4_t q1 = vcvtq_s32_f32(vmulq_f32(vaddq_f32(vcvtq_f32_u32(vld1q_u32(boxSum + i0 + 4)), half), r));
+        uint16x8_t q = vcombine_u16(vmovn_u32(vreinterpretq_u32_s32(vaddq_s32(q0, b))), vmovn_u32(vreinterpretq_u32_s32(vaddq_s32(q1, b))));
+        vst1_u8(out + i0, vmovn_u16(q)); // Narrowing discards high bits, so bias wraps as with ARUint8 arithmetic.
+    }
+#elif HAVE_INTEL_SIMD
+    const __m128 r = _mm_set1_ps(recip);
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128i b = _mm_set1_epi32(bias);
+    const __m128i mask = _mm_set1_epi32(0xff);
+    for (; i0 <= i1 - 16; i0 += 16) {
+        __m128i q0 = _mm_cvttps_epi32(_mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(boxSum + i0))), half), r));
+        __m128i q1 = _mm_cvttps_epi32(_mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(boxSum + i0 + 4))), half), r));
+        __m128i q2 = _mm_cvttps_epi32(_mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(boxSum + i0 + 8))), half), r));
+        __m128i q3 = _mm_cvttps_epi32(_mm_mul_ps(_mm_add_ps(_mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *)(boxSum + i0 + 12))), half), r));
+        // Mask to 8 bits so that bias wraps as with ARUint8 arithmetic, then pack without saturation.
+        q0 = _mm_and_si128(_mm_add_epi32(q0, b), mask);
+        q1 = _mm_and_si128(_mm_add_epi32(q1, b), mask);
+        q2 = _mm_and_si128(_mm_add_epi32(q2, b), mask);
+        q3 = _mm_and_si128(_mm_add_epi32(q3, b), mask);
+        _mm_storeu_si128((__m128i *)(out + i0), _mm_packus_epi16(_mm_packs_epi32(q0, q1), _mm_packs_epi32(q2, q3)));
+    }
+#endif
+    for (; i0 < i1; i0++) out[i0] = (ARUint8)((int)(((float)boxSum[i0] + 0.5f) * recip) + bias);
+}
+
+// Box filters the xsize by ysize image src. Each output row is written to dst, with each pixel
+// repeated scale (1 or 2) times horizontally and vertically, clipped to dstXsize by dstYsize.
+static void boxFilter(const ARUint8 *__restrict src, const int xsize, const int ysize, const int boxSize, const int bias,
+                      ARUint8 *__restrict dst, const int dstXsize, const int dstYsize, const int scale, void *buffer)
+{
+    uint32_t *boxSum = (uint32_t *)buffer;
+    uint16_t *colSum = (uint16_t *)(boxSum + xsize);
+    ARUint8  *rowOut = (ARUint8 *)(colSum + xsize);
+    ARUint8  *out;
+    int       kernelSizeHalf = boxSize >> 1;
+    int       kernelSize = 2*kernelSizeHalf + 1;
+    int       i, j, k, countX, countY;
+    uint32_t  sum;
+
+    // Column sums for output row 0 span rows [0, kernelSizeHalf].
+    memset(colSum, 0, xsize*sizeof(uint16_t));
+    for (j = 0; j <= kernelSizeHalf && j < ysize; j++) boxFilterColumnSumUpdate(colSum, src + j*xsize, NULL, xsize);
+
+    for (j = 0; j < ysize; j++) {
+        if (j > 0) {
+            boxFilterColumnSumUpdate(colSum, (j + kernelSizeHalf < ysize ? src + (j + kernelSizeHalf)*xsize : NULL),
+                                             (j - kernelSizeHalf - 1 >= 0 ? src + (j - kernelSizeHalf - 1)*xsize : NULL), xsize);
+        }
+        countY = (j + kernelSizeHalf < ysize ? j + kernelSizeHalf : ysize - 1) - (j - kernelSizeHalf > 0 ? j - kernelSizeHalf : 0) + 1;
+
+        // Horizontal running sum, split at the points where columns start leaving and stop entering the kernel.
+        sum = 0;
+        for (i = 0; i <= kernelSizeHalf && i < xsize; i++) sum += colSum[i];
+        k = (kernelSizeHalf < xsize - kernelSizeHalf - 1 ? kernelSizeHalf : xsize - kernelSizeHalf - 1);
+        for (i = 0; i < k; i++) {
+            boxSum[i] = sum;
+            sum += colSum[i + kernelSizeHalf + 1];
+        }
+        for (; i < xsize - kernelSizeHalf - 1; i++) {
+            boxSum[i] = sum;
+            sum += colSum[i + kernelSizeHalf + 1];
+            sum -= colSum[i - kernelSizeHalf];
+        }
+        for (; i < xsize; i++) {
+            boxSum[i] = sum;
+            if (i + kernelSizeHalf + 1 < xsize) sum += colSum[i + kernelSizeHalf + 1];
+            if (i - kernelSizeHalf >= 0) sum -= colSum[i - kernelSizeHalf];
+        }
+
+        out = (scale == 1 ? dst + j*dstXsize : rowOut);
+        for (i = 0; i < xsize; i++) {
+            countX = (i + kernelSizeHalf < xsize ? i + kernelSizeHalf : xsize - 1) - (i - kernelSizeHalf > 0 ? i - kernelSizeHalf : 0) + 1;
+            if (countX == kernelSize && kernelSize*countY <= BOX_FILTER_RECIP_COUNT_MAX) {
+                // Columns from here to xsize - kernelSizeHalf all have a full-width kernel.
+                boxFilterDivide(boxSum, i, xsize - kernelSizeHalf, kernelSize*countY, bias, out);
+                i = xsize - kernelSizeHalf - 1;
+                continue;
+            }
+            out[i] = (ARUint8)(boxSum[i] / (countX*countY) + bias);
+        }
+
+        if (scale == 2) {
+            ARUint8 *d = dst + 2*j*dstXsize;
+            for (i = 0; i < dstXsize/2; i++) d[2*i] = d[2*i + 1] = rowOut[i];
+            if (dstXsize & 1) d[dstXsize - 1] = rowOut[dstXsize/2];
+            if (2*j + 1 < dstYsize) memcpy(d + dstXsize, d, dstXsize);
+        }
+    }
+}
+
+static int boxFilterBufferAlloc(ARImageProcInfo *ipi)
+{
+    if (!ipi->boxFilterBuffer) {
+        // Box sums, column sums and an output row at full width, plus a half-resolution image.
+        ipi->boxFilterBuffer = malloc(ipi->imageX*(sizeof(uint32_t) + sizeof(uint16_t) + sizeof(ARUint8))
+                                      + ((ipi->imageX + 1)/2)*((ipi->imageY + 1)/2));
+        if (!ipi->boxFilterBuffer) return (-1);
+    }
+    return (0);
+}
+
 int arImageProcLumaHistAndBoxFilterWithBias(ARImageProcInfo *ipi, const ARUint8 *__restrict dataPtr, const int boxSize, const int bias)
 {
-    int ret, i;
-#if !AR_IMAGEPROC_USE_VIMAGE
-    int j, kernelSizeHalf;
+    int ret;
+#if AR_IMAGEPROC_USE_VIMAGE
+    int i;
 #endif
     
     ret = arImageProcLumaHist(ipi, dataPtr);
@@ -228,27 +450,43 @@ int arImageProcLumaHistAndBoxFilterWithBias(ARImageProcInfo *ipi, const ARUint8
         ARLOGe("Error %ld in vImageBoxConvolve_Planar8().\n", err);
         return (-1);
     }
+    if (bias) for (i = 0; i < ipi->imageX*ipi->imageY; i++) ipi->image2[i] += bias;
 #else
-    kernelSizeHalf = boxSize >> 1;
-    for (j = 0; j < ipi->imageY; j++) {
-        for (i = 0; i < ipi->imageX; i++) {
-            int val, count, kernel_i, kernel_j, ii, jj;
-            val = count = 0;
-            for (kernel_j = -kernelSizeHalf; kernel_j <= kernelSizeHalf; kernel_j++) {
-                jj = j + kernel_j;
-                if (jj < 0 || jj >= ipi->imageY) continue;
-                for (kernel_i = -kernelSizeHalf; kernel_i <= kernelSizeHalf; kernel_i++) {
-                    ii = i + kernel_i;
-                    if (ii < 0 || ii >= ipi->imageX) continue;
-                    val += dataPtr[ii + jj*(ipi->imageX)];
-                    count++;
-                }
-            }
-            ipi->image2[i + j*(ipi->imageX)] = val / count;
-        }
+    if (boxSize > BOX_FILTER_SIZE_MAX) {
+        ARLOGe("Error: box filter size %d exceeds maximum of %d.\n", boxSize, BOX_FILTER_SIZE_MAX);
+        return (-1);
     }
+    if (boxFilterBufferAlloc(ipi) < 0) return (-1);
+    boxFilter(dataPtr, ipi->imageX, ipi->imageY, boxSize, bias, ipi->image2, ipi->imageX, ipi->imageY, 1, ipi->boxFilterBuffer);
 #endif
-    if (bias) for (i = 0; i < ipi->imageX*ipi->imageY; i++) ipi->image2[i] += bias;
+    return (0);
+}
+
+int arImageProcLumaHistAndBoxFilterWithBiasHalfRes(ARImageProcInfo *ipi, const ARUint8 *__restrict dataPtr, const int boxSize, const int bias)
+{
+    int      ret, xsizeHalf, ysizeHalf;
+    ARUint8 *imageHalf;
+
+    if (boxSize > 2*BOX_FILTER_SIZE_MAX) {
+        ARLOGe("Error: box filter size %d exceeds maximum of %d.\n", boxSize, 2*BOX_FILTER_SIZE_MAX);
+        return (-1);
+    }
+
+    ret = arImageProcLumaHist(ipi, dataPtr);
+    if (ret < 0) return (ret);
+
+    if (!ipi->image2) {
+        ipi->image2 = (unsigned char *)malloc(ipi->imageX * ipi->imageY * sizeof(unsigned char));
+        if (!ipi->image2) return (-1);
+    }
+    if (boxFilterBufferAlloc(ipi) < 0) return (-1);
+
+    xsizeHalf = (ipi->imageX + 1)/2;
+    ysizeHalf = (ipi->imageY + 1)/2;
+    imageHalf = (ARUint8 *)ipi->boxFilterBuffer + ipi->imageX*(sizeof(uint32_t) + sizeof(uint16_t) + sizeof(ARUint8));
+    arImageProcDownsampleHalf(dataPtr, ipi->imageX, ipi->imageY, imageHalf);
+
+    boxFilter(imageHalf, xsizeHalf, ysizeHalf, (boxSize + 1)/2, bias, ipi->image2, ipi->imageX, ipi->imageY, 2, ipi->boxFilterBuffer);
     return (0);
 }
 #endif // !AR_DISABLE_THRESH_MODE_AUTO_ADAPTIVE
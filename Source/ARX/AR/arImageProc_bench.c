@@ -0,0 +1,125 @@
+/*
+ *  arImageProc_bench.c
+ *  artoolkitX
+ *
+ *  This file is part of artoolkitX.
+ *
+ *  artoolkitX is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  artoolkitX is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, the copyright holders of this library give you
+ *  permission to link this library with independent modules to produce an
+ *  executable, regardless of the license terms of these independent modules, and to
+ *  copy and distribute the resulting executable under terms of your choice,
+ *  provided that you also meet, for each linked independent module, the terms and
+ *  conditions of the license of that module. An independent module is a module
+ *  which is neither derived from nor based on this library. If you modify this
+ *  library, you may extend this exception to your version of the library, but you
+ *  are not obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  Copyright 2018 Realmax, Inc.
+ *
+ */
+
+// Times the adaptive threshold filters, full and half resolution, including the
+// histogram, and the direct box filter they replaced for small boxes. Not run by
+// ctest; run it by hand on a quiet machine with a Release build.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ARX/AR/arImageProc.h>
+#include <ARX/ARUtil/time.h>
+
+#if !AR_DISABLE_THRESH_MODE_AUTO_ADAPTIVE
+
+#define ITERATIONS 20
+#define DIRECT_BOX_SIZE_MAX 15
+
+// The filter this replaced: the full kernel summed at every pixel.
+static void boxFilterDirect( const ARUint8 *image, int xsize, int ysize, int boxSize, int bias, ARUint8 *out )
+{
+    int     i, j, ii, jj, kernel_i, kernel_j, val, count, half;
+
+    half = boxSize >> 1;
+    for( j = 0; j < ysize; j++ ) {
+        for( i = 0; i < xsize; i++ ) {
+            val = count = 0;
+            for( kernel_j = -half; kernel_j <= half; kernel_j++ ) {
+                jj = j + kernel_j;
+                if( jj < 0 || jj >= ysize ) continue;
+                for( kernel_i = -half; kernel_i <= half; kernel_i++ ) {
+                    ii = i + kernel_i;
+                    if( ii < 0 || ii >= xsize ) continue;
+                    val += image[ii + jj*xsize];
+                    count++;
+                }
+            }
+            out[i + j*xsize] = (ARUint8)(val / count + bias);
+        }
+    }
+}
+
+int main( void )
+{
+    static const int cases[][3] = {{640, 480, 3}, {640, 480, 9}, {640, 480, 15}, {640, 480, 63}, {1280, 720, 9}, {1920, 1080, 9}, {1920, 1080, 127}};
+    ARImageProcInfo    *ipi;
+    ARUint8            *image, *out;
+    int                 c, i, xsize, ysize, boxSize;
+    double              tDirect, tFull, tHalf;
+
+    srand(1);
+    for( c = 0; c < (int)(sizeof(cases)/sizeof(cases[0])); c++ ) {
+        xsize = cases[c][0];
+        ysize = cases[c][1];
+        boxSize = cases[c][2];
+        arMalloc(image, ARUint8, xsize*ysize);
+        arMalloc(out, ARUint8, xsize*ysize);
+        for( i = 0; i < xsize*ysize; i++ ) image[i] = (ARUint8)(rand() & 0xff);
+        ipi = arImageProcInit(xsize, ysize);
+
+        printf("%dx%d box %d:", xsize, ysize, boxSize);
+        if( boxSize <= DIRECT_BOX_SIZE_MAX ) {
+            arUtilTimerReset();
+            for( i = 0; i < ITERATIONS; i++ ) {
+                arImageProcLumaHist(ipi, image);
+                boxFilterDirect(image, xsize, ysize, boxSize, 0, out);
+            }
+            tDirect = arUtilTimer()/ITERATIONS;
+            printf(" direct %.2f ms,", tDirect*1000.0);
+        }
+        arUtilTimerReset();
+        for( i = 0; i < ITERATIONS; i++ ) arImageProcLumaHistAndBoxFilterWithBias(ipi, image, boxSize, 0);
+        tFull = arUtilTimer()/ITERATIONS;
+        arUtilTimerReset();
+        for( i = 0; i < ITERATIONS; i++ ) arImageProcLumaHistAndBoxFilterWithBiasHalfRes(ipi, image, boxSize, 0);
+        tHalf = arUtilTimer()/ITERATIONS;
+        printf(" full %.2f ms, half %.2f ms\n", tFull*1000.0, tHalf*1000.0);
+
+        arImageProcFinal(ipi);
+        free(image);
+        free(out);
+    }
+
+    return 0;
+}
+
+#else
+
+int main( void )
+{
+    printf("adaptive thresholding disabled\n");
+    return 0;
+}
+
+#endif // !AR_DISABLE_THRESH_MODE_AUTO_ADAPTIVE
@@ -0,0 +1,187 @@
+/*
+ *  arImageProc_test.c
+ *  artoolkitX
+ *
+ *  This file is part of artoolkitX.
+ *
+ *  artoolkitX is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  artoolkitX is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, the copyright holders of this library give you
+ *  permission to link this library with independent modules to produce an
+ *  executable, regardless of the license terms of these independent modules, and to
+ *  copy and distribute the resulting executable under terms of your choice,
+ *  provided that you also meet, for each linked independent module, the terms and
+ *  conditions of the license of that module. An independent module is a module
+ *  which is neither derived from nor based on this library. If you modify this
+ *  library, you may extend this exception to your version of the library, but you
+ *  are not obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  Copyright 2018 Realmax, Inc.
+ *
+ */
+
+// Checks the running-sum adaptive threshold filters against a reference box filter
+// built from an integral image, including edge truncation, truncating division and
+// bias wrap-around, and checks the luminance histogram against a direct count.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ARX/AR/arImageProc.h>
+
+#if !AR_DISABLE_THRESH_MODE_AUTO_ADAPTIVE
+
+// Mean over the box of size boxSize centred on each pixel, truncated at the image
+// edges, plus bias, modulo 256.
+static void boxFilterReference( const ARUint8 *image, int xsize, int ysize, int boxSize, int bias, ARUint8 *out )
+{
+    int    *integral;
+    int     i, j, x0, x1, y0, y1, half;
+
+    arMallocClear(integral, int, (xsize + 1)*(ysize + 1));
+    for( j = 0; j < ysize; j++ ) {
+        for( i = 0; i < xsize; i++ ) {
+            integral[(j + 1)*(xsize + 1) + i + 1] = image[j*xsize + i] + integral[j*(xsize + 1) + i + 1]
+                                                  + integral[(j + 1)*(xsize + 1) + i] - integral[j*(xsize + 1) + i];
+        }
+    }
+    half = boxSize >> 1;
+    for( j = 0; j < ysize; j++ ) {
+        y0 = (j - half < 0 ? 0 : j - half);
+        y1 = (j + half + 1 > ysize ? ysize : j + half + 1);
+        for( i = 0; i < xsize; i++ ) {
+            x0 = (i - half < 0 ? 0 : i - half);
+            x1 = (i + half + 1 > xsize ? xsize : i + half + 1);
+            out[j*xsize + i] = (ARUint8)((integral[y1*(xsize + 1) + x1] - integral[y0*(xsize + 1) + x1]
+                                        - integral[y1*(xsize + 1) + x0] + integral[y0*(xsize + 1) + x0]) / ((x1 - x0)*(y1 - y0)) + bias);
+        }
+    }
+    free(integral);
+}
+
+// arImageProcLumaHistAndBoxFilterWithBiasHalfRes(): 2x2 average with rounding, odd
+// edges averaged with themselves, box of half the size, each result covering 2x2 pixels.
+static void boxFilterHalfResReference( const ARUint8 *image, int xsize, int ysize, int boxSize, int bias, ARUint8 *out )
+{
+    ARUint8    *half, *halfOut;
+    int         i, j, xsizeHalf, ysizeHalf, i1, j1;
+
+    xsizeHalf = (xsize + 1)/2;
+    ysizeHalf = (ysize + 1)/2;
+    arMalloc(half, ARUint8, xsizeHalf*ysizeHalf);
+    arMalloc(halfOut, ARUint8, xsizeHalf*ysizeHalf);
+    for( j = 0; j < ysizeHalf; j++ ) {
+        j1 = (2*j + 1 < ysize ? 2*j + 1 : 2*j);
+        for( i = 0; i < xsizeHalf; i++ ) {
+            i1 = (2*i + 1 < xsize ? 2*i + 1 : 2*i);
+            if( i1 != 2*i ) half[j*xsizeHalf + i] = (ARUint8)((image[2*j*xsize + 2*i] + image[2*j*xsize + i1] + image[j1*xsize + 2*i] + image[j1*xsize + i1] + 2) >> 2);
+            else            half[j*xsizeHalf + i] = (ARUint8)((image[2*j*xsize + 2*i] + image[j1*xsize + 2*i] + 1) >> 1);
+        }
+    }
+    boxFilterReference(half, xsizeHalf, ysizeHalf, (boxSize + 1)/2, bias, halfOut);
+    for( j = 0; j < ysize; j++ ) {
+        for( i = 0; i < xsize; i++ ) out[j*xsize + i] = halfOut[(j/2)*xsizeHalf + i/2];
+    }
+    free(half);
+    free(halfOut);
+}
+
+static int compareImages( const ARUint8 *expected, const ARUint8 *actual, int xsize, int ysize )
+{
+    int     i;
+
+    for( i = 0; i < xsize*ysize; i++ ) {
+        if( expected[i] != actual[i] ) {
+            printf("differs at (%d, %d): %d, expected %d\n", i%xsize, i/xsize, actual[i], expected[i]);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main( void )
+{
+    static const int sizes[][2] = {{640, 480}, {641, 479}, {37, 23}, {5, 7}};
+    static const int boxSizes[] = {3, 9, 15, 63, 127};
+    static const int biases[] = {0, -7, 200};
+    ARImageProcInfo    *ipi;
+    ARUint8            *image, *expected;
+    unsigned long       hist[256];
+    int                 s, b, k, i, xsize, ysize;
+    int                 failures = 0;
+
+    srand(1);
+    for( s = 0; s < (int)(sizeof(sizes)/sizeof(sizes[0])); s++ ) {
+        xsize = sizes[s][0];
+        ysize = sizes[s][1];
+        arMalloc(image, ARUint8, xsize*ysize);
+        arMalloc(expected, ARUint8, xsize*ysize);
+        for( i = 0; i < xsize*ysize; i++ ) image[i] = (ARUint8)(rand() & 0xff);
+        // Include a run of equal values, which the histogram counts across several tables.
+        memset(image, 17, xsize*ysize/3);
+        memset(hist, 0, sizeof(hist));
+        for( i = 0; i < xsize*ysize; i++ ) hist[image[i]]++;
+        ipi = arImageProcInit(xsize, ysize);
+
+        for( b = 0; b < (int)(sizeof(boxSizes)/sizeof(boxSizes[0])); b++ ) {
+            for( k = 0; k < (int)(sizeof(biases)/sizeof(biases[0])); k++ ) {
+#if !AR_IMAGEPROC_USE_VIMAGE
+                printf("%dx%d box %d bias %d: ", xsize, ysize, boxSizes[b], biases[k]);
+                boxFilterReference(image, xsize, ysize, boxSizes[b], biases[k], expected);
+                if( arImageProcLumaHistAndBoxFilterWithBias(ipi, image, boxSizes[b], biases[k]) < 0 ) {
+                    printf("failed\n");
+                    failures++;
+                } else if( memcmp(hist, ipi->histBins, sizeof(hist)) != 0 ) {
+                    printf("histogram differs\n");
+                    failures++;
+                } else if( compareImages(expected, ipi->image2, xsize, ysize) < 0 ) {
+                    failures++;
+                } else {
+                    printf("ok\n");
+                }
+#endif
+                printf("%dx%d box %d bias %d half resolution: ", xsize, ysize, boxSizes[b], biases[k]);
+                boxFilterHalfResReference(image, xsize, ysize, boxSizes[b], biases[k], expected);
+                if( arImageProcLumaHistAndBoxFilterWithBiasHalfRes(ipi, image, boxSizes[b], biases[k]) < 0 ) {
+                    printf("failed\n");
+                    failures++;
+                } else if( memcmp(hist, ipi->histBins, sizeof(hist)) != 0 ) {
+                    printf("histogram differs\n");
+                    failures++;
+                } else if( compareImages(expected, ipi->image2, xsize, ysize) < 0 ) {
+                    failures++;
+                } else {
+                    printf("ok\n");
+                }
+            }
+        }
+
+        arImageProcFinal(ipi);
+        free(image);
+        free(expected);
+    }
+
+    return (failures ? 1 : 0);
+}
+
+#else
+
+int main( void )
+{
+    printf("adaptive thresholding disabled, skipped\n");
+    return 0;
+}
+
+#endif // !AR_DISABLE_THRESH_MODE_AUTO_ADAPTIVE
@@ -51,11 +51,29 @@
 #include <ARX/AR/ar.h>
 #include <ARX/AR/config.h>
 #include "arLabelingSub/arLabelingPrivate.h"
+#include "arParallel.h"
 
 int arLabeling( ARUint8 *imageLuma, int xsize, int ysize,
                 int debugMode, int labelingMode, int labelingThresh, int imageProcMode,
                 ARLabelInfo *labelInfo, ARUint8 *image_thresh )
 {
+    // Run-based labeling with SIMD thresholding, where the CPU supports it.
+    if (imageProcMode == AR_IMAGE_PROC_FRAME_IMAGE && arLabelingSubSIMDLevel() != AR_LABELING_SIMD_NONE) {
+        return arLabelingSubSIMD(imageLuma, xsize, ysize, labelingThresh,
+#if !AR_DISABLE_THRESH_MODE_AUTO_ADAPTIVE
+                                 image_thresh,
+#else
+                                 NULL,
+#endif
+                                 labelingMode == AR_LABELING_WHITE_REGION,
+#if !AR_DISABLE_LABELING_DEBUG_MODE
+                                 (debugMode == AR_DEBUG_ENABLE ? labelInfo->bwImage : NULL),
+#else
+                                 NULL,
+#endif
+                                 labelInfo);
+    }
+
 #if !AR_DISABLE_LABELING_DEBUG_MODE
     if (debugMode == AR_DEBUG_DISABLE) {
 #endif
@@ -102,3 +120,46 @@ int arLabeling( ARUint8 *imageLuma, int xsize, int ysize,
     }
 #endif
 }
+
+int arLabelingParallel( ARParallelT *parallel, ARUint8 *imageLuma, int xsize, int ysize,
+                        int debugMode, int labelingMode, int labelingThresh, int imageProcMode,
+                        ARLabelInfo *labelInfo, ARUint8 *image_thresh )
+{
+    if (arParallelGetThreadNum(parallel) == 1 || imageProcMode != AR_IMAGE_PROC_FRAME_IMAGE) {
+        return arLabeling(imageLuma, xsize, ysize, debugMode, labelingMode, labelingThresh, imageProcMode, labelInfo, image_thresh);
+    }
+
+    return arLabelingSubSIMDParallel(parallel, imageLuma, xsize, ysize, labelingThresh,
+#if !AR_DISABLE_THRESH_MODE_AUTO_ADAPTIVE
+                                     image_thresh,
+#else
+                                     NULL,
+#endif
+                                     labelingMode == AR_LABELING_WHITE_REGION,
+#if !AR_DISABLE_LABELING_DEBUG_MODE
+                                     (debugMode == AR_DEBUG_ENABLE ? labelInfo->bwImage : NULL),
+#else
+                                     NULL,
+#endif
+                                     labelInfo);
+}
+
+int arLabelingROI( ARUint8 *imageLuma, int xsize, int ysize,
+                   int debugMode, int labelingMode, int labelingThresh,
+                   ARLabelInfo *labelInfo, ARUint8 *image_thresh,
+                   const int roi[][4], int roiNum )
+{
+    return arLabelingSubSIMDROI(imageLuma, xsize, ysize, labelingThresh,
+#if !AR_DISABLE_THRESH_MODE_AUTO_ADAPTIVE
+                                image_thresh,
+#else
+                                NULL,
+#endif
+                                labelingMode == AR_LABELING_WHITE_REGION,
+#if !AR_DISABLE_LABELING_DEBUG_MODE
+                                (debugMode == AR_DEBUG_ENABLE ? labelInfo->bwImage : NULL),
+#else
+                                NULL,
+#endif
+                                labelInfo, roi, roiNum);
+}
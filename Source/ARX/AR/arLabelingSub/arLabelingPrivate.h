@@ -73,6 +73,21 @@ int arLabelingSubEBZ( ARUint8 *image, const int xsize, const int ysize, ARUint8*
 int arLabelingSubEWZ( ARUint8 *image, const int xsize, const int ysize, ARUint8* image_thresh, ARLabelInfo *labelInfo );
 #endif
 
+/*  Run-based, with SIMD thresholding. Frame image only. */
+
+#define AR_LABELING_SIMD_NONE   0
+#define AR_LABELING_SIMD_SSE2   1
+#define AR_LABELING_SIMD_AVX2   2
+#define AR_LABELING_SIMD_NEON   3
+
+void arLabelingSubSIMDInit( void ); // Probes the CPU on first call. Called by arCreateHandle(), before any labeling runs.
+int arLabelingSubSIMDLevel( void ); // Returns one of AR_LABELING_SIMD_*, or AR_LABELING_SIMD_NONE before arLabelingSubSIMDInit().
+int arLabelingSubSIMD( ARUint8 *image, int xsize, int ysize, int labelingThresh, ARUint8 *image_thresh, int whiteRegion, ARUint8 *bwImage, ARLabelInfo *labelInfo );
+// Labels horizontal strips of the image concurrently. Uses plain C thresholding where SIMD is unavailable.
+int arLabelingSubSIMDParallel( ARParallelT *parallel, ARUint8 *image, int xsize, int ysize, int labelingThresh, ARUint8 *image_thresh, int whiteRegion, ARUint8 *bwImage, ARLabelInfo *labelInfo );
+// Labels only within the given non-overlapping rectangles, each {x0, x1, y0, y1} with exclusive upper bounds.
+int arLabelingSubSIMDROI( ARUint8 *image, int xsize, int ysize, int labelingThresh, ARUint8 *image_thresh, int whiteRegion, ARUint8 *bwImage, ARLabelInfo *labelInfo, const int roi[][4], int roiNum );
+
 #ifdef __cplusplus
 }
 #endif
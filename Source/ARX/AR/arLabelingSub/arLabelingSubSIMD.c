@@ -0,0 +1,578 @@
+/*
+ *  arLabelingSubSIMD.c
+ *  artoolkitX
+ *
+ *  This file is part of artoolkitX.
+ *
+ *  artoolkitX is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  artoolkitX is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, the copyright holders of this library give you
+ *  permission to link this library with independent modules to produce an
+ *  executable, regardless of the license terms of these independent modules, and to
+ *  copy and distribute the resulting executable under terms of your choice,
+ *  provided that you also meet, for each linked independent module, the terms and
+ *  conditions of the license of that module. An independent module is a module
+ *  which is neither derived from nor based on this library. If you modify this
+ *  library, you may extend this exception to your version of the library, but you
+ *  are not obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  Copyright 2018 Realmax, Inc.
+ *
+ */
+
+//
+// Run-based labeling with SIMD thresholding.
+//
+// Each row is thresholded 16 (SSE2, NEON) or 32 (AVX2) pixels at a time into a
+// bitmask, the bitmask is decoded into runs of in-region pixels, and runs are
+// merged with the 8-connected runs of the row above using union-find over the
+// labelInfo->work array. Labels are always linked towards the lower label, so
+// that after flattening, work[] has the same form as that produced by the
+// per-pixel arLabelingSub*() kernels. label_num, area, clip and pos are identical
+// to the frame-image (R and Z) per-pixel kernels, and labelImage is equivalent
+// once resolved through work[].
+//
+
+#include <stdlib.h>
+#include <string.h> // memset()
+#include <stdint.h>
+#include <ARX/AR/ar.h>
+#include "arLabelingPrivate.h"
+#include "../arParallel.h"
+
+#if HAVE_ARM_NEON || HAVE_ARM64_NEON
+#  include <arm_neon.h>
+#elif HAVE_INTEL_SIMD
+#  include <emmintrin.h> // SSE2.
+#  if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#    include <immintrin.h>
+#    define AR_LABELING_HAVE_AVX2 1
+#  endif
+#endif
+#ifdef _MSC_VER
+#  include <intrin.h>
+#endif
+
+typedef void (*ARLabelingThreshRowFunc)(const ARUint8 *image, const ARUint8 *image_thresh, int labelingThresh, int whiteRegion, int n, uint32_t *bits);
+
+static int arLabelingSIMDLevel = -1;
+static ARLabelingThreshRowFunc arLabelingThreshRow = NULL;
+
+static inline int ctz32(uint32_t v)
+{
+#if defined(__GNUC__)
+    return (__builtin_ctz(v));
+#elif defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward(&i, v);
+    return ((int)i);
+#else
+    int i = 0;
+    while (!(v & 1u)) { v >>= 1; i++; }
+    return (i);
+#endif
+}
+
+// Reference thresholding for the tail of each row and for platforms without SIMD.
+// Sets bit i of bits if pixel i is in the labelled region.
+static void threshRowC(const ARUint8 *image, const ARUint8 *image_thresh, int labelingThresh, int whiteRegion, int i0, int n, uint32_t *bits)
+{
+    int i;
+    for (i = i0; i < n; i++) {
+        int t = (image_thresh ? image_thresh[i] : labelingThresh);
+        int in = (whiteRegion ? image[i] > t : image[i] <= t);
+        if (in) bits[i >> 5] |= (1u << (i & 31));
+    }
+}
+
+#if HAVE_ARM_NEON || HAVE_ARM64_NEON
+
+static inline uint16_t movemask_neon(uint8x16_t m)
+{
+    static const uint8_t weights[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t w = vandq_u8(m, vld1q_u8(weights));
+    uint8x8_t s = vpadd_u8(vget_low_u8(w), vget_high_u8(w)); // 8 -> 4 per half.
+    s = vpadd_u8(s, s);
+    s = vpadd_u8(s, s);
+    return ((uint16_t)(vget_lane_u8(s, 0) | (vget_lane_u8(s, 1) << 8)));
+}
+
+static void threshRowNEON(const ARUint8 *image, const ARUint8 *image_thresh, int labelingThresh, int whiteRegion, int n, uint32_t *bits)
+{
+    int i, n32 = n & ~31;
+    uint8x16_t t0 = vdupq_n_u8((uint8_t)labelingThresh), t1 = t0;
+    for (i = 0; i < n32; i += 32) {
+        uint8x16_t p0 = vld1q_u8(image + i);
+        uint8x16_t p1 = vld1q_u8(image + i + 16);
+        if (image_thresh) {
+            t0 = vld1q_u8(image_thresh + i);
+            t1 = vld1q_u8(image_thresh + i + 16);
+        }
+        uint8x16_t m0 = (whiteRegion ? vcgtq_u8(p0, t0) : vcleq_u8(p0, t0));
+        uint8x16_t m1 = (whiteRegion ? vcgtq_u8(p1, t1) : vcleq_u8(p1, t1));
+        bits[i >> 5] = (uint32_t)movemask_neon(m0) | ((uint32_t)movemask_neon(m1) << 16);
+    }
+    threshRowC(image, image_thresh, labelingThresh, whiteRegion, n32, n, bits);
+}
+
+#elif HAVE_INTEL_SIMD
+
+static void threshRowSSE2(const ARUint8 *image, const ARUint8 *image_thresh, int labelingThresh, int whiteRegion, int n, uint32_t *bits)
+{
+    int i, n32 = n & ~31;
+    __m128i t0 = _mm_set1_epi8((char)labelingThresh), t1 = t0;
+    for (i = 0; i < n32; i += 32) {
+        __m128i p0 = _mm_loadu_si128((const __m128i *)(image + i));
+        __m128i p1 = _mm_loadu_si128((const __m128i *)(image + i + 16));
+        if (image_thresh) {
+            t0 = _mm_loadu_si128((const __m128i *)(image_thresh + i));
+            t1 = _mm_loadu_si128((const __m128i *)(image_thresh + i + 16));
+        }
+        // No unsigned compare in SSE2, so use p <= t  <=>  min(p, t) == p.
+        uint32_t le = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(p0, t0), p0))
+                   | ((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(p1, t1), p1)) << 16);
+        bits[i >> 5] = (whiteRegion ? ~le : le);
+    }
+    threshRowC(image, image_thresh, labelingThresh, whiteRegion, n32, n, bits);
+}
+
+#  if AR_LABELING_HAVE_AVX2
+__attribute__((target("avx2")))
+static void threshRowAVX2(const ARUint8 *image, const ARUint8 *image_thresh, int labelingThresh, int whiteRegion, int n, uint32_t *bits)
+{
+    int i, n32 = n & ~31;
+    __m256i t = _mm256_set1_epi8((char)labelingThresh);
+    for (i = 0; i < n32; i += 32) {
+        __m256i p = _mm256_loadu_si256((const __m256i *)(image + i));
+        if (image_thresh) t = _mm256_loadu_si256((const __m256i *)(image_thresh + i));
+        uint32_t le = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(p, t), p));
+        bits[i >> 5] = (whiteRegion ? ~le : le);
+    }
+    threshRowC(image, image_thresh, labelingThresh, whiteRegion, n32, n, bits);
+}
+#  endif
+
+#endif // HAVE_INTEL_SIMD
+
+void arLabelingSubSIMDInit(void)
+{
+    if (arLabelingSIMDLevel == -1) {
+#if HAVE_ARM_NEON || HAVE_ARM64_NEON
+        arLabelingThreshRow = threshRowNEON;
+        arLabelingSIMDLevel = AR_LABELING_SIMD_NEON;
+        ARLOGi("arLabeling will use ARM NEON acceleration.\n");
+#elif HAVE_INTEL_SIMD
+#  if AR_LABELING_HAVE_AVX2
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            arLabelingThreshRow = threshRowAVX2;
+            arLabelingSIMDLevel = AR_LABELING_SIMD_AVX2;
+            ARLOGi("arLabeling will use Intel AVX2 acceleration.\n");
+        } else
+#  endif
+        {
+            arLabelingThreshRow = threshRowSSE2;
+            arLabelingSIMDLevel = AR_LABELING_SIMD_SSE2;
+            ARLOGi("arLabeling will use Intel SSE2 acceleration.\n");
+        }
+#else
+        arLabelingSIMDLevel = AR_LABELING_SIMD_NONE;
+        ARLOGd("arLabeling will NOT use SIMD acceleration.\n");
+#endif
+    }
+}
+
+int arLabelingSubSIMDLevel(void)
+{
+    // Only read here, as labeling threads call this concurrently.
+    return (arLabelingSIMDLevel == -1 ? AR_LABELING_SIMD_NONE : arLabelingSIMDLevel);
+}
+
+// Find with path halving. Invariant: work[l-1] <= l, and work[l-1] == l for roots.
+static inline int findRoot(int *work, int l)
+{
+    while (work[l - 1] != l) {
+        work[l - 1] = work[work[l - 1] - 1];
+        l = work[l - 1];
+    }
+    return (l);
+}
+
+// Plain C thresholding, used by parallel labeling on platforms without SIMD.
+static void threshRowPlain(const ARUint8 *image, const ARUint8 *image_thresh, int labelingThresh, int whiteRegion, int n, uint32_t *bits)
+{
+    threshRowC(image, image_thresh, labelingThresh, whiteRegion, 0, n, bits);
+}
+
+// Labels columns [x0, x1) of rows [j0, j1) of the image, ignoring connections to pixels outside
+// this range. Columns x0 and x1 - 1 are treated as background, as for the image border.
+// New labels are allocated from labelBase + 1 up to labelBase + labelMax inclusive.
+// On success, returns 0 and the number of labels used in *labelNum_p.
+static int labelRows(ARLabelingThreshRowFunc threshRow, ARUint8 *image, int xsize, int x0, int x1, int j0, int j1,
+                     int labelingThresh, ARUint8 *image_thresh, int whiteRegion, ARUint8 *bwImage, ARLabelInfo *labelInfo,
+                     int labelBase, int labelMax, int *labelNum_p)
+{
+    int       lxsize;
+    int       nwords, runsMax;
+    uint32_t *bits;
+    int      *runsBuf, *prevRuns, *curRuns, *tmp;
+    int       prevNum, curNum;
+    AR_LABELING_LABEL_TYPE *lpnt;
+    int      *work, *work2;
+    int       wk_max;
+    int       i, j, k, l, p;
+
+    lxsize = x1 - x0;
+    nwords = (lxsize + 31) >> 5;
+    runsMax = lxsize/2 + 1;
+
+    // Scratch: row bitmask, plus (start, end, label) triplets for the previous and current rows.
+    bits = (uint32_t *)malloc(nwords*sizeof(uint32_t) + 2*runsMax*3*sizeof(int));
+    if (!bits) {
+        ARLOGe("Out of memory!!\n");
+        return (-1);
+    }
+    runsBuf = (int *)(bits + nwords);
+    prevRuns = runsBuf;
+    curRuns = runsBuf + runsMax*3;
+    prevNum = 0;
+
+    wk_max = labelBase;
+    work = labelInfo->work;
+    work2 = labelInfo->work2;
+
+    for (j = j0; j < j1; j++) {
+        const ARUint8 *pnt = &(image[j*xsize + x0]);
+        const ARUint8 *pnt_thresh = (image_thresh ? &(image_thresh[j*xsize + x0]) : NULL);
+        uint32_t carry;
+
+        // Threshold row into bitmask, then mask out the leftmost and rightmost columns.
+        memset(bits, 0, nwords*sizeof(uint32_t));
+        (*threshRow)(pnt, pnt_thresh, labelingThresh, whiteRegion, lxsize, bits);
+        bits[0] &= ~1u;
+        bits[(lxsize - 1) >> 5] &= ~(1u << ((lxsize - 1) & 31));
+
+        // Decode runs from bit transitions. Run ends are exclusive.
+        curNum = 0;
+        carry = 0;
+        p = 0;
+        for (k = 0; k < nwords; k++) {
+            uint32_t v = bits[k];
+            uint32_t t = v ^ ((v << 1) | carry);
+            carry = v >> 31;
+            while (t) {
+                int b = ctz32(t);
+                t &= t - 1;
+                if (v & (1u << b)) {
+                    p = (k << 5) + b;
+                } else {
+                    curRuns[curNum*3 + 0] = p;
+                    curRuns[curNum*3 + 1] = (k << 5) + b;
+                    curNum++;
+                }
+            }
+        }
+
+        // Label runs, merging with 8-connected runs in the row above.
+        lpnt = &(labelInfo->labelImage[j*xsize + x0]);
+        memset(lpnt, 0, lxsize*sizeof(AR_LABELING_LABEL_TYPE));
+        if (bwImage) memset(&(bwImage[j*xsize + x0 + 1]), 0, lxsize - 2);
+        l = 0; // Index of first run in row above that could overlap.
+        for (k = 0; k < curNum; k++) {
+            int s = curRuns[k*3 + 0];
+            int e = curRuns[k*3 + 1];
+            int len = e - s;
+            int label = 0;
+            int m, n;
+
+            while (l < prevNum && prevRuns[l*3 + 1] < s) l++; // Skip runs ending before s - 1.
+            for (m = l; m < prevNum && prevRuns[m*3 + 0] <= e; m++) {
+                n = findRoot(work, prevRuns[m*3 + 2]);
+                if (!label) label = n;
+                else if (n < label) { work[label - 1] = n; label = n; }
+                else if (n > label) work[n - 1] = label;
+            }
+            if (!label) {
+                wk_max++;
+                if (wk_max > labelBase + labelMax) {
+                    free(bits);
+                    return (-1);
+                }
+                label = work[wk_max - 1] = wk_max;
+                m = (wk_max - 1)*7;
+                work2[m+0] = len; // area
+                work2[m+1] = (2*x0 + s + e - 1)*len/2; // pos[0]
+                work2[m+2] = j*len; // pos[1]
+                work2[m+3] = x0 + s; // clip[0]
+                work2[m+4] = x0 + e - 1; // clip[1]
+                work2[m+5] = j; // clip[2]
+                work2[m+6] = j; // clip[3]
+            } else {
+                m = (label - 1)*7;
+                work2[m+0] += len; // area
+                work2[m+1] += (2*x0 + s + e - 1)*len/2; // pos[0]
+                work2[m+2] += j*len; // pos[1]
+                if (work2[m+3] > x0 + s) work2[m+3] = x0 + s; // clip[0]
+                if (work2[m+4] < x0 + e - 1) work2[m+4] = x0 + e - 1; // clip[1]
+                work2[m+6] = j; // clip[3]
+            }
+            curRuns[k*3 + 2] = label;
+            for (i = s; i < e; i++) lpnt[i] = (AR_LABELING_LABEL_TYPE)label;
+            if (bwImage) memset(&(bwImage[j*xsize + x0 + s]), 255, len);
+        }
+
+        tmp = prevRuns; prevRuns = curRuns; curRuns = tmp;
+        prevNum = curNum;
+    }
+    free(bits);
+
+    *labelNum_p = wk_max - labelBase;
+    return (0);
+}
+
+// Resolves work[] and accumulates area, clip and pos into labelInfo. Labels in use are
+// the rangeNum ranges labelBase[r] + 1 to labelBase[r] + labelNum[r], in ascending order.
+static void labelFinalize(int xsize, int ysize, ARLabelInfo *labelInfo, int rangeNum, const int *labelBase, const int *labelNum)
+{
+    int      *work, *work2;
+    int       i, j, r;
+    int       *label_num;
+    int       *area;
+    int       *clip;
+    ARdouble  *pos;
+
+    work = labelInfo->work;
+    work2 = labelInfo->work2;
+
+    // Flatten. Since labels only ever point to lower labels, a single in-order pass suffices.
+    for (r = 0; r < rangeNum; r++) {
+        for (i = labelBase[r]; i < labelBase[r] + labelNum[r]; i++) work[i] = work[work[i] - 1];
+    }
+
+    label_num = &(labelInfo->label_num);
+    area = &(labelInfo->area[0]);
+    clip = &(labelInfo->clip[0][0]);
+    pos  = &(labelInfo->pos[0][0]);
+    j = 1;
+    for (r = 0; r < rangeNum; r++) {
+        for (i = labelBase[r] + 1; i <= labelBase[r] + labelNum[r]; i++) {
+            work[i - 1] = (work[i - 1] == i) ? j++ : work[work[i - 1] - 1];
+        }
+    }
+    *label_num = j - 1;
+    if (*label_num == 0) {
+        return;
+    }
+
+    memset( (ARUint8 *)area, 0, *label_num *     sizeof(int) );
+    memset( (ARUint8 *)pos,  0, *label_num * 2 * sizeof(ARdouble) );
+    for (i = 0; i < *label_num; i++) {
+        clip[i*4+0] = xsize;
+        clip[i*4+1] = 0;
+        clip[i*4+2] = ysize;
+        clip[i*4+3] = 0;
+    }
+    for (r = 0; r < rangeNum; r++) {
+        for (i = labelBase[r]; i < labelBase[r] + labelNum[r]; i++) {
+            j = work[i] - 1;
+            area[j]    += work2[i*7+0];
+            pos[j*2+0] += work2[i*7+1];
+            pos[j*2+1] += work2[i*7+2];
+            if( clip[j*4+0] > work2[i*7+3] ) clip[j*4+0] = work2[i*7+3];
+            if( clip[j*4+1] < work2[i*7+4] ) clip[j*4+1] = work2[i*7+4];
+            if( clip[j*4+2] > work2[i*7+5] ) clip[j*4+2] = work2[i*7+5];
+            if( clip[j*4+3] < work2[i*7+6] ) clip[j*4+3] = work2[i*7+6];
+        }
+    }
+
+    for (i = 0; i < *label_num; i++) {
+        pos[i*2+0] /= area[i];
+        pos[i*2+1] /= area[i];
+    }
+}
+
+static int labelWhole(ARLabelingThreshRowFunc threshRow, ARUint8 *image, int xsize, int ysize, int labelingThresh, ARUint8 *image_thresh, int whiteRegion, ARUint8 *bwImage, ARLabelInfo *labelInfo)
+{
+    int labelBase = 0;
+    int labelNum;
+
+    // Set top and bottom rows of labelImage to 0.
+    memset(labelInfo->labelImage, 0, xsize*sizeof(AR_LABELING_LABEL_TYPE));
+    memset(&(labelInfo->labelImage[(ysize - 1)*xsize]), 0, xsize*sizeof(AR_LABELING_LABEL_TYPE));
+
+    if (labelRows(threshRow, image, xsize, 0, xsize, 1, ysize - 1, labelingThresh, image_thresh, whiteRegion, bwImage, labelInfo,
+                  0, AR_LABELING_WORK_SIZE, &labelNum) < 0) {
+        ARLOGe("Error: labeling work overflow.\n");
+        return (-1);
+    }
+    labelFinalize(xsize, ysize, labelInfo, 1, &labelBase, &labelNum);
+
+    return 0;
+}
+
+int arLabelingSubSIMD(ARUint8 *image, int xsize, int ysize, int labelingThresh, ARUint8 *image_thresh, int whiteRegion, ARUint8 *bwImage, ARLabelInfo *labelInfo)
+{
+    if (arLabelingSubSIMDLevel() == AR_LABELING_SIMD_NONE) return (-1);
+
+    return (labelWhole(arLabelingThreshRow, image, xsize, ysize, labelingThresh, image_thresh, whiteRegion, bwImage, labelInfo));
+}
+
+// Parallel labeling. The image is split into horizontal strips, each labelled by one
+// thread into its own slice of the label space, and labels which meet across a
+// strip seam are then joined. Since all labels in a strip are lower than those in
+// the strip below, root labels remain in raster order and results are identical to
+// arLabelingSubSIMD().
+
+#define AR_LABELING_STRIP_ROWS_MIN 32
+
+typedef struct {
+    ARLabelingThreshRowFunc threshRow;
+    ARUint8     *image;
+    int          xsize;
+    int          labelingThresh;
+    ARUint8     *image_thresh;
+    int          whiteRegion;
+    ARUint8     *bwImage;
+    ARLabelInfo *labelInfo;
+    int          stripNum;
+    int          labelMax;                                      // Labels available per strip.
+    int          j0[AR_DETECTION_THREAD_MAX + 1];               // Strip s covers rows j0[s] to j0[s+1] - 1.
+    int          labelBase[AR_DETECTION_THREAD_MAX];
+    int          labelNum[AR_DETECTION_THREAD_MAX];
+    int          ret[AR_DETECTION_THREAD_MAX];
+} ARLabelingStripArgT;
+
+static void labelStripJob(void *arg, int index, int count)
+{
+    ARLabelingStripArgT *a = (ARLabelingStripArgT *)arg;
+    int s;
+
+    for (s = index; s < a->stripNum; s += count) {
+        a->ret[s] = labelRows(a->threshRow, a->image, a->xsize, 0, a->xsize, a->j0[s], a->j0[s + 1],
+                              a->labelingThresh, a->image_thresh, a->whiteRegion, a->bwImage, a->labelInfo,
+                              a->labelBase[s], a->labelMax, &(a->labelNum[s]));
+    }
+}
+
+// Joins labels in row j with 8-connected labels in row j - 1.
+static void labelJoinRows(int xsize, int j, ARLabelInfo *labelInfo)
+{
+    AR_LABELING_LABEL_TYPE *lpnt0 = &(labelInfo->labelImage[(j - 1)*xsize]);
+    AR_LABELING_LABEL_TYPE *lpnt1 = &(labelInfo->labelImage[j*xsize]);
+    int *work = labelInfo->work;
+    int  i, k, a, b;
+
+    for (i = 1; i < xsize - 1; i++) {
+        if (lpnt1[i] <= 0) continue;
+        for (k = i - 1; k <= i + 1; k++) {
+            if (lpnt0[k] <= 0) continue;
+            a = findRoot(work, lpnt1[i]);
+            b = findRoot(work, lpnt0[k]);
+            if (a < b) work[b - 1] = a;
+            else if (b < a) work[a - 1] = b;
+        }
+    }
+}
+
+int arLabelingSubSIMDParallel(ARParallelT *parallel, ARUint8 *image, int xsize, int ysize, int labelingThresh, ARUint8 *image_thresh, int whiteRegion, ARUint8 *bwImage, ARLabelInfo *labelInfo)
+{
+    ARLabelingStripArgT arg;
+    int s;
+
+    arg.threshRow = (arLabelingSubSIMDLevel() == AR_LABELING_SIMD_NONE ? threshRowPlain : arLabelingThreshRow);
+    arg.stripNum = arParallelGetThreadNum(parallel);
+    if (arg.stripNum > (ysize - 2) / AR_LABELING_STRIP_ROWS_MIN) arg.stripNum = (ysize - 2) / AR_LABELING_STRIP_ROWS_MIN;
+    if (arg.stripNum <= 1) {
+        return (labelWhole(arg.threshRow, image, xsize, ysize, labelingThresh, image_thresh, whiteRegion, bwImage, labelInfo));
+    }
+
+    arg.image = image;
+    arg.xsize = xsize;
+    arg.labelingThresh = labelingThresh;
+    arg.image_thresh = image_thresh;
+    arg.whiteRegion = whiteRegion;
+    arg.bwImage = bwImage;
+    arg.labelInfo = labelInfo;
+    arg.labelMax = (AR_LABELING_WORK_SIZE - 1) / arg.stripNum; // Keep labels within range of AR_LABELING_LABEL_TYPE.
+    for (s = 0; s < arg.stripNum; s++) {
+        arg.j0[s] = 1 + (ysize - 2) * s / arg.stripNum;
+        arg.labelBase[s] = arg.labelMax * s;
+    }
+    arg.j0[arg.stripNum] = ysize - 1;
+
+    // Set top and bottom rows of labelImage to 0.
+    memset(labelInfo->labelImage, 0, xsize*sizeof(AR_LABELING_LABEL_TYPE));
+    memset(&(labelInfo->labelImage[(ysize - 1)*xsize]), 0, xsize*sizeof(AR_LABELING_LABEL_TYPE));
+
+    arParallelRun(parallel, labelStripJob, &arg, arg.stripNum);
+
+    for (s = 0; s < arg.stripNum; s++) {
+        if (arg.ret[s] < 0) {
+            // A strip ran out of labels. Relabel serially, with the whole label space.
+            return (labelWhole(arg.threshRow, image, xsize, ysize, labelingThresh, image_thresh, whiteRegion, bwImage, labelInfo));
+        }
+    }
+    for (s = 1; s < arg.stripNum; s++) labelJoinRows(xsize, arg.j0[s], labelInfo);
+
+    labelFinalize(xsize, ysize, labelInfo, arg.stripNum, arg.labelBase, arg.labelNum);
+
+    return 0;
+}
+
+// Region of interest labeling. Each rectangle is labelled in turn into the next free part of
+// the label space, with its edge rows and columns treated as background, as for the image
+// border. Rectangles must not overlap. Regions which reach the edge of a rectangle (other than
+// at the image border, which arDetectMarker2() already checks) may be truncated, so their area
+// is set to 0, which excludes them from square detection.
+int arLabelingSubSIMDROI(ARUint8 *image, int xsize, int ysize, int labelingThresh, ARUint8 *image_thresh, int whiteRegion, ARUint8 *bwImage, ARLabelInfo *labelInfo,
+                         const int roi[][4], int roiNum)
+{
+    ARLabelingThreshRowFunc threshRow;
+    int labelBase[AR_SQUARE_MAX] = {0};
+    int labelNum[AR_SQUARE_MAX] = {0};
+    int r, i, l, x0, x1, y0, y1;
+
+    if (roiNum > AR_SQUARE_MAX) return (-1);
+    threshRow = (arLabelingSubSIMDLevel() == AR_LABELING_SIMD_NONE ? threshRowPlain : arLabelingThreshRow);
+
+    if (bwImage) memset(bwImage, 0, xsize*ysize);
+    for (r = 0; r < roiNum; r++) {
+        x0 = roi[r][0]; x1 = roi[r][1]; y0 = roi[r][2]; y1 = roi[r][3];
+        labelBase[r] = (r == 0 ? 0 : labelBase[r - 1] + labelNum[r - 1]);
+        labelNum[r] = 0;
+        if (x1 - x0 < 3 || y1 - y0 < 3) continue;
+        memset(&(labelInfo->labelImage[y0*xsize + x0]), 0, (x1 - x0)*sizeof(AR_LABELING_LABEL_TYPE));
+        memset(&(labelInfo->labelImage[(y1 - 1)*xsize + x0]), 0, (x1 - x0)*sizeof(AR_LABELING_LABEL_TYPE));
+        if (labelRows(threshRow, image, xsize, x0, x1, y0 + 1, y1 - 1, labelingThresh, image_thresh, whiteRegion, bwImage, labelInfo,
+                      labelBase[r], AR_LABELING_WORK_SIZE - labelBase[r], &(labelNum[r])) < 0) {
+            ARLOGe("Error: labeling work overflow.\n");
+            return (-1);
+        }
+    }
+    labelFinalize(xsize, ysize, labelInfo, roiNum, labelBase, labelNum);
+
+    for (r = 0; r < roiNum; r++) {
+        x0 = roi[r][0]; x1 = roi[r][1]; y0 = roi[r][2]; y1 = roi[r][3];
+        for (i = labelBase[r]; i < labelBase[r] + labelNum[r]; i++) {
+            l = labelInfo->work[i] - 1;
+            if ((x0 > 0     && labelInfo->clip[l][0] == x0 + 1) || (x1 < xsize && labelInfo->clip[l][1] == x1 - 2)
+             || (y0 > 0     && labelInfo->clip[l][2] == y0 + 1) || (y1 < ysize && labelInfo->clip[l][3] == y1 - 2)) {
+                labelInfo->area[l] = 0;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ *  arLabelingSubSIMD_bench.c
+ *  artoolkitX
+ *
+ *  This file is part of artoolkitX.
+ *
+ *  artoolkitX is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  artoolkitX is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, the copyright holders of this library give you
+ *  permission to link this library with independent modules to produce an
+ *  executable, regardless of the license terms of these independent modules, and to
+ *  copy and distribute the resulting executable under terms of your choice,
+ *  provided that you also meet, for each linked independent module, the terms and
+ *  conditions of the license of that module. An independent module is a module
+ *  which is neither derived from nor based on this library. If you modify this
+ *  library, you may extend this exception to your version of the library, but you
+ *  are not obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  Copyright 2018 Realmax, Inc.
+ *
+ */
+
+// Times the run-based labeler against arLabelingSubDBRC() on synthetic cluttered
+// images. Not run by ctest; run it by hand on a quiet machine with a Release build.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ARX/AR/ar.h>
+#include <ARX/ARUtil/time.h>
+#include "arLabelingPrivate.h"
+
+#define ITERATIONS 20
+
+static ARLabelInfo labelInfo;
+
+int main( void )
+{
+    static const int sizes[][2] = {{640, 480}, {1280, 720}, {1920, 1080}, {3840, 2160}};
+    ARUint8    *image;
+    int         s, i, x, y, xs, ys, v, xsize, ysize;
+    double      tScalar, tSIMD;
+
+    arLabelingSubSIMDInit();
+    if( arLabelingSubSIMDLevel() == AR_LABELING_SIMD_NONE ) {
+        printf("run-based labeling not available\n");
+        return 0;
+    }
+
+    srand(1);
+    for( s = 0; s < (int)(sizeof(sizes)/sizeof(sizes[0])); s++ ) {
+        xsize = sizes[s][0];
+        ysize = sizes[s][1];
+        arMalloc(image, ARUint8, xsize*ysize);
+        arMalloc(labelInfo.labelImage, AR_LABELING_LABEL_TYPE, xsize*ysize);
+        for( y = 0; y < ysize; y++ ) {
+            for( x = 0; x < xsize; x++ ) {
+                // A grid of dark square outlines, each with a dark dot inside, on a noisy
+                // light background. The grid is scaled to the frame so that every size has
+                // the same number of labels.
+                xs = (x*640/xsize)%24;
+                ys = (y*480/ysize)%24;
+                v = 180 + rand()%40 - 20;
+                if( xs >= 2 && xs < 22 && ys >= 2 && ys < 22 && (xs < 6 || xs >= 18 || ys < 6 || ys >= 18) ) v = 40 + rand()%40;
+                if( xs >= 10 && xs < 14 && ys >= 10 && ys < 14 ) v = 40 + rand()%40;
+                image[y*xsize + x] = (ARUint8)(v < 0 ? 0 : (v > 255 ? 255 : v));
+            }
+        }
+
+        arUtilTimerReset();
+        for( i = 0; i < ITERATIONS; i++ ) arLabelingSubDBRC(image, xsize, ysize, 100, &labelInfo);
+        tScalar = arUtilTimer()/ITERATIONS;
+        arUtilTimerReset();
+        for( i = 0; i < ITERATIONS; i++ ) arLabelingSubSIMD(image, xsize, ysize, 100, NULL, 0, NULL, &labelInfo);
+        tSIMD = arUtilTimer()/ITERATIONS;
+        printf("%dx%d: per-pixel %.2f ms, run-based %.2f ms, x%.1f (%d labels)\n", xsize, ysize, tScalar*1000.0, tSIMD*1000.0, tScalar/tSIMD, labelInfo.label_num);
+
+        free(image);
+        free(labelInfo.labelImage);
+    }
+
+    return 0;
+}
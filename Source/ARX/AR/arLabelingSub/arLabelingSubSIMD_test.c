@@ -0,0 +1,200 @@
+/*
+ *  arLabelingSubSIMD_test.c
+ *  artoolkitX
+ *
+ *  This file is part of artoolkitX.
+ *
+ *  artoolkitX is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  artoolkitX is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, the copyright holders of this library give you
+ *  permission to link this library with independent modules to produce an
+ *  executable, regardless of the license terms of these independent modules, and to
+ *  copy and distribute the resulting executable under terms of your choice,
+ *  provided that you also meet, for each linked independent module, the terms and
+ *  conditions of the license of that module. An independent module is a module
+ *  which is neither derived from nor based on this library. If you modify this
+ *  library, you may extend this exception to your version of the library, but you
+ *  are not obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  Copyright 2018 Realmax, Inc.
+ *
+ */
+
+// Checks the run-based labeler against the per-pixel arLabelingSub kernels, over
+// synthetic cluttered images, for black and white regions, fixed and adaptive
+// thresholds, and with and without a debug bwImage.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ARX/AR/ar.h>
+#include "arLabelingPrivate.h"
+
+typedef int (*ARLabelingSubFunc)( ARUint8 *image, int xsize, int ysize, int labelingThresh, ARLabelInfo *labelInfo );
+typedef int (*ARLabelingSubZFunc)( ARUint8 *image, const int xsize, const int ysize, ARUint8* image_thresh, ARLabelInfo *labelInfo );
+
+static ARLabelInfo expected, actual;
+
+// Dark and light diagonal bands with noise, cut by dark stripes, so that labels
+// merge in many different orders.
+static void makeImage( ARUint8 *image, ARUint8 *image_thresh, int xsize, int ysize )
+{
+    int     x, y, v;
+
+    for( y = 0; y < ysize; y++ ) {
+        for( x = 0; x < xsize; x++ ) {
+            v = 128 + 100*((x/37 + y/23)%3 - 1) + rand()%60 - 30;
+            if( ((x*7 + y*3)/50)%5 == 0 ) v = 40 + rand()%40;
+            image[y*xsize + x] = (ARUint8)(v < 0 ? 0 : (v > 255 ? 255 : v));
+            image_thresh[y*xsize + x] = (ARUint8)(90 + rand()%40);
+        }
+    }
+}
+
+static int labelOf( const ARLabelInfo *labelInfo, int i )
+{
+    return (labelInfo->labelImage[i] > 0 ? labelInfo->work[labelInfo->labelImage[i] - 1] : 0);
+}
+
+static int compare( int xsize, int ysize, int debug )
+{
+    int     i, x, y;
+
+    if( expected.label_num != actual.label_num ) {
+        printf("label_num %d, expected %d\n", actual.label_num, expected.label_num);
+        return -1;
+    }
+    if( memcmp(expected.area, actual.area, expected.label_num*sizeof(expected.area[0])) != 0 ) {
+        printf("area differs\n");
+        return -1;
+    }
+    if( memcmp(expected.clip, actual.clip, expected.label_num*sizeof(expected.clip[0])) != 0 ) {
+        printf("clip differs\n");
+        return -1;
+    }
+    if( memcmp(expected.pos, actual.pos, expected.label_num*sizeof(expected.pos[0])) != 0 ) {
+        printf("pos differs\n");
+        return -1;
+    }
+    // Label numbers before flattening may differ; what they resolve to may not.
+    for( i = 0; i < xsize*ysize; i++ ) {
+        if( labelOf(&expected, i) != labelOf(&actual, i) ) {
+            printf("labelImage differs at (%d, %d)\n", i%xsize, i/xsize);
+            return -1;
+        }
+    }
+#if !AR_DISABLE_LABELING_DEBUG_MODE
+    // The per-pixel kernels leave the image border of bwImage untouched.
+    if( debug ) {
+        for( y = 1; y < ysize - 1; y++ ) {
+            for( x = 1; x < xsize - 1; x++ ) {
+                if( expected.bwImage[y*xsize + x] != actual.bwImage[y*xsize + x] ) {
+                    printf("bwImage differs at (%d, %d)\n", x, y);
+                    return -1;
+                }
+            }
+        }
+    }
+#endif
+    return 0;
+}
+
+int main( void )
+{
+    static const int sizes[][2] = {{640, 480}, {333, 217}, {37, 23}, {17, 5}};
+    ARLabelingSubFunc   fixed[2][2] = {
+        {arLabelingSubDBRC, arLabelingSubDWRC},
+#if !AR_DISABLE_LABELING_DEBUG_MODE
+        {arLabelingSubEBRC, arLabelingSubEWRC}
+#else
+        {NULL, NULL}
+#endif
+    };
+#if !AR_DISABLE_THRESH_MODE_AUTO_ADAPTIVE
+    ARLabelingSubZFunc  adaptive[2][2] = {
+        {arLabelingSubDBZ, arLabelingSubDWZ},
+#  if !AR_DISABLE_LABELING_DEBUG_MODE
+        {arLabelingSubEBZ, arLabelingSubEWZ}
+#  else
+        {NULL, NULL}
+#  endif
+    };
+#endif
+    ARUint8    *image, *image_thresh;
+    int         s, xsize, ysize, debug, white, adaptiveMode, ret1, ret2;
+    int         failures = 0;
+
+    arLabelingSubSIMDInit();
+    if( arLabelingSubSIMDLevel() == AR_LABELING_SIMD_NONE ) {
+        printf("run-based labeling not available, skipped\n");
+        return 0;
+    }
+
+    srand(1);
+    for( s = 0; s < (int)(sizeof(sizes)/sizeof(sizes[0])); s++ ) {
+        xsize = sizes[s][0];
+        ysize = sizes[s][1];
+        arMalloc(image, ARUint8, xsize*ysize);
+        arMalloc(image_thresh, ARUint8, xsize*ysize);
+        arMalloc(expected.labelImage, AR_LABELING_LABEL_TYPE, xsize*ysize);
+        arMalloc(actual.labelImage, AR_LABELING_LABEL_TYPE, xsize*ysize);
+#if !AR_DISABLE_LABELING_DEBUG_MODE
+        arMallocClear(expected.bwImage, ARUint8, xsize*ysize);
+        arMallocClear(actual.bwImage, ARUint8, xsize*ysize);
+#endif
+        makeImage(image, image_thresh, xsize, ysize);
+
+        for( debug = 0; debug < 2; debug++ ) {
+            if( !fixed[debug][0] ) continue;
+            for( adaptiveMode = 0; adaptiveMode < 2; adaptiveMode++ ) {
+#if AR_DISABLE_THRESH_MODE_AUTO_ADAPTIVE
+                if( adaptiveMode ) continue;
+#endif
+                for( white = 0; white < 2; white++ ) {
+#if !AR_DISABLE_THRESH_MODE_AUTO_ADAPTIVE
+                    if( adaptiveMode ) ret1 = (adaptive[debug][white])(image, xsize, ysize, image_thresh, &expected);
+                    else
+#endif
+                    ret1 = (fixed[debug][white])(image, xsize, ysize, 100, &expected);
+#if !AR_DISABLE_LABELING_DEBUG_MODE
+                    ret2 = arLabelingSubSIMD(image, xsize, ysize, 100, (adaptiveMode ? image_thresh : NULL), white, (debug ? actual.bwImage : NULL), &actual);
+#else
+                    ret2 = arLabelingSubSIMD(image, xsize, ysize, 100, (adaptiveMode ? image_thresh : NULL), white, NULL, &actual);
+#endif
+                    printf("%dx%d %s %s%s: ", xsize, ysize, (white ? "white" : "black"), (adaptiveMode ? "adaptive" : "fixed"), (debug ? " debug" : ""));
+                    if( ret1 != ret2 ) {
+                        printf("returned %d, expected %d\n", ret2, ret1);
+                        failures++;
+                    } else if( ret1 == 0 && compare(xsize, ysize, debug) < 0 ) {
+                        failures++;
+                    } else {
+                        printf("%d labels, ok\n", actual.label_num);
+                    }
+                }
+            }
+        }
+
+        free(image);
+        free(image_thresh);
+        free(expected.labelImage);
+        free(actual.labelImage);
+#if !AR_DISABLE_LABELING_DEBUG_MODE
+        free(expected.bwImage);
+        free(actual.bwImage);
+#endif
+    }
+
+    return (failures ? 1 : 0);
+}
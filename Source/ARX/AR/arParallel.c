@@ -0,0 +1,169 @@
+/*
+ *  arParallel.c
+ *  artoolkitX
+ *
+ *  This file is part of artoolkitX.
+ *
+ *  artoolkitX is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  artoolkitX is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, the copyright holders of this library give you
+ *  permission to link this library with independent modules to produce an
+ *  executable, regardless of the license terms of these independent modules, and to
+ *  copy and distribute the resulting executable under terms of your choice,
+ *  provided that you also meet, for each linked independent module, the terms and
+ *  conditions of the license of that module. An independent module is a module
+ *  which is neither derived from nor based on this library. If you modify this
+ *  library, you may extend this exception to your version of the library, but you
+ *  are not obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  Copyright 2018 Realmax, Inc.
+ *
+ */
+
+#include <stdlib.h>
+#include <ARX/AR/ar.h>
+#include <ARX/ARUtil/thread_sub.h>
+#include "arParallel.h"
+
+typedef struct {
+    ARParallelFunc  func;
+    void           *arg;
+    int             index;
+    int             count;
+} ARParallelJobT;
+
+struct _ARParallelT {
+    int              threadNum;
+    THREAD_HANDLE_T *threadHandle[AR_DETECTION_THREAD_MAX];
+    ARParallelJobT   job[AR_DETECTION_THREAD_MAX];
+};
+
+static void *arParallelWorker(THREAD_HANDLE_T *threadHandle)
+{
+    ARParallelJobT *job = (ARParallelJobT *)threadGetArg(threadHandle);
+
+    while (threadStartWait(threadHandle) == 0) {
+        (*job->func)(job->arg, job->index, job->count);
+        threadEndSignal(threadHandle);
+    }
+    return (NULL);
+}
+
+ARParallelT *arParallelInit(int threadNum)
+{
+    ARParallelT *parallel;
+    int          i;
+
+    if (threadNum == AR_DETECTION_THREAD_NUM_AUTO) threadNum = threadGetCPU();
+    if (threadNum < 1) threadNum = 1;
+    if (threadNum > AR_DETECTION_THREAD_MAX) threadNum = AR_DETECTION_THREAD_MAX;
+
+    arMallocClear(parallel, ARParallelT, 1);
+    parallel->threadNum = 1;
+    for (i = 1; i < threadNum; i++) {
+        parallel->threadHandle[i] = threadInit(i, &(parallel->job[i]), arParallelWorker);
+        if (!parallel->threadHandle[i]) {
+            ARLOGe("Error starting detection thread %d.\n", i);
+            break;
+        }
+        parallel->threadNum++;
+    }
+    ARLOGi("Detection threads = %d\n", parallel->threadNum);
+
+    return (parallel);
+}
+
+int arParallelFinal(ARParallelT **parallel_p)
+{
+    int i;
+
+    if (!parallel_p) return (-1);
+    if (!*parallel_p) return (0);
+
+    for (i = 1; i < (*parallel_p)->threadNum; i++) {
+        threadWaitQuit((*parallel_p)->threadHandle[i]);
+        threadFree(&((*parallel_p)->threadHandle[i]));
+    }
+    free(*parallel_p);
+    *parallel_p = NULL;
+
+    return (0);
+}
+
+int arParallelGetThreadNum(ARParallelT *parallel)
+{
+    if (!parallel) return (1);
+    return (parallel->threadNum);
+}
+
+int arParallelRun(ARParallelT *parallel, ARParallelFunc func, void *arg, int count)
+{
+    int i;
+
+    if (count > arParallelGetThreadNum(parallel)) count = arParallelGetThreadNum(parallel);
+    if (count < 1) return (0);
+
+    for (i = 1; i < count; i++) {
+        parallel->job[i].func  = func;
+        parallel->job[i].arg   = arg;
+        parallel->job[i].index = i;
+        parallel->job[i].count = count;
+        threadStartSignal(parallel->threadHandle[i]);
+    }
+    (*func)(arg, 0, count);
+    for (i = 1; i < count; i++) {
+        threadEndWait(parallel->threadHandle[i]);
+    }
+
+    return (count);
+}
+
+ARBracketT *arBracketInit(int xsize, int ysize)
+{
+    ARBracketT *bracket;
+    int         i;
+
+    arMalloc(bracket, ARBracketT, 1);
+    for (i = 0; i < 2; i++) {
+        arMalloc(bracket->result[i].labelInfo.labelImage, AR_LABELING_LABEL_TYPE, xsize*ysize);
+#if !AR_DISABLE_LABELING_DEBUG_MODE
+        bracket->result[i].labelInfo.bwImage = NULL; // Allocated on first use in debug mode.
+#endif
+        bracket->result[i].labelInfo.label_num = 0;
+        bracket->result[i].marker2_num = 0;
+        bracket->result[i].marker_num = 0;
+    }
+
+    return (bracket);
+}
+
+int arBracketFinal(ARBracketT **bracket_p)
+{
+    int i;
+
+    if (!bracket_p) return (-1);
+    if (!*bracket_p) return (0);
+
+    for (i = 0; i < 2; i++) {
+        free((*bracket_p)->result[i].labelInfo.labelImage);
+#if !AR_DISABLE_LABELING_DEBUG_MODE
+        free((*bracket_p)->result[i].labelInfo.bwImage);
+#endif
+    }
+    free(*bracket_p);
+    *bracket_p = NULL;
+
+    return (0);
+}
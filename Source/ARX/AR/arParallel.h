@@ -0,0 +1,98 @@
+/*
+ *  arParallel.h
+ *  artoolkitX
+ *
+ *  This file is part of artoolkitX.
+ *
+ *  artoolkitX is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  artoolkitX is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, the copyright holders of this library give you
+ *  permission to link this library with independent modules to produce an
+ *  executable, regardless of the license terms of these independent modules, and to
+ *  copy and distribute the resulting executable under terms of your choice,
+ *  provided that you also meet, for each linked independent module, the terms and
+ *  conditions of the license of that module. An independent module is a module
+ *  which is neither derived from nor based on this library. If you modify this
+ *  library, you may extend this exception to your version of the library, but you
+ *  are not obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  Copyright 2018 Realmax, Inc.
+ *
+ */
+
+//
+// Internal fork-join worker pool used by arDetectMarker() when the ARHandle
+// has been configured with more than one detection thread.
+//
+
+#ifndef AR_PARALLEL_H
+#define AR_PARALLEL_H
+
+#include <ARX/AR/ar.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*ARParallelFunc)(void *arg, int index, int count);
+
+// Creates a pool which runs jobs on the calling thread plus (threadNum - 1) worker threads.
+ARParallelT *arParallelInit(int threadNum);
+int arParallelFinal(ARParallelT **parallel_p);
+int arParallelGetThreadNum(ARParallelT *parallel);
+
+// Calls func(arg, index, count) once for each index in [0, count), in parallel, and waits
+// for all calls to complete. count is clamped to the pool's thread count; the value
+// actually used is passed to func and returned. Index 0 runs on the calling thread.
+int arParallelRun(ARParallelT *parallel, ARParallelFunc func, void *arg, int count);
+
+// Detection results for one threshold, used when bracketing thresholds in parallel.
+typedef struct {
+    ARLabelInfo    labelInfo;
+    int            marker2_num;
+    ARMarkerInfo2  markerInfo2[AR_SQUARE_MAX];
+    int            marker_num;
+    ARMarkerInfo   markerInfo[AR_SQUARE_MAX];
+} ARBracketResultT;
+
+// Results for the over and under thresholds. The ARHandle itself holds the results for the current threshold.
+struct _ARBracketT {
+    ARBracketResultT result[2];
+};
+
+ARBracketT *arBracketInit(int xsize, int ysize);
+int arBracketFinal(ARBracketT **bracket_p);
+
+// Parallel versions of the arDetectMarker() pipeline stages. Each falls back to the
+// serial version when parallel is NULL or has only one thread, and produces the same
+// results as the serial version.
+int arLabelingParallel( ARParallelT *parallel, ARUint8 *imageLuma, int xsize, int ysize,
+                        int debugMode, int labelingMode, int labelingThresh, int imageProcMode,
+                        ARLabelInfo *labelInfo, ARUint8 *image_thresh );
+int arDetectMarker2Parallel( ARParallelT *parallel, int xsize, int ysize, ARLabelInfo *labelInfo, int imageProcMode,
+                             int areaMax, int areaMin, ARdouble squareFitThresh,
+                             ARMarkerInfo2 *markerInfo2, int *marker2_num );
+int arGetMarkerInfoParallel( ARParallelT *parallel, ARUint8 *image, int xsize, int ysize, int pixelFormat, ARMarkerInfo2 *markerInfo2, int marker2_num,
+                             ARPattHandle *pattHandle, int imageProcMode, int pattDetectMode, ARParamLTf *arParamLTf, ARdouble pattRatio,
+                             ARMarkerInfo *markerInfo, int *marker_num,
+                             const AR_MATRIX_CODE_TYPE matrixCodeType );
+int arPattGetIDGlobalBatchParallel( ARParallelT *parallel, ARPattHandle *pattHandle, int imageProcMode, int pattDetectMode,
+                                    ARUint8 *image, int xsize, int ysize, AR_PIXEL_FORMAT pixelFormat, ARParamLTf *paramLTf, ARdouble pattRatio,
+                                    const AR_MATRIX_CODE_TYPE matrixCodeType, ARMarkerInfo *markerInfo, int markerNum, int *result );
+
+#ifdef __cplusplus
+}
+#endif
+#endif // !AR_PARALLEL_H
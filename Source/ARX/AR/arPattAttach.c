@@ -47,6 +47,7 @@
  *******************************************************/
 
 #include <ARX/AR/ar.h>
+#include "arPattBank.h"
 
 int arPattAttach( ARHandle *arHandle, ARPattHandle *arPattHandle )
 {
@@ -54,6 +55,7 @@ int arPattAttach( ARHandle *arHandle, ARPattHandle *arPattHandle )
     if (arHandle->pattHandle) return (-1);
 
     arHandle->pattHandle = arPattHandle;
+    if (arPattHandle) arPattBankPrepare(arPattHandle); // Build the bank for all patterns loaded so far, once.
 
     return (0);
 }
@@ -0,0 +1,368 @@
+/*
+ *  arPattBank.c
+ *  artoolkitX
+ *
+ *  This file is part of artoolkitX.
+ *
+ *  artoolkitX is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  artoolkitX is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, the copyright holders of this library give you
+ *  permission to link this library with independent modules to produce an
+ *  executable, regardless of the license terms of these independent modules, and to
+ *  copy and distribute the resulting executable under terms of your choice,
+ *  provided that you also meet, for each linked independent module, the terms and
+ *  conditions of the license of that module. An independent module is a module
+ *  which is neither derived from nor based on this library. If you modify this
+ *  library, you may extend this exception to your version of the library, but you
+ *  are not obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  Copyright 2018 Realmax, Inc.
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include "arPattBank.h"
+#if HAVE_ARM_NEON || HAVE_ARM64_NEON
+#  include <arm_neon.h>
+#elif HAVE_INTEL_SIMD
+#  include <emmintrin.h> // SSE2.
+#endif
+
+// b must be 16-byte aligned. Pattern and input values lie in [-255, 255], so products can be summed pairwise in 32 bits,
+// and whole-pattern sums (at most 64 * 64 * 3 products) cannot overflow 32 bits.
+static int pattern_dot( const int16_t *a, const int16_t *b, const int n )
+{
+    int i = 0, sum;
+#if HAVE_ARM_NEON || HAVE_ARM64_NEON
+    int32x4_t acc = vdupq_n_s32(0);
+    int32x2_t acc2;
+    for (; i <= n - 8; i += 8) {
+        int16x8_t va = vld1q_s16(a + i);
+        int16x8_t vb = vld1q_s16(b + i);
+        acc = vmlal_s16(acc, vget_low_s16(va), vget_low_s16(vb));
+        acc = vmlal_s16(acc, vget_high_s16(va), vget_high_s16(vb));
+    }
+    acc2 = vadd_s32(vget_low_s32(acc), vget_high_s32(acc));
+    sum = vget_lane_s32(vpadd_s32(acc2, acc2), 0);
+#elif HAVE_INTEL_SIMD
+    __m128i acc0 = _mm_setzero_si128();
+    __m128i acc1 = _mm_setzero_si128();
+    for (; i <= n - 16; i += 16) {
+        acc0 = _mm_add_epi32(acc0, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(a + i)), _mm_load_si128((const __m128i *)(b + i))));
+        acc1 = _mm_add_epi32(acc1, _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(a + i + 8)), _mm_load_si128((const __m128i *)(b + i + 8))));
+    }
+    acc0 = _mm_add_epi32(acc0, acc1);
+    acc0 = _mm_add_epi32(acc0, _mm_shuffle_epi32(acc0, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc0 = _mm_add_epi32(acc0, _mm_shuffle_epi32(acc0, _MM_SHUFFLE(2, 3, 0, 1)));
+    sum = _mm_cvtsi128_si32(acc0);
+#else
+    sum = 0;
+#endif
+    for (; i < n; i++) sum += a[i] * b[i];
+    return (sum);
+}
+
+// Index of the prefilter block containing value i of a pattern.
+static int thumb_index( int i, int pattSize, int channels )
+{
+    int c = i % channels;
+    int x = (i / channels) % pattSize;
+    int y = (i / channels) / pattSize;
+    int blockSize = pattSize / AR_PATT_BANK_THUMB_SIZE;
+    return (((y / blockSize)*AR_PATT_BANK_THUMB_SIZE + x / blockSize)*channels + c);
+}
+
+
+void arPattBankFree(ARPattBank **bank_p)
+{
+    int m;
+
+    if (!bank_p || !*bank_p) return;
+    free((*bank_p)->slot);
+    for (m = 0; m < 2; m++) {
+        free((*bank_p)->mode[m].pow);
+        free((*bank_p)->mode[m].powHigh);
+    }
+    free((*bank_p)->mem);
+    free(*bank_p);
+    *bank_p = NULL;
+}
+
+int arPattBankUpdate(ARPattHandle *pattHandle)
+{
+    ARPattBank      *bank;
+    ARPattBankModeT *bm;
+    const int       *src;
+    int              k, j, r, m, i, channels, blockValues;
+    double           sum2, thumb2;
+    char            *aligned;
+
+    if (!pattHandle) return (-1);
+    arPattBankFree(&(pattHandle->bank));
+
+    arMalloc(bank, ARPattBank, 1);
+    bank->rowNum = 0;
+    for (k = 0; k < pattHandle->patt_num_max; k++) {
+        if (pattHandle->pattf[k] == 1) bank->rowNum += 4;
+    }
+    arMalloc(bank->slot, int, bank->rowNum + 1);
+    for (k = r = 0; k < pattHandle->patt_num_max; k++) {
+        if (pattHandle->pattf[k] != 1) continue;
+        for (j = 0; j < 4; j++) bank->slot[r++] = k*4 + j;
+    }
+
+    for (m = 0; m < 2; m++) {
+        bm = &(bank->mode[m]);
+        channels = (m == AR_PATT_BANK_COLOR ? 3 : 1);
+        bm->len = pattHandle->pattSize*pattHandle->pattSize*channels;
+        bm->stride = (bm->len + AR_PATT_BANK_ALIGN - 1)/AR_PATT_BANK_ALIGN*AR_PATT_BANK_ALIGN;
+        bm->thumbLen = AR_PATT_BANK_THUMB_SIZE*AR_PATT_BANK_THUMB_SIZE*channels;
+        blockValues = bm->len/bm->thumbLen;
+        // Block sums are held in 16 bits and their products summed in 32 bits, which limits the pattern size.
+        if (AR_PATT_MATCH_PREFILTER_MIN <= 0 || pattHandle->pattSize % AR_PATT_BANK_THUMB_SIZE != 0 ||
+            blockValues*255 > INT16_MAX || (double)blockValues*255*blockValues*255*bm->thumbLen > INT32_MAX) bm->thumbLen = 0;
+        arMalloc(bm->pow, ARdouble, bank->rowNum + 1);
+        bm->thumbStride = (bm->thumbLen + 15)/16*16;
+        arMalloc(bm->powHigh, ARdouble, bank->rowNum + 1);
+    }
+    arMalloc(bank->mem, char, (bank->rowNum*(bank->mode[0].stride + bank->mode[1].stride + bank->mode[0].thumbStride + bank->mode[1].thumbStride) + 1)*sizeof(int16_t) + 64);
+    aligned = (char *)(((uintptr_t)bank->mem + 63) & ~(uintptr_t)63);
+    bank->mode[0].data  = (int16_t *)aligned;
+    bank->mode[1].data  = bank->mode[0].data  + bank->rowNum*bank->mode[0].stride;
+    bank->mode[0].thumb = bank->mode[1].data  + bank->rowNum*bank->mode[1].stride;
+    bank->mode[1].thumb = bank->mode[0].thumb + bank->rowNum*bank->mode[0].thumbStride;
+
+    for (m = 0; m < 2; m++) {
+        bm = &(bank->mode[m]);
+        channels = (m == AR_PATT_BANK_COLOR ? 3 : 1);
+        blockValues = (bm->thumbLen ? bm->len/bm->thumbLen : 1);
+        for (r = 0; r < bank->rowNum; r++) {
+            int16_t *row = bm->data + r*bm->stride;
+            int16_t *thumb = bm->thumb + r*bm->thumbStride;
+            int32_t  thumbSum[AR_PATT_BANK_THUMB_SIZE*AR_PATT_BANK_THUMB_SIZE*3];
+            if (m == AR_PATT_BANK_COLOR) {
+                src = pattHandle->patt[bank->slot[r]];
+                bm->pow[r] = pattHandle->pattpow[bank->slot[r]];
+            } else {
+                src = pattHandle->pattBW[bank->slot[r]];
+                bm->pow[r] = pattHandle->pattpowBW[bank->slot[r]];
+            }
+            sum2 = 0.0;
+            for (i = 0; i < bm->len; i++) {
+                row[i] = (int16_t)src[i];
+                sum2 += (double)src[i]*src[i];
+            }
+            for (; i < bm->stride; i++) row[i] = 0;
+            if (bm->thumbLen) {
+                for (i = 0; i < bm->thumbLen; i++) thumbSum[i] = 0;
+                for (i = 0; i < bm->len; i++) thumbSum[thumb_index(i, pattHandle->pattSize, channels)] += src[i];
+                thumb2 = 0.0;
+                for (i = 0; i < bm->thumbLen; i++) thumb2 += (double)thumbSum[i]*thumbSum[i];
+                for (i = 0; i < bm->thumbLen; i++) thumb[i] = (int16_t)thumbSum[i];
+                for (; i < bm->thumbStride; i++) thumb[i] = 0;
+                thumb2 /= blockValues;
+                bm->powHigh[r] = (sum2 > thumb2 ? sqrt(sum2 - thumb2) : 0.0);
+            }
+        }
+    }
+
+    pattHandle->bank = bank;
+    pattHandle->bankDirty = 0;
+    return (0);
+}
+
+int arPattBankPrepare(ARPattHandle *pattHandle)
+{
+    if (!pattHandle) return (-1);
+    if (!pattHandle->bankDirty && pattHandle->bank) return (0);
+    return (arPattBankUpdate(pattHandle));
+}
+
+int arPattBankInputStride(const ARPattBank *bank, int bankMode)
+{
+    return (bank->mode[bankMode].stride);
+}
+
+// Dot products of one 16-byte aligned row b with each of 4 inputs, loading b once for all of them.
+// n must be a multiple of 8.
+static void pattern_dot4( const int16_t *const a[AR_PATT_BANK_BATCH], const int16_t *b, const int n, int sum[AR_PATT_BANK_BATCH] )
+{
+    int i = 0, k;
+#if HAVE_ARM_NEON || HAVE_ARM64_NEON
+    int32x4_t acc[AR_PATT_BANK_BATCH];
+    int32x2_t acc2;
+    for (k = 0; k < AR_PATT_BANK_BATCH; k++) acc[k] = vdupq_n_s32(0);
+    for (; i <= n - 8; i += 8) {
+        int16x8_t vb = vld1q_s16(b + i);
+        for (k = 0; k < AR_PATT_BANK_BATCH; k++) {
+            int16x8_t va = vld1q_s16(a[k] + i);
+            acc[k] = vmlal_s16(acc[k], vget_low_s16(va), vget_low_s16(vb));
+            acc[k] = vmlal_s16(acc[k], vget_high_s16(va), vget_high_s16(vb));
+        }
+    }
+    for (k = 0; k < AR_PATT_BANK_BATCH; k++) {
+        acc2 = vadd_s32(vget_low_s32(acc[k]), vget_high_s32(acc[k]));
+        sum[k] = vget_lane_s32(vpadd_s32(acc2, acc2), 0);
+    }
+#elif HAVE_INTEL_SIMD
+    __m128i acc[AR_PATT_BANK_BATCH];
+    for (k = 0; k < AR_PATT_BANK_BATCH; k++) acc[k] = _mm_setzero_si128();
+    for (; i <= n - 8; i += 8) {
+        __m128i vb = _mm_load_si128((const __m128i *)(b + i));
+        acc[0] = _mm_add_epi32(acc[0], _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(a[0] + i)), vb));
+        acc[1] = _mm_add_epi32(acc[1], _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(a[1] + i)), vb));
+        acc[2] = _mm_add_epi32(acc[2], _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(a[2] + i)), vb));
+        acc[3] = _mm_add_epi32(acc[3], _mm_madd_epi16(_mm_loadu_si128((const __m128i *)(a[3] + i)), vb));
+    }
+    for (k = 0; k < AR_PATT_BANK_BATCH; k++) {
+        acc[k] = _mm_add_epi32(acc[k], _mm_shuffle_epi32(acc[k], _MM_SHUFFLE(1, 0, 3, 2)));
+        acc[k] = _mm_add_epi32(acc[k], _mm_shuffle_epi32(acc[k], _MM_SHUFFLE(2, 3, 0, 1)));
+        sum[k] = _mm_cvtsi128_si32(acc[k]);
+    }
+#else
+    for (k = 0; k < AR_PATT_BANK_BATCH; k++) sum[k] = 0;
+#endif
+    for (; i < n; i++) {
+        for (k = 0; k < AR_PATT_BANK_BATCH; k++) sum[k] += a[k][i] * b[i];
+    }
+}
+
+// Block sums of an input row, and the root of its sum of squares after subtracting its block means.
+static void pattern_thumb( const ARPattBankModeT *bm, int bankMode, const int16_t *input, ARdouble datapow, int16_t *thumbIn, double *inHigh )
+{
+    int32_t thumbSum[AR_PATT_BANK_THUMB_SIZE*AR_PATT_BANK_THUMB_SIZE*3];
+    double  in2, thumb2;
+    int     i, channels, pattSize, blockValues;
+
+    channels = (bankMode == AR_PATT_BANK_COLOR ? 3 : 1);
+    pattSize = (int)(sqrt((double)(bm->len / channels)) + 0.5);
+    blockValues = bm->len / bm->thumbLen;
+    for (i = 0; i < bm->thumbLen; i++) thumbSum[i] = 0;
+    for (i = 0; i < bm->len; i++) thumbSum[thumb_index(i, pattSize, channels)] += input[i];
+    thumb2 = 0.0;
+    for (i = 0; i < bm->thumbLen; i++) thumb2 += (double)thumbSum[i]*thumbSum[i];
+    thumb2 /= blockValues;
+    for (i = 0; i < bm->thumbLen; i++) thumbIn[i] = (int16_t)thumbSum[i];
+    for (; i < bm->thumbStride; i++) thumbIn[i] = 0;
+    in2 = (double)datapow*datapow;
+    *inHigh = (in2 > thumb2 ? sqrt(in2 - thumb2) : 0.0);
+}
+
+// Matches up to AR_PATT_BANK_BATCH inputs. Each bank row is read once for the whole group, and its
+// correlation with every input that needs it is computed in the same pass.
+//
+// The prefilter bounds each correlation from above. Splitting input x and pattern p each into its
+// block means (x_L, p_L) and the remainder (x_H, p_H), which are orthogonal, gives
+// <x, p> = <x_L, p_L> + <x_H, p_H> <= <x_L, p_L> + |x_H| |p_H|. The bound is computed cheaply from
+// the block sums for every row, and rows are then correlated in full, skipping those whose bound
+// cannot beat the best correlation found so far for that input.
+static void pattern_match_group(const ARPattBank *bank, int bankMode, const int16_t *const *input, const ARdouble *datapow, int n,
+                                int *code, int *dir, ARdouble *cf)
+{
+    const ARPattBankModeT *bm = &(bank->mode[bankMode]);
+    const int16_t *in[AR_PATT_BANK_BATCH];
+    const int16_t *thumbPtr[AR_PATT_BANK_BATCH];
+    int16_t    thumbIn[AR_PATT_BANK_BATCH][AR_PATT_BANK_THUMB_SIZE*AR_PATT_BANK_THUMB_SIZE*3 + 16];
+    double     inHigh[AR_PATT_BANK_BATCH], b;
+    ARdouble   max[AR_PATT_BANK_BATCH], sum2;
+    ARdouble  *bound;
+    int        res[AR_PATT_BANK_BATCH], best[AR_PATT_BANK_BATCH], dot[AR_PATT_BANK_BATCH], need[AR_PATT_BANK_BATCH];
+    int        r, c, needNum, blockValues;
+
+    // Unused lanes repeat the first input; their results are ignored.
+    for (c = 0; c < AR_PATT_BANK_BATCH; c++) {
+        in[c] = input[c < n ? c : 0];
+        max[c] = 0.0;
+        res[c] = -1;
+    }
+
+    if (!bm->thumbLen || bank->rowNum < 4*AR_PATT_MATCH_PREFILTER_MIN) {
+        for (r = 0; r < bank->rowNum; r++) {
+            if (n == 1) dot[0] = pattern_dot(in[0], bm->data + r*bm->stride, bm->stride);
+            else pattern_dot4(in, bm->data + r*bm->stride, bm->stride, dot);
+            for (c = 0; c < n; c++) {
+                sum2 = dot[c] / bm->pow[r] / datapow[c];
+                if (sum2 > max[c]) { max[c] = sum2; res[c] = r; }
+            }
+        }
+    } else {
+        blockValues = bm->len / bm->thumbLen;
+        for (c = 0; c < n; c++) pattern_thumb(bm, bankMode, in[c], datapow[c], thumbIn[c], &(inHigh[c]));
+        for (c = 0; c < AR_PATT_BANK_BATCH; c++) thumbPtr[c] = thumbIn[c < n ? c : 0];
+
+        arMalloc(bound, ARdouble, n*bank->rowNum);
+        for (c = 0; c < n; c++) best[c] = 0;
+        for (r = 0; r < bank->rowNum; r++) {
+            if (n == 1) dot[0] = pattern_dot(thumbPtr[0], bm->thumb + r*bm->thumbStride, bm->thumbStride);
+            else pattern_dot4(thumbPtr, bm->thumb + r*bm->thumbStride, bm->thumbStride, dot);
+            for (c = 0; c < n; c++) {
+                b = ((double)dot[c]/blockValues + inHigh[c]*bm->powHigh[r]) / bm->pow[r] / datapow[c];
+                bound[c*bank->rowNum + r] = b + fabs(b)*1e-9 + 1e-12; // Allow for rounding.
+                if (b > bound[c*bank->rowNum + best[c]]) best[c] = r;
+            }
+        }
+        for (c = 0; c < n; c++) {
+            max[c] = pattern_dot(in[c], bm->data + best[c]*bm->stride, bm->stride) / bm->pow[best[c]] / datapow[c];
+            res[c] = (max[c] > 0.0 ? best[c] : -1);
+            if (max[c] < 0.0) max[c] = 0.0;
+        }
+        for (r = 0; r < bank->rowNum; r++) {
+            needNum = 0;
+            for (c = 0; c < n; c++) {
+                if (r != best[c] && bound[c*bank->rowNum + r] >= max[c]) need[needNum++] = c;
+            }
+            if (needNum == 0) continue;
+            if (needNum == 1) dot[need[0]] = pattern_dot(in[need[0]], bm->data + r*bm->stride, bm->stride);
+            else pattern_dot4(in, bm->data + r*bm->stride, bm->stride, dot);
+            while (needNum--) {
+                c = need[needNum];
+                sum2 = dot[c] / bm->pow[r] / datapow[c];
+                if (sum2 > max[c] || (sum2 == max[c] && r < res[c])) { max[c] = sum2; res[c] = r; }
+            }
+        }
+        free(bound);
+    }
+
+    for (c = 0; c < n; c++) {
+        if (res[c] < 0) {
+            code[c] = -1;
+            dir[c]  = -1;
+        } else {
+            code[c] = bank->slot[res[c]] / 4;
+            dir[c]  = bank->slot[res[c]] % 4;
+        }
+        cf[c] = max[c];
+    }
+}
+
+void arPattBankMatch(const ARPattBank *bank, int bankMode, const int16_t *input, ARdouble datapow,
+                     int *code, int *dir, ARdouble *cf)
+{
+    pattern_match_group(bank, bankMode, &input, &datapow, 1, code, dir, cf);
+}
+
+void arPattBankMatchBatch(const ARPattBank *bank, int bankMode, const int16_t *const *input, const ARdouble *datapow, int n,
+                          int *code, int *dir, ARdouble *cf)
+{
+    int i;
+
+    for (i = 0; i < n; i += AR_PATT_BANK_BATCH) {
+        pattern_match_group(bank, bankMode, input + i, datapow + i, (n - i < AR_PATT_BANK_BATCH ? n - i : AR_PATT_BANK_BATCH),
+                            code + i, dir + i, cf + i);
+    }
+}
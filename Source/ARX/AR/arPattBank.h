@@ -0,0 +1,108 @@
+/*
+ *  arPattBank.h
+ *  artoolkitX
+ *
+ *  This file is part of artoolkitX.
+ *
+ *  artoolkitX is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  artoolkitX is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, the copyright holders of this library give you
+ *  permission to link this library with independent modules to produce an
+ *  executable, regardless of the license terms of these independent modules, and to
+ *  copy and distribute the resulting executable under terms of your choice,
+ *  provided that you also meet, for each linked independent module, the terms and
+ *  conditions of the license of that module. An independent module is a module
+ *  which is neither derived from nor based on this library. If you modify this
+ *  library, you may extend this exception to your version of the library, but you
+ *  are not obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  Copyright 2018 Realmax, Inc.
+ *
+ */
+
+//
+// Internal pattern bank used for template matching. Holds all active pattern
+// orientations of an ARPattHandle as 16-bit values, one padded, cache-aligned
+// row per orientation, plus low-resolution block sums used to reject
+// non-matching patterns before computing their full correlation.
+//
+
+#ifndef AR_PATT_BANK_H
+#define AR_PATT_BANK_H
+
+#include <stdint.h>
+#include <ARX/AR/ar.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Rows are padded to a multiple of this many values, and aligned to 64 bytes.
+#define AR_PATT_BANK_ALIGN 32
+
+// Number of inputs correlated together against each row by arPattBankMatchBatch().
+#define AR_PATT_BANK_BATCH 4
+
+// Number of blocks along each side of the pattern for the prefilter thumbnail.
+#define AR_PATT_BANK_THUMB_SIZE 4
+
+typedef struct {
+    int        len;         // Values per pattern.
+    int        stride;      // Values per row, a multiple of AR_PATT_BANK_ALIGN.
+    int16_t   *data;        // rowNum rows.
+    ARdouble  *pow;         // Root of sum of squares of each row.
+    int        thumbLen;    // Blocks per pattern, or 0 if the prefilter is not used.
+    int        thumbStride; // Values per thumbnail row, a multiple of 16.
+    int16_t   *thumb;       // Sum of values in each block, rowNum rows.
+    ARdouble  *powHigh;     // Root of sum of squares of each row after subtracting its block means.
+} ARPattBankModeT;
+
+struct _ARPattBank {
+    int              rowNum;    // 4 orientations of each active pattern, in slot order.
+    int             *slot;      // Pattern slot * 4 + orientation of each row.
+    ARPattBankModeT  mode[2];   // AR_PATT_BANK_COLOR, AR_PATT_BANK_MONO.
+    void            *mem;
+};
+
+#define AR_PATT_BANK_COLOR 0
+#define AR_PATT_BANK_MONO  1
+
+// Rebuilds the bank of pattHandle from its active patterns, and clears bankDirty.
+int arPattBankUpdate(ARPattHandle *pattHandle);
+
+// Rebuilds the bank only if bankDirty is set. Callers that change the patterns just set bankDirty,
+// so that loading N patterns builds the bank once. Called from arPattAttach(), arDetectMarker() and
+// the other matching entry points before any threads are started, never from the threads, which
+// share the bank. Patterns must not be changed while another thread is matching against them.
+int arPattBankPrepare(ARPattHandle *pattHandle);
+void arPattBankFree(ARPattBank **bank_p);
+
+// Values per normalised input row for the given mode.
+int arPattBankInputStride(const ARPattBank *bank, int bankMode);
+
+// Finds the best match to a normalised input row (stride values, zero padded), giving the same
+// result as correlating against every row in order. datapow is the root of sum of squares of input.
+void arPattBankMatch(const ARPattBank *bank, int bankMode, const int16_t *input, ARdouble datapow,
+                     int *code, int *dir, ARdouble *cf);
+
+// Matches n inputs, giving the same results as arPattBankMatch() on each in turn. Inputs are taken
+// AR_PATT_BANK_BATCH at a time, and each bank row is correlated with all inputs of a group in one pass.
+void arPattBankMatchBatch(const ARPattBank *bank, int bankMode, const int16_t *const *input, const ARdouble *datapow, int n,
+                          int *code, int *dir, ARdouble *cf);
+
+#ifdef __cplusplus
+}
+#endif
+#endif // !AR_PATT_BANK_H
@@ -49,6 +49,7 @@
 #include <ARX/AR/ar.h>
 #include <stdio.h>
 #include <math.h>
+#include "arPattBank.h"
 
 ARPattHandle *arPattCreateHandle(void)
 {
@@ -81,6 +82,8 @@ ARPattHandle *arPattCreateHandle2(const int pattSize, const int patternCountMax)
             arMalloc(pattHandle->pattBW[i*4 + j], int, pattSize*pattSize);
         }
     }
+    pattHandle->bank = NULL;
+    pattHandle->bankDirty = 1;
 
     return pattHandle;
 }
@@ -99,6 +102,7 @@ int arPattDeleteHandle(ARPattHandle *pattHandle)
 		}
 	}
 	
+	arPattBankFree(&(pattHandle->bank));
 	free(pattHandle->patt);
 	free(pattHandle->pattBW);
 	free(pattHandle->pattf);
@@ -51,6 +51,8 @@
 #include <math.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include "arParallel.h"
+#include "arPattBank.h"
 #if DEBUG_PATT_GETID
 #  ifndef __APPLE__
 #    include <GL/gl.h>
@@ -99,6 +101,7 @@ int  cnt = 1;
 
 static void   get_cpara( ARdouble world[4][2], ARdouble vertex[4][2],
                          ARdouble para[3][3] );
+static int    pattern_input( int mode, const ARUint8 *data, int size, int16_t *input, int stride, ARdouble *datapow_p );
 static int    pattern_match( ARPattHandle *pattHandle, int mode, ARUint8 *data, int size,
                              int *code, int *dir, ARdouble *cf );
 static int    decode_bch(const AR_MATRIX_CODE_TYPE matrixCodeType, const uint64_t in, uint8_t recd127[127], uint64_t *out_p);
@@ -181,6 +184,53 @@ int arPattGetID2( ARPattHandle *pattHandle, int imageProcMode, int pattDetectMod
 }
 #endif // !AR_DISABLE_NON_CORE_FNS
 
+// Matrix code detection pass for one marker. Returns the error code for the pass.
+static int get_id_matrix( int imageProcMode, ARUint8 *image, int xsize, int ysize, AR_PIXEL_FORMAT pixelFormat, ARParamLTf *paramLTf, ARdouble vertex[4][2], ARdouble pattRatio,
+                          int *codeMatrix, int *dirMatrix, ARdouble *cfMatrix, const AR_MATRIX_CODE_TYPE matrixCodeType, int *errorCorrected, uint64_t *codeGlobalID_p,
+                          ARUint8 *ext_patt )
+{
+    int errorCodeMtx;
+    uint64_t codeGlobalID;
+
+    if (matrixCodeType == AR_MATRIX_CODE_GLOBAL_ID) {
+        if (arPattGetImage2(imageProcMode, AR_MATRIX_CODE_DETECTION, AR_GLOBAL_ID_OUTER_SIZE, AR_GLOBAL_ID_OUTER_SIZE * AR_PATT_SAMPLE_FACTOR2,
+                            image, xsize, ysize, pixelFormat, paramLTf, vertex, (((ARdouble)AR_GLOBAL_ID_OUTER_SIZE)/((ARdouble)(AR_GLOBAL_ID_OUTER_SIZE + 2))), ext_patt) < 0) {
+            errorCodeMtx = -6;
+            *codeMatrix = -1;
+        } else {
+            errorCodeMtx = get_global_id_code(ext_patt, &codeGlobalID, dirMatrix, cfMatrix, errorCorrected);
+            
+            if (errorCodeMtx < 0) {
+                *codeMatrix = -1;
+            } else if (codeGlobalID == UINT64_MAX) { // Heuristic-based elimination of frequently misrecognised codes.
+                errorCodeMtx = -5;
+                *codeMatrix = -1;
+            } else {
+                if ((codeGlobalID & 0xffff8000ULL) == 0ULL) *codeMatrix = (int)(codeGlobalID & 0x00007fffULL); // If upper 33 bits are zero, return lower 31 bits as regular matrix code as well.
+                else *codeMatrix = 0; // otherwise, regular matrix code = 0;
+                if (codeGlobalID_p) *codeGlobalID_p = codeGlobalID;
+            }
+        }
+    } else {
+        if (arPattGetImage2(imageProcMode, AR_MATRIX_CODE_DETECTION, matrixCodeType & AR_MATRIX_CODE_TYPE_SIZE_MASK, (matrixCodeType & AR_MATRIX_CODE_TYPE_SIZE_MASK) * AR_PATT_SAMPLE_FACTOR2,
+                            image, xsize, ysize, pixelFormat, paramLTf, vertex, pattRatio, ext_patt) < 0) {
+            errorCodeMtx = -6;
+            *codeMatrix = -1;
+        } else {
+#if DEBUG_PATT_GETID
+            glPixelZoom( 4.0f, -4.0f);
+            glRasterPos3f( 0.0f, (matrixCodeType & AR_MATRIX_CODE_TYPE_SIZE_MASK)*4.0f*cnt, 1.0f );
+            glDrawPixels( matrixCodeType & AR_MATRIX_CODE_TYPE_SIZE_MASK, matrixCodeType & AR_MATRIX_CODE_TYPE_SIZE_MASK, GL_LUMINANCE, GL_UNSIGNED_BYTE, ext_patt );
+            glPixelZoom( 1.0f, 1.0f);
+            cnt++;
+#endif
+            errorCodeMtx = get_matrix_code(ext_patt, matrixCodeType & AR_MATRIX_CODE_TYPE_SIZE_MASK, codeMatrix, dirMatrix, cfMatrix, matrixCodeType, errorCorrected);
+            if (codeGlobalID_p) *codeGlobalID_p = 0ULL;
+        }
+    }
+    return (errorCodeMtx);
+}
+
 int arPattGetIDGlobal( ARPattHandle *pattHandle, int imageProcMode, int pattDetectMode,
                       ARUint8 *image, int xsize, int ysize, AR_PIXEL_FORMAT pixelFormat, ARParamLTf *paramLTf, ARdouble vertex[4][2], ARdouble pattRatio,
                       int *codePatt, int *dirPatt, ARdouble *cfPatt, int *codeMatrix, int *dirMatrix, ARdouble *cfMatrix,
@@ -188,48 +238,13 @@ int arPattGetIDGlobal( ARPattHandle *pattHandle, int imageProcMode, int pattDete
 {
     ARUint8 ext_patt[MAX(AR_PATT_SIZE1_MAX,AR_PATT_SIZE2_MAX)*MAX(AR_PATT_SIZE1_MAX,AR_PATT_SIZE2_MAX)*3]; // Holds unwarped pattern extracted from image.
     int errorCodeMtx, errorCodePatt;
-    uint64_t codeGlobalID;
 
     // Matrix code detection pass.
     if( pattDetectMode == AR_MATRIX_CODE_DETECTION
        || pattDetectMode == AR_TEMPLATE_MATCHING_COLOR_AND_MATRIX
        || pattDetectMode == AR_TEMPLATE_MATCHING_MONO_AND_MATRIX ) {
-        if (matrixCodeType == AR_MATRIX_CODE_GLOBAL_ID) {
-            if (arPattGetImage2(imageProcMode, AR_MATRIX_CODE_DETECTION, AR_GLOBAL_ID_OUTER_SIZE, AR_GLOBAL_ID_OUTER_SIZE * AR_PATT_SAMPLE_FACTOR2,
-                                image, xsize, ysize, pixelFormat, paramLTf, vertex, (((ARdouble)AR_GLOBAL_ID_OUTER_SIZE)/((ARdouble)(AR_GLOBAL_ID_OUTER_SIZE + 2))), ext_patt) < 0) {
-                errorCodeMtx = -6;
-                *codeMatrix = -1;
-            } else {
-                errorCodeMtx = get_global_id_code(ext_patt, &codeGlobalID, dirMatrix, cfMatrix, errorCorrected);
-                
-                if (errorCodeMtx < 0) {
-                    *codeMatrix = -1;
-                } else if (codeGlobalID == UINT64_MAX) { // Heuristic-based elimination of frequently misrecognised codes.
-                    errorCodeMtx = -5;
-                    *codeMatrix = -1;
-                } else {
-                    if ((codeGlobalID & 0xffff8000ULL) == 0ULL) *codeMatrix = (int)(codeGlobalID & 0x00007fffULL); // If upper 33 bits are zero, return lower 31 bits as regular matrix code as well.
-                    else *codeMatrix = 0; // otherwise, regular matrix code = 0;
-                    if (codeGlobalID_p) *codeGlobalID_p = codeGlobalID;
-                }
-            }
-        } else {
-            if (arPattGetImage2(imageProcMode, AR_MATRIX_CODE_DETECTION, matrixCodeType & AR_MATRIX_CODE_TYPE_SIZE_MASK, (matrixCodeType & AR_MATRIX_CODE_TYPE_SIZE_MASK) * AR_PATT_SAMPLE_FACTOR2,
-                                image, xsize, ysize, pixelFormat, paramLTf, vertex, pattRatio, ext_patt) < 0) {
-                errorCodeMtx = -6;
-                *codeMatrix = -1;
-            } else {
-#if DEBUG_PATT_GETID
-                glPixelZoom( 4.0f, -4.0f);
-                glRasterPos3f( 0.0f, (matrixCodeType & AR_MATRIX_CODE_TYPE_SIZE_MASK)*4.0f*cnt, 1.0f );
-                glDrawPixels( matrixCodeType & AR_MATRIX_CODE_TYPE_SIZE_MASK, matrixCodeType & AR_MATRIX_CODE_TYPE_SIZE_MASK, GL_LUMINANCE, GL_UNSIGNED_BYTE, ext_patt );
-                glPixelZoom( 1.0f, 1.0f);
-                cnt++;
-#endif
-                errorCodeMtx = get_matrix_code(ext_patt, matrixCodeType & AR_MATRIX_CODE_TYPE_SIZE_MASK, codeMatrix, dirMatrix, cfMatrix, matrixCodeType, errorCorrected);
-                if (codeGlobalID_p) *codeGlobalID_p = 0ULL;
-            }
-        }
+        errorCodeMtx = get_id_matrix(imageProcMode, image, xsize, ysize, pixelFormat, paramLTf, vertex, pattRatio,
+                                     codeMatrix, dirMatrix, cfMatrix, matrixCodeType, errorCorrected, codeGlobalID_p, ext_patt);
     } else errorCodeMtx = 1;
     
     // Template matching pass.
@@ -282,6 +297,170 @@ int arPattGetIDGlobal( ARPattHandle *pattHandle, int imageProcMode, int pattDete
     
 }
 
+// Batched template matching. All candidates' unwarped patterns are normalised into one
+// contiguous tensor of 16-bit values, one row per candidate. The candidates with enough contrast
+// are then matched against the pattern handle's precomputed bank in groups, each bank row being
+// correlated with every candidate of a group in one pass (see arPattBank.h).
+
+typedef struct {
+    ARPattHandle       *pattHandle;
+    int                 imageProcMode;
+    int                 pattDetectMode;
+    ARUint8            *image;
+    int                 xsize;
+    int                 ysize;
+    AR_PIXEL_FORMAT     pixelFormat;
+    ARParamLTf         *paramLTf;
+    ARdouble            pattRatio;
+    AR_MATRIX_CODE_TYPE matrixCodeType;
+    ARMarkerInfo       *markerInfo;
+    int                 markerNum;
+    int                 pattMode;       // AR_TEMPLATE_MATCHING_COLOR or AR_TEMPLATE_MATCHING_MONO, or -1 if no template matching.
+    int                 stride;         // Values per tensor row.
+    int16_t            *input;          // markerNum rows of normalised candidate patterns.
+    ARdouble           *datapow;        // Root of sum of squares of each row.
+    int                *errorCodeMtx;
+    int                *errorCodePatt;
+    int                 matchNum;       // Candidates to be matched against the bank.
+    const int16_t     **matchInput;     // Their rows.
+    ARdouble           *matchDatapow;
+    int                *matchIndex;     // Their indices in markerInfo.
+    int                *matchCode;
+    int                *matchDir;
+    ARdouble           *matchCf;
+} ARPattBatchArgT;
+
+// Matrix decoding, and template extraction and normalisation, for candidates index, index + count, ...
+static void patt_batch_job( void *arg, int index, int count )
+{
+    ARPattBatchArgT *a = (ARPattBatchArgT *)arg;
+    ARUint8          ext_patt[MAX(AR_PATT_SIZE1_MAX,AR_PATT_SIZE2_MAX)*MAX(AR_PATT_SIZE1_MAX,AR_PATT_SIZE2_MAX)*3];
+    ARMarkerInfo    *m;
+    int              i;
+
+    for (i = index; i < a->markerNum; i += count) {
+        m = &(a->markerInfo[i]);
+        if (a->pattDetectMode == AR_MATRIX_CODE_DETECTION
+         || a->pattDetectMode == AR_TEMPLATE_MATCHING_COLOR_AND_MATRIX
+         || a->pattDetectMode == AR_TEMPLATE_MATCHING_MONO_AND_MATRIX) {
+            a->errorCodeMtx[i] = get_id_matrix(a->imageProcMode, a->image, a->xsize, a->ysize, a->pixelFormat, a->paramLTf, m->vertex, a->pattRatio,
+                                               &(m->idMatrix), &(m->dirMatrix), &(m->cfMatrix), a->matrixCodeType, &(m->errorCorrected), &(m->globalID), ext_patt);
+        } else a->errorCodeMtx[i] = 1;
+
+        if (a->pattMode < 0) a->errorCodePatt[i] = 1;
+        else if (!a->pattHandle || !a->pattHandle->bank) {
+            a->errorCodePatt[i] = -1;
+            m->idPatt = -1;
+        } else if (arPattGetImage2(a->imageProcMode, a->pattMode, a->pattHandle->pattSize, a->pattHandle->pattSize*AR_PATT_SAMPLE_FACTOR1,
+                                   a->image, a->xsize, a->ysize, a->pixelFormat, a->paramLTf, m->vertex, a->pattRatio, ext_patt) < 0) {
+            a->errorCodePatt[i] = -6;
+            m->idPatt = -1;
+        } else if (pattern_input(a->pattMode, ext_patt, a->pattHandle->pattSize, a->input + i*a->stride, a->stride, &(a->datapow[i])) < 0) {
+            a->errorCodePatt[i] = -2;
+            m->idPatt  = 0;
+            m->dirPatt = 0;
+            m->cfPatt  = -_1_0;
+        } else {
+            a->errorCodePatt[i] = 0; // Matched by patt_match_job().
+        }
+    }
+}
+
+// Template matching for groups of AR_PATT_BANK_BATCH candidates index, index + count, ...
+static void patt_match_job( void *arg, int index, int count )
+{
+    ARPattBatchArgT *a = (ARPattBatchArgT *)arg;
+    int              i, n;
+
+    for (i = index*AR_PATT_BANK_BATCH; i < a->matchNum; i += count*AR_PATT_BANK_BATCH) {
+        n = (a->matchNum - i < AR_PATT_BANK_BATCH ? a->matchNum - i : AR_PATT_BANK_BATCH);
+        arPattBankMatchBatch(a->pattHandle->bank, (a->pattMode == AR_TEMPLATE_MATCHING_COLOR ? AR_PATT_BANK_COLOR : AR_PATT_BANK_MONO),
+                             a->matchInput + i, a->matchDatapow + i, n, a->matchCode + i, a->matchDir + i, a->matchCf + i);
+    }
+}
+
+int arPattGetIDGlobalBatchParallel( ARParallelT *parallel, ARPattHandle *pattHandle, int imageProcMode, int pattDetectMode,
+                                    ARUint8 *image, int xsize, int ysize, AR_PIXEL_FORMAT pixelFormat, ARParamLTf *paramLTf, ARdouble pattRatio,
+                                    const AR_MATRIX_CODE_TYPE matrixCodeType, ARMarkerInfo *markerInfo, int markerNum, int *result )
+{
+    ARPattBatchArgT a;
+    int             i;
+
+    if (markerNum <= 0) return (0);
+    if (!markerInfo || !result) return (-1);
+
+    a.pattHandle     = pattHandle;
+    a.imageProcMode  = imageProcMode;
+    a.pattDetectMode = pattDetectMode;
+    a.image          = image;
+    a.xsize          = xsize;
+    a.ysize          = ysize;
+    a.pixelFormat    = pixelFormat;
+    a.paramLTf       = paramLTf;
+    a.pattRatio      = pattRatio;
+    a.matrixCodeType = matrixCodeType;
+    a.markerInfo     = markerInfo;
+    a.markerNum      = markerNum;
+    if (pattDetectMode == AR_TEMPLATE_MATCHING_COLOR || pattDetectMode == AR_TEMPLATE_MATCHING_COLOR_AND_MATRIX) a.pattMode = AR_TEMPLATE_MATCHING_COLOR;
+    else if (pattDetectMode == AR_TEMPLATE_MATCHING_MONO || pattDetectMode == AR_TEMPLATE_MATCHING_MONO_AND_MATRIX) a.pattMode = AR_TEMPLATE_MATCHING_MONO;
+    else a.pattMode = -1;
+    // Rebuild the bank if patterns have changed, now, before the threads that share it are started.
+    if (a.pattMode >= 0 && pattHandle) arPattBankPrepare(pattHandle);
+    if (a.pattMode >= 0 && pattHandle && pattHandle->bank) a.stride = arPattBankInputStride(pattHandle->bank, (a.pattMode == AR_TEMPLATE_MATCHING_COLOR ? AR_PATT_BANK_COLOR : AR_PATT_BANK_MONO));
+    else a.stride = 0;
+
+    arMalloc(a.input, int16_t, markerNum*a.stride + 1);
+    arMalloc(a.datapow, ARdouble, markerNum*3);
+    a.matchDatapow = a.datapow + markerNum;
+    a.matchCf = a.matchDatapow + markerNum;
+    arMalloc(a.errorCodeMtx, int, markerNum*5);
+    a.errorCodePatt = a.errorCodeMtx + markerNum;
+    a.matchIndex = a.errorCodePatt + markerNum;
+    a.matchCode = a.matchIndex + markerNum;
+    a.matchDir = a.matchCode + markerNum;
+    arMalloc(a.matchInput, const int16_t *, markerNum);
+
+    arParallelRun(parallel, patt_batch_job, &a, markerNum);
+
+    a.matchNum = 0;
+    for (i = 0; i < markerNum; i++) {
+        if (a.pattMode < 0 || a.errorCodePatt[i] != 0) continue;
+        a.matchIndex[a.matchNum] = i;
+        a.matchInput[a.matchNum] = a.input + i*a.stride;
+        a.matchDatapow[a.matchNum] = a.datapow[i];
+        a.matchNum++;
+    }
+    if (a.matchNum > 0) {
+        arParallelRun(parallel, patt_match_job, &a, (a.matchNum + AR_PATT_BANK_BATCH - 1)/AR_PATT_BANK_BATCH);
+        for (i = 0; i < a.matchNum; i++) {
+            markerInfo[a.matchIndex[i]].idPatt  = a.matchCode[i];
+            markerInfo[a.matchIndex[i]].dirPatt = a.matchDir[i];
+            markerInfo[a.matchIndex[i]].cfPatt  = a.matchCf[i];
+        }
+    }
+
+    for (i = 0; i < markerNum; i++) {
+        if (a.errorCodeMtx[i] == 1) result[i] = a.errorCodePatt[i];                                   // pattern-mode only.
+        else if (a.errorCodePatt[i] == 1) result[i] = a.errorCodeMtx[i];                              // matrix-mode only.
+        else if (a.errorCodeMtx[i] < 0 && a.errorCodePatt[i] < 0) result[i] = a.errorCodePatt[i];     // if mixed mode and errors in both modes, return error from pattern mode.
+        else result[i] = 0;
+    }
+
+    free(a.input);
+    free(a.datapow);
+    free(a.errorCodeMtx);
+    free(a.matchInput);
+    return (0);
+}
+
+int arPattGetIDGlobalBatch( ARPattHandle *pattHandle, int imageProcMode, int pattDetectMode,
+                            ARUint8 *image, int xsize, int ysize, AR_PIXEL_FORMAT pixelFormat, ARParamLTf *paramLTf, ARdouble pattRatio,
+                            const AR_MATRIX_CODE_TYPE matrixCodeType, ARMarkerInfo *markerInfo, int markerNum, int *result )
+{
+    return (arPattGetIDGlobalBatchParallel(NULL, pattHandle, imageProcMode, pattDetectMode, image, xsize, ysize, pixelFormat, paramLTf, pattRatio,
+                                           matrixCodeType, markerInfo, markerNum, result));
+}
+
 #if !AR_DISABLE_NON_CORE_FNS
 int arPattGetImage( int imageProcMode, int pattDetectMode, int patt_size, int sample_size,
                     ARUint8 *image, int xsize, int ysize, AR_PIXEL_FORMAT pixelFormat, int *x_coord, int *y_coord, int *vertex,
@@ -1689,14 +1868,36 @@ static void get_cpara( ARdouble world[4][2], ARdouble vertex[4][2],
     arMatrixFree( c );
 }
 
+// Normalises an unwarped pattern into 16-bit values with the mean removed, zero padded to stride values.
+static int pattern_input( int mode, const ARUint8 *data, int size, int16_t *input, int stride, ARdouble *datapow_p )
+{
+    const int len = (mode == AR_TEMPLATE_MATCHING_COLOR ? size*size*3 : size*size);
+    int       sum, ave, i;
+
+    ave = 0;
+    for (i = 0; i < len; i++) ave += (255 - data[i]);
+    ave /= len;
+
+    sum = 0;
+    for (i = 0; i < len; i++) {
+        input[i] = (int16_t)((255 - data[i]) - ave);
+        sum += input[i]*input[i];
+    }
+    for (; i < stride; i++) input[i] = 0;
+
+    *datapow_p = SQRT( (ARdouble)sum );
+    //if( datapow == 0.0 ) {
+    if ( *datapow_p/(mode == AR_TEMPLATE_MATCHING_COLOR ? size*SQRT_3_0 : size) < AR_PATT_CONTRAST_THRESH1 ) {
+        return -2; // Insufficient contrast.
+    }
+    return 0;
+}
+
 static int pattern_match( ARPattHandle *pattHandle, int mode, ARUint8 *data, int size, int *code, int *dir, ARdouble *cf )
 {
-    int   *input = NULL;
-    int    sum, ave;
-    int    res1, res2;
-    int    i, j, k, l;
+    int16_t *input;
     ARdouble datapow;
-    ARdouble sum2, max;
+    int      bankMode;
 
     if ( pattHandle == NULL || 0 >= size ) {
         *code = 0;
@@ -1704,128 +1905,91 @@ static int pattern_match( ARPattHandle *pattHandle, int mode, ARUint8 *data, int
         *cf   = -_1_0;
         return -1;
     }
+    if ( mode == AR_TEMPLATE_MATCHING_COLOR ) bankMode = AR_PATT_BANK_COLOR;
+    else if ( mode == AR_TEMPLATE_MATCHING_MONO ) bankMode = AR_PATT_BANK_MONO;
+    else return -1;
+    if ( arPattBankPrepare(pattHandle) < 0 ) { // Called from the application's thread, so the bank may be rebuilt here.
+        *code = 0;
+        *dir  = 0;
+        *cf   = -_1_0;
+        return -1;
+    }
 
-    if ( mode == AR_TEMPLATE_MATCHING_COLOR ) {
-        const int SIZE_SQD_X3 = size*size*3;
-        
-        arMalloc( input, int, SIZE_SQD_X3 );
-        if ( NULL == input ) {
-            return -1;
-        }
-
-        sum = ave = 0;
-        for (i=0; i < SIZE_SQD_X3; i++) {
-            ave += (255-data[i]);
-        }
-        ave /= (SIZE_SQD_X3);
-
-        for (i=0; i < SIZE_SQD_X3; i++) {
-            input[i] = (255-data[i]) - ave;
-            sum += input[i]*input[i];
-        }
-
-        datapow = SQRT( (ARdouble)sum );
-        //if( datapow == 0.0 ) {
-        if ( datapow/(size*SQRT_3_0) < AR_PATT_CONTRAST_THRESH1 ) {
-            *code = 0;
-            *dir  = 0;
-            *cf   = -_1_0;
-            free( input );
-            return -2; // Insufficient contrast.
-        }
-
-        res1 = res2 = -1;
-        k = -1; // Best match in search space.
-        max = _0_0;
-        for ( l = 0; l < pattHandle->patt_num; l++ ) { // Consider the whole search space.
-            k++;
-            while( pattHandle->pattf[k] == 0 ) k++; // No pattern at this slot.
-            if( pattHandle->pattf[k] == 2 ) continue; // Pattern at this slot is deactivated.
-            for( j = 0; j < 4; j++ ) { // The 4 rotated variants of the pattern.
-                sum = 0;
-                for(i=0; i < SIZE_SQD_X3; i++)
-                    sum += input[i] * pattHandle->patt[k * 4 + j][i]; // Correlation operation.
-                sum2 = sum / pattHandle->pattpow[k*4 + j] / datapow;
-                if( sum2 > max ) { max = sum2; res1 = j; res2 = k; }
-            }
-        }
-        *dir  = res1;
-        *code = res2;
-        *cf   = max;
-
+    arMalloc( input, int16_t, arPattBankInputStride(pattHandle->bank, bankMode) );
+    if ( pattern_input(mode, data, size, input, arPattBankInputStride(pattHandle->bank, bankMode), &datapow) < 0 ) {
+        *code = 0;
+        *dir  = 0;
+        *cf   = -_1_0;
         free( input );
-        return 0;
+        return -2; // Insufficient contrast.
     }
-    else if ( mode == AR_TEMPLATE_MATCHING_MONO ) {
-        const int SIZE_SQD = size*size;
-
-        arMalloc( input, int, SIZE_SQD );
-        if ( NULL == input ) {
-            return -1;
-        }
-        
-        sum = ave = 0;
-        for ( i=0; i < SIZE_SQD; i++ ) {
-            ave += (255-data[i]);
-        }
-        ave /= (SIZE_SQD);
 
-        for ( i=0; i < SIZE_SQD; i++ ) {
-            input[i] = (255-data[i]) - ave;
-            sum += input[i] * input[i];
-        }
+    // Correlate against all 4 rotated variants of every active pattern.
+    arPattBankMatch(pattHandle->bank, bankMode, input, datapow, code, dir, cf);
 
-        datapow = SQRT( (ARdouble)sum );
-        //if( datapow == 0.0 ) {
-        if ( datapow/size < AR_PATT_CONTRAST_THRESH1 ) {
-            *code = 0;
-            *dir  = 0;
-            *cf   = -_1_0;
-            free( input );
-            return -2; // Insufficient contrast.
-        }
-
-        res1 = res2 = -1;
-        k = -1;
-        max = _0_0;
-        for ( l = 0; l < pattHandle->patt_num; l++ ) {
-            k++;
-            while ( pattHandle->pattf[k] == 0 ) k++;
-            if ( pattHandle->pattf[k] == 2 ) continue;
-            for ( j = 0; j < 4; j++ ) {
-                sum = 0;
-                for ( i=0; i < SIZE_SQD; i++ )
-                    sum += input[i] * (pattHandle->pattBW[k * 4 + j][i]);
-                sum2 = sum / pattHandle->pattpowBW[k * 4 + j] / datapow;
-                if ( sum2 > max ) { max = sum2; res1 = j; res2 = k; }
-            }
-        }
-        *dir  = res1;
-        *code = res2;
-        *cf   = max;
-
-        free( input );
-        return 0;
-    }
-    else {
-        return -1;
-    }
+    free( input );
+    return 0;
 }
 
+// Galois field log and antilog tables for GF(2^4), GF(2^5) and GF(2^7).
+static const int bch_15_alpha_to[15] = {1, 2, 4, 8, 3, 6, 12, 11, 5, 10, 7, 14, 15, 13, 9};
+static const int bch_15_index_of[16] = {-1, 0, 1, 4, 2, 8, 5, 10, 3, 14, 9, 7, 6, 13, 11, 12};
+static const int bch_31_alpha_to[31] = {1, 2, 4, 8, 16, 5, 10, 20, 13, 26, 17, 7, 14, 28, 29, 31, 27, 19, 3, 6, 12, 24, 21, 15, 30, 25, 23, 11, 22, 9, 18};
+static const int bch_31_index_of[32] = {-1, 0, 1, 18, 2, 5, 19, 11, 3, 29, 6, 27, 20, 8, 12, 23, 4, 10, 30, 17, 7, 22, 28, 26, 21, 25, 9, 16, 13, 14, 24, 15};
+static const int bch_127_alpha_to[127] = {1, 2, 4, 8, 16, 32, 64, 3, 6, 12, 24, 48, 96, 67, 5, 10, 20, 40, 80, 35, 70, 15, 30, 60, 120, 115, 101, 73, 17, 34, 68, 11, 22, 44, 88, 51, 102, 79, 29, 58, 116, 107, 85, 41, 82, 39, 78, 31, 62, 124, 123, 117, 105, 81, 33, 66, 7, 14, 28, 56, 112, 99, 69, 9, 18, 36, 72, 19, 38, 76, 27, 54, 108, 91, 53, 106, 87, 45, 90, 55, 110, 95, 61, 122, 119, 109, 89, 49, 98, 71, 13, 26, 52, 104, 83, 37, 74, 23, 46, 92, 59, 118, 111, 93, 57, 114, 103, 77, 25, 50, 100, 75, 21, 42, 84, 43, 86, 47, 94, 63, 126, 127, 125, 121, 113, 97, 65};
+static const int bch_127_index_of[128] = {-1, 0, 1, 7, 2, 14, 8, 56, 3, 63, 15, 31, 9, 90, 57, 21, 4, 28, 64, 67, 16, 112, 32, 97, 10, 108, 91, 70, 58, 38, 22, 47, 5, 54, 29, 19, 65, 95, 68, 45, 17, 43, 113, 115, 33, 77, 98, 117, 11, 87, 109, 35, 92, 74, 71, 79, 59, 104, 39, 100, 23, 82, 48, 119, 6, 126, 55, 13, 30, 62, 20, 89, 66, 27, 96, 111, 69, 107, 46, 37, 18, 53, 44, 94, 114, 42, 116, 76, 34, 86, 78, 73, 99, 103, 118, 81, 12, 125, 88, 61, 110, 26, 36, 106, 93, 52, 75, 41, 72, 85, 80, 102, 60, 124, 105, 25, 40, 51, 101, 84, 24, 123, 83, 50, 49, 122, 120, 121};
+
+// Odd syndromes S1, S3, ..., S(2t-1) contributed by a 1 in each received bit position j, i.e. alpha^(i*j) in
+// polynomial form, packed m bits apiece with S1 in the least significant bits (t = 2, 3 and 9 respectively).
+// The odd syndromes of a received word are then the XOR of the entries for its set bits, and the even
+// syndromes follow from S(2i) = S(i)^2. Generated from the alpha_to tables above.
+static const uint64_t bch_15_syndrome[13] = {
+    0x11, 0x82, 0xc4, 0xa8, 0xf3, 0x16, 0x8c, 0xcb, 0xa5, 0xfa, 0x17, 0x8e, 0xcf};
+static const uint64_t bch_31_syndrome[22] = {
+    0x0421, 0x1502, 0x4544, 0x7f48, 0x31d0, 0x67e5, 0x486a, 0x4314, 0x6bcd, 0x757a, 0x1a51,
+    0x7887, 0x24ae, 0x21bc, 0x34fd, 0x73bf, 0x0e7b, 0x3d93, 0x59e3, 0x12e6, 0x512c, 0x3858};
+static const uint64_t bch_127_syndrome[120] = {
+    0x0102040810204081ULL, 0x28150d80c0680402ULL, 0x588994f500a62004ULL, 0x754ee96491e28608ULL,
+    0x26e1a6966231b010ULL, 0x6dd49212767cc520ULL, 0x6f1b6a421ab12840ULL, 0x3fe469689f8cc783ULL,
+    0x0cfce716c0fd3c06ULL, 0x650cbee5f129e48cULL, 0x29782320d37ee218ULL, 0x703a53fdc5b09630ULL,
+    0x2da289019efc3360ULL, 0x534d54a2f3491d43ULL, 0x4bf50a4c15c6ea85ULL, 0x025c98e86e5a938aULL,
+    0x50557fe282bb9f14ULL, 0x33054f8657fb7aa8ULL, 0x692935b3382350d0ULL, 0x4c17f9ed28094723ULL,
+    0x599d0345186ef846ULL, 0x5dc68dcc58dc848fULL, 0x7eae595b6939241eULL, 0x18349e0eeb0ae63cULL,
+    0x49ce70c47d7fb678ULL, 0x52fed87ae7d87573ULL, 0x6319dcb4d8422d65ULL, 0x5af05d4d68a1afc9ULL,
+    0x2575910e1990fb91ULL, 0x1543e5203af418a2ULL, 0x049832b94f4f06c4ULL, 0x23ee798f31a4740bULL,
+    0x66b8cd7582eb2516ULL, 0x51a8f99297276e2cULL, 0x1b098ff6996a77d8ULL, 0x3150d4863bcfb933ULL,
+    0x392cc451bc344ce6ULL, 0x7f3eef2b740725cfULL, 0x308aaa7e2c026a1dULL, 0x115b05f1746997baULL,
+    0x276981c67cb6ff74ULL, 0x459bccdab596bcebULL, 0x37fa76ff1e9ea0d5ULL, 0x4a31d5a403f88229ULL,
+    0x2ae64ae8a43a1052ULL, 0x08e8b6a78c6b8327ULL, 0x4684370ac4d7584eULL, 0x4f3774655d46429fULL,
+    0x21db5a3757aa943eULL, 0x3676105f08f7a37cULL, 0x62562aacc95e5e7bULL, 0x7210468daba0b2f5ULL,
+    0x7da1ac931c901169ULL, 0x60588754a5ec0b51ULL, 0x227c4ecf2e2519a1ULL, 0x4e13b8bd4203cec2ULL,
+    0x09b5a0cf96197587ULL, 0x6ed19dfa0a02e90eULL, 0x1732fc405e798f9cULL, 0x54f2802bc2dafdb8ULL,
+    0x106143996753a8f0ULL, 0x0fca2f36b9dd43e3ULL, 0x1dd748ffba21dc45ULL, 0x420e38e38e18e289ULL,
+    0x6c6c6e6262721212ULL, 0x47b3eb72d6ad9324ULL, 0x67ed28d59bf5db48ULL, 0x79accb7a5c57da93ULL,
+    0x4321f55394b656a6ULL, 0x44461b8aade6b74cULL, 0x1fb03c37d652bd1bULL, 0x12f961190addacb6ULL,
+    0x5f247e243f39e3ecULL, 0x2e6fc359e112da5bULL, 0x2ba76f48b31592b5ULL, 0x2065644f451fd76aULL,
+    0x1ee371afcf107b57ULL, 0x3ac05769c1641cadULL, 0x0793865133a326daULL, 0x5baac26d74e17237ULL,
+    0x0d1de2f6dd28d56eULL, 0x4dd93c25371e2b5fULL, 0x7163ee1dd9089fbdULL, 0x05de27c15b763efaULL,
+    0x0b5f5d9ffdceb0f7ULL, 0x3e411e708634816dULL, 0x248dbc760a7f0859ULL, 0x3d66ad30fec841b1ULL,
+    0x5cf609bc432e0c62ULL, 0x5648146ba564a1c7ULL, 0x40dd27b3efb30a0dULL, 0x3c4bd0a8e08d519aULL,
+    0x74c947cc818dcf34ULL, 0x0ec3201ea29df9e8ULL, 0x3586de877791c8d3ULL, 0x1a22d1168894c5a5ULL,
+    0x1953cba6f9f72c4aULL, 0x61397bacba4e6797ULL, 0x0ab6422feeacba2eULL, 0x16c4a2d8439514dcULL,
+    0x7cbb13bb048fe73bULL, 0x48bca52c6d9c7e76ULL, 0x7a801f3a26e134efULL, 0x3b1f3179db20e15dULL,
+    0x2fccf411fd180e39ULL, 0x03ea9700776a31f2ULL, 0x789065e249a78967ULL, 0x6bbffec35a9249cdULL,
+    0x1c940d3fafe58d99ULL, 0x6a97183b4053edb2ULL, 0x3482b09f60d56be4ULL, 0x320b3ad64147dbcbULL,
+    0x4144e23bf3da5e95ULL, 0x14a5b1d82443b6aaULL, 0x2c71b6598cd17154ULL, 0x7b6abbea3524cd2bULL,
+    0x138f2e011f7b29d6ULL, 0x7773c544f1cb4bafULL, 0x767e608ce24f5ddeULL, 0x5e06f1d426cc6ebfULL};
+
 static int decode_bch(const AR_MATRIX_CODE_TYPE matrixCodeType, const uint64_t in, uint8_t recd127[127], uint64_t *out_p)
 {
     uint64_t in_bitwise;
     uint8_t *recd;
     uint64_t out_bit;
-    int t, n, length, k;
+    uint64_t syn;
+    int t, n, m, length, k;
     uint8_t recd64[64];
     const int *alpha_to, *index_of;
-    const int bch_15_alpha_to[15] = {1, 2, 4, 8, 3, 6, 12, 11, 5, 10, 7, 14, 15, 13, 9};
-    const int bch_15_index_of[16] = {-1, 0, 1, 4, 2, 8, 5, 10, 3, 14, 9, 7, 6, 13, 11, 12};
-    const int bch_31_alpha_to[31] = {1, 2, 4, 8, 16, 5, 10, 20, 13, 26, 17, 7, 14, 28, 29, 31, 27, 19, 3, 6, 12, 24, 21, 15, 30, 25, 23, 11, 22, 9, 18};
-    const int bch_31_index_of[32] = {-1, 0, 1, 18, 2, 5, 19, 11, 3, 29, 6, 27, 20, 8, 12, 23, 4, 10, 30, 17, 7, 22, 28, 26, 21, 25, 9, 16, 13, 14, 24, 15};
-    const int bch_127_alpha_to[127] = {1, 2, 4, 8, 16, 32, 64, 3, 6, 12, 24, 48, 96, 67, 5, 10, 20, 40, 80, 35, 70, 15, 30, 60, 120, 115, 101, 73, 17, 34, 68, 11, 22, 44, 88, 51, 102, 79, 29, 58, 116, 107, 85, 41, 82, 39, 78, 31, 62, 124, 123, 117, 105, 81, 33, 66, 7, 14, 28, 56, 112, 99, 69, 9, 18, 36, 72, 19, 38, 76, 27, 54, 108, 91, 53, 106, 87, 45, 90, 55, 110, 95, 61, 122, 119, 109, 89, 49, 98, 71, 13, 26, 52, 104, 83, 37, 74, 23, 46, 92, 59, 118, 111, 93, 57, 114, 103, 77, 25, 50, 100, 75, 21, 42, 84, 43, 86, 47, 94, 63, 126, 127, 125, 121, 113, 97, 65};
-    const int bch_127_index_of[128] = {-1, 0, 1, 7, 2, 14, 8, 56, 3, 63, 15, 31, 9, 90, 57, 21, 4, 28, 64, 67, 16, 112, 32, 97, 10, 108, 91, 70, 58, 38, 22, 47, 5, 54, 29, 19, 65, 95, 68, 45, 17, 43, 113, 115, 33, 77, 98, 117, 11, 87, 109, 35, 92, 74, 71, 79, 59, 104, 39, 100, 23, 82, 48, 119, 6, 126, 55, 13, 30, 62, 20, 89, 66, 27, 96, 111, 69, 107, 46, 37, 18, 53, 44, 94, 114, 42, 116, 76, 34, 86, 78, 73, 99, 103, 118, 81, 12, 125, 88, 61, 110, 26, 36, 106, 93, 52, 75, 41, 72, 85, 80, 102, 60, 124, 105, 25, 40, 51, 101, 84, 24, 123, 83, 50, 49, 122, 120, 121};
+    const uint64_t *syndrome;
     int i, j, u, q, t2, count = 0, syn_error = 0;
 	int elp[20][18], d[20], l[20], u_lu[20], s[19], loc[127], reg[10]; // int elp[t2 + 2, t2], d[t2 + 2], l[t2 + 2], u_lu[t2 + 2], s[t2 + 1], loc[n], reg[t + 1].
     
@@ -1836,20 +2000,32 @@ static int decode_bch(const AR_MATRIX_CODE_TYPE matrixCodeType, const uint64_t i
             } else { // matrixCodeType == AR_MATRIX_CODE_4x4_BCH_13_5_5
                 t = 2; k = 5;
             }
-            n = 15;
+            n = 15; m = 4;
             length = 13;
             alpha_to = bch_15_alpha_to;
             index_of = bch_15_index_of;
+            syndrome = bch_15_syndrome;
         } else { // matrixCodeType == AR_MATRIX_CODE_5x5_BCH_22_12_5 || matrixCodeType == AR_MATRIX_CODE_5x5_BCH_22_7_7
             if (matrixCodeType == AR_MATRIX_CODE_5x5_BCH_22_12_5) {
                 t = 2; k = 12;
             } else { // matrixCodeType == AR_MATRIX_CODE_5x5_BCH_22_7_7
                 t = 3; k = 7;
             }
-            n = 31;
+            n = 31; m = 5;
             length = 22;
             alpha_to = bch_31_alpha_to;
             index_of = bch_31_index_of;
+            syndrome = bch_31_syndrome;
+        }
+        in_bitwise = in & ((1ULL << length) - 1);
+        syn = 0;
+        for (i = 0; in_bitwise; i++, in_bitwise >>= 1) {
+            if (in_bitwise & 1) syn ^= syndrome[i];
+        }
+        syn &= (1ULL << (m*t)) - 1; // Keep only the syndromes this code uses.
+        if (!syn) { // No errors, so the data bits can be taken as they are.
+            *out_p = (in >> (length - k)) & ((1ULL << k) - 1);
+            return (0);
         }
         // Unpack input into recd64[]. recd64[0] is least significant bit.
         in_bitwise = in;
@@ -1860,11 +2036,14 @@ static int decode_bch(const AR_MATRIX_CODE_TYPE matrixCodeType, const uint64_t i
         recd = recd64;
     } else if (matrixCodeType == AR_MATRIX_CODE_GLOBAL_ID) {
         t = 9; k = 64;
-        n = 127;
+        n = 127; m = 7;
         length = 120;
         alpha_to = bch_127_alpha_to;
         index_of = bch_127_index_of;
+        syndrome = bch_127_syndrome;
         recd = recd127;
+        syn = 0;
+        for (i = 0; i < length; i++) syn ^= syndrome[i] & (0 - (uint64_t)(recd[i] != 0));
     } else {
 #ifdef DEBUG_BCH
         ARLOGe("Error: unsupported BCH code.\n");
@@ -1905,14 +2084,11 @@ static int decode_bch(const AR_MATRIX_CODE_TYPE matrixCodeType, const uint64_t i
      */
 	t2 = 2 * t;
     
-	/* first form the syndromes */
-	for (i = 1; i <= t2; i++) {
-		s[i] = 0;
-		for (j = 0; j < length; j++) {
-			if (recd[j] != 0) s[i] ^= alpha_to[(i * j) % n];
-        }
-		if (s[i] != 0) syn_error = 1; /* set error flag if non-zero syndrome */
-		s[i] = index_of[s[i]]; /* convert syndrome from polynomial form to index form  */
+	/* unpack the syndromes and convert to index form */
+	syn_error = (syn != 0);
+	if (syn_error) {
+		for (i = 1; i <= t2; i += 2) s[i] = index_of[(syn >> (m*(i/2))) & ((1 << m) - 1)];
+		for (i = 2; i <= t2; i += 2) s[i] = (s[i/2] == -1 ? -1 : (2*s[i/2]) % n);
 	}
     
 	if (syn_error) {	/* if there are errors, try to correct them */
@@ -2008,7 +2184,8 @@ static int decode_bch(const AR_MATRIX_CODE_TYPE matrixCodeType, const uint64_t i
 				q = 1;
 				for (j = 1; j <= l[u]; j++) {
  					if (reg[j] != -1) {
-						reg[j] = (reg[j] + j) % n;
+						reg[j] += j;
+						if (reg[j] >= n) reg[j] -= n;
 						q ^= alpha_to[reg[j]];
 					}
                 }
@@ -2038,12 +2215,9 @@ static int decode_bch(const AR_MATRIX_CODE_TYPE matrixCodeType, const uint64_t i
 	} // End syn_error.
     
     // Pack the result into *out_p. Data bits begin with LSB at recd[length - k] through to MSB at recd[length - 1];
-    *out_p = 0LL;
-    out_bit = 1LL;
-    for (i = length - k; i < length; i++) {
-        *out_p += (uint64_t)recd[i] * out_bit;
-        out_bit <<= 1;
-    }
+    out_bit = 0LL;
+    for (i = length - 1; i >= length - k; i--) out_bit = (out_bit << 1) | recd[i];
+    *out_p = out_bit;
     
     if (syn_error) return (l[u]);
     else return (0);
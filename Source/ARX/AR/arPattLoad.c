@@ -51,6 +51,7 @@
 #include <ARX/AR/ar.h>
 #include <string.h>
 #include <ARX/ARUtil/file_utils.h>
+#include "arPattBank.h"
 
 int arPattLoadFromBuffer(ARPattHandle *pattHandle, const char *buffer) {
     
@@ -137,6 +138,7 @@ int arPattLoadFromBuffer(ARPattHandle *pattHandle, const char *buffer) {
 
     pattHandle->pattf[patno] = 1;
     pattHandle->patt_num++;
+    pattHandle->bankDirty = 1;
 
     return( patno );
 }
@@ -163,6 +165,7 @@ int arPattFree( ARPattHandle *pattHandle, int patno )
 
     pattHandle->pattf[patno] = 0;
     pattHandle->patt_num--;
+    pattHandle->bankDirty = 1;
 
     return 1;
 }
@@ -172,6 +175,7 @@ int arPattActivate( ARPattHandle *pattHandle, int patno )
     if( pattHandle->pattf[patno] == 0 ) return -1;
 
     pattHandle->pattf[patno] = 1;
+    pattHandle->bankDirty = 1;
 
     return 1;
 }
@@ -181,6 +185,7 @@ int arPattDeactivate( ARPattHandle *pattHandle, int patno )
     if( pattHandle->pattf[patno] == 0 ) return -1;
 
     pattHandle->pattf[patno] = 2;
+    pattHandle->bankDirty = 1;
 
     return 1;
 }
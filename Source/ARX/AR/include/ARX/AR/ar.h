@@ -258,6 +258,8 @@ typedef struct {
 
 /* --------------------------------------------------*/
 
+typedef struct _ARPattBank ARPattBank; ///< Opaque type. Precomputed bank of active patterns for template matching.
+
 /*!
     @brief   A structure which holds descriptions of trained patterns for template matching.
     @details Template (picture)-based pattern matching requires details of the pattern
@@ -274,6 +276,8 @@ typedef struct {
     ARdouble       *pattpowBW;      ///< Root-mean-square of the pattern intensities.
     //ARdouble        pattRatio;      ///< 
     int             pattSize;       ///< Number of rows/columns in the pattern.
+    ARPattBank     *bank;           ///< All orientations of the active patterns, prepared for matching. Rebuilt by arPattAttach() and arDetectMarker() when bankDirty is set.
+    int             bankDirty;      ///< Non-zero if patterns have been loaded, freed, activated or deactivated since bank was built.
 } ARPattHandle;
 
 /*!
@@ -330,6 +334,9 @@ typedef enum {
     AR_MATRIX_CODE_GLOBAL_ID = 0x0e | AR_MATRIX_CODE_TYPE_ECC_BCH___19
 } AR_MATRIX_CODE_TYPE;
 
+typedef struct _ARParallelT ARParallelT; ///< Opaque type. Worker pool used for parallel marker detection.
+typedef struct _ARBracketT ARBracketT; ///< Opaque type. Scratch results for parallel threshold bracketing.
+
 /*!
     @brief   Structure holding state of an instance of the square marker tracker.
     @details
@@ -363,9 +370,20 @@ typedef struct {
     int                arLabelingThreshAutoIntervalTTL;
     int                arLabelingThreshAutoBracketOver;
     int                arLabelingThreshAutoBracketUnder;
+    int                arLabelingThreshAdaptiveHalfRes;
+    int                arDetectionROIMode;
+    int                arDetectionROIFullScanInterval;
+    int                arDetectionROIFullScanTTL;
+    int                arDetectionROIMarkerNum;               ///< Number of markers identified at the last full-frame scan.
+    int                arDetectionROINum;                     ///< Number of regions of interest to label in the next frame, or 0 for the whole frame.
+    int                arDetectionROI[AR_SQUARE_MAX][4];      ///< Regions of interest, each {x0, x1, y0, y1}.
     ARImageProcInfo   *arImageProcInfo;
     ARdouble           pattRatio;                           ///< A value between 0.0 and 1.0, representing the proportion of the marker width which constitutes the pattern. In earlier versions, this value was fixed at 0.5.
     AR_MATRIX_CODE_TYPE matrixCodeType;                     ///< When matrix code pattern detection mode is active, indicates the type of matrix code to detect.
+    ARParallelT       *parallel;                            ///< Worker pool for parallel detection, or NULL if detection is serial. To set, call arSetDetectionThreadNum().
+    ARBracketT        *bracket;                             ///< Scratch results for the bracketing thresholds when bracketing in parallel. Allocated on first use.
+    int                arDetectionDownsample;               ///< Factor by which the image is downsampled for coarse square detection. To set, call arSetDetectionDownsample().
+    ARUint8           *arDetectionDownsampleImage;          ///< Downsampled luma (and adaptive threshold) images for coarse square detection. Allocated on first use.
 } ARHandle;
 
 
@@ -607,6 +625,106 @@ AR_EXTERN void arSetLabelingThreshModeAutoInterval(ARHandle *handle, const int i
  */
 AR_EXTERN int arGetLabelingThreshModeAutoInterval(const ARHandle *handle);
 
+/*!
+    @brief   Set whether the adaptive threshold image is calculated at half resolution.
+    @details
+        In AR_LABELING_THRESH_MODE_AUTO_ADAPTIVE, the threshold for each pixel is the
+        mean luminance in a box around it. When half resolution is enabled, the mean
+        is calculated on a 2x2 downsampled image and upsampled as required, which is
+        around four times faster but follows local changes in illumination less closely.
+    @param      handle An ARHandle referring to the current AR tracker to be modified.
+    @param      halfRes TRUE to calculate at half resolution, FALSE to calculate at full
+        resolution. Default value is AR_LABELING_THRESH_ADAPTIVE_HALF_RES_DEFAULT.
+    @see arGetLabelingThreshModeAdaptiveHalfRes
+    @see arImageProcLumaHistAndBoxFilterWithBiasHalfRes
+ */
+AR_EXTERN void arSetLabelingThreshModeAdaptiveHalfRes(ARHandle *handle, const int halfRes);
+
+/*!
+    @brief   Get whether the adaptive threshold image is calculated at half resolution.
+    @param      handle An ARHandle referring to the current AR tracker to be queried.
+    @result     TRUE if calculated at half resolution, FALSE otherwise.
+    @see arSetLabelingThreshModeAdaptiveHalfRes
+ */
+AR_EXTERN int arGetLabelingThreshModeAdaptiveHalfRes(const ARHandle *handle);
+
+/*!
+    @brief   Enable or disable tracking-assisted region of interest detection.
+    @details
+        When enabled, arDetectMarker() labels only regions of interest around the markers
+        identified in the previous frame, each expanded by AR_DETECTION_ROI_MARGIN times
+        its size on each side. The whole frame is still examined every
+        (interval + 1) frames (see arSetDetectionROIFullScanInterval), whenever fewer
+        markers are identified than in the frame the regions were built from, and
+        whenever no markers were identified. New markers are therefore found only at the
+        next full-frame scan.
+        Regions of interest are not used in AR_LABELING_THRESH_MODE_AUTO_BRACKETING or
+        in AR_IMAGE_PROC_FIELD_IMAGE mode.
+    @param      handle An ARHandle referring to the current AR tracker to be modified.
+    @param      mode TRUE to enable, FALSE to disable. Default value is AR_DETECTION_ROI_MODE_DEFAULT.
+    @see arGetDetectionROIMode
+    @see arSetDetectionROIFullScanInterval
+ */
+AR_EXTERN void arSetDetectionROIMode(ARHandle *handle, const int mode);
+
+/*!
+    @brief   Get whether tracking-assisted region of interest detection is enabled.
+    @param      handle An ARHandle referring to the current AR tracker to be queried.
+    @result     TRUE if enabled, FALSE otherwise.
+    @see arSetDetectionROIMode
+ */
+AR_EXTERN int arGetDetectionROIMode(const ARHandle *handle);
+
+/*!
+    @brief   Set the number of frames between full-frame scans in region of interest detection.
+    @details
+        This is the number of frames BETWEEN full-frame scans, meaning that the
+        whole frame is labelled at least every (interval + 1) frames.
+    @param      handle An ARHandle referring to the current AR tracker to be modified.
+    @param      interval An integer in the range [0,INT_MAX] (inclusive). Default value is
+        AR_DETECTION_ROI_FULL_SCAN_INTERVAL_DEFAULT.
+    @see arGetDetectionROIFullScanInterval
+    @see arSetDetectionROIMode
+ */
+AR_EXTERN void arSetDetectionROIFullScanInterval(ARHandle *handle, const int interval);
+
+/*!
+    @brief   Get the number of frames between full-frame scans in region of interest detection.
+    @param      handle An ARHandle referring to the current AR tracker to be queried.
+    @result     The number of frames between full-frame scans.
+    @see arSetDetectionROIFullScanInterval
+ */
+AR_EXTERN int arGetDetectionROIFullScanInterval(const ARHandle *handle);
+
+/*!
+    @brief   Set coarse-to-fine square detection.
+    @details
+        With a factor of 2 or 4, arDetectMarker() first labels and finds candidate squares in
+        a copy of the luma image downsampled by that factor, which is 4 or 16 times fewer
+        pixels. The image is then labelled at full resolution only in rectangles around
+        the candidates, and contours, lines and corners are found at full resolution there
+        (via arGetLine with the lens distortion lookup table), so the marker vertices
+        and poses obtained are the same as for full-resolution detection.
+        Markers whose borders are too thin to survive downsampling, around 2 * factor
+        pixels wide, will not be detected. Not used in AR_IMAGE_PROC_FIELD_IMAGE mode,
+        or in frames in which region of interest detection is active
+        (see arSetDetectionROIMode).
+    @param      handle An ARHandle referring to the current AR tracker to be modified.
+    @param      factor 1 (full-resolution detection only), 2, or 4. Default value is
+        AR_DETECTION_DOWNSAMPLE_DEFAULT.
+    @result     0 if successful, or -1 if the factor is not supported.
+    @see arGetDetectionDownsample
+ */
+AR_EXTERN int arSetDetectionDownsample(ARHandle *handle, const int factor);
+
+/*!
+    @brief   Get the downsampling factor for coarse-to-fine square detection.
+    @param      handle An ARHandle referring to the current AR tracker to be queried.
+    @result     1, 2, or 4.
+    @see arSetDetectionDownsample
+ */
+AR_EXTERN int arGetDetectionDownsample(const ARHandle *handle);
+
 /*!
     @brief   Set the image processing mode.
     @details
@@ -784,6 +902,31 @@ AR_EXTERN void arSetPattRatio(ARHandle *handle, const ARdouble pattRatio);
  */
 AR_EXTERN ARdouble arGetPattRatio(ARHandle *handle);
 
+/*!
+    @brief   Set the number of threads used for marker detection.
+    @details
+        When more than one thread is requested, arDetectMarker() labels horizontal
+        strips of the image concurrently and merges labels across the strip seams,
+        and splits contour extraction and marker info calculation across the
+        candidate regions. Detection results are identical to serial detection.
+        Parallel labeling applies to AR_IMAGE_PROC_FRAME_IMAGE mode only.
+    @param      handle An ARHandle referring to the current AR tracker to be modified.
+    @param      threadNum The number of threads to use, including the calling thread.
+        Pass 1 for serial detection, or AR_DETECTION_THREAD_NUM_AUTO to use one thread
+        per online CPU. The value is clamped to AR_DETECTION_THREAD_MAX. The default is
+        AR_DETECTION_THREAD_NUM_DEFAULT.
+    @see arGetDetectionThreadNum
+ */
+AR_EXTERN void arSetDetectionThreadNum(ARHandle *handle, int threadNum);
+
+/*!
+    @brief   Get the number of threads used for marker detection.
+    @param      handle An ARHandle referring to the current AR tracker to be queried.
+    @result     The number of threads actually in use, including the calling thread.
+    @see arSetDetectionThreadNum
+ */
+AR_EXTERN int arGetDetectionThreadNum(ARHandle *handle);
+
 /*!
     @brief   Set the expected pixel format for video frames being passed to arDetectMarker
     @details
@@ -872,6 +1015,25 @@ AR_EXTERN ARMarkerInfo  *arGetMarker( ARHandle *arHandle );
 AR_EXTERN int            arLabeling( ARUint8 *imageLuma, int xsize, int ysize,
                            int debugMode, int labelingMode, int labelingThresh, int imageProcMode,
                            ARLabelInfo *labelInfo, ARUint8 *image_thresh );
+/*!
+    @brief   Label connected regions, only within a set of rectangular regions of interest.
+    @details
+        As for arLabeling with AR_IMAGE_PROC_FRAME_IMAGE, except that only pixels inside
+        the rectangles are examined. The outer rows and columns of each rectangle are
+        treated as background, as are those of the image. Regions reaching the edge of a
+        rectangle, other than at the edge of the image, are given an area of 0 so that they
+        are not passed as candidate squares by arDetectMarker2. Outside the rectangles,
+        the contents of labelInfo->labelImage are undefined.
+    @param      roi Array of rectangles, each {x0, x1, y0, y1}, covering columns [x0, x1)
+        and rows [y0, y1). The rectangles must lie inside the image and must not overlap.
+    @param      roiNum Number of rectangles, at most AR_SQUARE_MAX.
+    @result     0 in case of no error, or -1 otherwise.
+    @see arLabeling
+ */
+AR_EXTERN int            arLabelingROI( ARUint8 *imageLuma, int xsize, int ysize,
+                           int debugMode, int labelingMode, int labelingThresh,
+                           ARLabelInfo *labelInfo, ARUint8 *image_thresh,
+                           const int roi[][4], int roiNum );
 AR_EXTERN int            arDetectMarker2( int xsize, int ysize, ARLabelInfo *labelInfo, int imageProcMode,
                                 int areaMax, int areaMin, ARdouble squareFitThresh,
                                 ARMarkerInfo2 *markerInfo2, int *marker2_num );
@@ -1068,6 +1230,11 @@ AR_EXTERN int arPattDeactivate(ARPattHandle *pattHandle, int patno);
 		the patterns the set which will be searched when marker
 		identification is performed on an image associated with the
 		same ARHandle.
+
+        The patterns are prepared for matching here, and again by
+        arDetectMarker() if patterns have since been loaded, freed,
+        activated or deactivated. Patterns must not be changed while
+        arDetectMarker() is running on any ARHandle they are attached to.
     @param      arHandle (description)
 	@param      pattHandle (description)
     @see    arPattDetach
@@ -1158,6 +1325,36 @@ AR_EXTERN int arPattGetIDGlobal( ARPattHandle *pattHandle, int imageProcMode, in
               int *codePatt, int *dirPatt, ARdouble *cfPatt, int *codeMatrix, int *dirMatrix, ARdouble *cfMatrix,
               const AR_MATRIX_CODE_TYPE matrixCodeType, int *errorCorrected, uint64_t *codeGlobalID_p );
 
+/*!
+    @brief   Match the interiors of a set of detected squares against known patterns.
+    @details
+        Gives the same results as calling arPattGetIDGlobal() for each marker in turn, but
+        in template matching modes, the patterns of all markers are first extracted, and each
+        known pattern is then correlated against all of them together using SIMD
+        instructions (SSE2 or NEON) where available. This is substantially faster when
+        there are many candidate squares or many loaded patterns.
+    @param      pattHandle Handle contained details of known patterns, i.e. loaded templates, or valid barcode IDs.
+    @param      imageProcMode See discussion of arSetImageProcMode().
+    @param      pattDetectMode See discussion of arSetPatternDetectionMode().
+    @param      image Pointer to packed raw image data.
+    @param      xsize Horizontal pixel dimension of raw image data.
+    @param      ysize Vertical pixel dimension of raw image data.
+    @param      pixelFormat Pixel format of raw image data.
+    @param      arParamLTf Lookup table for the camera parameters for the optical source from which the image was acquired. See arParamLTCreate.
+    @param      pattRatio A value between 0.0 and 1.0, representing the proportion of the marker width which constitutes the pattern.
+    @param      matrixCodeType When matrix code pattern detection mode is active, indicates the type of matrix code to detect.
+    @param      markerInfo Array of markers whose vertex fields are filled in. On return, the fields idPatt,
+        dirPatt, cfPatt, idMatrix, dirMatrix, cfMatrix, errorCorrected and globalID are filled in as for
+        the corresponding parameters of arPattGetIDGlobal(). Other fields are not modified.
+    @param      markerNum Number of markers in markerInfo.
+    @param      result Array of markerNum integers, filled with the value arPattGetIDGlobal() would return for each marker.
+    @result     0 if the markers were processed, or -1 in case of error.
+    @see    arPattGetIDGlobal
+ */
+AR_EXTERN int arPattGetIDGlobalBatch( ARPattHandle *pattHandle, int imageProcMode, int pattDetectMode,
+              ARUint8 *image, int xsize, int ysize, AR_PIXEL_FORMAT pixelFormat, ARParamLTf *arParamLTf, ARdouble pattRatio,
+              const AR_MATRIX_CODE_TYPE matrixCodeType, ARMarkerInfo *markerInfo, int markerNum, int *result );
+
 /*!
     @brief   Extract the image (i.e. locate and unwarp) of the pattern-space portion of a detected square.
     @param      imageProcMode See discussion of arSetImageProcMode().
@@ -87,6 +87,7 @@
 #define   AR_PATT_SIZE2_MAX                  32     // Maximum number of rows and columns allowed in pattern when pattern detection mode is AR_MATRIX_CODE_DETECTION.
 #define   AR_PATT_SAMPLE_FACTOR1              4     // Maximum number of samples per pattern pixel row / column when pattern detection mode is not AR_MATRIX_CODE_DETECTION.
 #define   AR_PATT_SAMPLE_FACTOR2              3     // Maximum number of samples per pattern pixel row / column when detection mode is AR_MATRIX_CODE_DETECTION.
+#define   AR_PATT_MATCH_PREFILTER_MIN       48      // Minimum number of active patterns for template matching to use the low-resolution prefilter, or 0 to never use it.
 #define   AR_PATT_CONTRAST_THRESH1           15.0	// Required contrast over pattern space when pattern detection mode is AR_TEMPLATE_MATCHING_MONO or AR_TEMPLATE_MATCHING_COLOR.
 #define   AR_PATT_CONTRAST_THRESH2           30.0	// Required contrast between black and white barcode segments when pattern detection mode is AR_MATRIX_CODE_DETECTION.
 #define   AR_PATT_RATIO                       0.5   // Default value for percentage of marker width or height considered to be pattern space. Equal to 1.0 - 2*borderSize. Must be 0.5 in order to be compatible with ARToolKit versions 1.0 to 4.4.
@@ -113,10 +114,23 @@
 #endif
 #define   AR_CHAIN_MAX                    10000
 
+#define   AR_DETECTION_THREAD_NUM_DEFAULT     1     // Number of threads used by arDetectMarker(). 1 = serial detection.
+#define   AR_DETECTION_THREAD_NUM_AUTO       -1     // Use one detection thread per online CPU.
+#define   AR_DETECTION_THREAD_MAX            32
+
+#define   AR_DETECTION_ROI_MODE_DEFAULT                FALSE  // If TRUE, label only around markers found in the previous frame.
+#define   AR_DETECTION_ROI_FULL_SCAN_INTERVAL_DEFAULT  9      // Number of frames between full-frame scans in ROI mode.
+#define   AR_DETECTION_ROI_MARGIN                      0.5    // ROI expansion on each side, as a proportion of marker size.
+#define   AR_DETECTION_ROI_MARGIN_MIN                  8      // Minimum ROI expansion on each side, in pixels.
+
+#define   AR_DETECTION_DOWNSAMPLE_DEFAULT              1      // 1 for full-resolution detection, or 2 or 4 for coarse-to-fine detection.
+#define   AR_DETECTION_DOWNSAMPLE_MARGIN               2      // Full-resolution ROI expansion around coarse candidates, in downsampled pixels.
+
 #define   AR_LABELING_THRESH_AUTO_INTERVAL_DEFAULT 7 // Number of frames between auto-threshold calculations.
 #define   AR_LABELING_THRESH_MODE_DEFAULT     AR_LABELING_THRESH_MODE_MANUAL
 #define   AR_LABELING_THRESH_ADAPTIVE_KERNEL_SIZE_DEFAULT 9
 #define   AR_LABELING_THRESH_ADAPTIVE_BIAS_DEFAULT (-7)
+#define   AR_LABELING_THRESH_ADAPTIVE_HALF_RES_DEFAULT FALSE // If TRUE, adaptive threshold image is calculated at half resolution.
 
 #define   AR_CONFIDENCE_CUTOFF_DEFAULT        0.5
 #define   AR_MATRIX_CODE_TYPE_DEFAULT         AR_MATRIX_CODE_3x3
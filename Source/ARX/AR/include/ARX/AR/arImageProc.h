@@ -75,6 +75,7 @@ struct _ARImageProcInfo {
     unsigned long cdfBins[256];         ///< Luminance cumulative density function.
     unsigned char min;                  ///< Minimum luminance.
     unsigned char max;                  ///< Maximum luminance.
+    void *boxFilterBuffer;              ///< Scratch buffer for box filtering, allocated as required.
 #if AR_IMAGEPROC_USE_VIMAGE
     void *tempBuffer;                   ///< Extra buffer when using macOS/iOS vImage framework.
 #endif
@@ -184,14 +185,45 @@ int arImageProcLumaHistAndOtsu(ARImageProcInfo *ipi, const ARUint8 *__restrict d
     @details 
         See https://developer.apple.com/library/ios/documentation/Performance/Reference/vImage_convolution/
         On macOS and iOS, the calculation is accelerated using the Accelerate framework.
+        On other platforms, a running-sum box filter is used, accelerated with SSE2 or NEON
+        where available, and the cost per pixel does not depend on boxSize.
+        The filtered image, with bias added, is placed in ipi->image2.
     @param ipi ARImageProcInfo structure describing the format of the image
         to be processed, as created by arImageProcInit.
     @result 0 in case of success, or a value less than 0 in case of error.
  */
 #if !AR_DISABLE_THRESH_MODE_AUTO_ADAPTIVE
 int arImageProcLumaHistAndBoxFilterWithBias(ARImageProcInfo *ipi, const ARUint8 *__restrict dataPtr, const int boxSize, const int bias);
+
+/*!
+    @brief Calculate image histogram, and box filter image at half resolution.
+    @details
+        As for arImageProcLumaHistAndBoxFilterWithBias, but the image is first downsampled
+        by averaging 2x2 blocks of pixels, filtered with a box of half the size, and the
+        result is upsampled to full resolution as it is written to ipi->image2. This is
+        around four times less work, and is suitable when the threshold image need only
+        follow gradual changes in illumination.
+    @param ipi ARImageProcInfo structure describing the format of the image
+        to be processed, as created by arImageProcInit.
+    @result 0 in case of success, or a value less than 0 in case of error.
+    @see arImageProcLumaHistAndBoxFilterWithBias
+ */
+int arImageProcLumaHistAndBoxFilterWithBiasHalfRes(ARImageProcInfo *ipi, const ARUint8 *__restrict dataPtr, const int boxSize, const int bias);
 #endif
 
+/*!
+    @brief Downsample a luminance image to half resolution.
+    @details
+        Each output pixel is the rounded mean of a 2x2 block of input pixels. Where xsize or
+        ysize is odd, the final column or row is averaged with itself.
+        Accelerated with SSE2 or NEON where available.
+    @param src Input image, xsize * ysize pixels.
+    @param xsize Width of the input image.
+    @param ysize Height of the input image.
+    @param dst Output image, of at least ((xsize + 1)/2) * ((ysize + 1)/2) pixels.
+ */
+void arImageProcDownsampleHalf(const ARUint8 *__restrict src, const int xsize, const int ysize, ARUint8 *__restrict dst);
+
 /*!
     @brief Calculate image histogram, cumulative density function, and minimum and maximum luminance values.
     @param ipi ARImageProcInfo structure describing the format of the image
@@ -0,0 +1,488 @@
+/*
+ *  AR2/bundle.c
+ *  artoolkitX
+ *
+ *  This file is part of artoolkitX.
+ *
+ *  artoolkitX is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  artoolkitX is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, the copyright holders of this library give you
+ *  permission to link this library with independent modules to produce an
+ *  executable, regardless of the license terms of these independent modules, and to
+ *  copy and distribute the resulting executable under terms of your choice,
+ *  provided that you also meet, for each linked independent module, the terms and
+ *  conditions of the license of that module. An independent module is a module
+ *  which is neither derived from nor based on this library. If you modify this
+ *  library, you may extend this exception to your version of the library, but you
+ *  are not obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  Copyright 2018 Realmax, Inc.
+ *  Copyright 2015 Daqri, LLC.
+ *  Copyright 2006-2015 ARToolworks, Inc.
+ *
+ *  Author(s): Hirokazu Kato, Philip Lamb
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ARX/AR/ar.h>
+#include <ARX/AR2/bundle.h>
+#ifdef _WIN32
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+//
+// Bundle file format, version 1 (AR2_BUNDLE_VERSION).
+//
+// An AR2BundleHeaderT, followed by sections each starting at a multiple of
+// AR2_BUNDLE_ALIGNMENT bytes from the start of the file:
+//   image:   imageNum AR2BundleImageT records, then each level's xsize*ysize luma
+//            pixels, each level aligned.
+//   feature: featurePointsNum AR2BundleFeaturePointsT records, then each record's
+//            AR2FeatureCoordT array.
+//   kpm:     (optional) a .fset3 file in the current format.
+// All offsets are from the start of the file, and all values are in the byte order of
+// the writer, which is recorded in byteOrder.
+//
+#define AR2_BUNDLE_MAGIC        "AR2B"
+#define AR2_BUNDLE_BYTE_ORDER   0x01020304u
+
+typedef struct {
+    char        magic[4];
+    uint32_t    version;
+    uint32_t    byteOrder;
+    uint32_t    coordSize;          // sizeof(AR2FeatureCoordT) of the writer.
+    int32_t     imageNum;
+    int32_t     featurePointsNum;
+    uint64_t    imageOffset;
+    uint64_t    featureOffset;
+    uint64_t    kpmOffset;          // Zero if there is no kpm section.
+    uint64_t    kpmSize;
+    uint64_t    fileSize;
+    uint64_t    reserved[3];        // Zero.
+} AR2BundleHeaderT;
+
+typedef struct {
+    int32_t     xsize;
+    int32_t     ysize;
+    float       dpi;
+    int32_t     reserved;
+    uint64_t    offset;
+} AR2BundleImageT;
+
+typedef struct {
+    int32_t     scale;
+    float       maxdpi;
+    float       mindpi;
+    int32_t     num;
+    uint64_t    offset;
+} AR2BundleFeaturePointsT;
+
+struct _AR2BundleT {
+    unsigned char  *data;
+    size_t          size;
+    int             mapped;     // If 0, data was allocated with malloc().
+    int             refCount;   // The caller's reference, plus one per image set read. Not atomic; see ar2CloseBundle().
+};
+
+static uint64_t ar2BundleAlign( uint64_t offset )
+{
+    return ((offset + AR2_BUNDLE_ALIGNMENT - 1) / AR2_BUNDLE_ALIGNMENT * AR2_BUNDLE_ALIGNMENT);
+}
+
+static char *ar2BundlePath( const char *filename, const char *ext )
+{
+    char   *buf;
+
+    arMalloc(buf, char, strlen(filename) + (ext ? strlen(ext) + 1 : 0) + 1);
+    if (ext) sprintf(buf, "%s.%s", filename, ext);
+    else     strcpy(buf, filename);
+    return (buf);
+}
+
+// Maps the file copy-on-write. Returns -1 without logging if the file can't be opened.
+static int ar2BundleMap( const char *path, AR2BundleT *bundle )
+{
+#ifdef _WIN32
+    HANDLE          file, mapping;
+    LARGE_INTEGER   len;
+
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return (-1);
+    if (!GetFileSizeEx(file, &len) || len.QuadPart <= 0 || (ULONGLONG)len.QuadPart > (SIZE_T)-1) {
+        CloseHandle(file);
+        return (-1);
+    }
+    mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) return (-1);
+    bundle->data = (unsigned char *)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping); // The view keeps the mapping alive.
+    if (!bundle->data) return (-1);
+    bundle->size = (size_t)len.QuadPart;
+#else
+    int             fd;
+    struct stat     st;
+    void           *data;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return (-1);
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return (-1);
+    }
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps the file open.
+    if (data == MAP_FAILED) return (-1);
+    bundle->data = (unsigned char *)data;
+    bundle->size = (size_t)st.st_size;
+#endif
+    bundle->mapped = 1;
+    return (0);
+}
+
+// Reads the whole file, where mapping is unavailable.
+static int ar2BundleRead( const char *path, AR2BundleT *bundle )
+{
+    FILE   *fp;
+    long    len;
+
+    if ((fp = fopen(path, "rb")) == NULL) return (-1);
+    if (fseek(fp, 0, SEEK_END) != 0 || (len = ftell(fp)) <= 0 || fseek(fp, 0, SEEK_SET) != 0) {
+        fclose(fp);
+        return (-1);
+    }
+    arMalloc(bundle->data, unsigned char, len);
+    if (fread(bundle->data, 1, len, fp) != (size_t)len) {
+        free(bundle->data);
+        fclose(fp);
+        return (-1);
+    }
+    fclose(fp);
+    bundle->size = (size_t)len;
+    bundle->mapped = 0;
+    return (0);
+}
+
+static void ar2BundleRelease( AR2BundleT *bundle )
+{
+    if (--bundle->refCount > 0) return;
+    if (bundle->mapped) {
+#ifdef _WIN32
+        UnmapViewOfFile(bundle->data);
+#else
+        munmap(bundle->data, bundle->size);
+#endif
+    } else {
+        free(bundle->data);
+    }
+    free(bundle);
+}
+
+// Checks the header of a bundle file of 'size' bytes. Returns -1 if the file is not a valid
+// bundle, or -2 (having logged why) if it is one this library can't read.
+static int ar2BundleCheckHeader( const AR2BundleHeaderT *header, uint64_t size )
+{
+    if (size < sizeof(AR2BundleHeaderT) || memcmp(header->magic, AR2_BUNDLE_MAGIC, 4) != 0) return (-1);
+    if (header->version != AR2_BUNDLE_VERSION) {
+        ARLOGe("Error: unsupported NFT bundle version %u.\n", header->version);
+        return (-2);
+    }
+    if (header->byteOrder != AR2_BUNDLE_BYTE_ORDER || header->coordSize != sizeof(AR2FeatureCoordT)) {
+        ARLOGe("Error: NFT bundle was written on an incompatible platform.\n");
+        return (-2);
+    }
+    if (header->imageNum <= 0 || header->featurePointsNum <= 0 || header->fileSize > size) return (-1);
+    if (header->imageOffset % AR2_BUNDLE_ALIGNMENT != 0 || header->featureOffset % AR2_BUNDLE_ALIGNMENT != 0 || header->kpmOffset % AR2_BUNDLE_ALIGNMENT != 0) return (-1);
+    if (header->imageOffset > header->fileSize || (header->fileSize - header->imageOffset) / sizeof(AR2BundleImageT) < (uint64_t)header->imageNum) return (-1);
+    if (header->featureOffset > header->fileSize || (header->fileSize - header->featureOffset) / sizeof(AR2BundleFeaturePointsT) < (uint64_t)header->featurePointsNum) return (-1);
+    if (header->kpmOffset > header->fileSize || header->kpmSize > header->fileSize - header->kpmOffset) return (-1);
+    return (0);
+}
+
+static int ar2BundleCheck( const AR2BundleT *bundle )
+{
+    const AR2BundleHeaderT          *header = (const AR2BundleHeaderT *)bundle->data;
+    const AR2BundleImageT           *image;
+    const AR2BundleFeaturePointsT   *points;
+    int                              i, ret;
+
+    if ((ret = ar2BundleCheckHeader(header, bundle->size)) < 0) return (ret);
+    image = (const AR2BundleImageT *)(bundle->data + header->imageOffset);
+    for (i = 0; i < header->imageNum; i++) {
+        if (image[i].xsize <= 0 || image[i].ysize <= 0 || image[i].offset > header->fileSize ||
+            (uint64_t)image[i].xsize * (uint64_t)image[i].ysize > header->fileSize - image[i].offset) return (-1);
+    }
+    points = (const AR2BundleFeaturePointsT *)(bundle->data + header->featureOffset);
+    for (i = 0; i < header->featurePointsNum; i++) {
+        if (points[i].num < 0 || points[i].offset > header->fileSize ||
+            (header->fileSize - points[i].offset) / sizeof(AR2FeatureCoordT) < (uint64_t)points[i].num) return (-1);
+    }
+    return (0);
+}
+
+AR2BundleT *ar2OpenBundle( const char *filename, const char *ext )
+{
+    AR2BundleT     *bundle;
+    char           *path;
+    int             ret;
+
+    if (!filename) return (NULL);
+    path = ar2BundlePath(filename, ext);
+    arMallocClear(bundle, AR2BundleT, 1);
+    if (ar2BundleMap(path, bundle) < 0 && ar2BundleRead(path, bundle) < 0) {
+        free(bundle);
+        free(path);
+        return (NULL);
+    }
+    bundle->refCount = 1;
+
+    if ((ret = ar2BundleCheck(bundle)) < 0) {
+        if (ret == -1) ARLOGe("Error: NFT bundle '%s' is truncated or corrupt.\n", path);
+        ar2BundleRelease(bundle);
+        free(path);
+        return (NULL);
+    }
+    free(path);
+
+    return (bundle);
+}
+
+void ar2CloseBundle( AR2BundleT **bundle_p )
+{
+    if (!bundle_p || !*bundle_p) return;
+    ar2BundleRelease(*bundle_p);
+    *bundle_p = NULL;
+}
+
+AR2ImageSetT *ar2ReadImageSetFromBundle( AR2BundleT *bundle )
+{
+#if AR2_CAPABLE_ADAPTIVE_TEMPLATE
+    ARLOGe("Error: NFT bundles are not supported with adaptive templates.\n");
+    return (NULL);
+#else
+    const AR2BundleHeaderT  *header;
+    const AR2BundleImageT   *image;
+    AR2ImageSetT            *imageSet;
+    int                      i;
+
+    if (!bundle) return (NULL);
+    header = (const AR2BundleHeaderT *)bundle->data;
+    image = (const AR2BundleImageT *)(bundle->data + header->imageOffset);
+
+    arMalloc(imageSet, AR2ImageSetT, 1);
+    imageSet->num = header->imageNum;
+    arMalloc(imageSet->scale, AR2ImageT *, imageSet->num);
+    for (i = 0; i < imageSet->num; i++) {
+        arMalloc(imageSet->scale[i], AR2ImageT, 1);
+        imageSet->scale[i]->xsize = image[i].xsize;
+        imageSet->scale[i]->ysize = image[i].ysize;
+        imageSet->scale[i]->dpi   = image[i].dpi;
+        imageSet->scale[i]->imgBW = bundle->data + image[i].offset;
+    }
+    imageSet->bundle = bundle; // The pixels are in the bundle, so hold it open.
+    bundle->refCount++;
+
+    return (imageSet);
+#endif
+}
+
+AR2FeatureSetT *ar2ReadFeatureSetFromBundle( AR2BundleT *bundle )
+{
+    const AR2BundleHeaderT          *header;
+    const AR2BundleFeaturePointsT   *points;
+    AR2FeatureSetT                  *featureSet;
+    int                              i;
+
+    if (!bundle) return (NULL);
+    header = (const AR2BundleHeaderT *)bundle->data;
+    points = (const AR2BundleFeaturePointsT *)(bundle->data + header->featureOffset);
+
+    // The feature set is small, so is copied out of the file.
+    arMalloc(featureSet, AR2FeatureSetT, 1);
+    featureSet->num = header->featurePointsNum;
+    arMalloc(featureSet->list, AR2FeaturePointsT, featureSet->num);
+    for (i = 0; i < featureSet->num; i++) {
+        featureSet->list[i].scale  = points[i].scale;
+        featureSet->list[i].maxdpi = points[i].maxdpi;
+        featureSet->list[i].mindpi = points[i].mindpi;
+        featureSet->list[i].num    = points[i].num;
+        arMalloc(featureSet->list[i].coord, AR2FeatureCoordT, (points[i].num > 0 ? points[i].num : 1));
+        memcpy(featureSet->list[i].coord, bundle->data + points[i].offset, sizeof(AR2FeatureCoordT) * points[i].num);
+    }
+
+    return (featureSet);
+}
+
+int ar2GetBundleKpmData( AR2BundleT *bundle, uint64_t *offset_p, uint64_t *size_p )
+{
+    const AR2BundleHeaderT  *header;
+
+    if (!bundle || !offset_p) return (-1);
+    header = (const AR2BundleHeaderT *)bundle->data;
+    if (header->kpmOffset == 0 || header->kpmSize == 0) return (-1);
+    *offset_p = header->kpmOffset;
+    if (size_p) *size_p = header->kpmSize;
+    return (0);
+}
+
+int ar2ReadBundleKpmLocation( const char *filename, const char *ext, uint64_t *offset_p, uint64_t *size_p )
+{
+    FILE               *fp;
+    char               *path;
+    AR2BundleHeaderT    header;
+    long                len;
+    int                 ret;
+
+    if (!filename || !offset_p) return (-1);
+    path = ar2BundlePath(filename, ext);
+    if ((fp = fopen(path, "rb")) == NULL) {
+        free(path);
+        return (-1);
+    }
+    // Only the header is read, so that the rest of the file need not be mapped or read here.
+    if (fseek(fp, 0, SEEK_END) != 0 || (len = ftell(fp)) < 0 || fseek(fp, 0, SEEK_SET) != 0 ||
+        fread(&header, sizeof(header), 1, fp) != 1) {
+        len = 0;
+    }
+    fclose(fp);
+    if ((ret = ar2BundleCheckHeader(&header, (uint64_t)len)) < 0) {
+        if (ret == -1) ARLOGe("Error: NFT bundle '%s' is truncated or corrupt.\n", path);
+        free(path);
+        return (-1);
+    }
+    free(path);
+    if (header.kpmOffset == 0 || header.kpmSize == 0) return (-1);
+    *offset_p = header.kpmOffset;
+    if (size_p) *size_p = header.kpmSize;
+    return (0);
+}
+
+int ar2WriteBundle( const char *filename, const char *ext, AR2ImageSetT *imageSet, AR2FeatureSetT *featureSet,
+                    const void *kpmData, size_t kpmDataSize )
+{
+#if AR2_CAPABLE_ADAPTIVE_TEMPLATE
+    ARLOGe("Error: NFT bundles are not supported with adaptive templates.\n");
+    return (-1);
+#else
+    FILE                    *fp;
+    char                    *path;
+    AR2BundleHeaderT         header;
+    AR2BundleImageT         *image = NULL;
+    AR2BundleFeaturePointsT *points = NULL;
+    static const char        zeros[AR2_BUNDLE_ALIGNMENT] = {0};
+    uint64_t                 offset, pos;
+    int                      i;
+
+    if (!filename || !imageSet || imageSet->num <= 0 || !featureSet || featureSet->num <= 0 || (!kpmData && kpmDataSize)) {
+        ARLOGe("ar2WriteBundle(): Invalid parameters.\n");
+        return (-1);
+    }
+
+    // Lay out the file.
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, AR2_BUNDLE_MAGIC, 4);
+    header.version          = AR2_BUNDLE_VERSION;
+    header.byteOrder        = AR2_BUNDLE_BYTE_ORDER;
+    header.coordSize        = sizeof(AR2FeatureCoordT);
+    header.imageNum         = imageSet->num;
+    header.featurePointsNum = featureSet->num;
+    header.imageOffset      = ar2BundleAlign(sizeof(header));
+    arMallocClear(image, AR2BundleImageT, imageSet->num);
+    offset = header.imageOffset + sizeof(AR2BundleImageT) * imageSet->num;
+    for (i = 0; i < imageSet->num; i++) {
+        image[i].xsize  = imageSet->scale[i]->xsize;
+        image[i].ysize  = imageSet->scale[i]->ysize;
+        image[i].dpi    = imageSet->scale[i]->dpi;
+        image[i].offset = ar2BundleAlign(offset);
+        offset = image[i].offset + (uint64_t)image[i].xsize * image[i].ysize;
+    }
+    header.featureOffset    = ar2BundleAlign(offset);
+    arMallocClear(points, AR2BundleFeaturePointsT, featureSet->num);
+    offset = header.featureOffset + sizeof(AR2BundleFeaturePointsT) * featureSet->num;
+    for (i = 0; i < featureSet->num; i++) {
+        points[i].scale  = featureSet->list[i].scale;
+        points[i].maxdpi = featureSet->list[i].maxdpi;
+        points[i].mindpi = featureSet->list[i].mindpi;
+        points[i].num    = featureSet->list[i].num;
+        points[i].offset = offset;
+        offset += sizeof(AR2FeatureCoordT) * (uint64_t)points[i].num;
+    }
+    if (kpmDataSize) {
+        header.kpmOffset    = ar2BundleAlign(offset);
+        header.kpmSize      = kpmDataSize;
+        offset = header.kpmOffset + kpmDataSize;
+    }
+    header.fileSize         = offset;
+
+    path = ar2BundlePath(filename, ext);
+    fp = fopen(path, "wb");
+    if (!fp) {
+        ARLOGe("Error: unable to open file '%s' for writing.\n", path);
+        free(path);
+        free(image);
+        free(points);
+        return (-1);
+    }
+
+    // Pad each item out to its offset as it is written.
+#define AR2_BUNDLE_PAD(to) ((to) - pos > sizeof(zeros) || fwrite(zeros, 1, (size_t)((to) - pos), fp) != (size_t)((to) - pos))
+    pos = 0;
+    if (fwrite(&header, sizeof(header), 1, fp) != 1) goto bailBadWrite;
+    pos += sizeof(header);
+    if (AR2_BUNDLE_PAD(header.imageOffset)) goto bailBadWrite;
+    if (fwrite(image, sizeof(AR2BundleImageT), imageSet->num, fp) != (size_t)imageSet->num) goto bailBadWrite;
+    pos = header.imageOffset + sizeof(AR2BundleImageT) * imageSet->num;
+    for (i = 0; i < imageSet->num; i++) {
+        if (AR2_BUNDLE_PAD(image[i].offset)) goto bailBadWrite;
+        if (fwrite(imageSet->scale[i]->imgBW, (size_t)image[i].xsize, (size_t)image[i].ysize, fp) != (size_t)image[i].ysize) goto bailBadWrite;
+        pos = image[i].offset + (uint64_t)image[i].xsize * image[i].ysize;
+    }
+    if (AR2_BUNDLE_PAD(header.featureOffset)) goto bailBadWrite;
+    if (fwrite(points, sizeof(AR2BundleFeaturePointsT), featureSet->num, fp) != (size_t)featureSet->num) goto bailBadWrite;
+    for (i = 0; i < featureSet->num; i++) {
+        if (points[i].num == 0) continue;
+        if (fwrite(featureSet->list[i].coord, sizeof(AR2FeatureCoordT), points[i].num, fp) != (size_t)points[i].num) goto bailBadWrite;
+    }
+    pos = header.featureOffset + sizeof(AR2BundleFeaturePointsT) * featureSet->num;
+    for (i = 0; i < featureSet->num; i++) pos += sizeof(AR2FeatureCoordT) * (uint64_t)points[i].num;
+    if (kpmDataSize) {
+        if (AR2_BUNDLE_PAD(header.kpmOffset)) goto bailBadWrite;
+        if (fwrite(kpmData, 1, kpmDataSize, fp) != kpmDataSize) goto bailBadWrite;
+    }
+#undef AR2_BUNDLE_PAD
+
+    fclose(fp);
+    free(path);
+    free(image);
+    free(points);
+    return (0);
+
+bailBadWrite:
+    ARLOGe("Error saving NFT bundle '%s': error writing data.\n", path);
+    fclose(fp);
+    free(path);
+    free(image);
+    free(points);
+    return (-1);
+#endif
+}
@@ -180,6 +180,51 @@ int ar2FreeFeatureSet( AR2FeatureSetT **featureSet )
 
 #include <math.h>
 #include <ARX/AR2/config.h>
+#include <ARX/ARUtil/thread_sub.h>
+#if HAVE_ARM_NEON || HAVE_ARM64_NEON
+#  include <arm_neon.h>
+#  define  AR2_FEATURE_MAP_SIMD  1
+#elif HAVE_INTEL_SIMD
+#  include <emmintrin.h> // SSE2.
+#  define  AR2_FEATURE_MAP_SIMD  1
+#else
+#  define  AR2_FEATURE_MAP_SIMD  0
+#endif
+
+// A feature map is generated on all CPUs, each thread taking every count'th row.
+typedef struct {
+	ARUint8   *imageBW;
+	int        xsize, ysize;
+	int        ts1, ts2;
+	int        search_size1, search_size2;
+	float      max_sim_thresh, sd_thresh;
+	int        gradThresh;        // Minimum gradient magnitude, x1000.
+	float     *fimage;            // Feature map.
+	float     *fimage2;           // Gradient magnitude.
+	ARUint32  *isum, *isum2;      // Integral images of imageBW and its square, (xsize + 1)*(ysize + 1).
+} AR2FeatureMapJobT;
+
+typedef struct {
+	AR2FeatureMapJobT  *job;
+	int                 index;
+	int                 count;
+} AR2FeatureMapArgT;
+
+// Template of raw pixel values, in rows padded with zeros to a multiple of 8.
+typedef struct {
+	ARUint16  *img;
+	int        size;              // ts1 + ts2 + 1.
+	int        groups;            // 8-pixel groups per row.
+	int        sum;
+	float      vlen;
+} AR2FeatureMapTemplateT;
+
+static void *ar2GenFeatureMapWorker(THREAD_HANDLE_T *threadHandle);
+static void ar2GenFeatureMapRows(AR2FeatureMapJobT *job, int index, int count);
+static void get_window_sums(const AR2FeatureMapJobT *job, int cx, int cy, int *sum, int *sum2);
+static int make_template_rows(const AR2FeatureMapJobT *job, int cx, int cy, AR2FeatureMapTemplateT *templ);
+static int get_similarity_rows(const AR2FeatureMapJobT *job, const AR2FeatureMapTemplateT *templ,
+	int cx, int cy, float  *sim);
 
 static int make_template(ARUint8 *imageBW, int xsize, int ysize,
 	int cx, int cy, int ts1, int ts2, float  sd_thresh,
@@ -203,25 +248,33 @@ AR2FeatureMapT *ar2GenFeatureMap(AR2ImageT *image,
 	int ts1, int ts2,
 	int search_size1, int search_size2,
 	float  max_sim_thresh, float  sd_thresh)
+{
+	return ar2GenFeatureMap2(image, ts1, ts2, search_size1, search_size2, max_sim_thresh, sd_thresh, AR2_GEN_FEATURE_MAP_DEFAULT_THREAD_NUM);
+}
+
+AR2FeatureMapT *ar2GenFeatureMap2(AR2ImageT *image,
+	int ts1, int ts2,
+	int search_size1, int search_size2,
+	float  max_sim_thresh, float  sd_thresh, int threadNum)
 {
 	AR2FeatureMapT  *featureMap;
-	float           *fimage, *fp;
+	float           *fimage;
 	float           *fimage2, *fp2;
-	float           *template;
 	ARUint8         *p;
 	float           dx, dy;
 	int             xsize, ysize;
 	int             hist[1000], sum;
 	int             i, j, k;
-	float           vlen;
-	float           max, sim;
-	int             ii, jj;
+	AR2FeatureMapJobT  job;
+	AR2FeatureMapArgT  *threadArg;
+	THREAD_HANDLE_T   **threadHandle;
+	ARUint32           *is1, *is2;
+	ARUint32            rs1, rs2;
 
 	xsize = image->xsize;
 	ysize = image->ysize;
 	arMalloc(fimage, float, xsize*ysize);
 	arMalloc(fimage2, float, xsize*ysize);
-	arMalloc(template, float, (ts1 + ts2 + 1)*(ts1 + ts2 + 1));
 
 
 	fp2 = fimage2;
@@ -276,70 +329,73 @@ AR2FeatureMapT *ar2GenFeatureMap(AR2ImageT *image,
 	ARLOGi(" Filtered features = %7d[pixel]\n", j);
 
 
-	fp = fimage;
-	fp2 = fimage2;
-	for (i = 0; i < xsize; i++) {
-		*(fp++) = 1.0f;
-		fp2++;
-	}
-	for (j = 1; j < ysize - 1; j++) {
-		ARLOGi("\r%4d/%4d.", j + 1, ysize); fflush(stdout);
-		*(fp++) = 1.0f;
-		fp2++;
-		for (i = 1; i < xsize - 1; i++) {
-			if (*fp2 <= *(fp2 - 1) || *fp2 <= *(fp2 + 1) || *fp2 <= *(fp2 - xsize) || *fp2 <= *(fp2 + xsize)) {
-				*(fp++) = 1.0f;
-				fp2++;
-				continue;
-			}
-			if ((int)(*fp2 * 1000) < k) {
-				*(fp++) = 1.0f;
-				fp2++;
-				continue;
-			}
-#if AR2_CAPABLE_ADAPTIVE_TEMPLATE
-			if (make_template(image->imgBWBlur[1], xsize, ysize, i, j, ts1, ts2, sd_thresh, template, &vlen) < 0) {
-#else
-			if (make_template(image->imgBW, xsize, ysize, i, j, ts1, ts2, sd_thresh, template, &vlen) < 0) {
-#endif
-				*(fp++) = 1.0f;
-				fp2++;
-				continue;
-			}
-
-			max = -1.0f;
-			for (jj = -search_size1; jj <= search_size1; jj++) {
-				for (ii = -search_size1; ii <= search_size1; ii++) {
-
-					if (ii*ii + jj*jj <= search_size2*search_size2) continue;
-					//if( jj >= -search_size2 && jj <= search_size2 && ii >= -search_size2 && ii <= search_size2 ) continue;
-
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
-					if (get_similarity(image->imgBWBlur[1], xsize, ysize, template, vlen, ts1, ts2, i + ii, j + jj, &sim) < 0) continue;
+	job.imageBW = image->imgBWBlur[1];
 #else
-					if (get_similarity(image->imgBW, xsize, ysize, template, vlen, ts1, ts2, i + ii, j + jj, &sim) < 0) continue;
+	job.imageBW = image->imgBW;
 #endif
+	job.xsize = xsize;
+	job.ysize = ysize;
+	job.ts1 = ts1;
+	job.ts2 = ts2;
+	job.search_size1 = search_size1;
+	job.search_size2 = search_size2;
+	job.max_sim_thresh = max_sim_thresh;
+	job.sd_thresh = sd_thresh;
+	job.gradThresh = k;
+	job.fimage = fimage;
+	job.fimage2 = fimage2;
+
+	// Window sums come from integral images. Sums over any template-sized window fit in 32 bits, so
+	// the unsigned wrap-around of the integral images themselves cancels out.
+	arMallocClear(job.isum, ARUint32, (xsize + 1)*(ysize + 1));
+	arMallocClear(job.isum2, ARUint32, (xsize + 1)*(ysize + 1));
+	p = job.imageBW;
+	for (j = 0; j < ysize; j++) {
+		is1 = &job.isum[(j + 1)*(xsize + 1) + 1];
+		is2 = &job.isum2[(j + 1)*(xsize + 1) + 1];
+		rs1 = rs2 = 0;
+		for (i = 0; i < xsize; i++) {
+			rs1 += *p;
+			rs2 += *p * *p;
+			*is1 = *(is1 - (xsize + 1)) + rs1;
+			*is2 = *(is2 - (xsize + 1)) + rs2;
+			is1++;
+			is2++;
+			p++;
+		}
+	}
 
-					if (sim > max) {
-						max = sim;
-						if (max > max_sim_thresh) break;
-					}
-				}
-				if (max > max_sim_thresh) break;
-			}
-			*(fp++) = (float)max;
-			fp2++;
-			}
-		*(fp++) = 1.0f;
-		fp2++;
+	if (threadNum == AR2_GEN_FEATURE_MAP_DEFAULT_THREAD_NUM) threadNum = threadGetCPU();
+	if (threadNum < 1) threadNum = 1;
+	arMalloc(threadArg, AR2FeatureMapArgT, threadNum);
+	arMalloc(threadHandle, THREAD_HANDLE_T *, threadNum);
+	for (i = 1; i < threadNum; i++) {
+		threadArg[i].job = &job;
+		threadArg[i].index = i;
+		threadHandle[i] = threadInit(i, &(threadArg[i]), ar2GenFeatureMapWorker);
+		if (!threadHandle[i]) {
+			ARLOGe("Error starting feature map thread %d.\n", i);
+			break;
 		}
-	for (i = 0; i < xsize; i++) {
-		*(fp++) = 1.0f;
-		fp2++;
 	}
+	threadNum = i;
+	for (i = 1; i < threadNum; i++) {
+		threadArg[i].count = threadNum;
+		threadStartSignal(threadHandle[i]);
+	}
+	ar2GenFeatureMapRows(&job, 0, threadNum);
+	for (i = 1; i < threadNum; i++) {
+		threadEndWait(threadHandle[i]);
+		threadWaitQuit(threadHandle[i]);
+		threadFree(&(threadHandle[i]));
+	}
+	free(threadHandle);
+	free(threadArg);
+	free(job.isum);
+	free(job.isum2);
 	ARLOGi("\n");
 	free(fimage2);
-	free(template);
 
 	arMalloc(featureMap, AR2FeatureMapT, 1);
 	featureMap->map = fimage;
@@ -590,4 +646,192 @@ static int get_similarity(ARUint8 *imageBW, int xsize, int ysize,
 #endif
 
 	return 0;
-}
\ No newline at end of file
+}
+
+static void *ar2GenFeatureMapWorker(THREAD_HANDLE_T *threadHandle)
+{
+	AR2FeatureMapArgT *arg = (AR2FeatureMapArgT *)threadGetArg(threadHandle);
+
+	while (threadStartWait(threadHandle) == 0) {
+		ar2GenFeatureMapRows(arg->job, arg->index, arg->count);
+		threadEndSignal(threadHandle);
+	}
+	return (NULL);
+}
+
+static void ar2GenFeatureMapRows(AR2FeatureMapJobT *job, int index, int count)
+{
+	AR2FeatureMapTemplateT  templ;
+	float                  *fp, *fp2;
+	float                   max, sim;
+	int                     xsize, ysize;
+	int                     search_size1, search_size2;
+	int                     i, j;
+	int                     ii, jj;
+
+	xsize = job->xsize;
+	ysize = job->ysize;
+	search_size1 = job->search_size1;
+	search_size2 = job->search_size2;
+	templ.size = job->ts1 + job->ts2 + 1;
+	templ.groups = (templ.size + 7) / 8;
+	arMallocClear(templ.img, ARUint16, templ.groups*8*templ.size);
+
+	for (j = index; j < ysize; j += count) {
+		if (index == 0) {
+			ARLOGi("\r%4d/%4d.", j + 1, ysize); fflush(stdout);
+		}
+		fp = &(job->fimage[j*xsize]);
+		fp2 = &(job->fimage2[j*xsize]);
+		if (j == 0 || j == ysize - 1) {
+			for (i = 0; i < xsize; i++) fp[i] = 1.0f;
+			continue;
+		}
+		fp[0] = 1.0f;
+		for (i = 1; i < xsize - 1; i++) {
+			if (fp2[i] <= fp2[i - 1] || fp2[i] <= fp2[i + 1] || fp2[i] <= fp2[i - xsize] || fp2[i] <= fp2[i + xsize]) {
+				fp[i] = 1.0f;
+				continue;
+			}
+			if ((int)(fp2[i] * 1000) < job->gradThresh) {
+				fp[i] = 1.0f;
+				continue;
+			}
+			if (make_template_rows(job, i, j, &templ) < 0) {
+				fp[i] = 1.0f;
+				continue;
+			}
+
+			max = -1.0f;
+			for (jj = -search_size1; jj <= search_size1; jj++) {
+				for (ii = -search_size1; ii <= search_size1; ii++) {
+					if (ii*ii + jj*jj <= search_size2*search_size2) continue;
+					if (get_similarity_rows(job, &templ, i + ii, j + jj, &sim) < 0) continue;
+					if (sim > max) {
+						max = sim;
+						if (max > job->max_sim_thresh) break;
+					}
+				}
+				if (max > job->max_sim_thresh) break;
+			}
+			fp[i] = max;
+		}
+		fp[xsize - 1] = 1.0f;
+	}
+
+	free(templ.img);
+}
+
+static void get_window_sums(const AR2FeatureMapJobT *job, int cx, int cy, int *sum, int *sum2)
+{
+	int     x0, x1, y0, y1;
+
+	x0 = cx - job->ts1;
+	x1 = cx + job->ts2 + 1;
+	y0 = (cy - job->ts1)*(job->xsize + 1);
+	y1 = (cy + job->ts2 + 1)*(job->xsize + 1);
+	*sum  = (int)(job->isum[y1 + x1]  - job->isum[y0 + x1]  - job->isum[y1 + x0]  + job->isum[y0 + x0]);
+	*sum2 = (int)(job->isum2[y1 + x1] - job->isum2[y0 + x1] - job->isum2[y1 + x0] + job->isum2[y0 + x0]);
+}
+
+// As make_template(), but keeping the raw pixel values for the integer kernel.
+static int make_template_rows(const AR2FeatureMapJobT *job, int cx, int cy, AR2FeatureMapTemplateT *templ)
+{
+	ARUint8   *ip;
+	ARUint16  *tp;
+	double     n, vlen1;
+	int        sum2;
+	int        i, j;
+
+	if (cy - job->ts1 < 0 || cy + job->ts2 >= job->ysize || cx - job->ts1 < 0 || cx + job->ts2 >= job->xsize) return -1;
+
+	get_window_sums(job, cx, cy, &(templ->sum), &sum2);
+	n = (double)(templ->size*templ->size);
+	vlen1 = (double)sum2 - (double)templ->sum*templ->sum / n;
+	if (vlen1 <= 0.0) return -1;
+	if (vlen1 / n < job->sd_thresh*job->sd_thresh) return -1;
+	templ->vlen = (float)sqrt(vlen1);
+
+	for (j = 0; j < templ->size; j++) {
+		ip = &(job->imageBW[(cy - job->ts1 + j)*job->xsize + (cx - job->ts1)]);
+		tp = &(templ->img[j*templ->groups*8]);
+		for (i = 0; i < templ->size; i++) *(tp++) = *(ip++);
+	}
+
+	return 0;
+}
+
+// As get_similarity(), with the window's sums taken from the integral images, and the template
+// dot product in integers.
+static int get_similarity_rows(const AR2FeatureMapJobT *job, const AR2FeatureMapTemplateT *templ,
+	int cx, int cy, float  *sim)
+{
+	const ARUint8   *ip;
+	const ARUint16  *tp;
+	double           n, vlen2, sxy;
+	int              sx, sxx, dot;
+	int              i, j;
+
+	if (cy - job->ts1 < 0 || cy + job->ts2 >= job->ysize || cx - job->ts1 < 0 || cx + job->ts2 >= job->xsize) return -1;
+
+	get_window_sums(job, cx, cy, &sx, &sxx);
+	n = (double)(templ->size*templ->size);
+	vlen2 = (double)sxx - (double)sx*sx / n;
+	if (vlen2 <= 0.0) return -1;
+
+	ip = &(job->imageBW[(cy - job->ts1)*job->xsize + (cx - job->ts1)]);
+	tp = templ->img;
+#if AR2_FEATURE_MAP_SIMD
+	// The kernel reads whole 8-byte groups, so the last row may only be used if they stay inside the image.
+	if ((cy + job->ts2)*job->xsize + (cx - job->ts1) + templ->groups*8 <= job->xsize*job->ysize) {
+#  if HAVE_ARM_NEON || HAVE_ARM64_NEON
+		uint32x4_t   s;
+		uint16x8_t   v, t;
+
+		s = vdupq_n_u32(0);
+		for (j = 0; j < templ->size; j++) {
+			for (i = 0; i < templ->groups; i++) {
+				v = vmovl_u8(vld1_u8(ip + i*8));
+				t = vld1q_u16(tp);
+				s = vmlal_u16(s, vget_low_u16(v), vget_low_u16(t));
+				s = vmlal_u16(s, vget_high_u16(v), vget_high_u16(t));
+				tp += 8;
+			}
+			ip += job->xsize;
+		}
+		dot = (int)(vgetq_lane_u32(s, 0) + vgetq_lane_u32(s, 1) + vgetq_lane_u32(s, 2) + vgetq_lane_u32(s, 3));
+#  else
+		__m128i      s, v, zero;
+		int          w[4];
+
+		s = zero = _mm_setzero_si128();
+		for (j = 0; j < templ->size; j++) {
+			for (i = 0; i < templ->groups; i++) {
+				// Pixels and template values are at most 255, so pairwise products and sums fit madd's 32-bit lanes.
+				v = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(ip + i*8)), zero);
+				s = _mm_add_epi32(s, _mm_madd_epi16(v, _mm_loadu_si128((const __m128i *)tp)));
+				tp += 8;
+			}
+			ip += job->xsize;
+		}
+		_mm_storeu_si128((__m128i *)w, s);
+		dot = w[0] + w[1] + w[2] + w[3];
+#  endif
+	}
+	else
+#endif
+	{
+		dot = 0;
+		for (j = 0; j < templ->size; j++) {
+			for (i = 0; i < templ->size; i++) dot += ip[i] * tp[i];
+			ip += job->xsize;
+			tp += templ->groups*8;
+		}
+	}
+
+	// Sum of (pixel * (template - template mean)).
+	sxy = (double)dot - (double)templ->sum*sx / n;
+	*sim = (float)(sxy / (templ->vlen * sqrt(vlen2)));
+
+	return 0;
+}
@@ -50,13 +50,16 @@ static AR2HandleT *ar2CreateHandleSub( AR_PIXEL_FORMAT pixFormat, int xsize, int
 AR2HandleT *ar2CreateHandle( ARParamLT *cparamLT, AR_PIXEL_FORMAT pixFormat, int threadNum )
 {
     AR2HandleT   *ar2Handle;
+    int           i;
 
     ar2Handle = ar2CreateHandleSub( pixFormat, cparamLT->param.xsize, cparamLT->param.ysize, threadNum );
 
     ar2Handle->trackingMode      = AR2_TRACKING_6DOF;
     ar2Handle->cparamLT          = cparamLT;
-    ar2Handle->icpHandle         = icpCreateHandle( cparamLT->param.mat );
-    icpSetInlierProbability( ar2Handle->icpHandle, 0.0 );
+    for( i = 0; i < ar2Handle->threadNum; i++ ) {
+        ar2Handle->state[i]->icpHandle = icpCreateHandle( cparamLT->param.mat );
+        icpSetInlierProbability( ar2Handle->state[i]->icpHandle, 0.0 );
+    }
 
     return ar2Handle;
 }
@@ -69,7 +72,6 @@ AR2HandleT *ar2CreateHandleHomography( int xsize, int ysize, AR_PIXEL_FORMAT pix
 
     ar2Handle->trackingMode      = AR2_TRACKING_HOMOGRAPHY;
     ar2Handle->cparamLT          = NULL;
-    ar2Handle->icpHandle         = NULL;
 
     return ar2Handle;
 }
@@ -88,6 +90,8 @@ static AR2HandleT *ar2CreateHandleSub( int pixFormat, int xsize, int ysize, int
     ar2Handle->blurLevel         = AR2_DEFAULT_BLUR_LEVEL;
 #endif
     ar2Handle->searchSize        = AR2_DEFAULT_SEARCH_SIZE;
+    ar2Handle->searchMode        = AR2_SEARCH_MODE_WINDOW;
+    ar2Handle->searchPyramid     = NULL;
     ar2Handle->templateSize1     = AR2_DEFAULT_TS1;
     ar2Handle->templateSize2     = AR2_DEFAULT_TS2;
     ar2Handle->searchFeatureNum  = AR2_DEFAULT_SEARCH_FEATURE_NUM;
@@ -110,7 +114,15 @@ static AR2HandleT *ar2CreateHandleSub( int pixFormat, int xsize, int ysize, int
     }
     ar2Handle->threadNum = threadNum;
     ARLOGi("Tracking thread = %d\n", threadNum);
+    ar2Handle->jobQueue  = threadQueueInit( threadNum*2 );
+    ar2Handle->doneQueue = threadQueueInit( threadNum );
+    if( ar2Handle->jobQueue == NULL || ar2Handle->doneQueue == NULL ) {
+        ARLOGe("Out of memory!!\n");
+        exit(1);
+    }
     for( i = 0; i < ar2Handle->threadNum; i++ ) {
+        arMalloc( ar2Handle->state[i], AR2TrackingStateT, 1 );
+        ar2Handle->state[i]->icpHandle = NULL;
         arMalloc( ar2Handle->arg[i].mfImage, ARUint8, xsize*ysize );
         ar2Handle->arg[i].templ = NULL;
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
@@ -136,9 +148,13 @@ int ar2DeleteHandle( AR2HandleT **ar2Handle )
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
         if( (*ar2Handle)->arg[i].templ2 != NULL ) ar2FreeTemplate ( (*ar2Handle)->arg[i].templ2 );
 #endif
+        if( (*ar2Handle)->state[i]->icpHandle != NULL ) icpDeleteHandle( &((*ar2Handle)->state[i]->icpHandle) );
+        free( (*ar2Handle)->state[i] );
     }
+    threadQueueFree( &((*ar2Handle)->jobQueue) );
+    threadQueueFree( &((*ar2Handle)->doneQueue) );
+    if( (*ar2Handle)->searchPyramid != NULL ) ar2DeleteSearchPyramid( &((*ar2Handle)->searchPyramid) );
 
-    if( (*ar2Handle)->icpHandle != NULL ) icpDeleteHandle( &((*ar2Handle)->icpHandle) );
     //if( (*ar2Handle)->cparamLT  != NULL ) arParamLTFree( (*ar2Handle)->cparamLT );
     free( *ar2Handle );
     *ar2Handle = NULL;
@@ -149,7 +165,7 @@ int ar2DeleteHandle( AR2HandleT **ar2Handle )
 int ar2SetTrackingMode( AR2HandleT *ar2Handle, int  trackingMode )
 {
     if( ar2Handle == NULL ) return -1;
-    if( trackingMode == AR2_TRACKING_6DOF && ar2Handle->icpHandle == NULL ) return -1;
+    if( trackingMode == AR2_TRACKING_6DOF && ar2Handle->state[0]->icpHandle == NULL ) return -1;
     ar2Handle->trackingMode = trackingMode;
     return 0;
 }
@@ -233,6 +249,25 @@ int ar2GetSearchSize( AR2HandleT *ar2Handle, int *searchSize )
     return 0;
 }
 
+int ar2SetSearchMode( AR2HandleT *ar2Handle, int searchMode )
+{
+    if( ar2Handle == NULL ) return -1;
+    if( searchMode != AR2_SEARCH_MODE_WINDOW && searchMode != AR2_SEARCH_MODE_PYRAMID ) return -1;
+    if( searchMode == AR2_SEARCH_MODE_PYRAMID && ar2Handle->searchPyramid == NULL ) {
+        ar2Handle->searchPyramid = ar2CreateSearchPyramid( ar2Handle->xsize, ar2Handle->ysize );
+        if( ar2Handle->searchPyramid == NULL ) return -1;
+    }
+    ar2Handle->searchMode = searchMode;
+    return 0;
+}
+
+int ar2GetSearchMode( AR2HandleT *ar2Handle, int *searchMode )
+{
+    if( ar2Handle == NULL ) return -1;
+    *searchMode = ar2Handle->searchMode;
+    return 0;
+}
+
 int ar2SetSearchFeatureNum( AR2HandleT *ar2Handle, int searchFeatureNum )
 {
     if( ar2Handle == NULL ) return -1;
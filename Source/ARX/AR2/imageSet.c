@@ -46,6 +46,7 @@
 #endif
 #include <ARX/AR2/imageFormat.h>
 #include <ARX/AR2/imageSet.h>
+#include <ARX/AR2/bundle.h>
 
 static AR2ImageT *ar2GenImageLayer1 ( ARUint8 *image, int xsize, int ysize, int nc, float srcdpi, float dstdpi );
 static AR2ImageT *ar2GenImageLayer2 ( AR2ImageT *src, float dstdpi );
@@ -67,6 +68,7 @@ AR2ImageSetT *ar2GenImageSet( ARUint8 *image, int xsize, int ysize, int nc, floa
     }
 
     arMalloc( imageSet, AR2ImageSetT, 1 );
+    imageSet->bundle = NULL;
     imageSet->num = dpi_num;
     arMalloc( imageSet->scale,  AR2ImageT*,  imageSet->num );
 
@@ -104,6 +106,7 @@ AR2ImageSetT *ar2ReadImageSet( char *filename )
     }
 
     arMalloc( imageSet, AR2ImageSetT, 1 );
+    imageSet->bundle = NULL;
 
     if( fread(&(imageSet->num), sizeof(imageSet->num), 1, fp) != 1 || imageSet->num <= 0) {
         ARLOGe("Error reading imageSet.\n");
@@ -244,16 +247,19 @@ int ar2FreeImageSet( AR2ImageSetT **imageSet )
     if( *imageSet == NULL ) return -1;
 
     for( i = 0; i < (*imageSet)->num; i++ ) {
+        if( (*imageSet)->bundle == NULL ) {
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
-        for( int j = 0; j < AR2_BLUR_IMAGE_MAX; j++ ) {
-            free( (*imageSet)->scale[i]->imgBWBlur[j] );
-        }
+            for( int j = 0; j < AR2_BLUR_IMAGE_MAX; j++ ) {
+                free( (*imageSet)->scale[i]->imgBWBlur[j] );
+            }
 #else
-        free( (*imageSet)->scale[i]->imgBW  );
+            free( (*imageSet)->scale[i]->imgBW  );
 #endif
+        }
         free( (*imageSet)->scale[i] );
     }
     free( (*imageSet)->scale );
+    ar2CloseBundle( &((*imageSet)->bundle) ); // Releases the image set's hold on the bundle.
     free( *imageSet );
     *imageSet = NULL;
 
@@ -458,6 +464,7 @@ static AR2ImageSetT *ar2ReadImageSetOld( FILE *fp )
 #endif
 
     arMalloc( imageSet, AR2ImageSetT, 1 );
+    imageSet->bundle = NULL;
     
     if( fread(&(imageSet->num), sizeof(imageSet->num), 1, fp) != 1 || imageSet->num <= 0) {
         ARLOGe("Error reading imageSet.\n");
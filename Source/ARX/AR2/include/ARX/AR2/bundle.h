@@ -0,0 +1,152 @@
+/*
+ *  AR2/bundle.h
+ *  artoolkitX
+ *
+ *  This file is part of artoolkitX.
+ *
+ *  artoolkitX is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  artoolkitX is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, the copyright holders of this library give you
+ *  permission to link this library with independent modules to produce an
+ *  executable, regardless of the license terms of these independent modules, and to
+ *  copy and distribute the resulting executable under terms of your choice,
+ *  provided that you also meet, for each linked independent module, the terms and
+ *  conditions of the license of that module. An independent module is a module
+ *  which is neither derived from nor based on this library. If you modify this
+ *  library, you may extend this exception to your version of the library, but you
+ *  are not obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  Copyright 2018 Realmax, Inc.
+ *  Copyright 2015 Daqri, LLC.
+ *  Copyright 2006-2015 ARToolworks, Inc.
+ *
+ *  Author(s): Hirokazu Kato, Philip Lamb
+ *
+ */
+
+#ifndef AR2_BUNDLE_H
+#define AR2_BUNDLE_H
+#include <stdint.h>
+#include <ARX/AR2/config.h>
+#include <ARX/AR2/imageSet.h>
+#include <ARX/AR2/featureSet.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define    AR2_BUNDLE_EXT         "nftb"  // Usual extension of an NFT bundle file.
+#define    AR2_BUNDLE_VERSION     1       // Version of the bundle format written by ar2WriteBundle.
+#define    AR2_BUNDLE_ALIGNMENT   64      // Alignment in bytes of each section and image level in a bundle.
+
+/*!
+    @typedef    AR2BundleT
+    @brief   An open NFT bundle.
+    @details
+        An NFT bundle holds, in a single file, the data otherwise held in a dataset's .iset,
+        .fset and .fset3 files. The file is memory-mapped, and the image set's levels are
+        stored as raw luma, so they are used in place rather than decoded and resampled.
+        Pages of the file are only read when first touched, so levels which are never
+        tracked at cost nothing to load.
+ */
+typedef struct _AR2BundleT AR2BundleT;
+
+/*!
+    @brief Open an NFT bundle.
+    @param filename Path to the bundle.
+    @param ext If non-NULL, a '.' character and this string will be appended to 'filename'.
+        Usually AR2_BUNDLE_EXT.
+    @result The open bundle, or NULL if the file does not exist or is not a valid bundle.
+        No error is logged if the file does not exist, so this may be used to look for a
+        bundle before falling back to separate files. Close with ar2CloseBundle.
+    @see ar2CloseBundle ar2CloseBundle
+ */
+AR2_EXTERN AR2BundleT     *ar2OpenBundle   ( const char *filename, const char *ext );
+
+/*!
+    @brief Close an NFT bundle.
+    @details
+        Image sets read from the bundle remain valid; the file is unmapped once they have
+        also been freed. The bundle's reference count is not atomic, so a bundle must not
+        be closed on one thread while image sets read from it are read or freed on another.
+    @param bundle_p Pointer to the bundle. On return, this location will be set to NULL.
+ */
+AR2_EXTERN void            ar2CloseBundle  ( AR2BundleT **bundle_p );
+
+/*!
+    @brief Get the image set held in an NFT bundle.
+    @details
+        The levels' pixels point into the mapped file. Free the image set with
+        ar2FreeImageSet as usual.
+    @param bundle The open bundle.
+    @result The image set, or NULL in case of error.
+ */
+AR2_EXTERN AR2ImageSetT   *ar2ReadImageSetFromBundle  ( AR2BundleT *bundle );
+
+/*!
+    @brief Get the feature set held in an NFT bundle.
+    @param bundle The open bundle.
+    @result The feature set, or NULL in case of error. Free with ar2FreeFeatureSet.
+ */
+AR2_EXTERN AR2FeatureSetT *ar2ReadFeatureSetFromBundle( AR2BundleT *bundle );
+
+/*!
+    @brief Find the KPM reference data held in an NFT bundle.
+    @details
+        The KPM data is a complete .fset3 dataset embedded in the bundle, which can be
+        loaded with kpmLoadRefDataSetAt.
+    @param bundle The open bundle.
+    @param offset_p On return, the offset in bytes of the KPM data from the start of the file.
+    @param size_p If non-NULL, on return, the size in bytes of the KPM data.
+    @result 0 if the bundle holds KPM data, or -1 if not.
+ */
+AR2_EXTERN int             ar2GetBundleKpmData( AR2BundleT *bundle, uint64_t *offset_p, uint64_t *size_p );
+
+/*!
+    @brief Find the KPM reference data held in an NFT bundle file, without opening the bundle.
+    @details
+        As ar2GetBundleKpmData, but reads only the bundle's header, so is cheap to call when
+        only the KPM data is wanted.
+    @param filename Path to the bundle.
+    @param ext If non-NULL, a '.' character and this string will be appended to 'filename'.
+        Usually AR2_BUNDLE_EXT.
+    @param offset_p On return, the offset in bytes of the KPM data from the start of the file.
+    @param size_p If non-NULL, on return, the size in bytes of the KPM data.
+    @result 0 if the bundle holds KPM data, or -1 if not, or if the file does not exist or is
+        not a valid bundle. No error is logged if the file does not exist.
+    @see ar2GetBundleKpmData ar2GetBundleKpmData
+ */
+AR2_EXTERN int             ar2ReadBundleKpmLocation( const char *filename, const char *ext, uint64_t *offset_p, uint64_t *size_p );
+
+/*!
+    @brief Write an NFT bundle.
+    @details
+        The bundle is specific to the byte order of the platform that wrote it.
+    @param filename Path to the bundle.
+    @param ext If non-NULL, a '.' character and this string will be appended to 'filename'.
+        Usually AR2_BUNDLE_EXT.
+    @param imageSet The image set. Must be a luma (non-adaptive template) image set.
+    @param featureSet The feature set.
+    @param kpmData If non-NULL, the contents of a .fset3 file as written by kpmSaveRefDataSetV2.
+    @param kpmDataSize Size in bytes of kpmData.
+    @result 0 if the bundle was written, or -1 in case of error.
+ */
+AR2_EXTERN int             ar2WriteBundle  ( const char *filename, const char *ext, AR2ImageSetT *imageSet, AR2FeatureSetT *featureSet,
+                                             const void *kpmData, size_t kpmDataSize );
+
+#ifdef __cplusplus
+}
+#endif
+#endif
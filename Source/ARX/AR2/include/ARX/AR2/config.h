@@ -121,6 +121,11 @@ extern "C" {
 
 
 
+/* matching.c */
+#define    AR2_SEARCH_PYRAMID_LEVEL_MAX             4           // Maximum number of search pyramid levels, including the full-size image.
+#define    AR2_SEARCH_PYRAMID_TEMPLATE_MIN          5           // Smallest template size (in pixels) worth matching on a pyramid level.
+#define    AR2_SEARCH_PYRAMID_REFINE_SIZE           2           // Radius of the search around each candidate when moving down a pyramid level.
+
 /* tracking.c */
 #define    AR2_TRACKING_SURFACE_MAX                 10          // Maximum number of surfaces per surface set (i.e. maximum number of discrete surfaces with fixed relationship to each other able to be combined into a surface set.)
 #define    AR2_TRACKING_CANDIDATE_MAX               200         // Maximum number of candidate feature points.
@@ -76,11 +76,21 @@ typedef struct {
 } AR2FeatureSetT;
 
 
+#define AR2_GEN_FEATURE_MAP_DEFAULT_THREAD_NUM    -1  // One thread per CPU.
+
+// As ar2GenFeatureMap2() with threadNum AR2_GEN_FEATURE_MAP_DEFAULT_THREAD_NUM.
 AR2_EXTERN AR2FeatureMapT *ar2GenFeatureMap( AR2ImageT *image,
                                   int ts1, int ts2,
                                   int search_size1, int search_size2,
                                   float  max_sim_thresh, float  sd_thresh );
 
+// Generates the map on threadNum threads, the calling thread included. Callers already
+// running several of these at once should divide the CPUs between them.
+AR2_EXTERN AR2FeatureMapT *ar2GenFeatureMap2( AR2ImageT *image,
+                                  int ts1, int ts2,
+                                  int search_size1, int search_size2,
+                                  float  max_sim_thresh, float  sd_thresh, int threadNum );
+
 AR2_EXTERN AR2FeatureMapT *ar2ReadFeatureMap( char *filename, char *ext );
 
 AR2_EXTERN int ar2SaveFeatureMap( char *filename, char *ext, AR2FeatureMapT *featureMap );
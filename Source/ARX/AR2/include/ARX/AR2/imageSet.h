@@ -64,6 +64,7 @@ typedef struct {
 typedef struct {
     AR2ImageT   **scale;
     int32_t       num;
+    struct _AR2BundleT *bundle;  // If non-NULL, the levels' pixels point into this NFT bundle rather than into allocated memory.
 } AR2ImageSetT;
 
 /*   image.c   */
@@ -74,6 +74,18 @@ typedef struct {
 #endif
 
 
+// Luma image at successively halved resolutions, built once per frame and shared by every template
+// searched in it. img[0] is the frame itself; the other levels are owned by the pyramid.
+typedef struct {
+    int              num;                                       /* number of levels built for the current frame */
+    int              levelMax;                                  /* number of levels allocated */
+    int              xsize[AR2_SEARCH_PYRAMID_LEVEL_MAX];
+    int              ysize[AR2_SEARCH_PYRAMID_LEVEL_MAX];
+    ARUint8         *img[AR2_SEARCH_PYRAMID_LEVEL_MAX];
+    AR_PIXEL_FORMAT  pixFormat;
+} AR2SearchPyramidT;
+
+
 typedef struct {
     int     snum;
     int     level;
@@ -118,6 +130,53 @@ AR_EXTERN int ar2GetBestMatching2( ARUint8 *img, ARUint8 *mfImage, int xsize, in
 AR_EXTERN int ar2GetBestMatching2(void);
 #endif
 
+/*!
+    @brief Allocate a search pyramid for frames of a given size.
+    @param xsize Width of the frames that will be set.
+    @param ysize Height of the frames that will be set.
+    @result The pyramid, or NULL in case of error. Free with ar2DeleteSearchPyramid().
+    @see ar2SetSearchPyramidImage
+ */
+AR_EXTERN AR2SearchPyramidT *ar2CreateSearchPyramid( int xsize, int ysize );
+
+AR_EXTERN int ar2DeleteSearchPyramid( AR2SearchPyramidT **pyramid );
+
+/*!
+    @brief Build the levels of a search pyramid from a frame.
+    @details The frame is referenced, not copied, so must remain valid while the pyramid is searched.
+        Only luma frames (AR_PIXEL_FORMAT_MONO, _420v, _420f and _NV21) are downsampled; for other
+        formats the pyramid holds just the frame, and ar2GetBestMatchingPyramid() falls back to
+        ar2GetBestMatching().
+    @param pyramid Pyramid created by ar2CreateSearchPyramid() for frames of this size.
+    @param img Incoming frame.
+    @param pixFormat Pixel format of img.
+    @result -1 in case of error, or 0 otherwise.
+ */
+AR_EXTERN int ar2SetSearchPyramidImage( AR2SearchPyramidT *pyramid, ARUint8 *img, AR_PIXEL_FORMAT pixFormat );
+
+/*!
+    @brief Get best match for a candidate feature template, searching coarse to fine on a pyramid.
+    @details The template is first located on the coarsest pyramid level at which the search radius
+        is no more than a few pixels, then refined one level at a time, and finally at full resolution
+        exactly as ar2GetBestMatching() does. The cost is therefore nearly independent of the search
+        radius. Small radii, for which the pyramid would not save work, are searched with
+        ar2GetBestMatching().
+    @param pyramid Pyramid built for the current frame by ar2SetSearchPyramidImage().
+    @param mfImage Buffer the size of the frame, to provide working memory.
+    @param mtemp Template undergoing matching.
+    @param rx search radius in x dimension.
+    @param ry search radius in y dimension.
+    @param search screen coordinates (second dimension is x and y) for up to three previous positions of this feature.
+    @param bx On return, x position of best candidate.
+    @param by On return, y position of best candidate.
+    @param val On return, the quality of the match of the best candidate.
+    @result -1 in case of error or no match, or 0 otherwise.
+    @see ar2GetBestMatching
+ */
+AR_EXTERN int ar2GetBestMatchingPyramid( AR2SearchPyramidT *pyramid, ARUint8 *mfImage,
+                         AR2TemplateT *mtemp, int rx, int ry,
+                         int search[3][2], int *bx, int *by, float *val);
+
 AR_EXTERN int ar2GetResolution( const ARParamLT *cparamLT, const float  trans[3][4], const float  pos[2], float  dpi[2] );
 AR_EXTERN int ar2GetResolution2( const ARParam *cparam, const float  trans[3][4], const float  pos[2], float  dpi[2] );
 
@@ -60,6 +60,9 @@
 
 #define    AR2_TRACKING_DEFAULT_THREAD_NUM    -1
 
+#define    AR2_SEARCH_MODE_WINDOW              0
+#define    AR2_SEARCH_MODE_PYRAMID             1
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -93,21 +96,45 @@ typedef struct {
 } AR2Tracking2DResultT;
 
 
+// One template to be matched by ar2Tracking2dTemplate(), and its result.
+typedef struct {
+    AR2TemplateCandidateT *candidate;
+    AR2Tracking2DResultT   result;
+    int                    ret;
+} AR2Tracking2DJobT;
+
 typedef struct _AR2HandleT           AR2HandleT;
 typedef struct _AR2Tracking2DParamT  AR2Tracking2DParamT;
 
+// Scratch for tracking one surface set, so that several surface sets can be tracked at once.
+typedef struct {
+    float                     wtrans1[AR2_TRACKING_SURFACE_MAX][3][4];
+    float                     wtrans2[AR2_TRACKING_SURFACE_MAX][3][4];
+    float                     wtrans3[AR2_TRACKING_SURFACE_MAX][3][4];
+    float                     pos[AR2_SEARCH_FEATURE_MAX+AR2_THREAD_MAX][2];
+    float                     pos2d[AR2_SEARCH_FEATURE_MAX][2];
+    float                     pos3d[AR2_SEARCH_FEATURE_MAX][3];
+    AR2TemplateCandidateT     candidate[AR2_TRACKING_CANDIDATE_MAX+1];
+    AR2TemplateCandidateT     candidate2[AR2_TRACKING_CANDIDATE_MAX+1];
+    AR2TemplateCandidateT     usedFeature[AR2_SEARCH_FEATURE_MAX];
+    ICPHandleT               *icpHandle;
+} AR2TrackingStateT;
+
 // Structure to pass parameters to threads spawned to run ar2Tracking2d().
+// Each thread either tracks a whole surface set (trans != NULL), or matches templates of
+// surfaceSet taken from the handle's job queue until it pops NULL.
 struct _AR2Tracking2DParamT {
     struct _AR2HandleT      *ar2Handle;  // Reference to parent AR2HandleT.
     AR2SurfaceSetT          *surfaceSet;
-    AR2TemplateCandidateT   *candidate;
+    AR2TrackingStateT       *state;      // Scratch for tracking surfaceSet.
     ARUint8                 *dataPtr;    // Input image.
     ARUint8                 *mfImage;    // (Internally allocated buffer same size as input image).
     AR2TemplateT            *templ;
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
     AR2Template2T           *templ2;
 #endif
-    AR2Tracking2DResultT     result;
+    float                  (*trans)[4];  // Pose of surfaceSet, when tracking a whole surface set.
+    float                    err;
     int                      ret;
 };
 
@@ -116,31 +143,26 @@ struct _AR2HandleT {
     int               xsize;
     int               ysize;
     ARParamLT        *cparamLT;
-    ICPHandleT       *icpHandle;
     AR_PIXEL_FORMAT   pixFormat;
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
     int               blurMethod;
     int               blurLevel;
 #endif
     int               searchSize;
+    int               searchMode;
     int               templateSize1;
     int               templateSize2;
     int               searchFeatureNum;
     float             simThresh;
     float             trackingThresh;
     /*--------------------------------*/
-    float                     wtrans1[AR2_TRACKING_SURFACE_MAX][3][4];
-    float                     wtrans2[AR2_TRACKING_SURFACE_MAX][3][4];
-    float                     wtrans3[AR2_TRACKING_SURFACE_MAX][3][4];
-    float                     pos[AR2_SEARCH_FEATURE_MAX+AR2_THREAD_MAX][2];
-    float                     pos2d[AR2_SEARCH_FEATURE_MAX][2];
-    float                     pos3d[AR2_SEARCH_FEATURE_MAX][3];
-    AR2TemplateCandidateT     candidate[AR2_TRACKING_CANDIDATE_MAX+1];
-    AR2TemplateCandidateT     candidate2[AR2_TRACKING_CANDIDATE_MAX+1];
-    AR2TemplateCandidateT     usedFeature[AR2_SEARCH_FEATURE_MAX];
     int                       threadNum;
     struct _AR2Tracking2DParamT       arg[AR2_THREAD_MAX];
     THREAD_HANDLE_T          *threadHandle[AR2_THREAD_MAX];
+    AR2TrackingStateT        *state[AR2_THREAD_MAX];    // One per surface set tracked at once. ar2Tracking() uses state[0].
+    THREAD_QUEUE_T           *jobQueue;                 // Templates waiting to be matched, then NULL for each thread when there are no more.
+    THREAD_QUEUE_T           *doneQueue;                // Templates that have been matched.
+    AR2SearchPyramidT        *searchPyramid;            // Built once per frame when searchMode is AR2_SEARCH_MODE_PYRAMID.
 };
 
 
@@ -169,7 +191,33 @@ struct _AR2HandleT {
  */
 int             ar2Tracking              ( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet,
                                            ARUint8 *dataPtr, float  trans[3][4], float  *err );
+
+/*!
+    Perform NFT texture tracking of several surface sets on an image frame.
+        The result is the same as calling ar2Tracking() for each surface set in turn, but
+        when more than one surface set is being tracked, they are tracked at the same time,
+        one per tracking thread, rather than sharing the threads between the templates of
+        one surface set at a time. Surface sets that are not being tracked (i.e. for which
+        ar2SetInitTrans() has not been called since tracking was last lost) are skipped.
+    @param ar2Handle Tracking settings structure, as returned via ar2CreateHandle.
+    @param surfaceSet Array of num surface sets, as returned via ar2ReadSurfaceSet. All must
+        be different.
+    @param num Number of surface sets.
+    @param dataPtr Pointer to image data on which tracking will be performed.
+    @param trans Array of num float[3][4] arrays which will be filled out with the poses.
+    @param err Array of num floats which will be filled out with the pose error values.
+    @param result Array of num ints which will be filled out with the value ar2Tracking()
+        would have returned for each surface set.
+    @result 0 if successful, or -1 in case of a bad parameter.
+    @see ar2Tracking ar2Tracking
+ */
+int             ar2TrackingMulti         ( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet[], int num,
+                                           ARUint8 *dataPtr, float  trans[][3][4], float  err[], int result[] );
+
 void           *ar2Tracking2d            ( THREAD_HANDLE_T *threadHandle );
+int             ar2Tracking2dTemplate    ( AR2Tracking2DParamT *arg, AR2Tracking2DJobT *job );
+int             ar2TrackingSurfaceSet    ( AR2HandleT *ar2Handle, AR2TrackingStateT *state, AR2SurfaceSetT *surfaceSet,
+                                           ARUint8 *dataPtr, float  trans[3][4], float  *err, AR2Tracking2DParamT *arg );
 /*
 int             ar2Tracking2d            ( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet,
                                            AR2TemplateCandidateT *candidate,
@@ -180,6 +228,8 @@ int             ar2Tracking2d            ( AR2HandleT *ar2Handle, AR2SurfaceSetT
     Read an NFT texture tracking surface set from file.
         Allocates, initialises and reads the contents of a surface set from storage.
         The surface set is usually generated by the genTexData utility, or equivalent.
+        Where a surface's NFT bundle (extension AR2_BUNDLE_EXT) exists, its image and feature
+        sets are taken from the bundle rather than from the .iset and .fset files.
         
         Once the surface set is no longer required, it should be disposed of by calling ar2FreeSurfaceSet().
     @param filename Pathname of the surface set to be loaded, less any filename extension.
@@ -283,13 +333,14 @@ int             ar2GetBlurLevel          ( AR2HandleT *ar2Handle, int *blurLevel
         A larger search window allows for greater movement of a feature between frames
         (e.g. faster optical motion, or same degree of optical motion but at a higher frame
         resolution), at the cost of greater search effort. Search effort increases with
-        the square of the search radius.
+        the square of the search radius, unless the search mode is AR2_SEARCH_MODE_PYRAMID.
  
         Default value is AR2_DEFAULT_SEARCH_SIZE, as defined in &lt;AR2/config.h&gt;
     @param ar2Handle Tracking settings structure, as returned via ar2CreateHandle.
     @param searchSize The new search size to use.
     @result -1 in case of error, or 0 otherwise.
     @see ar2GetSearchSize ar2GetSearchSize
+    @see ar2SetSearchMode ar2SetSearchMode
  */
 int             ar2SetSearchSize         ( AR2HandleT *ar2Handle, int  searchSize        );
 
@@ -305,6 +356,38 @@ int             ar2SetSearchSize         ( AR2HandleT *ar2Handle, int  searchSiz
  */
 int             ar2GetSearchSize         ( AR2HandleT *ar2Handle, int *searchSize        );
 
+/*!
+    Set how feature points are searched for within the search window.
+        With AR2_SEARCH_MODE_WINDOW, each feature is scored on a grid across the whole search
+        window, and the best few positions are refined. Search effort increases with the square
+        of the search radius.
+ 
+        With AR2_SEARCH_MODE_PYRAMID, a half-, quarter- and eighth-size copy of each video frame
+        is made, and each feature is located coarse to fine, down to the full-size frame. Search
+        effort then barely depends on the search radius, so large search sizes (e.g. to follow
+        fast motion) become affordable. Small search sizes are searched as with
+        AR2_SEARCH_MODE_WINDOW. Only luma frames (AR_PIXEL_FORMAT_MONO, _420v, _420f and
+        _NV21) are searched on a pyramid; other pixel formats always use AR2_SEARCH_MODE_WINDOW.
+ 
+        Default value is AR2_SEARCH_MODE_WINDOW.
+    @param ar2Handle Tracking settings structure, as returned via ar2CreateHandle.
+    @param searchMode AR2_SEARCH_MODE_WINDOW or AR2_SEARCH_MODE_PYRAMID.
+    @result -1 in case of error, or 0 otherwise.
+    @see ar2GetSearchMode ar2GetSearchMode
+    @see ar2SetSearchSize ar2SetSearchSize
+ */
+int             ar2SetSearchMode         ( AR2HandleT *ar2Handle, int  searchMode        );
+
+/*!
+    Get how feature points are searched for within the search window.
+        See the discussion under ar2SetSearchMode.
+    @param ar2Handle Tracking settings structure, as returned via ar2CreateHandle.
+    @param searchMode Pointer to an int, which on return will be filled with the current search mode.
+    @result -1 in case of error, or 0 otherwise.
+    @see ar2SetSearchMode ar2SetSearchMode
+ */
+int             ar2GetSearchMode         ( AR2HandleT *ar2Handle, int *searchMode        );
+
 /*!
     @brief
     @param ar2Handle Tracking settings structure, as returned via ar2CreateHandle.
@@ -44,6 +44,19 @@
 #include <ARX/AR2/config.h>
 #include <ARX/AR2/template.h>
 
+// Define AR2_MATCHING_DISABLE_SIMD to build the scalar code only, as matching_test does to check the vector kernels against it.
+#if AR2_MATCHING_DISABLE_SIMD
+#  define  AR2_MATCHING_SIMD  0
+#elif AR2_TEMP_SCALE == 2 && (HAVE_ARM_NEON || HAVE_ARM64_NEON)
+#  include <arm_neon.h>
+#  define  AR2_MATCHING_SIMD  1
+#elif AR2_TEMP_SCALE == 2 && HAVE_INTEL_SIMD
+#  include <emmintrin.h> // SSE2.
+#  define  AR2_MATCHING_SIMD  1
+#else
+#  define  AR2_MATCHING_SIMD  0
+#endif
+
 #define  USE_SEARCH1    1
 #define  USE_SEARCH2    1
 #define  USE_SEARCH3    1
@@ -52,11 +65,40 @@
 #define  KEEP_NUM       3
 
 
+// Template laid out in rows padded to a multiple of 8 pixels, for the vector kernels and for the
+// coarse levels of the search pyramid. mask is 0x00FF for valid pixels and 0 for null and padding
+// pixels, so that ANDing it with 16 bytes of a luma image row both picks out every second pixel and
+// drops the pixels the template ignores.
+typedef struct {
+    int          xsize, ysize;      /* template size */
+    int          groups;            /* 8-pixel groups per row */
+    int          xoff, yoff;        /* offset from template centre to first pixel, in template pixels */
+    int          vlen;
+    int          sum;
+    int          validNum;
+    ARUint16    *img;               /* template, 0 at null pixels */
+    ARUint16    *mask;
+} AR2TemplateRowsT;
+
+static void ar2SetTemplateRows         ( AR2TemplateRowsT *trows, const ARUint16 *img1, int xsize, int ysize, int xoff, int yoff );
+static void ar2SetTemplateRowsHalf     ( AR2TemplateRowsT *trows, const AR2TemplateRowsT *src );
+static void ar2FreeTemplateRows        ( AR2TemplateRowsT *trows );
+static int  ar2GetMatchingValue        ( int sum1, int sum2, int sum3, int sum, int vlen, int validNum );
+static int  ar2GetMatchingLevel        ( ARUint8 *img, int xsize, int ysize, const AR2TemplateRowsT *trows,
+                                         int x, int y, int *val );
+#if AR2_MATCHING_SIMD
+static void ar2GetMatchingSums2        ( const ARUint8 *p, int xsize, const AR2TemplateRowsT *trows,
+                                         int *sum1, int *sum2, int *sum3 );
+#endif
+
 static int ar2GetBestMatchingSubFine   ( ARUint8 *img, int xsize, int ysize, AR_PIXEL_FORMAT pixFormat,
-                                         AR2TemplateT *mtemp, int sx, int sy, int *val);
+                                         AR2TemplateT *mtemp, AR2TemplateRowsT *trows, int sx, int sy, int *val);
+static int ar2GetBestMatchingWindow    ( ARUint8 *img, int xsize, int ysize, AR_PIXEL_FORMAT pixFormat,
+                                         AR2TemplateT *mtemp, AR2TemplateRowsT *trows, int cx, int cy, int r,
+                                         int *bx, int *by, int *wval2 );
 static void updateCandidate            ( int x, int y, int wval,
                                          int *keep_num, int cx[KEEP_NUM], int cy[KEEP_NUM], int cval[KEEP_NUM] );
-#if 1
+#if !AR2_MATCHING_SIMD
 static int ar2GetBestMatchingSubFineOpt( ARUint8 *img, int xsize, int ysize, int sx1, int sy1, AR2TemplateT *mtemp,
                                          ARUint32 *subImage1, ARUint32 *subImage2, int sx2, int sy2, int *val);
 #endif
@@ -93,7 +135,9 @@ int ar2GetBestMatching( ARUint8 *img, ARUint8 *mfImage, int xsize, int ysize, AR
     int              ii;
     int              ret;
     ARUint8         *pmf;
-#if 0
+    AR2TemplateRowsT *trows;
+#if AR2_MATCHING_SIMD
+    AR2TemplateRowsT  trows0;
 #else
     ARUint32   *subImage1, *p11, *p12, w1;
     ARUint32   *subImage2, *p21, *p22, w2;
@@ -102,6 +146,15 @@ int ar2GetBestMatching( ARUint8 *img, ARUint8 *mfImage, int xsize, int ysize, AR
     ARUint8    *p3, *p4;
 #endif
 
+    // Luma images are matched with vector kernels where available.
+    trows = NULL;
+#if AR2_MATCHING_SIMD
+    if( pixFormat == AR_PIXEL_FORMAT_MONO || pixFormat == AR_PIXEL_FORMAT_420v || pixFormat == AR_PIXEL_FORMAT_420f || pixFormat == AR_PIXEL_FORMAT_NV21 ) {
+        ar2SetTemplateRows( &trows0, mtemp->img1, mtemp->xsize, mtemp->ysize, -(mtemp->xts1), -(mtemp->yts1) );
+        trows = &trows0;
+    }
+#endif
+
     // First pass: initialise.
     yts1 = mtemp->yts1;
     yts2 = mtemp->yts2;
@@ -138,7 +191,12 @@ int ar2GetBestMatching( ARUint8 *img, ARUint8 *mfImage, int xsize, int ysize, AR
     for( ii = 0; ii < 3; ii++ ) {      
         if( search_flag[ii] == 0 ) continue;
         if( search[ii][0] < 0 ) {
-            if( ret ) return -1; // If we haven't got at least one starting point for a search, bail out.
+            if( ret ) { // If we haven't got at least one starting point for a search, bail out.
+#if AR2_MATCHING_SIMD
+                if( trows ) ar2FreeTemplateRows( trows );
+#endif
+                return -1;
+            }
             else    break;
         }
 
@@ -153,7 +211,7 @@ int ar2GetBestMatching( ARUint8 *img, ARUint8 *mfImage, int xsize, int ysize, AR
                 if( i + mtemp->xts2*AR2_TEMP_SCALE >= xsize ) break;
                 if( mfImage[j*xsize + i] ) continue; // Skip pixels already matched.
                 mfImage[j*xsize + i] = 1; // Mark this pixel as matched.
-                if( ar2GetBestMatchingSubFine(img, xsize, ysize, pixFormat, mtemp, i, j, &wval) < 0 ) {
+                if( ar2GetBestMatchingSubFine(img, xsize, ysize, pixFormat, mtemp, trows, i, j, &wval) < 0 ) {
                     continue;
                 }
                 ret = 0;
@@ -165,27 +223,14 @@ int ar2GetBestMatching( ARUint8 *img, ARUint8 *mfImage, int xsize, int ysize, AR
     // Third pass. Determine best candidate.
     wval2 = 0;
     ret = -1;
-#if 0
+#if AR2_MATCHING_SIMD
     for(l = 0; l < keep_num; l++) {
-        for( j = cy[l] - SKIP_INTERVAL; j <= cy[l] + SKIP_INTERVAL; j++ ) {
-            if( j - mtemp->yts1*AR2_TEMP_SCALE <  0     ) continue;
-            if( j + mtemp->yts2*AR2_TEMP_SCALE >= ysize ) break;
-            for( i = cx[l] - SKIP_INTERVAL; i <= cx[l] + SKIP_INTERVAL; i++ ) {
-                if( i - mtemp->xts1*AR2_TEMP_SCALE <  0     ) continue;
-                if( i + mtemp->xts2*AR2_TEMP_SCALE >= xsize ) break;
-                if( ar2GetBestMatchingSubFine(img, xsize, ysize, pixFormat, mtemp, i, j, &wval) < 0 ) {
-                    continue;
-                }
-                if( wval > wval2 ) {
-                    *bx    =  i;
-                    *by    =  j;
-                     wval2 =  wval;
-                    *val   = (float)wval / 10000.0f;
-                    ret = 0;
-                }
-            }
+        if( ar2GetBestMatchingWindow(img, xsize, ysize, pixFormat, mtemp, trows, cx[l], cy[l], SKIP_INTERVAL, bx, by, &wval2) == 0 ) {
+            *val = (float)wval2 / 10000.0f;
+            ret = 0;
         }
     }
+    if( trows ) ar2FreeTemplateRows( trows );
 #else
     arMalloc( subImage1, ARUint32, ( (mtemp->xsize + 1)*AR2_TEMP_SCALE + (SKIP_INTERVAL*2)) * ((mtemp->ysize + 1)*AR2_TEMP_SCALE + (SKIP_INTERVAL*2) ) );
     arMalloc( subImage2, ARUint32, ( (mtemp->xsize + 1)*AR2_TEMP_SCALE + (SKIP_INTERVAL*2)) * ((mtemp->ysize + 1)*AR2_TEMP_SCALE + (SKIP_INTERVAL*2) ) );
@@ -197,23 +242,9 @@ int ar2GetBestMatching( ARUint8 *img, ARUint8 *mfImage, int xsize, int ysize, AR
          || cy[l] + SKIP_INTERVAL + mtemp->yts2*AR2_TEMP_SCALE >= ysize
          || cx[l] - SKIP_INTERVAL - mtemp->xts1*AR2_TEMP_SCALE < 0
          || cx[l] + SKIP_INTERVAL + mtemp->xts2*AR2_TEMP_SCALE >= xsize ) {
-            for( j = cy[l] - SKIP_INTERVAL; j <= cy[l] + SKIP_INTERVAL; j++ ) {
-                if( j - mtemp->yts1*AR2_TEMP_SCALE <  0     ) continue;
-                if( j + mtemp->yts2*AR2_TEMP_SCALE >= ysize ) break;
-                for( i = cx[l] - SKIP_INTERVAL; i <= cx[l] + SKIP_INTERVAL; i++ ) {
-                    if( i - mtemp->xts1*AR2_TEMP_SCALE <  0     ) continue;
-                    if( i + mtemp->xts2*AR2_TEMP_SCALE >= xsize ) break;
-                    if( ar2GetBestMatchingSubFine(img, xsize, ysize, pixFormat, mtemp, i, j, &wval) < 0 ) {
-                        continue;
-                    }
-                    if( wval > wval2 ) {
-                        *bx    =  i;
-                        *by    =  j;
-                        wval2 =  wval;
-                        *val   = (float)wval / 10000.0f;
-                        ret = 0;
-                    }
-                }
+            if( ar2GetBestMatchingWindow(img, xsize, ysize, pixFormat, mtemp, trows, cx[l], cy[l], SKIP_INTERVAL, bx, by, &wval2) == 0 ) {
+                *val = (float)wval2 / 10000.0f;
+                ret = 0;
             }
         }
         else {
@@ -272,18 +303,270 @@ int ar2GetBestMatching( ARUint8 *img, ARUint8 *mfImage, int xsize, int ysize, AR
     return ret;
 }
 
+AR2SearchPyramidT *ar2CreateSearchPyramid( int xsize, int ysize )
+{
+    AR2SearchPyramidT   *pyramid;
+    int                  l;
+
+    if( xsize <= 0 || ysize <= 0 ) {
+        ARLOGe("Error: invalid search pyramid size %dx%d.\n", xsize, ysize);
+        return NULL;
+    }
+
+    arMalloc( pyramid, AR2SearchPyramidT, 1 );
+    pyramid->xsize[0]  = xsize;
+    pyramid->ysize[0]  = ysize;
+    pyramid->img[0]    = NULL;
+    pyramid->pixFormat = AR_PIXEL_FORMAT_INVALID;
+    pyramid->num       = 0;
+    for( l = 1; l < AR2_SEARCH_PYRAMID_LEVEL_MAX; l++ ) {
+        pyramid->xsize[l] = pyramid->xsize[l - 1] / 2;
+        pyramid->ysize[l] = pyramid->ysize[l - 1] / 2;
+        if( pyramid->xsize[l] < AR2_SEARCH_PYRAMID_TEMPLATE_MIN*2 || pyramid->ysize[l] < AR2_SEARCH_PYRAMID_TEMPLATE_MIN*2 ) break;
+        arMalloc( pyramid->img[l], ARUint8, pyramid->xsize[l]*pyramid->ysize[l] );
+    }
+    pyramid->levelMax = l;
+
+    return pyramid;
+}
+
+int ar2DeleteSearchPyramid( AR2SearchPyramidT **pyramid )
+{
+    int     l;
+
+    if( pyramid == NULL || *pyramid == NULL ) return -1;
+
+    for( l = 1; l < (*pyramid)->levelMax; l++ ) free( (*pyramid)->img[l] );
+    free( *pyramid );
+    *pyramid = NULL;
+
+    return 0;
+}
+
+int ar2SetSearchPyramidImage( AR2SearchPyramidT *pyramid, ARUint8 *img, AR_PIXEL_FORMAT pixFormat )
+{
+    ARUint8     *p1, *p2, *q;
+    int          xsize, ysize;
+    int          i, j, l;
+
+    if( pyramid == NULL || img == NULL ) return -1;
+
+    pyramid->img[0]    = img;
+    pyramid->pixFormat = pixFormat;
+    if( pixFormat != AR_PIXEL_FORMAT_MONO && pixFormat != AR_PIXEL_FORMAT_420v && pixFormat != AR_PIXEL_FORMAT_420f && pixFormat != AR_PIXEL_FORMAT_NV21 ) {
+        pyramid->num = 1;
+        return 0;
+    }
+
+    // Each level is the 2x2 box average of the one below. For the bi-planar formats the luma plane comes first.
+    for( l = 1; l < pyramid->levelMax; l++ ) {
+        xsize = pyramid->xsize[l];
+        ysize = pyramid->ysize[l];
+        q = pyramid->img[l];
+        for( j = 0; j < ysize; j++ ) {
+            p1 = &(pyramid->img[l - 1][j*2*pyramid->xsize[l - 1]]);
+            p2 = p1 + pyramid->xsize[l - 1];
+            for( i = 0; i < xsize; i++ ) {
+                *(q++) = (ARUint8)((p1[0] + p1[1] + p2[0] + p2[1] + 2) >> 2);
+                p1 += 2;
+                p2 += 2;
+            }
+        }
+    }
+    pyramid->num = pyramid->levelMax;
+
+    return 0;
+}
+
+int ar2GetBestMatchingPyramid( AR2SearchPyramidT *pyramid, ARUint8 *mfImage,
+                               AR2TemplateT *mtemp, int rx, int ry,
+                               int search[3][2], int *bx, int *by, float *val)
+{
+    int              search_flag[] = {USE_SEARCH1, USE_SEARCH2, USE_SEARCH3};
+    AR2TemplateRowsT trows[AR2_SEARCH_PYRAMID_LEVEL_MAX];
+    AR2TemplateRowsT *trows0;
+    ARUint8         *img;
+    int              xsize, ysize;
+    int              top, r;
+    int              px, py, sx, sy, ex, ey, rxt, ryt;
+    int              keep_num;
+    int              cx[KEEP_NUM], cy[KEEP_NUM];
+    int              cval[KEEP_NUM];
+    int              wval, wval2;
+    int              found;
+    int              i, j, k, l;
+    int              ii;
+    int              ret;
+
+    if( pyramid == NULL || pyramid->img[0] == NULL ) return -1;
+
+    // Choose the coarsest level on which the search radius is within the spacing of ar2GetBestMatching()'s
+    // search grid, as long as the template is still big enough there to be matched reliably. Level 1 is
+    // matched with the template as it is, since it is sampled every AR2_TEMP_SCALE pixels.
+    r = (rx > ry ? rx : ry);
+    top = 0;
+    if( pyramid->num > 2 && (r >> 1) > SKIP_INTERVAL ) {
+        ar2SetTemplateRows( &trows[1], mtemp->img1, mtemp->xsize, mtemp->ysize, -(mtemp->xts1), -(mtemp->yts1) );
+        top = 1;
+        while( top + 1 < pyramid->num && (r >> top) > SKIP_INTERVAL ) {
+            ar2SetTemplateRowsHalf( &trows[top + 1], &trows[top] );
+            if( trows[top + 1].xsize < AR2_SEARCH_PYRAMID_TEMPLATE_MIN
+             || trows[top + 1].ysize < AR2_SEARCH_PYRAMID_TEMPLATE_MIN
+             || trows[top + 1].vlen == 0 ) {
+                ar2FreeTemplateRows( &trows[top + 1] );
+                break;
+            }
+            top++;
+        }
+        if( top == 1 ) {
+            ar2FreeTemplateRows( &trows[1] );
+            top = 0;
+        }
+    }
+    if( top == 0 ) {
+        // Nothing to gain from the pyramid.
+        return ar2GetBestMatching( pyramid->img[0], mfImage, pyramid->xsize[0], pyramid->ysize[0], pyramid->pixFormat,
+                                   mtemp, rx, ry, search, bx, by, val );
+    }
+
+    // First pass: search every position within the scaled radius on the top level, for the best KEEP_NUM candidates.
+    img   = pyramid->img[top];
+    xsize = pyramid->xsize[top];
+    ysize = pyramid->ysize[top];
+    rxt   = (rx + (1 << top) - 1) >> top;
+    ryt   = (ry + (1 << top) - 1) >> top;
+    for( ii = 0; ii < 3; ii++ ) {
+        if( search_flag[ii] == 0 ) continue;
+        if( search[ii][0] < 0 ) break;
+        px = search[ii][0] >> top;
+        py = search[ii][1] >> top;
+        sx = (px - rxt < 0      ? 0         : px - rxt);
+        ex = (px + rxt >= xsize ? xsize - 1 : px + rxt);
+        sy = (py - ryt < 0      ? 0         : py - ryt);
+        ey = (py + ryt >= ysize ? ysize - 1 : py + ryt);
+        for( j = sy; j <= ey; j++ ) {
+            for( i = sx; i <= ex; i++ ) mfImage[j*xsize + i] = 0;
+        }
+    }
+    keep_num = 0;
+    for( ii = 0; ii < 3; ii++ ) {
+        if( search_flag[ii] == 0 ) continue;
+        if( search[ii][0] < 0 ) break;
+        px = search[ii][0] >> top;
+        py = search[ii][1] >> top;
+        for( j = py - ryt; j <= py + ryt; j++ ) {
+            if( j < 0 ) continue;
+            if( j >= ysize ) break;
+            for( i = px - rxt; i <= px + rxt; i++ ) {
+                if( i < 0 ) continue;
+                if( i >= xsize ) break;
+                if( mfImage[j*xsize + i] ) continue; // Skip positions already matched.
+                mfImage[j*xsize + i] = 1;
+                if( ar2GetMatchingLevel( img, xsize, ysize, &trows[top], i, j, &wval ) < 0 ) continue;
+                updateCandidate( i, j, wval, &keep_num, cx, cy, cval );
+            }
+        }
+    }
+
+    // Second pass: refine each candidate on the levels below, down to level 1.
+    for( k = top - 1; k >= 1; k-- ) {
+        for( l = 0; l < keep_num; l++ ) {
+            px = cx[l]*2;
+            py = cy[l]*2;
+            found = 0;
+            for( j = py - AR2_SEARCH_PYRAMID_REFINE_SIZE; j <= py + AR2_SEARCH_PYRAMID_REFINE_SIZE; j++ ) {
+                for( i = px - AR2_SEARCH_PYRAMID_REFINE_SIZE; i <= px + AR2_SEARCH_PYRAMID_REFINE_SIZE; i++ ) {
+                    if( ar2GetMatchingLevel( pyramid->img[k], pyramid->xsize[k], pyramid->ysize[k], &trows[k], i, j, &wval ) < 0 ) continue;
+                    if( !found || wval > cval[l] ) {
+                        cx[l]   = i;
+                        cy[l]   = j;
+                        cval[l] = wval;
+                        found = 1;
+                    }
+                }
+            }
+            if( !found ) {
+                cx[l] = px;
+                cy[l] = py;
+            }
+        }
+    }
+
+    // Third pass: determine best candidate at full resolution, where the level 1 template doubles as the
+    // vector kernels' layout of the full-size template. Level 1 has placed each candidate to within a
+    // pixel there, so only AR2_TEMP_SCALE pixels either side need be searched, once per distinct position.
+#if AR2_MATCHING_SIMD
+    trows0 = &trows[1];
+#else
+    trows0 = NULL;
+#endif
+    wval2 = 0;
+    ret = -1;
+    for( l = 0; l < keep_num; l++ ) {
+        for( k = 0; k < l; k++ ) {
+            if( cx[k] == cx[l] && cy[k] == cy[l] ) break;
+        }
+        if( k < l ) continue;
+        if( ar2GetBestMatchingWindow( pyramid->img[0], pyramid->xsize[0], pyramid->ysize[0], pyramid->pixFormat,
+                                      mtemp, trows0, cx[l]*2, cy[l]*2, AR2_TEMP_SCALE, bx, by, &wval2 ) == 0 ) {
+            *val = (float)wval2 / 10000.0f;
+            ret = 0;
+        }
+    }
+    for( k = 1; k <= top; k++ ) ar2FreeTemplateRows( &trows[k] );
+
+    return ret;
+}
+
+static int ar2GetBestMatchingWindow( ARUint8 *img, int xsize, int ysize, AR_PIXEL_FORMAT pixFormat,
+                                     AR2TemplateT *mtemp, AR2TemplateRowsT *trows, int cx, int cy, int r,
+                                     int *bx, int *by, int *wval2 )
+{
+    int     wval;
+    int     i, j;
+    int     ret;
+
+    // Score every position within r of (cx, cy), keeping the best that beats *wval2.
+    ret = -1;
+    for( j = cy - r; j <= cy + r; j++ ) {
+        if( j - mtemp->yts1*AR2_TEMP_SCALE <  0     ) continue;
+        if( j + mtemp->yts2*AR2_TEMP_SCALE >= ysize ) break;
+        for( i = cx - r; i <= cx + r; i++ ) {
+            if( i - mtemp->xts1*AR2_TEMP_SCALE <  0     ) continue;
+            if( i + mtemp->xts2*AR2_TEMP_SCALE >= xsize ) break;
+            if( ar2GetBestMatchingSubFine(img, xsize, ysize, pixFormat, mtemp, trows, i, j, &wval) < 0 ) {
+                continue;
+            }
+            if( wval > *wval2 ) {
+                *bx    = i;
+                *by    = j;
+                *wval2 = wval;
+                ret = 0;
+            }
+        }
+    }
+
+    return ret;
+}
+
 static int ar2GetBestMatchingSubFine( ARUint8 *img, int xsize, int ysize, AR_PIXEL_FORMAT pixFormat,
-                                      AR2TemplateT *mtemp, int sx, int sy, int *val)
+                                      AR2TemplateT *mtemp, AR2TemplateRowsT *trows, int sx, int sy, int *val)
 {
     ARUint16            *p1;
     ARUint8             *p2;
     int                  w;
     int                  sum1, sum2, sum3;
-    int                  vlen;
     int                  i, j;
 
     p1 = mtemp->img1;
     sum1 = sum2 = sum3 = 0;
+#if AR2_MATCHING_SIMD
+    // The kernel reads whole 16-byte groups, so the last row may only be used if they stay inside the image.
+    if( trows && (sy + (trows->yoff + trows->ysize - 1)*AR2_TEMP_SCALE)*xsize + sx + trows->xoff*AR2_TEMP_SCALE + trows->groups*16 <= xsize*ysize ) {
+        ar2GetMatchingSums2( &img[(sy + trows->yoff*AR2_TEMP_SCALE)*xsize + sx + trows->xoff*AR2_TEMP_SCALE], xsize, trows, &sum1, &sum2, &sum3 );
+    }
+    else
+#endif
     if( pixFormat == AR_PIXEL_FORMAT_MONO || pixFormat == AR_PIXEL_FORMAT_420v || pixFormat == AR_PIXEL_FORMAT_420f || pixFormat == AR_PIXEL_FORMAT_NV21 ) {
 #if 0
         for( j = -(mtemp->yts1); j <= mtemp->yts2; j++ ) {
@@ -396,15 +679,252 @@ static int ar2GetBestMatchingSubFine( ARUint8 *img, int xsize, int ysize, AR_PIX
         }
     }
     
-    sum3 -= sum1 * mtemp->sum / mtemp->validNum;
-    vlen = sum2 - sum1*sum1/mtemp->validNum;
-    if( vlen == 0 ) *val = 0;
-    else            *val = sum3 * 100 / mtemp->vlen * 100 / (int)sqrtf((float)vlen);
+    *val = ar2GetMatchingValue( sum1, sum2, sum3, mtemp->sum, mtemp->vlen, mtemp->validNum );
 
     return 0;
 }
 
-#if 1
+static int ar2GetMatchingValue( int sum1, int sum2, int sum3, int sum, int vlen, int validNum )
+{
+    int                  vlen2;
+
+    sum3 -= sum1 * sum / validNum;
+    vlen2 = sum2 - sum1*sum1/validNum;
+    if( vlen2 == 0 ) return 0;
+    else             return sum3 * 100 / vlen * 100 / (int)sqrtf((float)vlen2);
+}
+
+static void ar2SetTemplateRows( AR2TemplateRowsT *trows, const ARUint16 *img1, int xsize, int ysize, int xoff, int yoff )
+{
+    int                  rowLen;
+    int                  sum, sum2, k;
+    int                  i, j;
+
+    trows->xsize  = xsize;
+    trows->ysize  = ysize;
+    trows->groups = (xsize + 7) / 8;
+    trows->xoff   = xoff;
+    trows->yoff   = yoff;
+    rowLen = trows->groups*8;
+    arMalloc( trows->img,  ARUint16, rowLen*ysize );
+    arMalloc( trows->mask, ARUint16, rowLen*ysize );
+
+    sum = sum2 = k = 0;
+    for( j = 0; j < ysize; j++ ) {
+        for( i = 0; i < rowLen; i++ ) {
+            if( i < xsize && *img1 != AR2_TEMPLATE_NULL_PIXEL ) {
+                trows->img[j*rowLen + i]  = *img1;
+                trows->mask[j*rowLen + i] = 0x00FF;
+                sum  += *img1;
+                sum2 += *img1 * *img1;
+                k++;
+            }
+            else {
+                trows->img[j*rowLen + i]  = 0;
+                trows->mask[j*rowLen + i] = 0;
+            }
+            if( i < xsize ) img1++;
+        }
+    }
+    // As in ar2SetTemplateSub().
+    trows->sum      = sum;
+    trows->validNum = k;
+    trows->vlen     = (k == 0 ? 0 : (int)sqrtf((float)(sum2 - sum*sum/k)));
+}
+
+// Halve a template in each dimension, to match it on the next pyramid level. Each pixel is the
+// average of the valid pixels among the 2x2 it covers, or null if there are none.
+static void ar2SetTemplateRowsHalf( AR2TemplateRowsT *trows, const AR2TemplateRowsT *src )
+{
+    ARUint16            *img1;
+    int                  xoff, yoff, xsize, ysize;
+    int                  rowLen;
+    int                  sum, n, u, v;
+    int                  i, j, k, l;
+
+    xoff  = (src->xoff < 0 ? -((1 - src->xoff)/2) : src->xoff/2);
+    yoff  = (src->yoff < 0 ? -((1 - src->yoff)/2) : src->yoff/2);
+    xsize = (src->xoff + src->xsize + 1)/2 - xoff;
+    ysize = (src->yoff + src->ysize + 1)/2 - yoff;
+    rowLen = src->groups*8;
+    arMalloc( img1, ARUint16, xsize*ysize );
+    for( j = 0; j < ysize; j++ ) {
+        for( i = 0; i < xsize; i++ ) {
+            sum = n = 0;
+            for( l = 0; l < 2; l++ ) {
+                v = (yoff + j)*2 + l - src->yoff;
+                if( v < 0 || v >= src->ysize ) continue;
+                for( k = 0; k < 2; k++ ) {
+                    u = (xoff + i)*2 + k - src->xoff;
+                    if( u < 0 || u >= src->xsize || src->mask[v*rowLen + u] == 0 ) continue;
+                    sum += src->img[v*rowLen + u];
+                    n++;
+                }
+            }
+            img1[j*xsize + i] = (n == 0 ? AR2_TEMPLATE_NULL_PIXEL : (ARUint16)((sum + n/2)/n));
+        }
+    }
+    ar2SetTemplateRows( trows, img1, xsize, ysize, xoff, yoff );
+    free( img1 );
+}
+
+static void ar2FreeTemplateRows( AR2TemplateRowsT *trows )
+{
+    free( trows->img );
+    free( trows->mask );
+    trows->img = NULL;
+    trows->mask = NULL;
+}
+
+// Score a template laid out in rows against a luma image whose pixels match the template's one for
+// one, i.e. a pyramid level above the full-size frame. Returns -1 if the template does not fit.
+static int ar2GetMatchingLevel( ARUint8 *img, int xsize, int ysize, const AR2TemplateRowsT *trows,
+                                int x, int y, int *val )
+{
+    const ARUint8       *p;
+    const ARUint16      *t, *m;
+    int                  sum1, sum2, sum3, w;
+    int                  i, j;
+
+    x += trows->xoff;
+    y += trows->yoff;
+    if( x < 0 || y < 0 || x + trows->xsize > xsize || y + trows->ysize > ysize ) return -1;
+    p = &img[y*xsize + x];
+    t = trows->img;
+    m = trows->mask;
+
+#if AR2_MATCHING_SIMD
+    // The kernel reads whole 8-byte groups, so the last row may only be used if they stay inside the image.
+    if( (y + trows->ysize - 1)*xsize + x + trows->groups*8 <= xsize*ysize ) {
+#  if HAVE_ARM_NEON || HAVE_ARM64_NEON
+        uint32x4_t       s1, s2, s3;
+        uint16x8_t       v;
+
+        s1 = s2 = s3 = vdupq_n_u32( 0 );
+        for( j = 0; j < trows->ysize; j++ ) {
+            for( i = 0; i < trows->groups; i++ ) {
+                v = vandq_u16( vmovl_u8( vld1_u8( p + i*8 ) ), vld1q_u16( m ) );
+                s1 = vpadalq_u16( s1, v );
+                s2 = vmlal_u16( s2, vget_low_u16( v ), vget_low_u16( v ) );
+                s2 = vmlal_u16( s2, vget_high_u16( v ), vget_high_u16( v ) );
+                s3 = vmlal_u16( s3, vget_low_u16( v ), vld1_u16( t ) );
+                s3 = vmlal_u16( s3, vget_high_u16( v ), vld1_u16( t + 4 ) );
+                t += 8;
+                m += 8;
+            }
+            p += xsize;
+        }
+        sum1 = (int)(vgetq_lane_u32( s1, 0 ) + vgetq_lane_u32( s1, 1 ) + vgetq_lane_u32( s1, 2 ) + vgetq_lane_u32( s1, 3 ));
+        sum2 = (int)(vgetq_lane_u32( s2, 0 ) + vgetq_lane_u32( s2, 1 ) + vgetq_lane_u32( s2, 2 ) + vgetq_lane_u32( s2, 3 ));
+        sum3 = (int)(vgetq_lane_u32( s3, 0 ) + vgetq_lane_u32( s3, 1 ) + vgetq_lane_u32( s3, 2 ) + vgetq_lane_u32( s3, 3 ));
+#  else
+        __m128i          s1, s2, s3, v, ones, zero;
+        int              ws[4];
+
+        s1 = s2 = s3 = zero = _mm_setzero_si128();
+        ones = _mm_set1_epi16( 1 );
+        for( j = 0; j < trows->ysize; j++ ) {
+            for( i = 0; i < trows->groups; i++ ) {
+                v = _mm_unpacklo_epi8( _mm_loadl_epi64( (const __m128i *)(p + i*8) ), zero );
+                v = _mm_and_si128( v, _mm_loadu_si128( (const __m128i *)m ) );
+                s1 = _mm_add_epi32( s1, _mm_madd_epi16( v, ones ) );
+                s2 = _mm_add_epi32( s2, _mm_madd_epi16( v, v ) );
+                s3 = _mm_add_epi32( s3, _mm_madd_epi16( v, _mm_loadu_si128( (const __m128i *)t ) ) );
+                t += 8;
+                m += 8;
+            }
+            p += xsize;
+        }
+        _mm_storeu_si128( (__m128i *)ws, s1 );
+        sum1 = ws[0] + ws[1] + ws[2] + ws[3];
+        _mm_storeu_si128( (__m128i *)ws, s2 );
+        sum2 = ws[0] + ws[1] + ws[2] + ws[3];
+        _mm_storeu_si128( (__m128i *)ws, s3 );
+        sum3 = ws[0] + ws[1] + ws[2] + ws[3];
+#  endif
+    }
+    else
+#endif
+    {
+        sum1 = sum2 = sum3 = 0;
+        for( j = 0; j < trows->ysize; j++ ) {
+            for( i = 0; i < trows->xsize; i++ ) {
+                w = p[i] & m[i];
+                sum1 += w;
+                sum2 += w*w;
+                sum3 += w*t[i];
+            }
+            p += xsize;
+            t += trows->groups*8;
+            m += trows->groups*8;
+        }
+    }
+
+    *val = ar2GetMatchingValue( sum1, sum2, sum3, trows->sum, trows->vlen, trows->validNum );
+    return 0;
+}
+
+#if AR2_MATCHING_SIMD
+// Sums of pixel, pixel squared and pixel times template over the template's valid pixels, where p is
+// the image pixel under the template's first pixel, and template pixels are AR2_TEMP_SCALE apart.
+static void ar2GetMatchingSums2( const ARUint8 *p, int xsize, const AR2TemplateRowsT *trows,
+                                 int *sum1, int *sum2, int *sum3 )
+{
+    const ARUint16      *t, *m;
+    int                  i, j;
+#if HAVE_ARM_NEON || HAVE_ARM64_NEON
+    uint32x4_t           s1, s2, s3;
+    uint16x8_t           v;
+
+    s1 = s2 = s3 = vdupq_n_u32( 0 );
+    t = trows->img;
+    m = trows->mask;
+    for( j = 0; j < trows->ysize; j++ ) {
+        for( i = 0; i < trows->groups; i++ ) {
+            v = vandq_u16( vmovl_u8( vld2_u8( p + i*16 ).val[0] ), vld1q_u16( m ) );
+            s1 = vpadalq_u16( s1, v );
+            s2 = vmlal_u16( s2, vget_low_u16( v ), vget_low_u16( v ) );
+            s2 = vmlal_u16( s2, vget_high_u16( v ), vget_high_u16( v ) );
+            s3 = vmlal_u16( s3, vget_low_u16( v ), vld1_u16( t ) );
+            s3 = vmlal_u16( s3, vget_high_u16( v ), vld1_u16( t + 4 ) );
+            t += 8;
+            m += 8;
+        }
+        p += AR2_TEMP_SCALE*xsize;
+    }
+    *sum1 = (int)(vgetq_lane_u32( s1, 0 ) + vgetq_lane_u32( s1, 1 ) + vgetq_lane_u32( s1, 2 ) + vgetq_lane_u32( s1, 3 ));
+    *sum2 = (int)(vgetq_lane_u32( s2, 0 ) + vgetq_lane_u32( s2, 1 ) + vgetq_lane_u32( s2, 2 ) + vgetq_lane_u32( s2, 3 ));
+    *sum3 = (int)(vgetq_lane_u32( s3, 0 ) + vgetq_lane_u32( s3, 1 ) + vgetq_lane_u32( s3, 2 ) + vgetq_lane_u32( s3, 3 ));
+#else
+    __m128i              s1, s2, s3, v, ones;
+    int                  w[4];
+
+    s1 = s2 = s3 = _mm_setzero_si128();
+    ones = _mm_set1_epi16( 1 );
+    t = trows->img;
+    m = trows->mask;
+    for( j = 0; j < trows->ysize; j++ ) {
+        for( i = 0; i < trows->groups; i++ ) {
+            // Pixels and template values are at most 255, so pairwise products and sums fit madd's 32-bit lanes.
+            v = _mm_and_si128( _mm_loadu_si128( (const __m128i *)(p + i*16) ), _mm_loadu_si128( (const __m128i *)m ) );
+            s1 = _mm_add_epi32( s1, _mm_madd_epi16( v, ones ) );
+            s2 = _mm_add_epi32( s2, _mm_madd_epi16( v, v ) );
+            s3 = _mm_add_epi32( s3, _mm_madd_epi16( v, _mm_loadu_si128( (const __m128i *)t ) ) );
+            t += 8;
+            m += 8;
+        }
+        p += AR2_TEMP_SCALE*xsize;
+    }
+    _mm_storeu_si128( (__m128i *)w, s1 );
+    *sum1 = w[0] + w[1] + w[2] + w[3];
+    _mm_storeu_si128( (__m128i *)w, s2 );
+    *sum2 = w[0] + w[1] + w[2] + w[3];
+    _mm_storeu_si128( (__m128i *)w, s3 );
+    *sum3 = w[0] + w[1] + w[2] + w[3];
+#endif
+}
+
+#else
 static int ar2GetBestMatchingSubFineOpt( ARUint8 *img, int xsize, int ysize, int sx1, int sy1, AR2TemplateT *mtemp,
                                          ARUint32 *subImage1, ARUint32 *subImage2, int sx2, int sy2, int *val)
 {
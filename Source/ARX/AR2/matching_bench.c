@@ -0,0 +1,95 @@
+/*
+ *  matching_bench.c
+ *  artoolkitX
+ *
+ *  This file is part of artoolkitX.
+ *
+ *  artoolkitX is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  artoolkitX is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, the copyright holders of this library give you
+ *  permission to link this library with independent modules to produce an
+ *  executable, regardless of the license terms of these independent modules, and to
+ *  copy and distribute the resulting executable under terms of your choice,
+ *  provided that you also meet, for each linked independent module, the terms and
+ *  conditions of the license of that module. An independent module is a module
+ *  which is neither derived from nor based on this library. If you modify this
+ *  library, you may extend this exception to your version of the library, but you
+ *  are not obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  Copyright 2018 Realmax, Inc.
+ *
+ */
+
+// Times ar2GetBestMatching() against the scalar build of matching.c, for the
+// template sizes, search radii and null pixel fractions used in tracking. Not run
+// by ctest; run it by hand on a quiet machine with a Release build.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ARX/ARUtil/time.h>
+#include "matching_test.h"
+
+#define XSIZE       640
+#define YSIZE       480
+#define ITERATIONS  2000
+
+int main( void )
+{
+    static const int cases[][3] = {{6, 12, 0}, {6, 12, 10}, {11, 12, 0}, {11, 24, 10}}; // Template size, search radius, % null.
+    ARUint8        *img, *mfImage;
+    static AR2TemplateT *mtemp[ITERATIONS];
+    static int      search[ITERATIONS][3][2];
+    int             c, k, pass, cx, cy, bx, by, ret;
+    float           val;
+    long            checksum[2];
+    double          t[2];
+
+    srand(5);
+    arMalloc( img, ARUint8, XSIZE*YSIZE );
+    arMallocClear( mfImage, ARUint8, XSIZE*YSIZE );
+    ar2MatchingTestImage( img, XSIZE, YSIZE );
+
+    for( c = 0; c < (int)(sizeof(cases)/sizeof(cases[0])); c++ ) {
+        // Make all templates beforehand, so that only matching is timed.
+        for( k = 0; k < ITERATIONS; k++ ) {
+            mtemp[k] = ar2GenTemplate( cases[c][0], cases[c][0] );
+            cx = 40 + (k*37)%(XSIZE - 80);
+            cy = 40 + (k*53)%(YSIZE - 80);
+            ar2MatchingTestTemplate( mtemp[k], img, XSIZE, YSIZE, cx, cy, cases[c][2] );
+            search[k][0][0] = cx + 3;
+            search[k][0][1] = cy - 2;
+            search[k][1][0] = cx + 5;
+            search[k][1][1] = cy + 1;
+            search[k][2][0] = search[k][2][1] = -1;
+        }
+        for( pass = 0; pass < 2; pass++ ) {
+            checksum[pass] = 0;
+            arUtilTimerReset();
+            for( k = 0; k < ITERATIONS; k++ ) {
+                if( pass == 0 ) ret = ar2GetBestMatchingScalar( img, mfImage, XSIZE, YSIZE, AR_PIXEL_FORMAT_MONO, mtemp[k], cases[c][1], cases[c][1], search[k], &bx, &by, &val );
+                else            ret = ar2GetBestMatching( img, mfImage, XSIZE, YSIZE, AR_PIXEL_FORMAT_MONO, mtemp[k], cases[c][1], cases[c][1], search[k], &bx, &by, &val );
+                checksum[pass] += ret*7 + bx*31 + by*17 + (long)(val*10000);
+            }
+            t[pass] = arUtilTimer();
+        }
+        printf("template %dx%d, search %d, %d%% null: scalar %.1f us, vector %.1f us, checksums %s\n",
+               mtemp[0]->xsize, mtemp[0]->ysize, cases[c][1], cases[c][2], t[0]*1.0e6/ITERATIONS, t[1]*1.0e6/ITERATIONS, (checksum[0] == checksum[1] ? "match" : "DIFFER"));
+        for( k = 0; k < ITERATIONS; k++ ) ar2FreeTemplate( mtemp[k] );
+    }
+
+    free( img );
+    free( mfImage );
+    return 0;
+}
@@ -0,0 +1,134 @@
+/*
+ *  matching_test.c
+ *  artoolkitX
+ *
+ *  This file is part of artoolkitX.
+ *
+ *  artoolkitX is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  artoolkitX is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, the copyright holders of this library give you
+ *  permission to link this library with independent modules to produce an
+ *  executable, regardless of the license terms of these independent modules, and to
+ *  copy and distribute the resulting executable under terms of your choice,
+ *  provided that you also meet, for each linked independent module, the terms and
+ *  conditions of the license of that module. An independent module is a module
+ *  which is neither derived from nor based on this library. If you modify this
+ *  library, you may extend this exception to your version of the library, but you
+ *  are not obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  Copyright 2018 Realmax, Inc.
+ *
+ */
+
+// Checks ar2GetBestMatching() and ar2GetBestMatchingPyramid() against the scalar
+// build of matching.c, for templates with and without null pixels, searched both
+// inside the frame and at its edges, where the vector kernels fall back to scalar code.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "matching_test.h"
+
+#define XSIZE       640
+#define YSIZE       480
+#define POSITIONS   200
+
+static int compareResults( const char *what, int ret1, int bx1, int by1, float val1, int ret2, int bx2, int by2, float val2 )
+{
+    if( ret1 != ret2 || (ret1 == 0 && (bx1 != bx2 || by1 != by2 || memcmp(&val1, &val2, sizeof(float)) != 0)) ) {
+        printf("%s: returned %d (%d, %d) %f, expected %d (%d, %d) %f\n", what, ret2, bx2, by2, val2, ret1, bx1, by1, val1);
+        return 1;
+    }
+    return 0;
+}
+
+int main( void )
+{
+    static const int templateSizes[] = {6, 11};
+    static const int radii[] = {12, 24};
+    static const int nullPercents[] = {0, 10, 60};
+    ARUint8            *img, *mfImage1, *mfImage2;
+    AR2SearchPyramidT  *pyramid1, *pyramid2;
+    AR2TemplateT       *mtemp;
+    int                 t, r, n, k, cx, cy;
+    int                 search[3][2];
+    int                 ret1, ret2, bx1, by1, bx2, by2;
+    float               val1, val2;
+    int                 failures = 0, matches = 0, calls = 0;
+
+    srand(5);
+    arMalloc( img, ARUint8, XSIZE*YSIZE );
+    arMallocClear( mfImage1, ARUint8, XSIZE*YSIZE );
+    arMallocClear( mfImage2, ARUint8, XSIZE*YSIZE );
+    ar2MatchingTestImage( img, XSIZE, YSIZE );
+    pyramid1 = ar2CreateSearchPyramidScalar( XSIZE, YSIZE );
+    pyramid2 = ar2CreateSearchPyramid( XSIZE, YSIZE );
+    ar2SetSearchPyramidImageScalar( pyramid1, img, AR_PIXEL_FORMAT_MONO );
+    ar2SetSearchPyramidImage( pyramid2, img, AR_PIXEL_FORMAT_MONO );
+    for( k = 1; k < pyramid1->num; k++ ) {
+        if( memcmp(pyramid1->img[k], pyramid2->img[k], pyramid1->xsize[k]*pyramid1->ysize[k]) != 0 ) {
+            printf("search pyramid level %d differs\n", k);
+            failures++;
+        }
+    }
+
+    for( t = 0; t < (int)(sizeof(templateSizes)/sizeof(templateSizes[0])); t++ ) {
+        mtemp = ar2GenTemplate( templateSizes[t], templateSizes[t] );
+        for( r = 0; r < (int)(sizeof(radii)/sizeof(radii[0])); r++ ) {
+            for( n = 0; n < (int)(sizeof(nullPercents)/sizeof(nullPercents[0])); n++ ) {
+                for( k = 0; k < POSITIONS; k++ ) {
+                    // Every fourth position is within a few pixels of the right or bottom edge.
+                    if( k%4 == 0 ) {
+                        cx = XSIZE - 1 - rand()%(templateSizes[t]*AR2_TEMP_SCALE + 8);
+                        cy = (k%8 == 0 ? YSIZE - 1 - rand()%(templateSizes[t]*AR2_TEMP_SCALE + 8) : rand()%YSIZE);
+                    } else {
+                        cx = rand()%XSIZE;
+                        cy = rand()%YSIZE;
+                    }
+                    ar2MatchingTestTemplate( mtemp, img, XSIZE, YSIZE, cx, cy, nullPercents[n] );
+                    search[0][0] = cx + 3;
+                    search[0][1] = cy - 2;
+                    search[1][0] = cx + 5;
+                    search[1][1] = cy + 1;
+                    search[2][0] = search[2][1] = -1;
+
+                    ret1 = ar2GetBestMatchingScalar( img, mfImage1, XSIZE, YSIZE, AR_PIXEL_FORMAT_MONO, mtemp, radii[r], radii[r], search, &bx1, &by1, &val1 );
+                    ret2 = ar2GetBestMatching( img, mfImage2, XSIZE, YSIZE, AR_PIXEL_FORMAT_MONO, mtemp, radii[r], radii[r], search, &bx2, &by2, &val2 );
+                    failures += compareResults( "ar2GetBestMatching", ret1, bx1, by1, val1, ret2, bx2, by2, val2 );
+                    if( ret1 == 0 ) matches++;
+
+                    ret1 = ar2GetBestMatchingPyramidScalar( pyramid1, mfImage1, mtemp, radii[r], radii[r], search, &bx1, &by1, &val1 );
+                    ret2 = ar2GetBestMatchingPyramid( pyramid2, mfImage2, mtemp, radii[r], radii[r], search, &bx2, &by2, &val2 );
+                    failures += compareResults( "ar2GetBestMatchingPyramid", ret1, bx1, by1, val1, ret2, bx2, by2, val2 );
+                    calls++;
+                }
+                if( memcmp(mfImage1, mfImage2, XSIZE*YSIZE) != 0 ) {
+                    printf("mfImage differs\n");
+                    failures++;
+                }
+                printf("template %dx%d, search %d, %d%% null: %d failures so far\n", mtemp->xsize, mtemp->ysize, radii[r], nullPercents[n], failures);
+            }
+        }
+        ar2FreeTemplate( mtemp );
+    }
+
+    printf("%d positions, %d matched, %d failures\n", calls, matches, failures);
+    ar2DeleteSearchPyramidScalar( &pyramid1 );
+    ar2DeleteSearchPyramid( &pyramid2 );
+    free( img );
+    free( mfImage1 );
+    free( mfImage2 );
+    return (failures ? 1 : 0);
+}
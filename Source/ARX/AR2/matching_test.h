@@ -0,0 +1,104 @@
+/*
+ *  matching_test.h
+ *  artoolkitX
+ *
+ *  This file is part of artoolkitX.
+ *
+ *  artoolkitX is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  artoolkitX is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, the copyright holders of this library give you
+ *  permission to link this library with independent modules to produce an
+ *  executable, regardless of the license terms of these independent modules, and to
+ *  copy and distribute the resulting executable under terms of your choice,
+ *  provided that you also meet, for each linked independent module, the terms and
+ *  conditions of the license of that module. An independent module is a module
+ *  which is neither derived from nor based on this library. If you modify this
+ *  library, you may extend this exception to your version of the library, but you
+ *  are not obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  Copyright 2018 Realmax, Inc.
+ *
+ */
+
+// Shared by matching_test and matching_bench: the scalar build of matching.c, and
+// synthetic frames and templates.
+
+#ifndef AR2_MATCHING_TEST_H
+#define AR2_MATCHING_TEST_H
+
+#include <stdlib.h>
+#include <math.h>
+#include <ARX/AR2/template.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int ar2GetBestMatchingScalar( ARUint8 *img, ARUint8 *mfImage, int xsize, int ysize, AR_PIXEL_FORMAT pixFormat,
+                              AR2TemplateT *mtemp, int rx, int ry,
+                              int search[3][2], int *bx, int *by, float *val);
+AR2SearchPyramidT *ar2CreateSearchPyramidScalar( int xsize, int ysize );
+int ar2DeleteSearchPyramidScalar( AR2SearchPyramidT **pyramid );
+int ar2SetSearchPyramidImageScalar( AR2SearchPyramidT *pyramid, ARUint8 *img, AR_PIXEL_FORMAT pixFormat );
+int ar2GetBestMatchingPyramidScalar( AR2SearchPyramidT *pyramid, ARUint8 *mfImage,
+                                     AR2TemplateT *mtemp, int rx, int ry,
+                                     int search[3][2], int *bx, int *by, float *val);
+
+// Smooth pattern with noise.
+static void ar2MatchingTestImage( ARUint8 *img, int xsize, int ysize )
+{
+    int     i, j;
+
+    for( j = 0; j < ysize; j++ ) {
+        for( i = 0; i < xsize; i++ ) {
+            img[j*xsize+i] = (ARUint8)(128 + 60*sin(i*0.21 + j*0.13) + 40*cos(i*0.05 - j*0.3) + rand()%20);
+        }
+    }
+}
+
+// Samples the template every AR2_TEMP_SCALE pixels around (cx, cy), clamped to the
+// image, adds noise, and makes nullPercent of its pixels null. Sets sum, validNum and
+// vlen as ar2SetTemplateSub() does.
+static void ar2MatchingTestTemplate( AR2TemplateT *mtemp, const ARUint8 *img, int xsize, int ysize, int cx, int cy, int nullPercent )
+{
+    int     i, j, x, y, v, k, sum, sum2;
+
+    sum = sum2 = k = 0;
+    for( j = 0; j < mtemp->ysize; j++ ) {
+        for( i = 0; i < mtemp->xsize; i++ ) {
+            if( rand()%100 < nullPercent ) {
+                mtemp->img1[j*mtemp->xsize+i] = AR2_TEMPLATE_NULL_PIXEL;
+                continue;
+            }
+            x = cx + (i - mtemp->xts1)*AR2_TEMP_SCALE;
+            y = cy + (j - mtemp->yts1)*AR2_TEMP_SCALE;
+            x = (x < 0 ? 0 : (x >= xsize ? xsize - 1 : x));
+            y = (y < 0 ? 0 : (y >= ysize ? ysize - 1 : y));
+            v = (img[y*xsize+x] + rand()%7) & 0xff;
+            mtemp->img1[j*mtemp->xsize+i] = (ARUint16)v;
+            sum += v;
+            sum2 += v*v;
+            k++;
+        }
+    }
+    mtemp->sum = sum;
+    mtemp->validNum = k;
+    mtemp->vlen = (k ? (int)sqrtf((float)(sum2 - sum*sum/k)) : 0);
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif // !AR2_MATCHING_TEST_H
@@ -0,0 +1,45 @@
+/*
+ *  matching_test_scalar.c
+ *  artoolkitX
+ *
+ *  This file is part of artoolkitX.
+ *
+ *  artoolkitX is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  artoolkitX is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  As a special exception, the copyright holders of this library give you
+ *  permission to link this library with independent modules to produce an
+ *  executable, regardless of the license terms of these independent modules, and to
+ *  copy and distribute the resulting executable under terms of your choice,
+ *  provided that you also meet, for each linked independent module, the terms and
+ *  conditions of the license of that module. An independent module is a module
+ *  which is neither derived from nor based on this library. If you modify this
+ *  library, you may extend this exception to your version of the library, but you
+ *  are not obligated to do so. If you do not wish to do so, delete this exception
+ *  statement from your version.
+ *
+ *  Copyright 2018 Realmax, Inc.
+ *
+ */
+
+// matching.c built without its vector kernels, under other names, so that
+// matching_test and matching_bench can compare against it in one program.
+
+#define AR2_MATCHING_DISABLE_SIMD       1
+#define ar2GetBestMatching              ar2GetBestMatchingScalar
+#define ar2CreateSearchPyramid          ar2CreateSearchPyramidScalar
+#define ar2DeleteSearchPyramid          ar2DeleteSearchPyramidScalar
+#define ar2SetSearchPyramidImage        ar2SetSearchPyramidImageScalar
+#define ar2GetBestMatchingPyramid       ar2GetBestMatchingPyramidScalar
+
+#include "matching.c"
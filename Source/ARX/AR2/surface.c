@@ -40,6 +40,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <ARX/AR2/bundle.h>
 #include <ARX/AR2/coord.h>
 #include <ARX/AR2/featureSet.h>
 #include <ARX/AR2/template.h>
@@ -54,6 +55,7 @@ AR2SurfaceSetT *ar2ReadSurfaceSet( const char *filename, const char *ext, ARPatt
     FILE            *fp = NULL;
     int              readMode;
     char             buf[256], name[256];
+    AR2BundleT      *bundle;
     int              i, j, k;
 
     if( ext == NULL || *ext == '\0' || strcmp(ext,"fset") == 0 ) {
@@ -105,28 +107,52 @@ AR2SurfaceSetT *ar2ReadSurfaceSet( const char *filename, const char *ext, ARPatt
             if( sscanf(buf, "%s", name) != 1 ) break;
             ar2UtilRemoveExt( name );
         }
-        ARLOGi("  Read ImageSet.\n");
-        surfaceSet->surface[i].imageSet = ar2ReadImageSet( name );
-        if( surfaceSet->surface[i].imageSet == NULL ) {
-            ARLOGe("Error opening file '%s.iset'.\n", name);
-            free(surfaceSet->surface);
-            free(surfaceSet);
-			if (fp) fclose(fp); //COVHI10426
-            return (NULL);
-        }
-        ARLOGi("    end.\n");
-
-        ARLOGi("  Read FeatureSet.\n");
-        surfaceSet->surface[i].featureSet = ar2ReadFeatureSet( name, "fset" );
-        if( surfaceSet->surface[i].featureSet == NULL ) {
-            ARLOGe("Error opening file '%s.fset'.\n", name);
-            ar2FreeImageSet(&surfaceSet->surface[i].imageSet);
-            free(surfaceSet->surface);
-            free(surfaceSet);
-			if (fp) fclose(fp); //COVHI10426
-            return (NULL);
+        // A bundle holding both sets, if present, is used in place of the .iset and .fset files.
+        // Adaptive templates need image sets the bundle can't supply, so they always use the files.
+#if !AR2_CAPABLE_ADAPTIVE_TEMPLATE
+        bundle = ar2OpenBundle( name, AR2_BUNDLE_EXT );
+#else
+        bundle = NULL;
+#endif
+        if( bundle ) {
+            ARLOGi("  Read NFT bundle.\n");
+            surfaceSet->surface[i].imageSet = ar2ReadImageSetFromBundle( bundle );
+            surfaceSet->surface[i].featureSet = ar2ReadFeatureSetFromBundle( bundle );
+            ar2CloseBundle( &bundle );
+            if( surfaceSet->surface[i].imageSet == NULL || surfaceSet->surface[i].featureSet == NULL ) {
+                ARLOGe("Error reading file '%s.%s'.\n", name, AR2_BUNDLE_EXT);
+                ar2FreeFeatureSet(&surfaceSet->surface[i].featureSet);
+                ar2FreeImageSet(&surfaceSet->surface[i].imageSet);
+                free(surfaceSet->surface);
+                free(surfaceSet);
+                if (fp) fclose(fp);
+                return (NULL);
+            }
+            ARLOGi("    end.\n");
+        } else {
+            ARLOGi("  Read ImageSet.\n");
+            surfaceSet->surface[i].imageSet = ar2ReadImageSet( name );
+            if( surfaceSet->surface[i].imageSet == NULL ) {
+                ARLOGe("Error opening file '%s.iset'.\n", name);
+                free(surfaceSet->surface);
+                free(surfaceSet);
+                if (fp) fclose(fp); //COVHI10426
+                return (NULL);
+            }
+            ARLOGi("    end.\n");
+
+            ARLOGi("  Read FeatureSet.\n");
+            surfaceSet->surface[i].featureSet = ar2ReadFeatureSet( name, "fset" );
+            if( surfaceSet->surface[i].featureSet == NULL ) {
+                ARLOGe("Error opening file '%s.fset'.\n", name);
+                ar2FreeImageSet(&surfaceSet->surface[i].imageSet);
+                free(surfaceSet->surface);
+                free(surfaceSet);
+                if (fp) fclose(fp); //COVHI10426
+                return (NULL);
+            }
+            ARLOGi("    end.\n");
         }
-        ARLOGi("    end.\n");
 
         if (pattHandle) {
             ARLOGi("  Read MarkerSet.\n");
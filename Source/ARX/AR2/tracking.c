@@ -66,17 +66,89 @@ static int    getDeltaS( float  H[8], float  dU[], float  J_U_H[][8], int n );
 
 
 int ar2Tracking( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet, ARUint8 *dataPtr, float  trans[3][4], float  *err )
+{
+    if (!ar2Handle || !surfaceSet || !dataPtr || !trans || !err) return (-1);
+
+    if( ar2Handle->searchMode == AR2_SEARCH_MODE_PYRAMID ) {
+        ar2SetSearchPyramidImage( ar2Handle->searchPyramid, dataPtr, ar2Handle->pixFormat );
+    }
+
+    return ar2TrackingSurfaceSet( ar2Handle, ar2Handle->state[0], surfaceSet, dataPtr, trans, err, NULL );
+}
+
+int ar2TrackingMulti( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet[], int num, ARUint8 *dataPtr, float  trans[][3][4], float  err[], int result[] )
+{
+    int                     index[AR2_THREAD_MAX];
+    int                     i, j, k;
+
+    if (!ar2Handle || (num > 0 && (!surfaceSet || !trans || !err || !result)) || !dataPtr) return (-1);
+
+    // The search pyramid is built once, and shared by all surface sets.
+    if( ar2Handle->searchMode == AR2_SEARCH_MODE_PYRAMID ) {
+        ar2SetSearchPyramidImage( ar2Handle->searchPyramid, dataPtr, ar2Handle->pixFormat );
+    }
+
+    i = 0;
+    while( i < num ) {
+        // Give each thread a surface set being tracked.
+        for( k = 0; k < ar2Handle->threadNum && i < num; i++ ) {
+            if( !surfaceSet[i] ) {
+                result[i] = -1;
+                continue;
+            }
+            if( surfaceSet[i]->contNum <= 0 ) {
+                result[i] = -2; // Tracking not initialised.
+                continue;
+            }
+            index[k++] = i;
+        }
+        
+        // The blur level is shared by all surface sets, so adapting it needs them tracked one at a time.
+#if AR2_CAPABLE_ADAPTIVE_TEMPLATE
+        if( k == 1 || ar2Handle->blurMethod == AR2_ADAPTIVE_BLUR ) {
+#else
+        if( k == 1 ) {
+#endif
+            // Alone, a surface set is tracked faster by sharing the threads between its templates.
+            for( j = 0; j < k; j++ ) {
+                result[index[j]] = ar2TrackingSurfaceSet( ar2Handle, ar2Handle->state[0], surfaceSet[index[j]], dataPtr, trans[index[j]], &err[index[j]], NULL );
+            }
+            continue;
+        }
+        for( j = 0; j < k; j++ ) {
+            ar2Handle->arg[j].ar2Handle  = ar2Handle;
+            ar2Handle->arg[j].surfaceSet = surfaceSet[index[j]];
+            ar2Handle->arg[j].state      = ar2Handle->state[j];
+            ar2Handle->arg[j].dataPtr    = dataPtr;
+            ar2Handle->arg[j].trans      = trans[index[j]];
+            threadStartSignal( ar2Handle->threadHandle[j] );
+        }
+        for( j = 0; j < k; j++ ) {
+            threadEndWait( ar2Handle->threadHandle[j] );
+            result[index[j]] = ar2Handle->arg[j].ret;
+            err[index[j]] = ar2Handle->arg[j].err;
+        }
+    }
+
+    return 0;
+}
+
+int ar2TrackingSurfaceSet( AR2HandleT *ar2Handle, AR2TrackingStateT *state, AR2SurfaceSetT *surfaceSet,
+                           ARUint8 *dataPtr, float  trans[3][4], float  *err, AR2Tracking2DParamT *arg )
 {
     AR2TemplateCandidateT  *candidatePtr;
-    AR2TemplateCandidateT  *cp[AR2_THREAD_MAX];
+    AR2Tracking2DJobT       job[AR2_THREAD_MAX];
+    AR2Tracking2DJobT      *freeJob[AR2_THREAD_MAX];
+    AR2Tracking2DJobT      *pending[AR2_THREAD_MAX]; // Jobs being matched, in the order they were selected.
+    AR2Tracking2DJobT      *jobPtr;
+    char                    done[AR2_THREAD_MAX];   // Per job, whether its match has come back.
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
     float                   aveBlur;
 #endif
+    int                     freeNum, pendingNum, started;
     int                     num, num2;
     int                     i, j, k;
 
-    if (!ar2Handle || !surfaceSet || !dataPtr || !trans || !err) return (-1);
-
     if( surfaceSet->contNum <= 0  ) {
         ARLOGd("ar2Tracking() error: ar2SetInitTrans() must be called first.\n");
         return -2;
@@ -85,95 +157,132 @@ int ar2Tracking( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet, ARUint8 *dat
     *err = 0.0F;
 
     for( i = 0; i < surfaceSet->num; i++ ) {
-        arUtilMatMulf( (const float (*)[4])surfaceSet->trans1, (const float (*)[4])surfaceSet->surface[i].trans, ar2Handle->wtrans1[i] );
-        if( surfaceSet->contNum > 1 ) arUtilMatMulf( (const float (*)[4])surfaceSet->trans2, (const float (*)[4])surfaceSet->surface[i].trans, ar2Handle->wtrans2[i] );
-        if( surfaceSet->contNum > 2 ) arUtilMatMulf( (const float (*)[4])surfaceSet->trans3, (const float (*)[4])surfaceSet->surface[i].trans, ar2Handle->wtrans3[i] );
+        arUtilMatMulf( (const float (*)[4])surfaceSet->trans1, (const float (*)[4])surfaceSet->surface[i].trans, state->wtrans1[i] );
+        if( surfaceSet->contNum > 1 ) arUtilMatMulf( (const float (*)[4])surfaceSet->trans2, (const float (*)[4])surfaceSet->surface[i].trans, state->wtrans2[i] );
+        if( surfaceSet->contNum > 2 ) arUtilMatMulf( (const float (*)[4])surfaceSet->trans3, (const float (*)[4])surfaceSet->surface[i].trans, state->wtrans3[i] );
     }
 
     if( ar2Handle->trackingMode == AR2_TRACKING_6DOF ) {
-        extractVisibleFeatures(ar2Handle->cparamLT, ar2Handle->wtrans1, surfaceSet, ar2Handle->candidate, ar2Handle->candidate2);
+        extractVisibleFeatures(ar2Handle->cparamLT, state->wtrans1, surfaceSet, state->candidate, state->candidate2);
     }
     else {
-        extractVisibleFeaturesHomography(ar2Handle->xsize, ar2Handle->ysize, ar2Handle->wtrans1, surfaceSet, ar2Handle->candidate, ar2Handle->candidate2);
+        extractVisibleFeaturesHomography(ar2Handle->xsize, ar2Handle->ysize, state->wtrans1, surfaceSet, state->candidate, state->candidate2);
+    }
+
+    // Templates are selected on this thread and matched on the tracking threads, which take them from
+    // the job queue as they become free, so no thread waits for the slowest match of a round. Results
+    // are committed in the order the templates were selected, holding any that come back early until
+    // the oldest is done, and the next template is selected after each commit. Selection and results
+    // therefore do not depend on thread timing. When called from a tracking thread, match the
+    // templates on that thread, one at a time.
+    freeNum = (arg ? 1 : ar2Handle->threadNum);
+    for( j = 0; j < freeNum; j++ ) freeJob[j] = &(job[j]);
+    if( !arg ) {
+        for( j = 0; j < ar2Handle->threadNum; j++ ) {
+            ar2Handle->arg[j].ar2Handle  = ar2Handle;
+            ar2Handle->arg[j].surfaceSet = surfaceSet;
+            ar2Handle->arg[j].state      = state;
+            ar2Handle->arg[j].dataPtr    = dataPtr;
+            ar2Handle->arg[j].trans      = NULL;
+        }
     }
+    started = 0;
 
-    candidatePtr = ar2Handle->candidate;
+    candidatePtr = state->candidate;
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
     aveBlur = 0.0F;
 #endif
     i = 0; // Counts up to searchFeatureNum.
     num = 0;
-    while( i < ar2Handle->searchFeatureNum ) {
-        num2 = num;
-        for( j = 0; j < ar2Handle->threadNum; j++ ) {
-            if( i == ar2Handle->searchFeatureNum ) break;
+    pendingNum = 0;
+    for(;;) {
+        while( freeNum > 0 && i < ar2Handle->searchFeatureNum ) {
+            // Select with the positions of the templates accepted so far, then those still being matched.
+            num2 = num;
+            for( j = 0; j < pendingNum; j++ ) {
+                state->pos[num2][0] = pending[j]->candidate->sx;
+                state->pos[num2][1] = pending[j]->candidate->sy;
+                num2++;
+            }
+            if( num2 > 4 ) num2 = 4;
 
-            k = ar2SelectTemplate( candidatePtr, surfaceSet->prevFeature, num2, ar2Handle->pos, ar2Handle->xsize, ar2Handle->ysize );
+            k = ar2SelectTemplate( candidatePtr, surfaceSet->prevFeature, num2, state->pos, ar2Handle->xsize, ar2Handle->ysize );
             if( k < 0 ) {
-                if( candidatePtr == ar2Handle->candidate ) {
-                    candidatePtr = ar2Handle->candidate2;
-                    k = ar2SelectTemplate( candidatePtr, surfaceSet->prevFeature, num2, ar2Handle->pos, ar2Handle->xsize, ar2Handle->ysize );
+                if( candidatePtr == state->candidate ) {
+                    candidatePtr = state->candidate2;
+                    k = ar2SelectTemplate( candidatePtr, surfaceSet->prevFeature, num2, state->pos, ar2Handle->xsize, ar2Handle->ysize );
                     if( k < 0 ) break; // PRL 2012-05-15: Give up if we can't select template from alternate candidate either.
                 }
                 else break;
             }
 
-            cp[j] = &(candidatePtr[k]);
-            ar2Handle->pos[num2][0] = candidatePtr[k].sx;
-            ar2Handle->pos[num2][1] = candidatePtr[k].sy;
-            ar2Handle->arg[j].ar2Handle  = ar2Handle;
-            ar2Handle->arg[j].surfaceSet = surfaceSet;
-            ar2Handle->arg[j].candidate  = &(candidatePtr[k]);
-            ar2Handle->arg[j].dataPtr    = dataPtr;
-
-            threadStartSignal( ar2Handle->threadHandle[j] );
-            num2++;
-            if( num2 == 5 ) num2 = num;
+            jobPtr = freeJob[--freeNum];
+            jobPtr->candidate = &(candidatePtr[k]);
+            done[jobPtr - job] = 0;
+            pending[pendingNum++] = jobPtr;
             i++;
+            if( arg ) {
+                ar2Tracking2dTemplate( arg, jobPtr );
+            }
+            else {
+                threadQueuePush( ar2Handle->jobQueue, jobPtr );
+                if( started < ar2Handle->threadNum ) threadStartSignal( ar2Handle->threadHandle[started++] );
+            }
         }
-        k = j;
-        if( k == 0 ) break;
+        if( pendingNum == 0 ) break;
 
-        for( j = 0; j < k; j++ ) {
-            threadEndWait( ar2Handle->threadHandle[j] );
+        if( !arg ) {
+            while( !done[pending[0] - job] ) {
+                jobPtr = (AR2Tracking2DJobT *)threadQueuePop( ar2Handle->doneQueue );
+                done[jobPtr - job] = 1;
+            }
+        }
+        jobPtr = pending[0];
+        for( j = 0; j < pendingNum - 1; j++ ) pending[j] = pending[j+1];
+        pendingNum--;
+        freeJob[freeNum++] = jobPtr;
 
-            if( ar2Handle->arg[j].ret == 0 && ar2Handle->arg[j].result.sim > ar2Handle->simThresh ) {
-                if( ar2Handle->trackingMode == AR2_TRACKING_6DOF ) {
+        if( jobPtr->ret == 0 && jobPtr->result.sim > ar2Handle->simThresh ) {
+            if( ar2Handle->trackingMode == AR2_TRACKING_6DOF ) {
 #ifdef ARDOUBLE_IS_FLOAT
-                    arParamObserv2Ideal(ar2Handle->cparamLT->param.dist_factor,
-                                        ar2Handle->arg[j].result.pos2d[0], ar2Handle->arg[j].result.pos2d[1],
-                                        &ar2Handle->pos2d[num][0], &ar2Handle->pos2d[num][1], ar2Handle->cparamLT->param.dist_function_version);
+                arParamObserv2Ideal(ar2Handle->cparamLT->param.dist_factor,
+                                    jobPtr->result.pos2d[0], jobPtr->result.pos2d[1],
+                                    &state->pos2d[num][0], &state->pos2d[num][1], ar2Handle->cparamLT->param.dist_function_version);
 #else
-                    ARdouble pos2d0, pos2d1;
-                    arParamObserv2Ideal(ar2Handle->cparamLT->param.dist_factor,                    
-                                        (ARdouble)(ar2Handle->arg[j].result.pos2d[0]), (ARdouble)(ar2Handle->arg[j].result.pos2d[1]),
-                                        &pos2d0, &pos2d1, ar2Handle->cparamLT->param.dist_function_version);
-                    ar2Handle->pos2d[num][0] = (float)pos2d0;
-                    ar2Handle->pos2d[num][1] = (float)pos2d1;
+                ARdouble pos2d0, pos2d1;
+                arParamObserv2Ideal(ar2Handle->cparamLT->param.dist_factor,                    
+                                    (ARdouble)(jobPtr->result.pos2d[0]), (ARdouble)(jobPtr->result.pos2d[1]),
+                                    &pos2d0, &pos2d1, ar2Handle->cparamLT->param.dist_function_version);
+                state->pos2d[num][0] = (float)pos2d0;
+                state->pos2d[num][1] = (float)pos2d1;
 #endif
-                }
-                else {
-                    ar2Handle->pos2d[num][0] = ar2Handle->arg[j].result.pos2d[0];
-                    ar2Handle->pos2d[num][1] = ar2Handle->arg[j].result.pos2d[1];
-                }
-                ar2Handle->pos3d[num][0] = ar2Handle->arg[j].result.pos3d[0];
-                ar2Handle->pos3d[num][1] = ar2Handle->arg[j].result.pos3d[1];
-                ar2Handle->pos3d[num][2] = ar2Handle->arg[j].result.pos3d[2];
-                ar2Handle->pos[num][0] = cp[j]->sx;
-                ar2Handle->pos[num][1] = cp[j]->sy;
-                ar2Handle->usedFeature[num].snum  = cp[j]->snum;
-                ar2Handle->usedFeature[num].level = cp[j]->level;
-                ar2Handle->usedFeature[num].num   = cp[j]->num;
-                ar2Handle->usedFeature[num].flag  = 0;
+            }
+            else {
+                state->pos2d[num][0] = jobPtr->result.pos2d[0];
+                state->pos2d[num][1] = jobPtr->result.pos2d[1];
+            }
+            state->pos3d[num][0] = jobPtr->result.pos3d[0];
+            state->pos3d[num][1] = jobPtr->result.pos3d[1];
+            state->pos3d[num][2] = jobPtr->result.pos3d[2];
+            state->pos[num][0] = jobPtr->candidate->sx;
+            state->pos[num][1] = jobPtr->candidate->sy;
+            state->usedFeature[num].snum  = jobPtr->candidate->snum;
+            state->usedFeature[num].level = jobPtr->candidate->level;
+            state->usedFeature[num].num   = jobPtr->candidate->num;
+            state->usedFeature[num].flag  = 0;
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
-                aveBlur += ar2Handle->arg[j].result.blurLevel;
+            aveBlur += jobPtr->result.blurLevel;
 #endif
-                num++;
-            }
+            num++;
         }
     }
+    if( !arg ) {
+        // Release the threads that were given templates.
+        for( j = 0; j < started; j++ ) threadQueuePush( ar2Handle->jobQueue, NULL );
+        for( j = 0; j < started; j++ ) threadEndWait( ar2Handle->threadHandle[j] );
+    }
     for( i = 0; i < num; i++ ) {
-        surfaceSet->prevFeature[i] = ar2Handle->usedFeature[i];
+        surfaceSet->prevFeature[i] = state->usedFeature[i];
     }
     surfaceSet->prevFeature[num].flag = -1;
     //ARLOGd("------\nNum = %d\n", num);
@@ -183,23 +292,23 @@ int ar2Tracking( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet, ARUint8 *dat
             surfaceSet->contNum = 0;
             return -3;
         }
-        *err = ar2GetTransMat( ar2Handle->icpHandle, surfaceSet->trans1, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 0 );
+        *err = ar2GetTransMat( state->icpHandle, surfaceSet->trans1, state->pos2d, state->pos3d, num, trans, 0 );
         //ARLOGd("outlier  0%%: err = %f, num = %d\n", *err, num);
         if( *err > ar2Handle->trackingThresh ) {
-            icpSetInlierProbability( ar2Handle->icpHandle, 0.8F );
-            *err = ar2GetTransMat( ar2Handle->icpHandle, trans, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 1 );
+            icpSetInlierProbability( state->icpHandle, 0.8F );
+            *err = ar2GetTransMat( state->icpHandle, trans, state->pos2d, state->pos3d, num, trans, 1 );
             //ARLOGd("outlier 20%%: err = %f, num = %d\n", *err, num);
             if( *err > ar2Handle->trackingThresh ) {
-                icpSetInlierProbability( ar2Handle->icpHandle, 0.6F );
-                *err = ar2GetTransMat( ar2Handle->icpHandle, trans, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 1 );
+                icpSetInlierProbability( state->icpHandle, 0.6F );
+                *err = ar2GetTransMat( state->icpHandle, trans, state->pos2d, state->pos3d, num, trans, 1 );
                 //ARLOGd("outlier 60%%: err = %f, num = %d\n", *err, num);
                 if( *err > ar2Handle->trackingThresh ) {
-                    icpSetInlierProbability( ar2Handle->icpHandle, 0.4F );
-                    *err = ar2GetTransMat( ar2Handle->icpHandle, trans, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 1 );
+                    icpSetInlierProbability( state->icpHandle, 0.4F );
+                    *err = ar2GetTransMat( state->icpHandle, trans, state->pos2d, state->pos3d, num, trans, 1 );
                     //ARLOGd("outlier 60%%: err = %f, num = %d\n", *err, num);
                     if( *err > ar2Handle->trackingThresh ) {
-                        icpSetInlierProbability( ar2Handle->icpHandle, 0.0F );
-                        *err = ar2GetTransMat( ar2Handle->icpHandle, trans, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 1 );
+                        icpSetInlierProbability( state->icpHandle, 0.0F );
+                        *err = ar2GetTransMat( state->icpHandle, trans, state->pos2d, state->pos3d, num, trans, 1 );
                         //ARLOGd("outlier Max: err = %f, num = %d\n", *err, num);
                         if( *err > ar2Handle->trackingThresh ) {
                             surfaceSet->contNum = 0;
@@ -218,19 +327,19 @@ int ar2Tracking( AR2HandleT *ar2Handle, AR2SurfaceSetT *surfaceSet, ARUint8 *dat
             surfaceSet->contNum = 0;
             return -3;
         }
-        *err = ar2GetTransMatHomography( surfaceSet->trans1, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 0, 1.0F );
+        *err = ar2GetTransMatHomography( surfaceSet->trans1, state->pos2d, state->pos3d, num, trans, 0, 1.0F );
         //ARLOGd("outlier  0%%: err = %f, num = %d\n", *err, num);
         if( *err > ar2Handle->trackingThresh ) {
-            *err = ar2GetTransMatHomography( trans, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 1, 0.8F );
+            *err = ar2GetTransMatHomography( trans, state->pos2d, state->pos3d, num, trans, 1, 0.8F );
             //ARLOGd("outlier 20%%: err = %f, num = %d\n", *err, num);
             if( *err > ar2Handle->trackingThresh ) {
-                *err = ar2GetTransMatHomography( trans, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 1, 0.6F );
+                *err = ar2GetTransMatHomography( trans, state->pos2d, state->pos3d, num, trans, 1, 0.6F );
                 //ARLOGd("outlier 40%%: err = %f, num = %d\n", *err, num);
                 if( *err > ar2Handle->trackingThresh ) {
-                    *err = ar2GetTransMatHomography( trans, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 1, 0.4F );
+                    *err = ar2GetTransMatHomography( trans, state->pos2d, state->pos3d, num, trans, 1, 0.4F );
                     //ARLOGd("outlier 60%%: err = %f, num = %d\n", *err, num);
                     if( *err > ar2Handle->trackingThresh ) {
-                        *err = ar2GetTransMatHomography( trans, ar2Handle->pos2d, ar2Handle->pos3d, num, trans, 1, 0.0F );
+                        *err = ar2GetTransMatHomography( trans, state->pos2d, state->pos3d, num, trans, 1, 0.0F );
                         //ARLOGd("outlier Max: err = %f, num = %d\n", *err, num);
                         if( *err > ar2Handle->trackingThresh ) {
                             surfaceSet->contNum = 0;
@@ -47,11 +47,11 @@
 #include <ARX/AR2/tracking.h>
 
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
-static int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR2TemplateCandidateT *candidate,
+static int ar2Tracking2dSub ( AR2HandleT *handle, AR2TrackingStateT *state, AR2SurfaceSetT *surfaceSet, AR2TemplateCandidateT *candidate,
                               ARUint8 *dataPtr, ARUint8 *mfImage, AR2TemplateT **templ,
                               AR2Template2T **templ2, AR2Tracking2DResultT *result );
 #else
-static int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR2TemplateCandidateT *candidate,
+static int ar2Tracking2dSub ( AR2HandleT *handle, AR2TrackingStateT *state, AR2SurfaceSetT *surfaceSet, AR2TemplateCandidateT *candidate,
                               ARUint8 *dataPtr, ARUint8 *mfImage, AR2TemplateT **templ,
                               AR2Tracking2DResultT *result );
 #endif
@@ -59,6 +59,7 @@ static int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR
 void *ar2Tracking2d( THREAD_HANDLE_T *threadHandle )
 {
     AR2Tracking2DParamT  *arg;
+    AR2Tracking2DJobT    *job;
     int                   ID;
 
     arg          = (AR2Tracking2DParamT *)threadGetArg(threadHandle);
@@ -68,13 +69,16 @@ void *ar2Tracking2d( THREAD_HANDLE_T *threadHandle )
     for(;;) {
         if( threadStartWait(threadHandle) < 0 ) break;
 
-#if AR2_CAPABLE_ADAPTIVE_TEMPLATE
-        arg->ret = ar2Tracking2dSub( arg->ar2Handle, arg->surfaceSet, arg->candidate,
-                                     arg->dataPtr, arg->mfImage, &(arg->templ), &(arg->templ2), &(arg->result) );
-#else
-        arg->ret = ar2Tracking2dSub( arg->ar2Handle, arg->surfaceSet, arg->candidate,
-                                     arg->dataPtr, arg->mfImage, &(arg->templ), &(arg->result) );
-#endif
+        if( arg->trans ) {
+            arg->ret = ar2TrackingSurfaceSet( arg->ar2Handle, arg->state, arg->surfaceSet, arg->dataPtr, arg->trans, &(arg->err), arg );
+        }
+        else {
+            // Match templates as they are queued, until told there are no more.
+            while( (job = (AR2Tracking2DJobT *)threadQueuePop( arg->ar2Handle->jobQueue )) != NULL ) {
+                ar2Tracking2dTemplate( arg, job );
+                threadQueuePush( arg->ar2Handle->doneQueue, job );
+            }
+        }
         threadEndSignal(threadHandle);
     }
     ARLOGi("End tracking_thread #%d.\n", ID);
@@ -82,13 +86,25 @@ void *ar2Tracking2d( THREAD_HANDLE_T *threadHandle )
     return NULL;
 }
 
+int ar2Tracking2dTemplate( AR2Tracking2DParamT *arg, AR2Tracking2DJobT *job )
+{
+#if AR2_CAPABLE_ADAPTIVE_TEMPLATE
+    job->ret = ar2Tracking2dSub( arg->ar2Handle, arg->state, arg->surfaceSet, job->candidate,
+                                 arg->dataPtr, arg->mfImage, &(arg->templ), &(arg->templ2), &(job->result) );
+#else
+    job->ret = ar2Tracking2dSub( arg->ar2Handle, arg->state, arg->surfaceSet, job->candidate,
+                                 arg->dataPtr, arg->mfImage, &(arg->templ), &(job->result) );
+#endif
+    return job->ret;
+}
+
 
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
-static int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR2TemplateCandidateT *candidate,
+static int ar2Tracking2dSub ( AR2HandleT *handle, AR2TrackingStateT *state, AR2SurfaceSetT *surfaceSet, AR2TemplateCandidateT *candidate,
                               ARUint8 *dataPtr, ARUint8 *mfImage, AR2TemplateT **templ,
                               AR2Template2T **templ2, AR2Tracking2DResultT *result )
 #else
-static int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR2TemplateCandidateT *candidate,
+static int ar2Tracking2dSub ( AR2HandleT *handle, AR2TrackingStateT *state, AR2SurfaceSetT *surfaceSet, AR2TemplateCandidateT *candidate,
                               ARUint8 *dataPtr, ARUint8 *mfImage, AR2TemplateT **templ,
                               AR2Tracking2DResultT *result )
 #endif
@@ -112,7 +128,7 @@ static int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
     if( handle->blurMethod == AR2_CONSTANT_BLUR ) {
         if( ar2SetTemplateSub( handle->cparamLT,
-                               (const float (*)[4])handle->wtrans1[snum],
+                               (const float (*)[4])state->wtrans1[snum],
                                surfaceSet->surface[snum].imageSet,
                              &(surfaceSet->surface[snum].featureSet->list[level]),
                                fnum,
@@ -127,7 +143,7 @@ static int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR
     }
     else {
         if( ar2SetTemplate2Sub( handle->cparamLT,
-                                (const float (*)[4])handle->wtrans1[snum],
+                                (const float (*)[4])state->wtrans1[snum],
                                 surfaceSet->surface[snum].imageSet,
                               &(surfaceSet->surface[snum].featureSet->list[level]),
                                 fnum,
@@ -142,7 +158,7 @@ static int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR
     }
 #else
     if( ar2SetTemplateSub( handle->cparamLT,
-                           (const float (*)[4])handle->wtrans1[snum],
+                           (const float (*)[4])state->wtrans1[snum],
                            surfaceSet->surface[snum].imageSet,
                          &(surfaceSet->surface[snum].featureSet->list[level]),
                            fnum,
@@ -158,28 +174,41 @@ static int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR
     // Get the screen coordinates for up to three previous positions of this feature into search[][].
     if( surfaceSet->contNum == 1 ) {
         ar2GetSearchPoint( handle->cparamLT,
-                           (const float (*)[4])handle->wtrans1[snum], NULL, NULL,
+                           (const float (*)[4])state->wtrans1[snum], NULL, NULL,
                          &(surfaceSet->surface[snum].featureSet->list[level].coord[fnum]),
                            search );
     }
     else if( surfaceSet->contNum == 2 ) {
         ar2GetSearchPoint( handle->cparamLT,
-                           (const float (*)[4])handle->wtrans1[snum],
-                           (const float (*)[4])handle->wtrans2[snum], NULL,
+                           (const float (*)[4])state->wtrans1[snum],
+                           (const float (*)[4])state->wtrans2[snum], NULL,
                          &(surfaceSet->surface[snum].featureSet->list[level].coord[fnum]),
                            search );
     }
     else {
         ar2GetSearchPoint( handle->cparamLT,
-                           (const float (*)[4])handle->wtrans1[snum],
-                           (const float (*)[4])handle->wtrans2[snum],
-                           (const float (*)[4])handle->wtrans3[snum],
+                           (const float (*)[4])state->wtrans1[snum],
+                           (const float (*)[4])state->wtrans2[snum],
+                           (const float (*)[4])state->wtrans3[snum],
                          &(surfaceSet->surface[snum].featureSet->list[level].coord[fnum]),
                            search );
     }
 
 #if AR2_CAPABLE_ADAPTIVE_TEMPLATE
-    if( handle->blurMethod == AR2_CONSTANT_BLUR ) {
+    if( handle->blurMethod == AR2_CONSTANT_BLUR && handle->searchMode == AR2_SEARCH_MODE_PYRAMID ) {
+        if( ar2GetBestMatchingPyramid( handle->searchPyramid,
+                                       mfImage,
+                                      *templ,
+                                       handle->searchSize,
+                                       handle->searchSize,
+                                       search,
+                                       &bx, &by,
+                                     &(result->sim)) < 0 ) {
+            return -1;
+        }
+        result->blurLevel = handle->blurLevel;
+    }
+    else if( handle->blurMethod == AR2_CONSTANT_BLUR ) {
         if( ar2GetBestMatching( dataPtr,
                                 mfImage,
                                 handle->xsize,
@@ -212,18 +241,32 @@ static int ar2Tracking2dSub ( AR2HandleT *handle, AR2SurfaceSetT *surfaceSet, AR
         }
     }
 #else
-    if( ar2GetBestMatching( dataPtr,
-                            mfImage,
-                            handle->xsize,
-                            handle->ysize,
-                            handle->pixFormat,
-                           *templ,
-                            handle->searchSize,
-                            handle->searchSize,
-                            search,
-                            &bx, &by,
-                          &(result->sim)) < 0 ) {
-        return -1;
+    if( handle->searchMode == AR2_SEARCH_MODE_PYRAMID ) {
+        if( ar2GetBestMatchingPyramid( handle->searchPyramid,
+                                       mfImage,
+                                      *templ,
+                                       handle->searchSize,
+                                       handle->searchSize,
+                                       search,
+                                       &bx, &by,
+                                     &(result->sim)) < 0 ) {
+            return -1;
+        }
+    }
+    else {
+        if( ar2GetBestMatching( dataPtr,
+                                mfImage,
+                                handle->xsize,
+                                handle->ysize,
+                                handle->pixFormat,
+                               *templ,
+                                handle->searchSize,
+                                handle->searchSize,
+                                search,
+                                &bx, &by,
+                              &(result->sim)) < 0 ) {
+            return -1;
+        }
     }
 #endif
 
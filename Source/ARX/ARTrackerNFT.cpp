@@ -42,18 +42,62 @@
 
 #if HAVE_NFT
 #include <ARX/ARTrackableNFT.h>
+#include <ARX/AR2/bundle.h>
+#include <ARX/AR2/coord.h>
+#include <ARX/ARUtil/time.h>
 #include "trackingSub.h"
+#include <algorithm>
+
+// Default time, in seconds, for which KPM looks for lost pages near where they were last tracked.
+#define KPM_RECOVERY_TIMEOUT_DEFAULT 1.0f
+
+static double timeNow(void)
+{
+    uint64_t sec;
+    uint32_t usec;
+    arUtilTimeSinceEpoch(&sec, &usec);
+    return ((double)sec + (double)usec*1.0e-6);
+}
+
+// Bounding box in the frame of the surfaces of a surface set with the pose trans. Returns false
+// if any part of the surfaces is not in front of the camera.
+static bool getSurfaceSetBounds(const ARParamLT *cparamLT, const AR2SurfaceSetT *surfaceSet, const float trans[3][4], float bounds[4])
+{
+    float wtrans[3][4];
+    float sx, sy;
+    
+    bounds[0] = bounds[1] = bounds[2] = bounds[3] = 0.0f;
+    for (int i = 0; i < surfaceSet->num; i++) {
+        const AR2ImageT *image = surfaceSet->surface[i].imageSet->scale[0];
+        const float width = image->xsize * 25.4f / image->dpi;
+        const float height = image->ysize * 25.4f / image->dpi;
+        arUtilMatMulf(trans, surfaceSet->surface[i].trans, wtrans);
+        for (int j = 0; j < 4; j++) {
+            const float mx = (j & 1) ? width : 0.0f;
+            const float my = (j & 2) ? height : 0.0f;
+            if (wtrans[2][0]*mx + wtrans[2][1]*my + wtrans[2][3] <= 0.0f) return false;
+            if (ar2MarkerCoord2ScreenCoord(cparamLT, wtrans, mx, my, &sx, &sy) < 0) return false;
+            if ((i == 0 && j == 0) || sx < bounds[0]) bounds[0] = sx;
+            if ((i == 0 && j == 0) || sy < bounds[1]) bounds[1] = sy;
+            if ((i == 0 && j == 0) || sx > bounds[2]) bounds[2] = sx;
+            if ((i == 0 && j == 0) || sy > bounds[3]) bounds[3] = sy;
+        }
+    }
+    return (surfaceSet->num > 0);
+}
 
 ARTrackerNFT::ARTrackerNFT() :
     m_videoSourceIsStereo(false),
     m_nftMultiMode(false),
     m_kpmRequired(true),
-    m_kpmBusy(false),
+    m_kpmThreadCount(TRACKING_INIT_THREAD_AUTO),
+    m_kpmRecoveryTimeout(KPM_RECOVERY_TIMEOUT_DEFAULT),
     trackingThreadHandle(NULL),
     m_ar2Handle(NULL),
     m_kpmHandle(NULL),
     m_surfaceSet{NULL}
 {
+    for (int i = 0; i < PAGES_MAX; i++) m_pageLostTime[i] = -1.0;
 }
 
 ARTrackerNFT::~ARTrackerNFT()
@@ -76,6 +120,36 @@ bool ARTrackerNFT::NFTMultiMode() const
     return m_nftMultiMode;
 }
 
+void ARTrackerNFT::setKPMThreadCount(int count)
+{
+    if (count < 1) count = TRACKING_INIT_THREAD_AUTO;
+    if (count == m_kpmThreadCount) return;
+    m_kpmThreadCount = count;
+    
+    // Restart the KPM threads. Extra threads share the already-loaded data, so this is cheap.
+    if (trackingThreadHandle) {
+        trackingInitQuit(&trackingThreadHandle);
+        trackingThreadHandle = trackingInitInit(m_kpmHandle, m_kpmThreadCount);
+        if (!trackingThreadHandle) ARLOGe("trackingInitInit()\n");
+    }
+}
+
+int ARTrackerNFT::KPMThreadCount() const
+{
+    if (trackingThreadHandle) return trackingInitGetThreadNum(trackingThreadHandle);
+    return m_kpmThreadCount;
+}
+
+void ARTrackerNFT::setKPMRecoveryTimeout(float seconds)
+{
+    m_kpmRecoveryTimeout = (seconds > 0.0f ? seconds : 0.0f);
+}
+
+float ARTrackerNFT::KPMRecoveryTimeout() const
+{
+    return m_kpmRecoveryTimeout;
+}
+
 bool ARTrackerNFT::start(ARParamLT *paramLT, AR_PIXEL_FORMAT pixelFormat)
 {
     if (!paramLT || pixelFormat == AR_PIXEL_FORMAT_INVALID) return false;
@@ -105,6 +179,7 @@ bool ARTrackerNFT::start(ARParamLT *paramLT, AR_PIXEL_FORMAT pixelFormat)
         ar2SetTemplateSize2(m_ar2Handle, 6);
     } else {
         ARLOGi("Using NFT tracking settings for more than one CPU.\n");
+        kpmSetMatchingThreadNum(m_kpmHandle, KpmMatchingThreadNumAuto); // Shared out between the KPM workers by trackingInitInit().
         // Settings for devices with dual/multi-core CPUs.
         ar2SetTrackingThresh( m_ar2Handle, 5.0 );
         ar2SetSimThresh( m_ar2Handle, 0.50 );
@@ -134,9 +209,9 @@ bool ARTrackerNFT::unloadNFTData(void)
     if (trackingThreadHandle) {
         ARLOGi("Stopping NFT tracking thread.\n");
         trackingInitQuit(&trackingThreadHandle);
-        m_kpmBusy = false;
     }
     for (i = 0; i < PAGES_MAX; i++) m_surfaceSet[i] = NULL; // Discard weak-references.
+    for (i = 0; i < PAGES_MAX; i++) m_pageLostTime[i] = -1.0; // Page numbers may change.
     m_kpmRequired = true;
     
     return true;
@@ -157,11 +232,20 @@ bool ARTrackerNFT::loadNFTData(std::vector<ARTrackable *>& trackables)
     
     for (std::vector<ARTrackable *>::iterator it = trackables.begin(); it != trackables.end(); ++it) {
         if ((*it)->type == ARTrackable::NFT) {
-            // Load KPM data.
+            // Load KPM data, from the NFT bundle if there is one.
             KpmRefDataSet *refDataSet2;
-            ARLOGi("Reading '%s.fset3'.\n", ((ARTrackableNFT *)(*it))->datasetPathname);
-            if (kpmLoadRefDataSet(((ARTrackableNFT *)(*it))->datasetPathname, "fset3", &refDataSet2) < 0) {
-                ARLOGe("Error reading KPM data from '%s.fset3'.\n", ((ARTrackableNFT *)(*it))->datasetPathname);
+            const char *datasetPathname = ((ARTrackableNFT *)(*it))->datasetPathname;
+            uint64_t kpmOffset, kpmSize;
+            int kpmErr;
+            if (ar2ReadBundleKpmLocation(datasetPathname, AR2_BUNDLE_EXT, &kpmOffset, &kpmSize) == 0) {
+                ARLOGi("Reading KPM data from '%s.%s'.\n", datasetPathname, AR2_BUNDLE_EXT);
+                kpmErr = kpmLoadRefDataSetAt(datasetPathname, AR2_BUNDLE_EXT, kpmOffset, kpmSize, &refDataSet2);
+            } else {
+                ARLOGi("Reading '%s.fset3'.\n", datasetPathname);
+                kpmErr = kpmLoadRefDataSet(datasetPathname, "fset3", &refDataSet2);
+            }
+            if (kpmErr < 0) {
+                ARLOGe("Error reading KPM data for '%s'.\n", datasetPathname);
                 ((ARTrackableNFT *)(*it))->pageNo = -1;
                 continue;
             }
@@ -187,15 +271,14 @@ bool ARTrackerNFT::loadNFTData(std::vector<ARTrackable *>& trackables)
             }
         }
     }
-    if (kpmSetRefDataSet(m_kpmHandle, refDataSet) < 0) {
-        ARLOGe("kpmSetRefDataSet\n");
+    if (kpmSetRefDataSetOwned(m_kpmHandle, &refDataSet) < 0) { // Mapped data stays in place, shared by all the KPM workers.
+        ARLOGe("kpmSetRefDataSetOwned\n");
         exit(-1);
     }
-    kpmDeleteRefDataSet(&refDataSet);
     
     // Start the KPM tracking thread.
     ARLOGi("Starting NFT tracking thread.\n");
-    trackingThreadHandle = trackingInitInit(m_kpmHandle);
+    trackingThreadHandle = trackingInitInit(m_kpmHandle, m_kpmThreadCount);
     if (!trackingThreadHandle) {
         ARLOGe("trackingInitInit()\n");
         return false;
@@ -210,6 +293,49 @@ bool ARTrackerNFT::isRunning()
     return (bool)(m_kpmHandle && m_ar2Handle);
 }
 
+bool ARTrackerNFT::getKPMHint(TrackingInitHint *hint, double now)
+{
+    int i, j;
+    
+    // Look for the pages lost recently, most recently lost first.
+    hint->pageNum = 0;
+    for (i = 0; i < PAGES_MAX; i++) {
+        if (m_pageLostTime[i] < 0.0) continue;
+        if (now - m_pageLostTime[i] > m_kpmRecoveryTimeout) {
+            m_pageLostTime[i] = -1.0;
+            continue;
+        }
+        for (j = hint->pageNum; j > 0 && m_pageLostTime[hint->pages[j - 1]] < m_pageLostTime[i]; j--) hint->pages[j] = hint->pages[j - 1];
+        hint->pages[j] = i;
+        hint->pageNum++;
+    }
+    if (hint->pageNum == 0) return false;
+    
+    // Look only near where they were last tracked, allowing them to have moved by up to half their size.
+    float bounds[4] = {0.0f, 0.0f, 0.0f, 0.0f}, pageBounds[4];
+    hint->region[2] = 0;
+    for (i = 0; i < hint->pageNum; i++) {
+        if (!getSurfaceSetBounds(m_ar2Handle->cparamLT, m_surfaceSet[hint->pages[i]], m_pageTrans[hint->pages[i]], pageBounds)) return true;
+        for (j = 0; j < 2; j++) {
+            if (i == 0 || pageBounds[j] < bounds[j]) bounds[j] = pageBounds[j];
+            if (i == 0 || pageBounds[j + 2] > bounds[j + 2]) bounds[j + 2] = pageBounds[j + 2];
+        }
+    }
+    float marginX = (bounds[2] - bounds[0]) * 0.5f;
+    float marginY = (bounds[3] - bounds[1]) * 0.5f;
+    int x0 = (int)std::max(bounds[0] - marginX, 0.0f);
+    int y0 = (int)std::max(bounds[1] - marginY, 0.0f);
+    int x1 = (int)std::min(bounds[2] + marginX + 1.0f, (float)m_ar2Handle->xsize);
+    int y1 = (int)std::min(bounds[3] + marginY + 1.0f, (float)m_ar2Handle->ysize);
+    if (x1 > x0 && y1 > y0) {
+        hint->region[0] = x0;
+        hint->region[1] = y0;
+        hint->region[2] = x1 - x0;
+        hint->region[3] = y1 - y0;
+    }
+    return true;
+}
+
 bool ARTrackerNFT::update(AR2VideoBufferT *buff, std::vector<ARTrackable *>& trackables)
 {
     ARLOGd("ARX::ARTrackerNFT::update()\n");
@@ -227,51 +353,62 @@ bool ARTrackerNFT::update(AR2VideoBufferT *buff, std::vector<ARTrackable *>& tra
     if (trackingThreadHandle) {
         
         // Do KPM tracking.
-        float err;
         float trackingTrans[3][4];
+        double now = timeNow();
         
         if (m_kpmRequired) {
-            if (!m_kpmBusy) {
-                trackingInitStart(trackingThreadHandle, buff->buffLuma);
-                m_kpmBusy = true;
-            } else {
-                int ret;
-                int pageNo;
-                ret = trackingInitGetResult(trackingThreadHandle, trackingTrans, &pageNo);
-                if (ret != 0) {
-                    m_kpmBusy = false;
-                    if (ret == 1) {
-                        if (pageNo >= 0 && pageNo < PAGES_MAX) {
-                            if (m_surfaceSet[pageNo]->contNum < 1) {
-                                ARLOGd("Detected page %d.\n", pageNo);
-                                ar2SetInitTrans(m_surfaceSet[pageNo], trackingTrans); // Sets surfaceSet[page]->contNum = 1.
-                            }
-                        } else {
-                            ARLOGe("Detected page with bad page number %d.\n", pageNo);
-                        }
-                    } else /*if (ret < 0)*/ {
-                        ARLOGd("No page detected.\n");
+            int ret;
+            int pageNo;
+            ret = trackingInitGetResult(trackingThreadHandle, trackingTrans, &pageNo);
+            if (ret == 1) {
+                if (pageNo >= 0 && pageNo < PAGES_MAX) {
+                    if (m_surfaceSet[pageNo]->contNum < 1) {
+                        ARLOGd("Detected page %d.\n", pageNo);
+                        ar2SetInitTrans(m_surfaceSet[pageNo], trackingTrans); // Sets surfaceSet[page]->contNum = 1.
+                        memcpy(m_pageTrans[pageNo], trackingTrans, sizeof(trackingTrans));
                     }
+                } else {
+                    ARLOGe("Detected page with bad page number %d.\n", pageNo);
+                }
+            } else {
+                if (ret < 0) {
+                    ARLOGd("No page detected.\n");
                 }
+                // Hand the newest frame to an idle worker, if there is one. Shortly after tracking of
+                // pages is lost, only look for those pages, near where they were last tracked.
+                TrackingInitHint hint;
+                trackingInitStart(trackingThreadHandle, buff->buffLuma, (getKPMHint(&hint, now) ? &hint : NULL));
             }
         }
         
-        // Do AR2 tracking and update NFT markers.
+        // Do AR2 tracking of all pages at once, then update NFT markers.
         int page = 0;
         int pagesTracked = 0;
         bool success = true;
         ARdouble *transL2R = (m_videoSourceIsStereo ? (ARdouble *)m_transL2R : NULL);
         
-        for (std::vector<ARTrackable *>::iterator it = trackables.begin(); it != trackables.end(); ++it) {
+        int pageCount = 0;
+        for (std::vector<ARTrackable *>::iterator it = trackables.begin(); it != trackables.end() && pageCount < PAGES_MAX; ++it) {
+            if ((*it)->type == ARTrackable::NFT) pageCount++;
+        }
+        float pageTrans[PAGES_MAX][3][4];
+        float pageErr[PAGES_MAX];
+        int pageResult[PAGES_MAX];
+        ar2TrackingMulti(m_ar2Handle, m_surfaceSet, pageCount, buff->buffLuma, pageTrans, pageErr, pageResult);
+        
+        for (std::vector<ARTrackable *>::iterator it = trackables.begin(); it != trackables.end() && page < pageCount; ++it) {
             if ((*it)->type == ARTrackable::NFT) {
                 
-                if (m_surfaceSet[page]->contNum > 0) {
-                    if (ar2Tracking(m_ar2Handle, m_surfaceSet[page], buff->buffLuma, trackingTrans, &err) < 0) {
+                if (pageResult[page] != -2) { // -2: Not being tracked.
+                    if (pageResult[page] < 0) {
                         ARLOGd("Tracking lost on page %d.\n", page);
+                        m_pageLostTime[page] = now;
                         success &= ((ARTrackableNFT *)(*it))->updateWithNFTResults(-1, NULL, NULL);
                     } else {
-                        ARLOGd("Tracked page %d (pos = {% 4f, % 4f, % 4f}).\n", page, trackingTrans[0][3], trackingTrans[1][3], trackingTrans[2][3]);
-                        success &= ((ARTrackableNFT *)(*it))->updateWithNFTResults(page, trackingTrans, (ARdouble (*)[4])transL2R);
+                        ARLOGd("Tracked page %d (pos = {% 4f, % 4f, % 4f}).\n", page, pageTrans[page][0][3], pageTrans[page][1][3], pageTrans[page][2][3]);
+                        success &= ((ARTrackableNFT *)(*it))->updateWithNFTResults(page, pageTrans[page], (ARdouble (*)[4])transL2R);
+                        memcpy(m_pageTrans[page], pageTrans[page], sizeof(pageTrans[page]));
+                        m_pageLostTime[page] = -1.0;
                         pagesTracked++;
                     }
                 }
@@ -54,6 +54,7 @@ extern "C" {
 #endif
 
 typedef struct _THREAD_HANDLE_T THREAD_HANDLE_T;
+typedef struct _THREAD_QUEUE_T THREAD_QUEUE_T;
 
 //
 // Client-side.
@@ -112,6 +113,22 @@ ARUTIL_EXTERN void *threadGetArg( THREAD_HANDLE_T *flag );    // Get the 'arg' v
 
 ARUTIL_EXTERN int threadGetCPU(void); // Returns the number of online CPUs in the system.
 
+//
+// Work queues.
+//
+
+ARUTIL_EXTERN THREAD_QUEUE_T *threadQueueInit( int size ); // Create a first-in first-out queue of up to size pointers, which may be shared between threads. Returns NULL in case of failure.
+ARUTIL_EXTERN int threadQueueFree( THREAD_QUEUE_T **queue ); // Frees the queue pointed to by the location pointed to by queue. No thread may be waiting on it. Location pointed to by queue is set to NULL. Returns -1 if queue or *queue is NULL.
+ARUTIL_EXTERN int threadQueuePush( THREAD_QUEUE_T *queue, void *item ); // Add item (which may be NULL) to the tail of the queue, waiting while the queue is full.
+ARUTIL_EXTERN void *threadQueuePop( THREAD_QUEUE_T *queue ); // Remove and return the item at the head of the queue, waiting while the queue is empty.
+
+// Example worker pulling jobs until it is sent NULL:
+//
+//    while ((job = threadQueuePop(jobQueue)) != NULL) {
+//        // Do the job.
+//        threadQueuePush(doneQueue, job);
+//    }
+
 
 #ifdef __cplusplus
 }
@@ -87,6 +87,16 @@ struct _THREAD_HANDLE_T {
     void           *arg;
 };
 
+struct _THREAD_QUEUE_T {
+    void          **items;
+    int             size;
+    int             head;   // Index of the next item to pop.
+    int             count;
+    pthread_mutex_t mut;
+    pthread_cond_t  cond1;  // Signals that an item has been pushed.
+    pthread_cond_t  cond2;  // Signals that an item has been popped.
+};
+
 //
 // Worker-side.
 //
@@ -270,3 +280,70 @@ int threadGetCPU(void)
     return (int)sysconf(_SC_NPROCESSORS_ONLN);
 #endif
 }
+
+//
+// Work queues.
+//
+
+THREAD_QUEUE_T *threadQueueInit( int size )
+{
+    THREAD_QUEUE_T *queue;
+
+    if( size <= 0 ) return NULL;
+    queue = (THREAD_QUEUE_T *)malloc(sizeof(THREAD_QUEUE_T));
+    if( queue == NULL ) return NULL;
+    queue->items = (void **)malloc(sizeof(void *) * size);
+    if( queue->items == NULL ) {
+        free( queue );
+        return NULL;
+    }
+    queue->size  = size;
+    queue->head  = 0;
+    queue->count = 0;
+    pthread_mutex_init( &(queue->mut), NULL );
+    pthread_cond_init( &(queue->cond1), NULL );
+    pthread_cond_init( &(queue->cond2), NULL );
+
+    return queue;
+}
+
+int threadQueueFree( THREAD_QUEUE_T **queue )
+{
+    if (!queue || !*queue) return -1;
+    pthread_mutex_destroy(&((*queue)->mut));
+    pthread_cond_destroy(&((*queue)->cond1));
+    pthread_cond_destroy(&((*queue)->cond2));
+    free( (*queue)->items );
+    free( *queue );
+    *queue = NULL;
+    return 0;
+}
+
+int threadQueuePush( THREAD_QUEUE_T *queue, void *item )
+{
+    pthread_mutex_lock(&(queue->mut));
+    while (queue->count == queue->size) {
+        pthread_cond_wait(&(queue->cond2), &(queue->mut));
+    }
+    queue->items[(queue->head + queue->count) % queue->size] = item;
+    queue->count++;
+    pthread_cond_signal(&(queue->cond1));
+    pthread_mutex_unlock(&(queue->mut));
+    return 0;
+}
+
+void *threadQueuePop( THREAD_QUEUE_T *queue )
+{
+    void *item;
+
+    pthread_mutex_lock(&(queue->mut));
+    while (queue->count == 0) {
+        pthread_cond_wait(&(queue->cond1), &(queue->mut));
+    }
+    item = queue->items[queue->head];
+    queue->head = (queue->head + 1) % queue->size;
+    queue->count--;
+    pthread_cond_signal(&(queue->cond2));
+    pthread_mutex_unlock(&(queue->mut));
+    return item;
+}
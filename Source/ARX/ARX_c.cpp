@@ -357,6 +357,13 @@ void arwSetTrackerOptionInt(int option, int value)
         gARTK->get2dTracker()->setDetectorType(value);
 #else
         return;
+#endif
+    } else if (option == ARW_TRACKER_OPTION_NFT_KPM_THREAD_COUNT) {
+#if HAVE_NFT
+        if (value < 0) return;
+        gARTK->getNFTTracker()->setKPMThreadCount(value);
+#else
+        return;
 #endif
     }
 }
@@ -407,6 +414,12 @@ int arwGetTrackerOptionInt(int option)
         return gARTK->getSquareTracker()->patternSize();
     } else if (option == ARW_TRACKER_OPTION_SQUARE_PATTERN_COUNT_MAX) {
         return gARTK->getSquareTracker()->patternCountMax();
+    } else if (option == ARW_TRACKER_OPTION_NFT_KPM_THREAD_COUNT) {
+#if HAVE_NFT
+        return gARTK->getNFTTracker()->KPMThreadCount();
+#else
+        return (INT_MAX);
+#endif
     }
     return (INT_MAX);
 }
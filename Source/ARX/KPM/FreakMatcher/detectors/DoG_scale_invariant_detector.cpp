@@ -38,12 +38,17 @@
 #include <framework/timers.h>
 #include <math/math_utils.h>
 #include <math/linear_algebra.h>
+#include <math/indexing.h>
 #include <algorithm>
 #include <functional>
 #include "interpolate.h"
 
 using namespace vision;
 
+// Size of the tasks handed to each thread when detecting on a worker pool
+static const size_t kRowsPerTask = 16;
+static const size_t kPointsPerTask = 16;
+
 DoGPyramid::DoGPyramid()
 : mNumOctaves(0)
 , mNumScalesPerOctave(0)
@@ -68,21 +73,48 @@ void DoGPyramid::alloc(const GaussianScaleSpacePyramid* pyramid) {
     }
 }
 
-void DoGPyramid::compute(const GaussianScaleSpacePyramid* pyramid) {
+void DoGPyramid::compute(const GaussianScaleSpacePyramid* pyramid, WorkerPool* pool) {
     ASSERT(mImages.size() > 0, "Laplacian pyramid has not been allocated");
     ASSERT(pyramid->numOctaves() > 0, "Pyramid does not contain any levels");
     ASSERT(dynamic_cast<const BinomialPyramid32f*>(pyramid), "Only binomial pyramid is supported");
     
-    for(size_t i = 0; i < mNumOctaves; i++) {
-        for(size_t j = 0; j < mNumScalesPerOctave; j++) {
-            difference_image_binomial(get(i, j),
-                                      pyramid->get(i, j),
-                                      pyramid->get(i, j+1));
+    if(!pool || pool->threadNum() == 1) {
+        for(size_t i = 0; i < mNumOctaves; i++) {
+            for(size_t j = 0; j < mNumScalesPerOctave; j++) {
+                difference_image_binomial(get(i, j),
+                                          pyramid->get(i, j),
+                                          pyramid->get(i, j+1),
+                                          0,
+                                          get(i, j).height());
+            }
         }
+        return;
     }
+    
+    mBands.clear();
+    for(size_t i = 0; i < mImages.size(); i++) {
+        AppendRowBands(mBands, i, 0, mImages[i].height(), kRowsPerTask);
+    }
+    
+    DifferenceJob job;
+    job.dog = this;
+    job.pyramid = pyramid;
+    pool->forEach(differenceTask, &job, mBands.size());
+}
+
+void DoGPyramid::differenceTask(void* arg, int thread, size_t task) {
+    DifferenceJob* job = (DifferenceJob*)arg;
+    const RowBand& band = job->dog->mBands[task];
+    size_t octave = band.image/job->dog->mNumScalesPerOctave;
+    size_t scale = band.image%job->dog->mNumScalesPerOctave;
+    job->dog->difference_image_binomial(job->dog->get(band.image),
+                                        job->pyramid->get(octave, scale),
+                                        job->pyramid->get(octave, scale+1),
+                                        band.begin,
+                                        band.end);
 }
 
-void DoGPyramid::difference_image_binomial(Image& d, const Image& im1, const Image& im2) {
+void DoGPyramid::difference_image_binomial(Image& d, const Image& im1, const Image& im2, size_t row_begin, size_t row_end) {
     ASSERT(d.type() == IMAGE_F32, "Only F32 images supported");
     ASSERT(im1.type() == IMAGE_F32, "Only F32 images supported");
     ASSERT(im2.type() == IMAGE_F32, "Only F32 images supported");
@@ -95,7 +127,7 @@ void DoGPyramid::difference_image_binomial(Image& d, const Image& im1, const Ima
     ASSERT(im1.height() == im2.height(), "Images must have the same height");
     
     // Compute diff
-    for(size_t i = 0; i < im1.height(); i++) {
+    for(size_t i = row_begin; i < row_end; i++) {
         float* p0 = d.get<float>(i);
         const float* p1 = im1.get<float>(i);
         const float* p2 = im2.get<float>(i);
@@ -113,9 +145,9 @@ DoGScaleInvariantDetector::DoGScaleInvariantDetector()
 , mFindOrientation(true)
 , mLaplacianThreshold(0)
 , mEdgeThreshold(10)
-, mMaxSubpixelDistanceSqr(3*3) {
+, mMaxSubpixelDistanceSqr(3*3)
+, mWorkerPool(NULL) {
     setMaxNumFeaturePoints(kMaxNumFeaturePoints);
-    mOrientations.resize(kMaxNumOrientations);
 }
 
 DoGScaleInvariantDetector::~DoGScaleInvariantDetector() {}
@@ -148,7 +180,7 @@ void DoGScaleInvariantDetector::detect(const GaussianScaleSpacePyramid* pyramid)
     
     // Compute Laplacian images (DoG)
     TIMED("DoG Pyramid") {
-        mLaplacianPyramid.compute(pyramid);
+        mLaplacianPyramid.compute(pyramid, parallel() ? mWorkerPool : NULL);
     }
     
     // Detect minima and maximum in Laplacian images
@@ -178,269 +210,315 @@ void DoGScaleInvariantDetector::extractFeatures(const GaussianScaleSpacePyramid*
     // Clear old features
     mFeaturePoints.clear();
     
+    if(!parallel()) {
+        for(size_t i = 1; i < laplacian->size()-1; i++) {
+            extractFeatures(mFeaturePoints, pyramid, laplacian, i, 0, laplacian->get(i).height());
+        }
+        return;
+    }
+    
+    mBands.clear();
+    for(size_t i = 1; i < laplacian->size()-1; i++) {
+        AppendRowBands(mBands, i, 0, laplacian->get(i).height(), kRowsPerTask);
+    }
+    if(mTaskFeaturePoints.size() < mBands.size()) {
+        mTaskFeaturePoints.resize(mBands.size());
+    }
+    
+    DetectJob job;
+    job.detector = this;
+    job.pyramid = pyramid;
+    mWorkerPool->forEach(extremaTask, &job, mBands.size());
+    
+    for(size_t i = 0; i < mBands.size(); i++) {
+        mFeaturePoints.insert(mFeaturePoints.end(), mTaskFeaturePoints[i].begin(), mTaskFeaturePoints[i].end());
+    }
+}
+
+void DoGScaleInvariantDetector::extremaTask(void* arg, int thread, size_t task) {
+    DetectJob* job = (DetectJob*)arg;
+    DoGScaleInvariantDetector* detector = job->detector;
+    const RowBand& band = detector->mBands[task];
+    
+    std::vector<FeaturePoint>& points = detector->mTaskFeaturePoints[task];
+    points.clear();
+    detector->extractFeatures(points, job->pyramid, &detector->mLaplacianPyramid, band.image, band.begin, band.end);
+}
+
+void DoGScaleInvariantDetector::extractFeatures(std::vector<FeaturePoint>& points,
+                                                const GaussianScaleSpacePyramid* pyramid,
+                                                const DoGPyramid* laplacian,
+                                                size_t level,
+                                                size_t row_begin,
+                                                size_t row_end) const {
+    
     float laplacianSqrThreshold = sqr(mLaplacianThreshold);
     
-    for(size_t i = 1; i < mLaplacianPyramid.size()-1; i++) {
-        const Image& im0 = laplacian->get(i-1);
-        const Image& im1 = laplacian->get(i);
-        const Image& im2 = laplacian->get(i+1);
+    const Image& im0 = laplacian->get(level-1);
+    const Image& im1 = laplacian->get(level);
+    const Image& im2 = laplacian->get(level+1);
+    
+    int octave = laplacian->octaveFromIndex((int)level);
+    int scale = laplacian->scaleFromIndex((int)level);
+    
+    if(im0.width() == im1.width() && im0.width() == im2.width()) { // All images are the same size
+        ASSERT(im0.height() == im1.height(), "Height is inconsistent");
+        ASSERT(im0.height() == im2.height(), "Height is inconsistent");
         
-        int octave = laplacian->octaveFromIndex((int)i);
-        int scale = laplacian->scaleFromIndex((int)i);
+        size_t width_minus_1 = im1.width() - 1;
+        size_t heigh_minus_1 = im1.height() - 1;
         
-        if(im0.width() == im1.width() && im0.width() == im2.width()) { // All images are the same size
-            ASSERT(im0.height() == im1.height(), "Height is inconsistent");
-            ASSERT(im0.height() == im2.height(), "Height is inconsistent");
+        size_t end_y = min2<size_t>(row_end, heigh_minus_1);
+        
+        for(size_t row = max2<size_t>(row_begin, 1); row < end_y; row++) {
+            const float* im0_ym1 = im0.get<float>(row-1);
+            const float* im0_y   = im0.get<float>(row);
+            const float* im0_yp1 = im0.get<float>(row+1);
             
-            size_t width_minus_1 = im1.width() - 1;
-            size_t heigh_minus_1 = im1.height() - 1;
+            const float* im1_ym1 = im1.get<float>(row-1);
+            const float* im1_y   = im1.get<float>(row);
+            const float* im1_yp1 = im1.get<float>(row+1);
             
-            for(size_t row = 1; row < heigh_minus_1; row++) {
-                const float* im0_ym1 = im0.get<float>(row-1);
-                const float* im0_y   = im0.get<float>(row);
-                const float* im0_yp1 = im0.get<float>(row+1);
-                
-                const float* im1_ym1 = im1.get<float>(row-1);
-                const float* im1_y   = im1.get<float>(row);
-                const float* im1_yp1 = im1.get<float>(row+1);
+            const float* im2_ym1 = im2.get<float>(row-1);
+            const float* im2_y   = im2.get<float>(row);
+            const float* im2_yp1 = im2.get<float>(row+1);
+            
+            for(size_t col = 1; col < width_minus_1; col++) {
+                const float& value = im1_y[col];
+                FeaturePoint fp;
                 
-                const float* im2_ym1 = im2.get<float>(row-1);
-                const float* im2_y   = im2.get<float>(row);
-                const float* im2_yp1 = im2.get<float>(row+1);
+                // Check laplacian score
+                if(sqr(value) < laplacianSqrThreshold) {
+                    continue;
+                }
                 
-                for(size_t col = 1; col < width_minus_1; col++) {
-                    const float& value = im1_y[col];
-                    FeaturePoint fp;
-                    
-                    // Check laplacian score
-                    if(sqr(value) < laplacianSqrThreshold) {
-                        continue;
-                    }
-                    
 #define NONMAX_CHECK(OPERATOR, VALUE)                  \
-                    /* im0 - 9 evaluations */          \
-                    VALUE OPERATOR im0_ym1[col-1]   && \
-                    VALUE OPERATOR im0_ym1[col]     && \
-                    VALUE OPERATOR im0_ym1[col+1]   && \
-                    VALUE OPERATOR im0_y[col-1]     && \
-                    VALUE OPERATOR im0_y[col]       && \
-                    VALUE OPERATOR im0_y[col+1]     && \
-                    VALUE OPERATOR im0_yp1[col-1]   && \
-                    VALUE OPERATOR im0_yp1[col]     && \
-                    VALUE OPERATOR im0_yp1[col+1]   && \
-                    /* im1 - 8 evaluations */          \
-                    VALUE OPERATOR im1_ym1[col-1]   && \
-                    VALUE OPERATOR im1_ym1[col]     && \
-                    VALUE OPERATOR im1_ym1[col+1]   && \
-                    VALUE OPERATOR im1_y[col-1]     && \
-                    VALUE OPERATOR im1_y[col+1]     && \
-                    VALUE OPERATOR im1_yp1[col-1]   && \
-                    VALUE OPERATOR im1_yp1[col]     && \
-                    VALUE OPERATOR im1_yp1[col+1]   && \
-                    /* im2 - 9 evaluations */          \
-                    VALUE OPERATOR im2_ym1[col-1]   && \
-                    VALUE OPERATOR im2_ym1[col]     && \
-                    VALUE OPERATOR im2_ym1[col+1]   && \
-                    VALUE OPERATOR im2_y[col-1]     && \
-                    VALUE OPERATOR im2_y[col]       && \
-                    VALUE OPERATOR im2_y[col+1]     && \
-                    VALUE OPERATOR im2_yp1[col-1]   && \
-                    VALUE OPERATOR im2_yp1[col]     && \
-                    VALUE OPERATOR im2_yp1[col+1]
-                    
-                    bool extrema = false;
-                    if(NONMAX_CHECK(>, value)) { // strictly greater than
-                        extrema = true;
-                    } else if(NONMAX_CHECK(<, value)) { // strictly less than
-                        extrema = true;
-                    }
+                /* im0 - 9 evaluations */          \
+                VALUE OPERATOR im0_ym1[col-1]   && \
+                VALUE OPERATOR im0_ym1[col]     && \
+                VALUE OPERATOR im0_ym1[col+1]   && \
+                VALUE OPERATOR im0_y[col-1]     && \
+                VALUE OPERATOR im0_y[col]       && \
+                VALUE OPERATOR im0_y[col+1]     && \
+                VALUE OPERATOR im0_yp1[col-1]   && \
+                VALUE OPERATOR im0_yp1[col]     && \
+                VALUE OPERATOR im0_yp1[col+1]   && \
+                /* im1 - 8 evaluations */          \
+                VALUE OPERATOR im1_ym1[col-1]   && \
+                VALUE OPERATOR im1_ym1[col]     && \
+                VALUE OPERATOR im1_ym1[col+1]   && \
+                VALUE OPERATOR im1_y[col-1]     && \
+                VALUE OPERATOR im1_y[col+1]     && \
+                VALUE OPERATOR im1_yp1[col-1]   && \
+                VALUE OPERATOR im1_yp1[col]     && \
+                VALUE OPERATOR im1_yp1[col+1]   && \
+                /* im2 - 9 evaluations */          \
+                VALUE OPERATOR im2_ym1[col-1]   && \
+                VALUE OPERATOR im2_ym1[col]     && \
+                VALUE OPERATOR im2_ym1[col+1]   && \
+                VALUE OPERATOR im2_y[col-1]     && \
+                VALUE OPERATOR im2_y[col]       && \
+                VALUE OPERATOR im2_y[col+1]     && \
+                VALUE OPERATOR im2_yp1[col-1]   && \
+                VALUE OPERATOR im2_yp1[col]     && \
+                VALUE OPERATOR im2_yp1[col+1]
+                
+                bool extrema = false;
+                if(NONMAX_CHECK(>, value)) { // strictly greater than
+                    extrema = true;
+                } else if(NONMAX_CHECK(<, value)) { // strictly less than
+                    extrema = true;
+                }
+                
+                if(extrema) {
+                    fp.octave = octave;
+                    fp.scale  = scale;
+                    fp.score  = value;
+                    fp.sigma  = pyramid->effectiveSigma(octave, scale);
                     
-                    if(extrema) {
-                        fp.octave = octave;
-                        fp.scale  = scale;
-                        fp.score  = value;
-                        fp.sigma  = pyramid->effectiveSigma(octave, scale);
-                        
-                        bilinear_upsample_point(fp.x,
-                                                fp.y,
-                                                col,
-                                                row,
-                                                octave);
-                        
-                        mFeaturePoints.push_back(fp);
-                    }
+                    bilinear_upsample_point(fp.x,
+                                            fp.y,
+                                            col,
+                                            row,
+                                            octave);
                     
-#undef NONMAX_CHECK
+                    points.push_back(fp);
                 }
+                
+#undef NONMAX_CHECK
             }
-        } else if(im0.width() == im1.width() && (im1.width()>>1) == im2.width()) { // 0,1 are the same size, 2 is half size
-            ASSERT(im0.height() == im1.height(), "Height is inconsistent");
-            ASSERT((im1.height()>>1) == im2.height(), "Height is inconsistent");
-    
-            size_t end_x = std::floor(((im2.width()-1)-0.5f)*2.f+0.5f);
-            size_t end_y = std::floor(((im2.height()-1)-0.5f)*2.f+0.5f);
+        }
+    } else if(im0.width() == im1.width() && (im1.width()>>1) == im2.width()) { // 0,1 are the same size, 2 is half size
+        ASSERT(im0.height() == im1.height(), "Height is inconsistent");
+        ASSERT((im1.height()>>1) == im2.height(), "Height is inconsistent");
 
-            for(size_t row = 2; row < end_y; row++) {
-                const float* im0_ym1 = im0.get<float>(row-1);
-                const float* im0_y   = im0.get<float>(row);
-                const float* im0_yp1 = im0.get<float>(row+1);
-                
-                const float* im1_ym1 = im1.get<float>(row-1);
-                const float* im1_y   = im1.get<float>(row);
-                const float* im1_yp1 = im1.get<float>(row+1);
+        size_t end_x = std::floor(((im2.width()-1)-0.5f)*2.f+0.5f);
+        size_t end_y = std::floor(((im2.height()-1)-0.5f)*2.f+0.5f);
 
-                for(size_t col = 2; col < end_x; col++) {
-                    const float& value = im1_y[col];
-                    FeaturePoint fp;
-                    
-                    // Check laplacian score
-                    if(sqr(value) < laplacianSqrThreshold) {
-                        continue;
-                    }
-                    
-                    // Compute downsampled point location
-                    float ds_x = col*0.5f-0.25f;
-                    float ds_y = row*0.5f-0.25f;
-                                        
+        end_y = min2<size_t>(row_end, end_y);
+
+        for(size_t row = max2<size_t>(row_begin, 2); row < end_y; row++) {
+            const float* im0_ym1 = im0.get<float>(row-1);
+            const float* im0_y   = im0.get<float>(row);
+            const float* im0_yp1 = im0.get<float>(row+1);
+            
+            const float* im1_ym1 = im1.get<float>(row-1);
+            const float* im1_y   = im1.get<float>(row);
+            const float* im1_yp1 = im1.get<float>(row+1);
+
+            for(size_t col = 2; col < end_x; col++) {
+                const float& value = im1_y[col];
+                FeaturePoint fp;
+                
+                // Check laplacian score
+                if(sqr(value) < laplacianSqrThreshold) {
+                    continue;
+                }
+                
+                // Compute downsampled point location
+                float ds_x = col*0.5f-0.25f;
+                float ds_y = row*0.5f-0.25f;
+                                    
 #define NONMAX_CHECK(OPERATOR, VALUE)                  \
-                    /* im0 - 9 evaluations */          \
-                    VALUE OPERATOR im0_ym1[col-1]   && \
-                    VALUE OPERATOR im0_ym1[col]     && \
-                    VALUE OPERATOR im0_ym1[col+1]   && \
-                    VALUE OPERATOR im0_y[col-1]     && \
-                    VALUE OPERATOR im0_y[col]       && \
-                    VALUE OPERATOR im0_y[col+1]     && \
-                    VALUE OPERATOR im0_yp1[col-1]   && \
-                    VALUE OPERATOR im0_yp1[col]     && \
-                    VALUE OPERATOR im0_yp1[col+1]   && \
-                    /* im1 - 8 evaluations */          \
-                    VALUE OPERATOR im1_ym1[col-1]   && \
-                    VALUE OPERATOR im1_ym1[col]     && \
-                    VALUE OPERATOR im1_ym1[col+1]   && \
-                    VALUE OPERATOR im1_y[col-1]     && \
-                    VALUE OPERATOR im1_y[col+1]     && \
-                    VALUE OPERATOR im1_yp1[col-1]   && \
-                    VALUE OPERATOR im1_yp1[col]     && \
-                    VALUE OPERATOR im1_yp1[col+1]   && \
-                    /* im2 - 9 evaluations */          \
-                    VALUE OPERATOR bilinear_interpolation<float>(im2, ds_x-0.5f, ds_y-0.5f)   && \
-                    VALUE OPERATOR bilinear_interpolation<float>(im2, ds_x,      ds_y-0.5f)   && \
-                    VALUE OPERATOR bilinear_interpolation<float>(im2, ds_x+0.5f, ds_y-0.5f)   && \
-                    VALUE OPERATOR bilinear_interpolation<float>(im2, ds_x-0.5f, ds_y)        && \
-                    VALUE OPERATOR bilinear_interpolation<float>(im2, ds_x,      ds_y)        && \
-                    VALUE OPERATOR bilinear_interpolation<float>(im2, ds_x+0.5f, ds_y)        && \
-                    VALUE OPERATOR bilinear_interpolation<float>(im2, ds_x-0.5f, ds_y+0.5f)   && \
-                    VALUE OPERATOR bilinear_interpolation<float>(im2, ds_x,      ds_y+0.5f)   && \
-                    VALUE OPERATOR bilinear_interpolation<float>(im2, ds_x+0.5f, ds_y+0.5f)
+                /* im0 - 9 evaluations */          \
+                VALUE OPERATOR im0_ym1[col-1]   && \
+                VALUE OPERATOR im0_ym1[col]     && \
+                VALUE OPERATOR im0_ym1[col+1]   && \
+                VALUE OPERATOR im0_y[col-1]     && \
+                VALUE OPERATOR im0_y[col]       && \
+                VALUE OPERATOR im0_y[col+1]     && \
+                VALUE OPERATOR im0_yp1[col-1]   && \
+                VALUE OPERATOR im0_yp1[col]     && \
+                VALUE OPERATOR im0_yp1[col+1]   && \
+                /* im1 - 8 evaluations */          \
+                VALUE OPERATOR im1_ym1[col-1]   && \
+                VALUE OPERATOR im1_ym1[col]     && \
+                VALUE OPERATOR im1_ym1[col+1]   && \
+                VALUE OPERATOR im1_y[col-1]     && \
+                VALUE OPERATOR im1_y[col+1]     && \
+                VALUE OPERATOR im1_yp1[col-1]   && \
+                VALUE OPERATOR im1_yp1[col]     && \
+                VALUE OPERATOR im1_yp1[col+1]   && \
+                /* im2 - 9 evaluations */          \
+                VALUE OPERATOR bilinear_interpolation<float>(im2, ds_x-0.5f, ds_y-0.5f)   && \
+                VALUE OPERATOR bilinear_interpolation<float>(im2, ds_x,      ds_y-0.5f)   && \
+                VALUE OPERATOR bilinear_interpolation<float>(im2, ds_x+0.5f, ds_y-0.5f)   && \
+                VALUE OPERATOR bilinear_interpolation<float>(im2, ds_x-0.5f, ds_y)        && \
+                VALUE OPERATOR bilinear_interpolation<float>(im2, ds_x,      ds_y)        && \
+                VALUE OPERATOR bilinear_interpolation<float>(im2, ds_x+0.5f, ds_y)        && \
+                VALUE OPERATOR bilinear_interpolation<float>(im2, ds_x-0.5f, ds_y+0.5f)   && \
+                VALUE OPERATOR bilinear_interpolation<float>(im2, ds_x,      ds_y+0.5f)   && \
+                VALUE OPERATOR bilinear_interpolation<float>(im2, ds_x+0.5f, ds_y+0.5f)
 
-                    bool extrema = false;
-                    if(NONMAX_CHECK(>, value)) { // strictly greater than
-                        extrema = true;
-                    } else if(NONMAX_CHECK(<, value)) { // strictly less than
-                        extrema = true;
-                    }
+                bool extrema = false;
+                if(NONMAX_CHECK(>, value)) { // strictly greater than
+                    extrema = true;
+                } else if(NONMAX_CHECK(<, value)) { // strictly less than
+                    extrema = true;
+                }
+                
+                if(extrema) {
+                    fp.octave = octave;
+                    fp.scale  = scale;
+                    fp.score  = value;
+                    fp.sigma  = pyramid->effectiveSigma(octave, scale);
                     
-                    if(extrema) {
-                        fp.octave = octave;
-                        fp.scale  = scale;
-                        fp.score  = value;
-                        fp.sigma  = pyramid->effectiveSigma(octave, scale);
-                        
-                        bilinear_upsample_point(fp.x,
-                                                fp.y,
-                                                col,
-                                                row,
-                                                octave);
-                        
-                        mFeaturePoints.push_back(fp);
-                    }
+                    bilinear_upsample_point(fp.x,
+                                            fp.y,
+                                            col,
+                                            row,
+                                            octave);
                     
-#undef NONMAX_CHECK
+                    points.push_back(fp);
                 }
+                
+#undef NONMAX_CHECK
             }
-        } else if((im0.width()>>1) == im1.width() && (im0.width()>>1) == im2.width()) { // 0 is twice the size of 1 and 2
-            ASSERT((im0.height()>>1) == im1.height(), "Height is inconsistent");
-            ASSERT((im0.height()>>1) == im2.height(), "Height is inconsistent");
+        }
+    } else if((im0.width()>>1) == im1.width() && (im0.width()>>1) == im2.width()) { // 0 is twice the size of 1 and 2
+        ASSERT((im0.height()>>1) == im1.height(), "Height is inconsistent");
+        ASSERT((im0.height()>>1) == im2.height(), "Height is inconsistent");
+        
+        size_t width_minus_1 = im1.width() - 1;
+        size_t height_minus_1 = im1.height() - 1;
+        
+        size_t end_y = min2<size_t>(row_end, height_minus_1);
+        
+        for(size_t row = max2<size_t>(row_begin, 1); row < end_y; row++) {
+            const float* im1_ym1 = im1.get<float>(row-1);
+            const float* im1_y   = im1.get<float>(row);
+            const float* im1_yp1 = im1.get<float>(row+1);
             
-            size_t width_minus_1 = im1.width() - 1;
-            size_t height_minus_1 = im1.height() - 1;
+            const float* im2_ym1 = im2.get<float>(row-1);
+            const float* im2_y   = im2.get<float>(row);
+            const float* im2_yp1 = im2.get<float>(row+1);
             
-            for(size_t row = 1; row < height_minus_1; row++) {
-                const float* im1_ym1 = im1.get<float>(row-1);
-                const float* im1_y   = im1.get<float>(row);
-                const float* im1_yp1 = im1.get<float>(row+1);
+            for(size_t col = 1; col < width_minus_1; col++) {
+                const float& value = im1_y[col];
+                FeaturePoint fp;
                 
-                const float* im2_ym1 = im2.get<float>(row-1);
-                const float* im2_y   = im2.get<float>(row);
-                const float* im2_yp1 = im2.get<float>(row+1);
+                // Check laplacian score
+                if(sqr(value) < laplacianSqrThreshold) {
+                    continue;
+                }
+                
+                float us_x = (col<<1)+0.5f;
+                float us_y = (row<<1)+0.5f;
                 
-                for(size_t col = 1; col < width_minus_1; col++) {
-                    const float& value = im1_y[col];
-                    FeaturePoint fp;
-                    
-                    // Check laplacian score
-                    if(sqr(value) < laplacianSqrThreshold) {
-                        continue;
-                    }
-                    
-                    float us_x = (col<<1)+0.5f;
-                    float us_y = (row<<1)+0.5f;
-                    
 #define NONMAX_CHECK(OPERATOR, VALUE)                  \
-                    /* im1 - 8 evaluations */          \
-                    VALUE OPERATOR im1_ym1[col-1]   && \
-                    VALUE OPERATOR im1_ym1[col]     && \
-                    VALUE OPERATOR im1_ym1[col+1]   && \
-                    VALUE OPERATOR im1_y[col-1]     && \
-                    VALUE OPERATOR im1_y[col+1]     && \
-                    VALUE OPERATOR im1_yp1[col-1]   && \
-                    VALUE OPERATOR im1_yp1[col]     && \
-                    VALUE OPERATOR im1_yp1[col+1]   && \
-                    /* im2 - 9 evaluations */          \
-                    VALUE OPERATOR im2_ym1[col-1]   && \
-                    VALUE OPERATOR im2_ym1[col]     && \
-                    VALUE OPERATOR im2_ym1[col+1]   && \
-                    VALUE OPERATOR im2_y[col-1]     && \
-                    VALUE OPERATOR im2_y[col]       && \
-                    VALUE OPERATOR im2_y[col+1]     && \
-                    VALUE OPERATOR im2_yp1[col-1]   && \
-                    VALUE OPERATOR im2_yp1[col]     && \
-                    VALUE OPERATOR im2_yp1[col+1]   && \
-                    /* im2 - 9 evaluations */          \
-                    VALUE OPERATOR bilinear_interpolation<float>(im0, us_x-2.f, us_y-2.f)   && \
-                    VALUE OPERATOR bilinear_interpolation<float>(im0, us_x,     us_y-2.f)   && \
-                    VALUE OPERATOR bilinear_interpolation<float>(im0, us_x+2.f, us_y-2.f)   && \
-                    VALUE OPERATOR bilinear_interpolation<float>(im0, us_x-2.f, us_y)       && \
-                    VALUE OPERATOR bilinear_interpolation<float>(im0, us_x,     us_y)       && \
-                    VALUE OPERATOR bilinear_interpolation<float>(im0, us_x+2.f, us_y)       && \
-                    VALUE OPERATOR bilinear_interpolation<float>(im0, us_x-2.f, us_y+2.f)   && \
-                    VALUE OPERATOR bilinear_interpolation<float>(im0, us_x,     us_y+2.f)   && \
-                    VALUE OPERATOR bilinear_interpolation<float>(im0, us_x+2.f, us_y+2.f)
-                    
-                    bool extrema = false;
-                    if(NONMAX_CHECK(>, value)) { // strictly greater than
-                        extrema = true;
-                    } else if(NONMAX_CHECK(<, value)) { // strictly less than
-                        extrema = true;
-                    }
+                /* im1 - 8 evaluations */          \
+                VALUE OPERATOR im1_ym1[col-1]   && \
+                VALUE OPERATOR im1_ym1[col]     && \
+                VALUE OPERATOR im1_ym1[col+1]   && \
+                VALUE OPERATOR im1_y[col-1]     && \
+                VALUE OPERATOR im1_y[col+1]     && \
+                VALUE OPERATOR im1_yp1[col-1]   && \
+                VALUE OPERATOR im1_yp1[col]     && \
+                VALUE OPERATOR im1_yp1[col+1]   && \
+                /* im2 - 9 evaluations */          \
+                VALUE OPERATOR im2_ym1[col-1]   && \
+                VALUE OPERATOR im2_ym1[col]     && \
+                VALUE OPERATOR im2_ym1[col+1]   && \
+                VALUE OPERATOR im2_y[col-1]     && \
+                VALUE OPERATOR im2_y[col]       && \
+                VALUE OPERATOR im2_y[col+1]     && \
+                VALUE OPERATOR im2_yp1[col-1]   && \
+                VALUE OPERATOR im2_yp1[col]     && \
+                VALUE OPERATOR im2_yp1[col+1]   && \
+                /* im2 - 9 evaluations */          \
+                VALUE OPERATOR bilinear_interpolation<float>(im0, us_x-2.f, us_y-2.f)   && \
+                VALUE OPERATOR bilinear_interpolation<float>(im0, us_x,     us_y-2.f)   && \
+                VALUE OPERATOR bilinear_interpolation<float>(im0, us_x+2.f, us_y-2.f)   && \
+                VALUE OPERATOR bilinear_interpolation<float>(im0, us_x-2.f, us_y)       && \
+                VALUE OPERATOR bilinear_interpolation<float>(im0, us_x,     us_y)       && \
+                VALUE OPERATOR bilinear_interpolation<float>(im0, us_x+2.f, us_y)       && \
+                VALUE OPERATOR bilinear_interpolation<float>(im0, us_x-2.f, us_y+2.f)   && \
+                VALUE OPERATOR bilinear_interpolation<float>(im0, us_x,     us_y+2.f)   && \
+                VALUE OPERATOR bilinear_interpolation<float>(im0, us_x+2.f, us_y+2.f)
+                
+                bool extrema = false;
+                if(NONMAX_CHECK(>, value)) { // strictly greater than
+                    extrema = true;
+                } else if(NONMAX_CHECK(<, value)) { // strictly less than
+                    extrema = true;
+                }
+                
+                if(extrema) {
+                    fp.octave = octave;
+                    fp.scale  = scale;
+                    fp.score  = value;
+                    fp.sigma  = pyramid->effectiveSigma(octave, scale);
                     
-                    if(extrema) {
-                        fp.octave = octave;
-                        fp.scale  = scale;
-                        fp.score  = value;
-                        fp.sigma  = pyramid->effectiveSigma(octave, scale);
-                        
-                        bilinear_upsample_point(fp.x,
-                                                fp.y,
-                                                col,
-                                                row,
-                                                octave);
-                        
-                        mFeaturePoints.push_back(fp);
-                    }
+                    bilinear_upsample_point(fp.x,
+                                            fp.y,
+                                            col,
+                                            row,
+                                            octave);
                     
-#undef NONMAX_CHECK
+                    points.push_back(fp);
                 }
+                
+#undef NONMAX_CHECK
             }
         }
     }
@@ -470,83 +548,114 @@ void DoGScaleInvariantDetector::pruneFeatures() {
 }
 
 void DoGScaleInvariantDetector::findSubpixelLocations(const GaussianScaleSpacePyramid* pyramid) {
+    size_t num_points = 0;
+    
+    if(!parallel()) {
+        for(size_t i = 0; i < mFeaturePoints.size(); i++) {
+            if(findSubpixelLocation(mFeaturePoints[i], pyramid)) {
+                mFeaturePoints[num_points++] = mFeaturePoints[i];
+            }
+        }
+    } else {
+        mKeepFeaturePoints.resize(mFeaturePoints.size());
+        
+        DetectJob job;
+        job.detector = this;
+        job.pyramid = pyramid;
+        mWorkerPool->forEach(subpixelTask, &job, (mFeaturePoints.size()+kPointsPerTask-1)/kPointsPerTask);
+        
+        for(size_t i = 0; i < mFeaturePoints.size(); i++) {
+            if(mKeepFeaturePoints[i]) {
+                mFeaturePoints[num_points++] = mFeaturePoints[i];
+            }
+        }
+    }
+    
+    mFeaturePoints.resize(num_points);
+}
+
+void DoGScaleInvariantDetector::subpixelTask(void* arg, int thread, size_t task) {
+    DetectJob* job = (DetectJob*)arg;
+    DoGScaleInvariantDetector* detector = job->detector;
+    
+    size_t end = min2<size_t>((task+1)*kPointsPerTask, detector->mFeaturePoints.size());
+    for(size_t i = task*kPointsPerTask; i < end; i++) {
+        detector->mKeepFeaturePoints[i] = detector->findSubpixelLocation(detector->mFeaturePoints[i], job->pyramid);
+    }
+}
+
+bool DoGScaleInvariantDetector::findSubpixelLocation(FeaturePoint& kp, const GaussianScaleSpacePyramid* pyramid) const {
     float A[9];
     float b[3];
     float u[3];
     int x, y;
     float xp, yp;
-    int num_points;
     float laplacianSqrThreshold;
     float hessianThreshold;
     
-    num_points = 0;
     laplacianSqrThreshold = sqr(mLaplacianThreshold);
     hessianThreshold = (sqr(mEdgeThreshold+1)/mEdgeThreshold);
     
-    for(size_t i = 0; i < mFeaturePoints.size(); i++) {
-        FeaturePoint& kp = mFeaturePoints[i];
-        
-        ASSERT(kp.scale < mLaplacianPyramid.numScalePerOctave(), "Feature point scale is out of bounds");
-        int lap_index = kp.octave*mLaplacianPyramid.numScalePerOctave()+kp.scale;
-        
-        // Downsample the feature point to the detection octave
-        bilinear_downsample_point(xp, yp, kp.x, kp.y, kp.octave);
-        
-        // Compute the discrete pixel location
-        x = (int)(xp+0.5f);
-        y = (int)(yp+0.5f);
-        
-        // Get Laplacian images
-        const Image& lap0 = mLaplacianPyramid.images()[lap_index-1];
-        const Image& lap1 = mLaplacianPyramid.images()[lap_index];
-        const Image& lap2 = mLaplacianPyramid.images()[lap_index+1];
-        
-        // Compute the Hessian
-        if(!ComputeSubpixelHessian(A, b, lap0, lap1, lap2, x, y)) {
-            continue;
-        }
-        
-        // A*u=b
-        if(!SolveSymmetricLinearSystem3x3(u, A, b)) {
-            continue;
-        }
-        
-        // If points move too much in the sub-pixel update, then the point probably
-        // unstable.
-        if(sqr(u[0])+sqr(u[1]) > mMaxSubpixelDistanceSqr) {
-            continue;
-        }
-        
-        // Compute the edge score
-        if(!ComputeEdgeScore(kp.edge_score, A)) {
-            continue;
-        }
-        
-        // Compute a linear estimate of the intensity
-        ASSERT(kp.score == lap1.get<float>(y)[x], "Score is not consistent with the DoG image");
-        kp.score = lap1.get<float>(y)[x] - (b[0]*u[0] + b[1]*u[1] + b[2]*u[2]);
-        
-        // Update the location:
-        // Apply the update on the downsampled location and then upsample the result.
-        bilinear_upsample_point(kp.x, kp.y, xp+u[0], yp+u[1], kp.octave);
-        
-        // Update the scale
-        kp.sp_scale = kp.scale + u[2];
-        kp.sp_scale = ClipScalar<float>(kp.sp_scale, 0, mLaplacianPyramid.numScalePerOctave());
-        
-        if(std::abs(kp.edge_score)  < hessianThreshold &&
-           sqr(kp.score)            >= laplacianSqrThreshold &&
-           kp.x                     >= 0 &&
-           kp.x                     < mLaplacianPyramid.images()[0].width() &&
-           kp.y                     >= 0 &&
-           kp.y                     < mLaplacianPyramid.images()[0].height()) {
-            // Update the sigma
-            kp.sigma = pyramid->effectiveSigma(kp.octave, kp.sp_scale);
-            mFeaturePoints[num_points++] = kp;
-        }
+    ASSERT(kp.scale < mLaplacianPyramid.numScalePerOctave(), "Feature point scale is out of bounds");
+    int lap_index = kp.octave*mLaplacianPyramid.numScalePerOctave()+kp.scale;
+    
+    // Downsample the feature point to the detection octave
+    bilinear_downsample_point(xp, yp, kp.x, kp.y, kp.octave);
+    
+    // Compute the discrete pixel location
+    x = (int)(xp+0.5f);
+    y = (int)(yp+0.5f);
+    
+    // Get Laplacian images
+    const Image& lap0 = mLaplacianPyramid.images()[lap_index-1];
+    const Image& lap1 = mLaplacianPyramid.images()[lap_index];
+    const Image& lap2 = mLaplacianPyramid.images()[lap_index+1];
+    
+    // Compute the Hessian
+    if(!ComputeSubpixelHessian(A, b, lap0, lap1, lap2, x, y)) {
+        return false;
     }
     
-    mFeaturePoints.resize(num_points);
+    // A*u=b
+    if(!SolveSymmetricLinearSystem3x3(u, A, b)) {
+        return false;
+    }
+    
+    // If points move too much in the sub-pixel update, then the point probably
+    // unstable.
+    if(sqr(u[0])+sqr(u[1]) > mMaxSubpixelDistanceSqr) {
+        return false;
+    }
+    
+    // Compute the edge score
+    if(!ComputeEdgeScore(kp.edge_score, A)) {
+        return false;
+    }
+    
+    // Compute a linear estimate of the intensity
+    ASSERT(kp.score == lap1.get<float>(y)[x], "Score is not consistent with the DoG image");
+    kp.score = lap1.get<float>(y)[x] - (b[0]*u[0] + b[1]*u[1] + b[2]*u[2]);
+    
+    // Update the location:
+    // Apply the update on the downsampled location and then upsample the result.
+    bilinear_upsample_point(kp.x, kp.y, xp+u[0], yp+u[1], kp.octave);
+    
+    // Update the scale
+    kp.sp_scale = kp.scale + u[2];
+    kp.sp_scale = ClipScalar<float>(kp.sp_scale, 0, mLaplacianPyramid.numScalePerOctave());
+    
+    if(std::abs(kp.edge_score)  < hessianThreshold &&
+       sqr(kp.score)            >= laplacianSqrThreshold &&
+       kp.x                     >= 0 &&
+       kp.x                     < mLaplacianPyramid.images()[0].width() &&
+       kp.y                     >= 0 &&
+       kp.y                     < mLaplacianPyramid.images()[0].height()) {
+        // Update the sigma
+        kp.sigma = pyramid->effectiveSigma(kp.octave, kp.sp_scale);
+        return true;
+    }
+    
+    return false;
 }
 
 void DoGScaleInvariantDetector::findFeatureOrientations(const GaussianScaleSpacePyramid* pyramid) {
@@ -556,55 +665,112 @@ void DoGScaleInvariantDetector::findFeatureOrientations(const GaussianScaleSpace
         }
         return;
     }
-
-    int num_angles;
+    
     mTmpOrientatedFeaturePoints.clear();
-    mTmpOrientatedFeaturePoints.reserve(mFeaturePoints.size()*kMaxNumOrientations);
     
     // Compute the gradient pyramid
-    mOrientationAssignment.computeGradients(pyramid);
+    mOrientationAssignment.computeGradients(pyramid, parallel() ? mWorkerPool : NULL);
+    
+    // Allocate scratch memory for each thread
+    size_t num_threads = parallel() ? mWorkerPool->threadNum() : 1;
+    if(mThreadStates.size() < num_threads) {
+        mThreadStates.resize(num_threads);
+    }
+    for(size_t i = 0; i < num_threads; i++) {
+        mThreadStates[i].histogram.resize(mOrientationAssignment.numBins());
+        mThreadStates[i].orientations.resize(kMaxNumOrientations);
+    }
     
     // Compute an orientation for each feature point
-    for(size_t i = 0; i < mFeaturePoints.size(); i++) {
-        float x, y, s;
-        
-        // Down sample the point to the detected octave
-        bilinear_downsample_point(x,
-                                  y,
-                                  s, 
-                                  mFeaturePoints[i].x,
-                                  mFeaturePoints[i].y,
-                                  mFeaturePoints[i].sigma,
-                                  mFeaturePoints[i].octave);
-        
-        // Downsampling the point can cause (x,y) to leave the image bounds by
-        // a tiny amount. Here we just clip it to be within the image bounds.
-        x = ClipScalar<float>(x, 0, pyramid->get(mFeaturePoints[i].octave, 0).width()-1);
-        y = ClipScalar<float>(y, 0, pyramid->get(mFeaturePoints[i].octave, 0).height()-1);
+    if(!parallel()) {
+        mTmpOrientatedFeaturePoints.reserve(mFeaturePoints.size()*kMaxNumOrientations);
+        for(size_t i = 0; i < mFeaturePoints.size(); i++) {
+            findFeatureOrientations(mTmpOrientatedFeaturePoints,
+                                    &mThreadStates[0].orientations[0],
+                                    &mThreadStates[0].histogram[0],
+                                    mFeaturePoints[i],
+                                    pyramid);
+        }
+    } else {
+        size_t num_tasks = (mFeaturePoints.size()+kPointsPerTask-1)/kPointsPerTask;
+        if(mTaskFeaturePoints.size() < num_tasks) {
+            mTaskFeaturePoints.resize(num_tasks);
+        }
         
-        // Compute dominant orientations
-        mOrientationAssignment.compute(&mOrientations[0],
-                                       num_angles,
-                                       mFeaturePoints[i].octave,
-                                       mFeaturePoints[i].scale,
-                                       x,
-                                       y,
-                                       s);
+        DetectJob job;
+        job.detector = this;
+        job.pyramid = pyramid;
+        mWorkerPool->forEach(orientationTask, &job, num_tasks);
         
-        // Create a feature point for each angle
-        for(int j = 0; j < num_angles; j++) {
-            // Copy the feature point
-            FeaturePoint fp = mFeaturePoints[i];
-            // Update the orientation
-            fp.angle = mOrientations[j];
-            // Store oriented feature point
-            mTmpOrientatedFeaturePoints.push_back(fp);
+        for(size_t i = 0; i < num_tasks; i++) {
+            mTmpOrientatedFeaturePoints.insert(mTmpOrientatedFeaturePoints.end(), mTaskFeaturePoints[i].begin(), mTaskFeaturePoints[i].end());
         }
     }
     
     mFeaturePoints.swap(mTmpOrientatedFeaturePoints);
 }
 
+void DoGScaleInvariantDetector::orientationTask(void* arg, int thread, size_t task) {
+    DetectJob* job = (DetectJob*)arg;
+    DoGScaleInvariantDetector* detector = job->detector;
+    ThreadState& state = detector->mThreadStates[thread];
+    
+    std::vector<FeaturePoint>& points = detector->mTaskFeaturePoints[task];
+    points.clear();
+    
+    size_t end = min2<size_t>((task+1)*kPointsPerTask, detector->mFeaturePoints.size());
+    for(size_t i = task*kPointsPerTask; i < end; i++) {
+        detector->findFeatureOrientations(points,
+                                          &state.orientations[0],
+                                          &state.histogram[0],
+                                          detector->mFeaturePoints[i],
+                                          job->pyramid);
+    }
+}
+
+void DoGScaleInvariantDetector::findFeatureOrientations(std::vector<FeaturePoint>& points,
+                                                        float* orientations,
+                                                        float* histogram,
+                                                        const FeaturePoint& fp,
+                                                        const GaussianScaleSpacePyramid* pyramid) const {
+    float x, y, s;
+    int num_angles;
+    
+    // Down sample the point to the detected octave
+    bilinear_downsample_point(x,
+                              y,
+                              s, 
+                              fp.x,
+                              fp.y,
+                              fp.sigma,
+                              fp.octave);
+    
+    // Downsampling the point can cause (x,y) to leave the image bounds by
+    // a tiny amount. Here we just clip it to be within the image bounds.
+    x = ClipScalar<float>(x, 0, pyramid->get(fp.octave, 0).width()-1);
+    y = ClipScalar<float>(y, 0, pyramid->get(fp.octave, 0).height()-1);
+    
+    // Compute dominant orientations
+    mOrientationAssignment.compute(orientations,
+                                   num_angles,
+                                   histogram,
+                                   fp.octave,
+                                   fp.scale,
+                                   x,
+                                   y,
+                                   s);
+    
+    // Create a feature point for each angle
+    for(int j = 0; j < num_angles; j++) {
+        // Copy the feature point
+        FeaturePoint p = fp;
+        // Update the orientation
+        p.angle = orientations[j];
+        // Store oriented feature point
+        points.push_back(p);
+    }
+}
+
 namespace vision {
     
     void PruneDoGFeatures(std::vector<std::vector<std::vector<std::pair<float, size_t> > > >& buckets,
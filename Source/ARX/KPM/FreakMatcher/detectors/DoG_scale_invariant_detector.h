@@ -40,6 +40,7 @@
 #include "interpolate.h"
 #include "utils/point.h"
 #include <framework/error.h>
+#include <framework/worker_pool.h>
 #include <math/math_utils.h>
 
 namespace vision {
@@ -59,9 +60,9 @@ namespace vision {
         void alloc(const GaussianScaleSpacePyramid* pyramid);
         
         /**
-         * Compute the Difference-of-Gaussian from a Gaussian Pyramid.
+         * Compute the Difference-of-Gaussian from a Gaussian Pyramid, on POOL if it is not NULL.
          */
-        void compute(const GaussianScaleSpacePyramid* pyramid);
+        void compute(const GaussianScaleSpacePyramid* pyramid, WorkerPool* pool = NULL);
         
         /**
          * Get a Laplacian image at a level in the pyramid.
@@ -109,12 +110,23 @@ namespace vision {
         int mNumOctaves;
         int mNumScalesPerOctave;
         
+        // Bands of the DoG images to compute in parallel
+        std::vector<RowBand> mBands;
+        
+        // Work shared between the threads computing the DoG images
+        struct DifferenceJob {
+            DoGPyramid* dog;
+            const GaussianScaleSpacePyramid* pyramid;
+        };
+        
+        static void differenceTask(void* arg, int thread, size_t task);
+        
         /**
-         * Compute the difference image.
+         * Compute rows [row_begin, row_end) of the difference image.
          *
          * d = im1 - im2
          */
-        void difference_image_binomial(Image& d, const Image& im1, const Image& im2);
+        void difference_image_binomial(Image& d, const Image& im1, const Image& im2, size_t row_begin, size_t row_end);
     };
     
     class DoGScaleInvariantDetector {
@@ -153,6 +165,17 @@ namespace vision {
          */
         void detect(const GaussianScaleSpacePyramid* pyramid);
         
+        /**
+         * Get/Set the threads to detect with. NULL, the default, detects on the calling thread.
+         * The feature points are the same, and in the same order, for any number of threads.
+         */
+        WorkerPool* workerPool() const {
+            return mWorkerPool;
+        }
+        void setWorkerPool(WorkerPool* pool) {
+            mWorkerPool = pool;
+        }
+        
         /**
          * Get/Set the Laplacian absolute threshold.
          */
@@ -244,9 +267,39 @@ namespace vision {
         // Orientation assignment
         OrientationAssignment mOrientationAssignment;
         
-        // Vector of orientations. Pre-allocated to the maximum
-        // number of orientations per feature point.
-        std::vector<float> mOrientations;
+        // Threads to detect with, or NULL
+        WorkerPool* mWorkerPool;
+        
+        // Scratch memory for each thread. The vector of orientations is pre-allocated
+        // to the maximum number of orientations per feature point.
+        struct ThreadState {
+            std::vector<float> histogram;
+            std::vector<float> orientations;
+        };
+        std::vector<ThreadState> mThreadStates;
+        
+        // Units of parallel work. The points found by each task are kept separately, and
+        // concatenated in task order so that the result is the same as on a single thread.
+        std::vector<RowBand> mBands;
+        std::vector<std::vector<FeaturePoint> > mTaskFeaturePoints;
+        
+        // Whether each feature point survived sub-pixel refinement
+        std::vector<unsigned char> mKeepFeaturePoints;
+        
+        // Work shared between the threads of one detection phase
+        struct DetectJob {
+            DoGScaleInvariantDetector* detector;
+            const GaussianScaleSpacePyramid* pyramid;
+        };
+        
+        static void extremaTask(void* arg, int thread, size_t task);
+        static void subpixelTask(void* arg, int thread, size_t task);
+        static void orientationTask(void* arg, int thread, size_t task);
+        
+        /**
+         * @return True if the detection phases should be run on the worker pool
+         */
+        inline bool parallel() const { return mWorkerPool && mWorkerPool->threadNum() > 1; }
         
         /**
          * Extract the minima/maxima.
@@ -254,11 +307,27 @@ namespace vision {
         void extractFeatures(const GaussianScaleSpacePyramid* pyramid,
                              const DoGPyramid* laplacian);
         
+        /**
+         * Extract the minima/maxima in rows [row_begin, row_end) of one Laplacian image.
+         */
+        void extractFeatures(std::vector<FeaturePoint>& points,
+                             const GaussianScaleSpacePyramid* pyramid,
+                             const DoGPyramid* laplacian,
+                             size_t level,
+                             size_t row_begin,
+                             size_t row_end) const;
+        
         /**
          * Sub-pixel refinement.
          */
         void findSubpixelLocations(const GaussianScaleSpacePyramid* pyramid);
         
+        /**
+         * Sub-pixel refinement of one feature point.
+         * @return True if the point should be kept
+         */
+        bool findSubpixelLocation(FeaturePoint& kp, const GaussianScaleSpacePyramid* pyramid) const;
+        
         /**
          * Prune the number of features.
          */
@@ -269,6 +338,15 @@ namespace vision {
          */
         void findFeatureOrientations(const GaussianScaleSpacePyramid* pyramid);
         
+        /**
+         * Append a copy of a feature point for each of its dominant orientations.
+         */
+        void findFeatureOrientations(std::vector<FeaturePoint>& points,
+                                     float* orientations,
+                                     float* histogram,
+                                     const FeaturePoint& fp,
+                                     const GaussianScaleSpacePyramid* pyramid) const;
+        
     }; // DoGScaleInvariantDetector
     
     inline void ComputeSubpixelDerivatives(float& Dx,
@@ -37,230 +37,278 @@
 #include <framework/error.h>
 //#include <framework/logger.h>
 
+#if defined(__x86_64__) || defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#  define PYRAMID_HAVE_SSE2 1
+#  include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  define PYRAMID_HAVE_NEON 1
+#  include <arm_neon.h>
+#endif
+
 using namespace vision;
 
 namespace vision {
-
-    void binomial_4th_order(float* dst,
-                            unsigned short* tmp,
-                            const unsigned char* src,
-                            size_t width,
-                            size_t height) {
-        unsigned short* tmp_ptr;
-        float* dst_ptr;
-        
-        size_t width_minus_1, width_minus_2;
-        size_t height_minus_2;
-        
-        ASSERT(width >= 5, "Image is too small");
-        ASSERT(height >= 5, "Image is too small");
-        
-        width_minus_1 = width-1;
-        width_minus_2 = width-2;
-        height_minus_2 = height-2;
-        
-        tmp_ptr = tmp;
-        
-        // Apply horizontal filter
-        for(size_t row = 0; row < height; row++) {
-            const unsigned char* src_ptr = &src[row*width];
-            
-            // Left border is computed by extending the border pixel beyond the image
-            *(tmp_ptr++) = ((src_ptr[0]<<1)+(src_ptr[0]<<2)) + ((src_ptr[0]+src_ptr[1])<<2) + (src_ptr[0]+src_ptr[2]);
-            *(tmp_ptr++) = ((src_ptr[1]<<1)+(src_ptr[1]<<2)) + ((src_ptr[0]+src_ptr[2])<<2) + (src_ptr[0]+src_ptr[3]);
-            
-            // Compute non-border pixels
-            for(size_t col = 2; col < width_minus_2; col++, tmp_ptr++) {
-                *tmp_ptr = ((src_ptr[col]<<1)+(src_ptr[col]<<2)) + ((src_ptr[col-1]+src_ptr[col+1])<<2) + (src_ptr[col-2]+src_ptr[col+2]);
-            }
-            
-            // Right border. Computed similarily as the left border.
-            *(tmp_ptr++) = ((src_ptr[width_minus_2]<<1)+(src_ptr[width_minus_2]<<2)) + ((src_ptr[width_minus_2-1]+src_ptr[width_minus_2+1])<<2) + (src_ptr[width_minus_2-2]+src_ptr[width_minus_2+1]);
-            *(tmp_ptr++) = ((src_ptr[width_minus_1]<<1)+(src_ptr[width_minus_1]<<2)) + ((src_ptr[width_minus_1-1]+src_ptr[width_minus_1])<<2)   + (src_ptr[width_minus_1-2]+src_ptr[width_minus_1]);
+    
+    //
+    // Row kernels for the 5-tap binomial filter [1 4 6 4 1] and the 2x2 box downsample.
+    // The SIMD versions evaluate the same expressions in the same order as the scalar
+    // tails, so results are bit-identical on every platform.
+    //
+    
+    // Horizontal filter of interior pixels [begin, end) of an 8-bit row. Needs begin >= 2
+    // and end <= width-2.
+    static inline void binomial_row(unsigned short* dst, const unsigned char* src, size_t begin, size_t end) {
+        size_t col = begin;
+#if PYRAMID_HAVE_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        for(; col+8 <= end; col += 8) {
+            __m128i m2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)&src[col-2]), zero);
+            __m128i m1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)&src[col-1]), zero);
+            __m128i c  = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)&src[col]), zero);
+            __m128i p1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)&src[col+1]), zero);
+            __m128i p2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)&src[col+2]), zero);
+            __m128i v  = _mm_add_epi16(_mm_slli_epi16(c, 1), _mm_slli_epi16(c, 2));
+            v = _mm_add_epi16(v, _mm_slli_epi16(_mm_add_epi16(m1, p1), 2));
+            v = _mm_add_epi16(v, _mm_add_epi16(m2, p2));
+            _mm_storeu_si128((__m128i*)&dst[col], v);
         }
-        
-        const unsigned short* pm2;
-        const unsigned short* pm1;
-        const unsigned short* p;
-        const unsigned short* pp1;
-        const unsigned short* pp2;
-        
-        // Apply vertical filter along top border. This is applied twice as there are two
-        // border pixels.
-        pm2     = tmp;
-        pm1     = tmp;
-        p       = tmp;
-        pp1     = p+width;
-        pp2     = pp1+width;
-        dst_ptr = dst;
-        
-        for(size_t col = 0; col < width; col++, dst_ptr++, pm2++, pm1++, p++, pp1++, pp2++) {
-            *dst_ptr = (((*p<<1)+(*p<<2)) + ((*pm1+*pp1)<<2) + (*pm2+*pp2))*(1.f/256.f);
+#elif PYRAMID_HAVE_NEON
+        for(; col+8 <= end; col += 8) {
+            uint16x8_t m2 = vmovl_u8(vld1_u8(&src[col-2]));
+            uint16x8_t m1 = vmovl_u8(vld1_u8(&src[col-1]));
+            uint16x8_t c  = vmovl_u8(vld1_u8(&src[col]));
+            uint16x8_t p1 = vmovl_u8(vld1_u8(&src[col+1]));
+            uint16x8_t p2 = vmovl_u8(vld1_u8(&src[col+2]));
+            uint16x8_t v  = vmulq_n_u16(c, 6);
+            v = vaddq_u16(v, vshlq_n_u16(vaddq_u16(m1, p1), 2));
+            v = vaddq_u16(v, vaddq_u16(m2, p2));
+            vst1q_u16(&dst[col], v);
         }
-        
-        pm2     = tmp;
-        pm1     = tmp;
-        p       = tmp+width;
-        pp1     = p+width;
-        pp2     = pp1+width;
-        dst_ptr = dst+width;
-        
-        for(size_t col = 0; col < width; col++, dst_ptr++, pm2++, pm1++, p++, pp1++, pp2++) {
-            *dst_ptr = (((*p<<1)+(*p<<2)) + ((*pm1+*pp1)<<2) + (*pm2+*pp2))*(1.f/256.f);
+#endif
+        for(; col < end; col++) {
+            dst[col] = ((src[col]<<1)+(src[col]<<2)) + ((src[col-1]+src[col+1])<<2) + (src[col-2]+src[col+2]);
         }
-        
-        // Apply vertical filter for non-border pixels.
-        pm2 = tmp;
-        pm1 = pm2+width;
-        p   = pm1+width;
-        pp1 = p+width;
-        pp2 = pp1+width;
-        
-        for(size_t row = 2; row < height_minus_2; row++) {
-            pm2 = &tmp[(row-2)*width];
-            pm1 = pm2+width;
-            p   = pm1+width;
-            pp1 = p+width;
-            pp2 = pp1+width;
-            
-            dst_ptr = &dst[row*width];
-            
-            for(size_t col = 0; col < width; col++, dst_ptr++, pm2++, pm1++, p++, pp1++, pp2++) {
-                *dst_ptr = (((*p<<1)+(*p<<2)) + ((*pm1+*pp1)<<2) + (*pm2+*pp2))*(1.f/256.f);
-            }
+    }
+    
+    // Horizontal filter of interior pixels [begin, end) of a float row.
+    static inline void binomial_row(float* dst, const float* src, size_t begin, size_t end) {
+        size_t col = begin;
+#if PYRAMID_HAVE_SSE2
+        const __m128 six = _mm_set1_ps(6.f);
+        const __m128 four = _mm_set1_ps(4.f);
+        for(; col+4 <= end; col += 4) {
+            __m128 v = _mm_mul_ps(six, _mm_loadu_ps(&src[col]));
+            v = _mm_add_ps(v, _mm_mul_ps(four, _mm_add_ps(_mm_loadu_ps(&src[col-1]), _mm_loadu_ps(&src[col+1]))));
+            v = _mm_add_ps(v, _mm_loadu_ps(&src[col-2]));
+            v = _mm_add_ps(v, _mm_loadu_ps(&src[col+2]));
+            _mm_storeu_ps(&dst[col], v);
         }
-        
-        // Apply vertical filter for bottom border. Similar to top border.
-        pm2     = tmp+(height-4)*width;
-        pm1     = pm2+width;
-        p       = pm1+width;
-        pp1     = p+width;
-        pp2     = pp1;
-        dst_ptr = dst+(height-2)*width;
-        
-        for(size_t col = 0; col < width; col++, dst_ptr++, pm2++, pm1++, p++, pp1++, pp2++) {
-            *dst_ptr = (((*p<<1)+(*p<<2)) + ((*pm1+*pp1)<<2) + (*pm2+*pp2))*(1.f/256.f);
+#elif PYRAMID_HAVE_NEON
+        for(; col+4 <= end; col += 4) {
+            // Separate multiplies and adds, as fused multiply-adds would round differently.
+            float32x4_t v = vmulq_n_f32(vld1q_f32(&src[col]), 6.f);
+            v = vaddq_f32(v, vmulq_n_f32(vaddq_f32(vld1q_f32(&src[col-1]), vld1q_f32(&src[col+1])), 4.f));
+            v = vaddq_f32(v, vld1q_f32(&src[col-2]));
+            v = vaddq_f32(v, vld1q_f32(&src[col+2]));
+            vst1q_f32(&dst[col], v);
         }
-        
-        pm2     = tmp+(height-3)*width;
-        pm1     = pm2+width;
-        p       = pm1+width;
-        pp1     = p;
-        pp2     = p;
-        dst_ptr = dst+(height-1)*width;
-        
-        for(size_t col = 0; col < width; col++, dst_ptr++, pm2++, pm1++, p++, pp1++, pp2++) {
-            *dst_ptr = (((*p<<1)+(*p<<2)) + ((*pm1+*pp1)<<2) + (*pm2+*pp2))*(1.f/256.f);
+#endif
+        for(; col < end; col++) {
+            dst[col] = (6.f*src[col] + 4.f*(src[col-1]+src[col+1]) + src[col-2] + src[col+2]);
         }
     }
     
-    void binomial_4th_order(float* dst,
-                            float* tmp,
-                            const float* src,
-                            size_t width,
-                            size_t height) {
-        float* tmp_ptr;
-        float* dst_ptr;
-        
-        size_t width_minus_1, width_minus_2;
-        size_t height_minus_2;
-        
+    // Vertical filter of a whole row from the five horizontally filtered rows around it.
+    static inline void binomial_col(float* dst,
+                                    const unsigned short* pm2,
+                                    const unsigned short* pm1,
+                                    const unsigned short* p,
+                                    const unsigned short* pp1,
+                                    const unsigned short* pp2,
+                                    size_t width) {
+        size_t col = 0;
+#if PYRAMID_HAVE_SSE2
+        // The sum is at most 256*255, so it fits in 16 bits.
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 scale = _mm_set1_ps(1.f/256.f);
+        for(; col+8 <= width; col += 8) {
+            __m128i c = _mm_loadu_si128((const __m128i*)&p[col]);
+            __m128i v = _mm_add_epi16(_mm_slli_epi16(c, 1), _mm_slli_epi16(c, 2));
+            v = _mm_add_epi16(v, _mm_slli_epi16(_mm_add_epi16(_mm_loadu_si128((const __m128i*)&pm1[col]), _mm_loadu_si128((const __m128i*)&pp1[col])), 2));
+            v = _mm_add_epi16(v, _mm_add_epi16(_mm_loadu_si128((const __m128i*)&pm2[col]), _mm_loadu_si128((const __m128i*)&pp2[col])));
+            _mm_storeu_ps(&dst[col],   _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(v, zero)), scale));
+            _mm_storeu_ps(&dst[col+4], _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(v, zero)), scale));
+        }
+#elif PYRAMID_HAVE_NEON
+        for(; col+8 <= width; col += 8) {
+            uint16x8_t v = vmulq_n_u16(vld1q_u16(&p[col]), 6);
+            v = vaddq_u16(v, vshlq_n_u16(vaddq_u16(vld1q_u16(&pm1[col]), vld1q_u16(&pp1[col])), 2));
+            v = vaddq_u16(v, vaddq_u16(vld1q_u16(&pm2[col]), vld1q_u16(&pp2[col])));
+            vst1q_f32(&dst[col],   vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(v))), 1.f/256.f));
+            vst1q_f32(&dst[col+4], vmulq_n_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(v))), 1.f/256.f));
+        }
+#endif
+        for(; col < width; col++) {
+            dst[col] = (((p[col]<<1)+(p[col]<<2)) + ((pm1[col]+pp1[col])<<2) + (pm2[col]+pp2[col]))*(1.f/256.f);
+        }
+    }
+    
+    static inline void binomial_col(float* dst,
+                                    const float* pm2,
+                                    const float* pm1,
+                                    const float* p,
+                                    const float* pp1,
+                                    const float* pp2,
+                                    size_t width) {
+        size_t col = 0;
+#if PYRAMID_HAVE_SSE2
+        const __m128 six = _mm_set1_ps(6.f);
+        const __m128 four = _mm_set1_ps(4.f);
+        const __m128 scale = _mm_set1_ps(1.f/256.f);
+        for(; col+4 <= width; col += 4) {
+            __m128 v = _mm_mul_ps(six, _mm_loadu_ps(&p[col]));
+            v = _mm_add_ps(v, _mm_mul_ps(four, _mm_add_ps(_mm_loadu_ps(&pm1[col]), _mm_loadu_ps(&pp1[col]))));
+            v = _mm_add_ps(v, _mm_loadu_ps(&pm2[col]));
+            v = _mm_add_ps(v, _mm_loadu_ps(&pp2[col]));
+            _mm_storeu_ps(&dst[col], _mm_mul_ps(v, scale));
+        }
+#elif PYRAMID_HAVE_NEON
+        for(; col+4 <= width; col += 4) {
+            float32x4_t v = vmulq_n_f32(vld1q_f32(&p[col]), 6.f);
+            v = vaddq_f32(v, vmulq_n_f32(vaddq_f32(vld1q_f32(&pm1[col]), vld1q_f32(&pp1[col])), 4.f));
+            v = vaddq_f32(v, vld1q_f32(&pm2[col]));
+            v = vaddq_f32(v, vld1q_f32(&pp2[col]));
+            vst1q_f32(&dst[col], vmulq_n_f32(v, 1.f/256.f));
+        }
+#endif
+        for(; col < width; col++) {
+            dst[col] = (6.f*p[col] + 4.f*(pm1[col]+pp1[col]) + pm2[col] + pp2[col])*(1.f/256.f);
+        }
+    }
+    
+    // Average each 2x2 block of two source rows into one destination row of DST_WIDTH pixels.
+    static inline void downsample_row(float* dst, const float* src1, const float* src2, size_t dst_width) {
+        size_t col = 0;
+#if PYRAMID_HAVE_SSE2
+        const __m128 quarter = _mm_set1_ps(0.25f);
+        for(; col+4 <= dst_width; col += 4) {
+            __m128 a0 = _mm_loadu_ps(&src1[col<<1]);
+            __m128 a1 = _mm_loadu_ps(&src1[(col<<1)+4]);
+            __m128 b0 = _mm_loadu_ps(&src2[col<<1]);
+            __m128 b1 = _mm_loadu_ps(&src2[(col<<1)+4]);
+            __m128 v = _mm_add_ps(_mm_shuffle_ps(a0, a1, _MM_SHUFFLE(2,0,2,0)), _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(3,1,3,1)));
+            v = _mm_add_ps(v, _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(2,0,2,0)));
+            v = _mm_add_ps(v, _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(3,1,3,1)));
+            _mm_storeu_ps(&dst[col], _mm_mul_ps(v, quarter));
+        }
+#elif PYRAMID_HAVE_NEON
+        for(; col+4 <= dst_width; col += 4) {
+            float32x4x2_t a = vld2q_f32(&src1[col<<1]);
+            float32x4x2_t b = vld2q_f32(&src2[col<<1]);
+            float32x4_t v = vaddq_f32(vaddq_f32(vaddq_f32(a.val[0], a.val[1]), b.val[0]), b.val[1]);
+            vst1q_f32(&dst[col], vmulq_n_f32(v, 0.25f));
+        }
+#endif
+        for(; col < dst_width; col++) {
+            dst[col] = (src1[col<<1]+src1[(col<<1)+1]+src2[col<<1]+src2[(col<<1)+1])*0.25f;
+        }
+    }
+
+    // Horizontal filter of a whole row, extending the border pixels beyond the image.
+    static inline unsigned short binomial_tap(const unsigned char* src, size_t m2, size_t m1, size_t c, size_t p1, size_t p2) {
+        return ((src[c]<<1)+(src[c]<<2)) + ((src[m1]+src[p1])<<2) + (src[m2]+src[p2]);
+    }
+    
+    static inline float binomial_tap(const float* src, size_t m2, size_t m1, size_t c, size_t p1, size_t p2) {
+        return 6.f*src[c] + 4.f*(src[m1]+src[p1]) + src[m2] + src[p2];
+    }
+    
+    template<typename SRC, typename TMP>
+    static inline void binomial_row_clamped(TMP* dst, const SRC* src, size_t width) {
+        const size_t w1 = width-1;
+        dst[0]    = binomial_tap(src, 0, 0, 0, 1, 2);
+        dst[1]    = binomial_tap(src, 0, 0, 1, 2, 3);
+        binomial_row(dst, src, 2, width-2);
+        dst[w1-1] = binomial_tap(src, w1-3, w1-2, w1-1, w1, w1);
+        dst[w1]   = binomial_tap(src, w1-2, w1-1, w1, w1, w1);
+    }
+    
+    // Vertical filter of ROW from a ring of 5 horizontally filtered rows, where row i is
+    // kept at TMP[(i%5)*WIDTH]. Rows beyond the border are the border row.
+    template<typename TMP>
+    static inline void binomial_col_clamped(float* dst, const TMP* tmp, size_t row, size_t h1, size_t width) {
+        const size_t rm2 = row >= 2 ? row-2 : 0;
+        const size_t rm1 = row >= 1 ? row-1 : 0;
+        const size_t rp1 = row+1 <= h1 ? row+1 : h1;
+        const size_t rp2 = row+2 <= h1 ? row+2 : h1;
+        binomial_col(dst,
+                     &tmp[(rm2%5)*width],
+                     &tmp[(rm1%5)*width],
+                     &tmp[(row%5)*width],
+                     &tmp[(rp1%5)*width],
+                     &tmp[(rp2%5)*width],
+                     width);
+    }
+    
+    // Each output row is filtered vertically as soon as the horizontally filtered rows around
+    // it are in the ring. This keeps the temporary rows in cache instead of streaming a whole
+    // intermediate image through memory.
+    template<typename SRC, typename TMP>
+    static void binomial_4th_order_rows(float* dst, TMP* tmp, const SRC* src, size_t width, size_t height) {
         ASSERT(width >= 5, "Image is too small");
         ASSERT(height >= 5, "Image is too small");
         
-        width_minus_1 = width-1;
-        width_minus_2 = width-2;
-        height_minus_2 = height-2;
-        
-        tmp_ptr = tmp;
-        
-        // Apply horizontal filter
+        const size_t h1 = height-1;
+        size_t next = 0;
         for(size_t row = 0; row < height; row++) {
-            const float* src_ptr = &src[row*width];
-            
-            // Left border is computed by extending the border pixel beyond the image
-            *(tmp_ptr++) = 6.f*src_ptr[0] + 4.f*(src_ptr[0]+src_ptr[1]) + src_ptr[0] + src_ptr[2];
-            *(tmp_ptr++) = 6.f*src_ptr[1] + 4.f*(src_ptr[0]+src_ptr[2]) + src_ptr[0] + src_ptr[3];
-            
-            // Compute non-border pixels
-            for(size_t col = 2; col < width_minus_2; col++, tmp_ptr++) {
-                *tmp_ptr = (6.f*src_ptr[col] + 4.f*(src_ptr[col-1]+src_ptr[col+1]) + src_ptr[col-2] + src_ptr[col+2]);
+            for(; next <= row+2 && next <= h1; next++) {
+                binomial_row_clamped(&tmp[(next%5)*width], &src[next*width], width);
             }
-            
-            // Right border. Computed similarily as the left border.
-            *(tmp_ptr++) = 6.f*src_ptr[width_minus_2] + 4.f*(src_ptr[width_minus_2-1]+src_ptr[width_minus_2+1]) + src_ptr[width_minus_2-2] + src_ptr[width_minus_2+1];
-            *(tmp_ptr++) = 6.f*src_ptr[width_minus_1] + 4.f*(src_ptr[width_minus_1-1]+src_ptr[width_minus_1])   + src_ptr[width_minus_1-2] + src_ptr[width_minus_1];
-        }
-        
-        const float* pm2;
-        const float* pm1;
-        const float* p;
-        const float* pp1;
-        const float* pp2;
-        
-        // Apply vertical filter along top border. This is applied twice as there are two
-        // border pixels.
-        pm2     = tmp;
-        pm1     = tmp;
-        p       = tmp;
-        pp1     = p+width;
-        pp2     = pp1+width;
-        dst_ptr = dst;
-        
-        for(size_t col = 0; col < width; col++, dst_ptr++, pm2++, pm1++, p++, pp1++, pp2++) {
-            *dst_ptr = (6.f*(*p) + 4.f*(*pm1+*pp1) + (*pm2) + (*pp2))*(1.f/256.f);;
-        }
-        
-        pm2     = tmp;
-        pm1     = tmp;
-        p       = tmp+width;
-        pp1     = p+width;
-        pp2     = pp1+width;
-        dst_ptr = dst+width;
-        
-        for(size_t col = 0; col < width; col++, dst_ptr++, pm2++, pm1++, p++, pp1++, pp2++) {
-            *dst_ptr = (6.f*(*p) + 4.f*(*pm1+*pp1) + (*pm2) + (*pp2))*(1.f/256.f);;
+            binomial_col_clamped(&dst[row*width], tmp, row, h1, width);
         }
+    }
+    
+    // Two passes of the filter, pipelined so that each row of the first pass is filtered
+    // horizontally by the second as soon as it is produced. TMP1 holds the 5 row ring of the
+    // first pass. TMP2 holds one row of first pass output followed by the ring of the second.
+    template<typename SRC, typename TMP>
+    static void binomial_4th_order_twice_rows(float* dst, TMP* tmp1, float* tmp2, const SRC* src, size_t width, size_t height) {
+        ASSERT(width >= 5, "Image is too small");
+        ASSERT(height >= 5, "Image is too small");
         
-        // Apply vertical filter for non-border pixels.
-        for(size_t row = 2; row < height_minus_2; row++) {
-            pm2 = &tmp[(row-2)*width];
-            pm1 = pm2+width;
-            p   = pm1+width;
-            pp1 = p+width;
-            pp2 = pp1+width;
-            
-            dst_ptr = &dst[row*width];
-            
-            for(size_t col = 0; col < width; col++, dst_ptr++, pm2++, pm1++, p++, pp1++, pp2++) {
-                *dst_ptr = (6.f*(*p) + 4.f*(*pm1+*pp1) + (*pm2) + (*pp2))*(1.f/256.f);;
+        float* mid = tmp2;
+        float* ring2 = tmp2+width;
+        const size_t h1 = height-1;
+        size_t next1 = 0;
+        size_t next2 = 0;
+        for(size_t row = 0; row < height; row++) {
+            for(; next2 <= row+2 && next2 <= h1; next2++) {
+                for(; next1 <= next2+2 && next1 <= h1; next1++) {
+                    binomial_row_clamped(&tmp1[(next1%5)*width], &src[next1*width], width);
+                }
+                binomial_col_clamped(mid, tmp1, next2, h1, width);
+                binomial_row_clamped(&ring2[(next2%5)*width], mid, width);
             }
-        }
-        
-        // Apply vertical filter for bottom border. Similar to top border.
-        pm2     = tmp+(height-4)*width;
-        pm1     = pm2+width;
-        p       = pm1+width;
-        pp1     = p+width;
-        pp2     = pp1;
-        dst_ptr = dst+(height-2)*width;
-        
-        for(size_t col = 0; col < width; col++, dst_ptr++, pm2++, pm1++, p++, pp1++, pp2++) {
-            *dst_ptr = (6.f*(*p) + 4.f*(*pm1+*pp1) + (*pm2) + (*pp2))*(1.f/256.f);;
-        }
-        
-        pm2     = tmp+(height-3)*width;
-        pm1     = pm2+width;
-        p       = pm1+width;
-        pp1     = p;
-        pp2     = p;
-        dst_ptr = dst+(height-1)*width;
-        
-        for(size_t col = 0; col < width; col++, dst_ptr++, pm2++, pm1++, p++, pp1++, pp2++) {
-            *dst_ptr = (6.f*(*p) + 4.f*(*pm1+*pp1) + (*pm2) + (*pp2))*(1.f/256.f);;
+            binomial_col_clamped(&dst[row*width], ring2, row, h1, width);
         }
     }
     
+    void binomial_4th_order(float* dst,
+                            unsigned short* tmp,
+                            const unsigned char* src,
+                            size_t width,
+                            size_t height) {
+        binomial_4th_order_rows(dst, tmp, src, width, height);
+    }
+    
+    void binomial_4th_order(float* dst,
+                            float* tmp,
+                            const float* src,
+                            size_t width,
+                            size_t height) {
+        binomial_4th_order_rows(dst, tmp, src, width, height);
+    }
+    
     void downsample_bilinear(float* dst, const float* src, size_t src_width, size_t src_height) {
         size_t dst_width;
         size_t dst_height;
@@ -270,12 +318,10 @@ namespace vision {
         dst_width = src_width>>1;
         dst_height = src_height>>1;
         
-        for(size_t row = 0; row < dst_height; row++) {
+        for(size_t row = 0; row < dst_height; row++, dst += dst_width) {
             src_ptr1 = &src[(row<<1)*src_width];
             src_ptr2 = src_ptr1 + src_width;
-            for(size_t col = 0; col < dst_width; col++, src_ptr1+=2, src_ptr2+=2) {
-                *(dst++) = (src_ptr1[0]+src_ptr1[1]+src_ptr2[0]+src_ptr2[1])*0.25f;
-            }
+            downsample_row(dst, src_ptr1, src_ptr2, dst_width);
         }
     }
     
@@ -316,9 +362,10 @@ void BinomialPyramid32f::alloc(size_t width,
         }
     }
     
-    mTemp_us16.resize(width*height);
-    mTemp_f32_1.resize(width*height);
-    mTemp_f32_2.resize(width*height);
+    // Ring buffers of horizontally filtered rows. See binomial_4th_order_twice_rows().
+    mTemp_us16.resize(width*5);
+    mTemp_f32_1.resize(width*5);
+    mTemp_f32_2.resize(width*6);
     
 }
 
@@ -379,7 +426,28 @@ void BinomialPyramid32f::apply_filter(Image& dst, const Image& src) {
 }
 
 void BinomialPyramid32f::apply_filter_twice(Image& dst, const Image& src) {
-    Image tmp((unsigned char*)&mTemp_f32_2[0], src.type(), src.width(), src.height(), (int)src.step(), 1);
-    apply_filter(tmp, src);
-    apply_filter(dst, tmp);
+    ASSERT(dst.type() == IMAGE_F32, "Destination image should be a float");
+    
+    switch(src.type()) {
+        case IMAGE_UINT8:
+            binomial_4th_order_twice_rows((float*)dst.get(),
+                                          &mTemp_us16[0],
+                                          &mTemp_f32_2[0],
+                                          (const unsigned char*)src.get(),
+                                          src.width(),
+                                          src.height());
+            break;
+        case IMAGE_F32:
+            binomial_4th_order_twice_rows((float*)dst.get(),
+                                          &mTemp_f32_1[0],
+                                          &mTemp_f32_2[0],
+                                          (const float*)src.get(),
+                                          src.width(),
+                                          src.height());
+            break;
+        case IMAGE_UNKNOWN:
+            throw EXCEPTION("Unknown image type");
+        default:
+            throw EXCEPTION("Unsupported image type");
+    }
 }
@@ -152,7 +152,7 @@ namespace vision {
      * Apply a 2D binomial filter to a source image.
      *
      * @param[out] dst Destination image
-     * @param[in] tmp Temporary memory of same size as source
+     * @param[in] tmp Temporary memory for at least 5 rows of the source
      * @param[in] src Source image
      * @param[in] width Width of image
      * @param[in] height Height of image
@@ -0,0 +1,77 @@
+//
+//  gaussian_scale_space_pyramid_bench.cpp
+//  artoolkitX
+//
+//  This file is part of artoolkitX.
+//
+//  artoolkitX is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  artoolkitX is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules, and to
+//  copy and distribute the resulting executable under terms of your choice,
+//  provided that you also meet, for each linked independent module, the terms and
+//  conditions of the license of that module. An independent module is a module
+//  which is neither derived from nor based on this library. If you modify this
+//  library, you may extend this exception to your version of the library, but you
+//  are not obligated to do so. If you do not wish to do so, delete this exception
+//  statement from your version.
+//
+//  Copyright 2018 Realmax, Inc.
+
+// Times BinomialPyramid32f::build(), as the median of several runs. Not run by ctest;
+// run it by hand on a quiet machine with a Release build.
+
+#include <detectors/gaussian_scale_space_pyramid.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+using namespace vision;
+
+static const int kRuns = 7;
+static const int kIterations = 100;
+
+int main(void) {
+    static const int sizes[][2] = {{640, 480}, {1280, 720}, {1920, 1080}};
+    
+    srand(1);
+    for(size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+        const int width = sizes[s][0], height = sizes[s][1];
+        std::vector<unsigned char> image(width*height);
+        for(int y = 0; y < height; y++) {
+            for(int x = 0; x < width; x++) {
+                image[y*width+x] = (unsigned char)(128 + 60*sin(x*0.05)*cos(y*0.07) + (rand()%60));
+            }
+        }
+        Image im(&image[0], IMAGE_UINT8, width, height, width, 1);
+        BinomialPyramid32f pyramid;
+        pyramid.alloc(width, height, numOctaves(width, height, 8));
+        pyramid.build(im);
+        
+        std::vector<double> times(kRuns);
+        for(int r = 0; r < kRuns; r++) {
+            std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            for(int i = 0; i < kIterations; i++) pyramid.build(im);
+            times[r] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count()/kIterations;
+        }
+        std::sort(times.begin(), times.end());
+        printf("%dx%d: pyramid build %.3f ms (median of %d runs of %d)\n", width, height, times[kRuns/2], kRuns, kIterations);
+    }
+    
+    return 0;
+}
@@ -0,0 +1,177 @@
+//
+//  gaussian_scale_space_pyramid_test.cpp
+//  artoolkitX
+//
+//  This file is part of artoolkitX.
+//
+//  artoolkitX is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  artoolkitX is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules, and to
+//  copy and distribute the resulting executable under terms of your choice,
+//  provided that you also meet, for each linked independent module, the terms and
+//  conditions of the license of that module. An independent module is a module
+//  which is neither derived from nor based on this library. If you modify this
+//  library, you may extend this exception to your version of the library, but you
+//  are not obligated to do so. If you do not wish to do so, delete this exception
+//  statement from your version.
+//
+//  Copyright 2018 Realmax, Inc.
+
+// Checks the binomial filter and downsample row kernels, and a whole pyramid build,
+// bit for bit against the scalar code they replaced.
+
+#include <detectors/gaussian_scale_space_pyramid.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace vision;
+
+// The filters as they were before the row kernels, with borders extended by clamping.
+static inline size_t clampIndex(long i, size_t n) {
+    return (i < 0 ? 0 : (i >= (long)n ? n-1 : (size_t)i));
+}
+
+static void binomialReference(float* dst, const unsigned char* src, size_t width, size_t height) {
+    std::vector<unsigned short> tmp(width*height);
+    for(size_t row = 0; row < height; row++) {
+        const unsigned char* s = &src[row*width];
+        for(long col = 0; col < (long)width; col++) {
+            tmp[row*width+col] = ((s[col]<<1)+(s[col]<<2)) + ((s[clampIndex(col-1, width)]+s[clampIndex(col+1, width)])<<2) + (s[clampIndex(col-2, width)]+s[clampIndex(col+2, width)]);
+        }
+    }
+    for(long row = 0; row < (long)height; row++) {
+        const unsigned short* pm2 = &tmp[clampIndex(row-2, height)*width];
+        const unsigned short* pm1 = &tmp[clampIndex(row-1, height)*width];
+        const unsigned short* p   = &tmp[row*width];
+        const unsigned short* pp1 = &tmp[clampIndex(row+1, height)*width];
+        const unsigned short* pp2 = &tmp[clampIndex(row+2, height)*width];
+        for(size_t col = 0; col < width; col++) {
+            dst[row*width+col] = (((p[col]<<1)+(p[col]<<2)) + ((pm1[col]+pp1[col])<<2) + (pm2[col]+pp2[col]))*(1.f/256.f);
+        }
+    }
+}
+
+static void binomialReference(float* dst, const float* src, size_t width, size_t height) {
+    std::vector<float> tmp(width*height);
+    for(size_t row = 0; row < height; row++) {
+        const float* s = &src[row*width];
+        for(long col = 0; col < (long)width; col++) {
+            tmp[row*width+col] = 6.f*s[col] + 4.f*(s[clampIndex(col-1, width)]+s[clampIndex(col+1, width)]) + s[clampIndex(col-2, width)] + s[clampIndex(col+2, width)];
+        }
+    }
+    for(long row = 0; row < (long)height; row++) {
+        const float* pm2 = &tmp[clampIndex(row-2, height)*width];
+        const float* pm1 = &tmp[clampIndex(row-1, height)*width];
+        const float* p   = &tmp[row*width];
+        const float* pp1 = &tmp[clampIndex(row+1, height)*width];
+        const float* pp2 = &tmp[clampIndex(row+2, height)*width];
+        for(size_t col = 0; col < width; col++) {
+            dst[row*width+col] = (6.f*p[col] + 4.f*(pm1[col]+pp1[col]) + pm2[col] + pp2[col])*(1.f/256.f);
+        }
+    }
+}
+
+static void downsampleReference(float* dst, const float* src, size_t src_width, size_t src_height) {
+    for(size_t row = 0; row < src_height/2; row++) {
+        const float* s1 = &src[2*row*src_width];
+        const float* s2 = s1 + src_width;
+        for(size_t col = 0; col < src_width/2; col++) {
+            *(dst++) = (s1[2*col]+s1[2*col+1]+s2[2*col]+s2[2*col+1])*0.25f;
+        }
+    }
+}
+
+static int compare(const char* what, const float* expected, const float* actual, size_t width, size_t height) {
+    for(size_t i = 0; i < width*height; i++) {
+        if(memcmp(&expected[i], &actual[i], sizeof(float)) != 0) {
+            printf("%s %dx%d: differs at (%d, %d): %.9g, expected %.9g\n", what, (int)width, (int)height, (int)(i%width), (int)(i/width), actual[i], expected[i]);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(void) {
+    static const int sizes[][2] = {{640, 480}, {641, 479}, {37, 23}, {5, 5}, {6, 9}, {21, 5}};
+    int failures = 0;
+    
+    srand(1);
+    for(size_t s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+        const size_t width = sizes[s][0], height = sizes[s][1];
+        std::vector<unsigned char> image(width*height);
+        std::vector<float> imagef(width*height), expected(width*height), actual(width*height);
+        std::vector<unsigned short> tmp16(width*height);
+        std::vector<float> tmp32(width*height);
+        for(size_t i = 0; i < image.size(); i++) image[i] = (unsigned char)(rand() & 0xff);
+        for(size_t i = 0; i < imagef.size(); i++) imagef[i] = (float)(rand() & 0xffff)*(1.f/256.f);
+        
+        binomialReference(&expected[0], &image[0], width, height);
+        binomial_4th_order(&actual[0], &tmp16[0], &image[0], width, height);
+        failures += compare("8-bit filter", &expected[0], &actual[0], width, height);
+        
+        binomialReference(&expected[0], &imagef[0], width, height);
+        binomial_4th_order(&actual[0], &tmp32[0], &imagef[0], width, height);
+        failures += compare("float filter", &expected[0], &actual[0], width, height);
+        
+        downsampleReference(&expected[0], &imagef[0], width, height);
+        downsample_bilinear(&actual[0], &imagef[0], width, height);
+        failures += compare("downsample", &expected[0], &actual[0], width/2, height/2);
+    }
+    
+    // A whole pyramid, including the pipelined double filter.
+    for(size_t s = 0; s < 2; s++) {
+        const size_t width = sizes[s][0], height = sizes[s][1];
+        std::vector<unsigned char> image(width*height);
+        for(size_t i = 0; i < image.size(); i++) image[i] = (unsigned char)(rand() & 0xff);
+        
+        BinomialPyramid32f pyramid;
+        pyramid.alloc(width, height, numOctaves((int)width, (int)height, 8));
+        pyramid.build(Image(&image[0], IMAGE_UINT8, width, height, (int)width, 1));
+        
+        std::vector<float> level, filtered, previous;
+        for(int octave = 0; octave < pyramid.numOctaves(); octave++) {
+            const size_t w = width>>octave, h = height>>octave;
+            level.resize(w*h);
+            filtered.resize(w*h);
+            if(octave == 0) binomialReference(&level[0], &image[0], w, h);
+            else downsampleReference(&level[0], &previous[0], width>>(octave-1), height>>(octave-1));
+            for(int scale = 0; scale < pyramid.numScalesPerOctave(); scale++) {
+                if(scale > 0) {
+                    binomialReference(&filtered[0], &level[0], w, h);
+                    if(scale == 2) {
+                        level.swap(filtered);
+                        binomialReference(&filtered[0], &level[0], w, h);
+                    }
+                    level.swap(filtered);
+                }
+                const Image& im = pyramid.get(octave, scale);
+                for(size_t row = 0; row < h; row++) {
+                    if(compare("pyramid", &level[row*w], im.get<float>(row), w, 1)) {
+                        printf("  at octave %d, scale %d, row %d\n", octave, scale, (int)row);
+                        failures++;
+                        break;
+                    }
+                }
+            }
+            previous.swap(level);
+        }
+    }
+    
+    printf("%d mismatches\n", failures);
+    return (failures ? 1 : 0);
+}
@@ -45,6 +45,15 @@ namespace vision {
                                const float* im,
                                size_t width,
                                size_t height) {
+        ComputePolarGradients(gradient, im, width, height, 0, height);
+    }
+    
+    void ComputePolarGradients(float* gradient,
+                               const float* im,
+                               size_t width,
+                               size_t height,
+                               size_t row_begin,
+                               size_t row_end) {
         
 #define SET_GRADIENT(dx, dy)                \
 *(gradient++) = std::atan2(dy, dx)+PI;      \
@@ -62,31 +71,14 @@ p_ptr++; pm1_ptr++; pp1_ptr++;              \
         width_minus_1 = width-1;
         height_minus_1 = height-1;
         
-        // Top row
-        pm1_ptr = im;
-        p_ptr   = im;
-        pp1_ptr = p_ptr+width;
-        
-        dx = p_ptr[1] - p_ptr[0];
-        dy = pp1_ptr[0] - pm1_ptr[0];
-        SET_GRADIENT(dx, dy)
+        gradient += row_begin*width*2;
         
-        for(int col = 1; col < width_minus_1; col++) {
-            dx = p_ptr[1] - p_ptr[-1];
-            dy = pp1_ptr[0] - pm1_ptr[0];
-            SET_GRADIENT(dx, dy)
-        }
-        
-        dx = p_ptr[0] - p_ptr[-1];
-        dy = pp1_ptr[0] - pm1_ptr[0];
-        SET_GRADIENT(dx, dy)
-        
-        // Non-border pixels
-        pm1_ptr = im;
-        p_ptr   = pm1_ptr+width;
-        pp1_ptr = p_ptr+width;
-        
-        for(int row = 1; row < height_minus_1; row++) {
+        for(size_t row = row_begin; row < row_end; row++) {
+            // The top and bottom rows are computed by extending the border row beyond the image
+            p_ptr   = &im[row*width];
+            pm1_ptr = row > 0 ? p_ptr-width : p_ptr;
+            pp1_ptr = row < height_minus_1 ? p_ptr+width : p_ptr;
+            
             dx = p_ptr[1] - p_ptr[0];
             dy = pp1_ptr[0] - pm1_ptr[0];
             SET_GRADIENT(dx, dy)
@@ -102,25 +94,6 @@ p_ptr++; pm1_ptr++; pp1_ptr++;              \
             SET_GRADIENT(dx, dy)
         }
         
-        // Lower row
-        p_ptr   = &im[height_minus_1*width];
-        pm1_ptr = p_ptr-width;
-        pp1_ptr = p_ptr;
-        
-        dx = p_ptr[1] - p_ptr[0];
-        dy = pp1_ptr[0] - pm1_ptr[0];
-        SET_GRADIENT(dx, dy)
-        
-        for(int col = 1; col < width_minus_1; col++) {
-            dx = p_ptr[1] - p_ptr[-1];
-            dy = pp1_ptr[0] - pm1_ptr[0];
-            SET_GRADIENT(dx, dy)
-        }
-        
-        dx = p_ptr[0]   - p_ptr[-1];
-        dy = pp1_ptr[0] - pm1_ptr[0];
-        SET_GRADIENT(dx, dy)
-        
 #undef SET_GRADIENT
     }
     
@@ -47,6 +47,17 @@ namespace vision {
                                size_t width,
                                size_t height);
     
+    /**
+     * Compute the gradients in polar coordinates of rows [row_begin, row_end) of an image.
+     * GRADIENT points to the gradient image of the whole image.
+     */
+    void ComputePolarGradients(float* gradient,
+                               const float* im,
+                               size_t width,
+                               size_t height,
+                               size_t row_begin,
+                               size_t row_end);
+    
     /**
      * Compute the spatial derivates (dx,dy).
      */
@@ -87,27 +87,67 @@ void OrientationAssignment::alloc(size_t fine_width,
     }
 }
 
-void OrientationAssignment::computeGradients(const GaussianScaleSpacePyramid* pyramid) {
-    // Loop over each pyramid image and compute the gradients
+void OrientationAssignment::computeGradients(const GaussianScaleSpacePyramid* pyramid, WorkerPool* pool) {
+    if(!pool || pool->threadNum() == 1) {
+        // Loop over each pyramid image and compute the gradients
+        for(size_t i = 0; i < pyramid->images().size(); i++) {
+            const Image& im = pyramid->images()[i];
+            
+            // Compute gradient image
+            ASSERT(im.width() == im.step()/sizeof(float), "Step size must be equal to width for now");
+            ComputePolarGradients(mGradients[i].get<float>(),
+                                  im.get<float>(),
+                                  im.width(),
+                                  im.height());
+        }
+        return;
+    }
+    
+    // Split the images into bands of rows, so that the large images at the bottom of the
+    // pyramid are shared between the threads.
+    mGradientBands.clear();
     for(size_t i = 0; i < pyramid->images().size(); i++) {
-        const Image& im = pyramid->images()[i];
-
-        // Compute gradient image
-        ASSERT(im.width() == im.step()/sizeof(float), "Step size must be equal to width for now");
-        ComputePolarGradients(mGradients[i].get<float>(),
-                              im.get<float>(),
-                              im.width(),
-                              im.height());
+        AppendRowBands(mGradientBands, i, 0, pyramid->images()[i].height(), 16);
     }
+    
+    GradientJob job;
+    job.assignment = this;
+    job.pyramid = pyramid;
+    pool->forEach(gradientTask, &job, mGradientBands.size());
+}
+
+void OrientationAssignment::gradientTask(void* arg, int thread, size_t task) {
+    GradientJob* job = (GradientJob*)arg;
+    const RowBand& band = job->assignment->mGradientBands[task];
+    const Image& im = job->pyramid->images()[band.image];
+    
+    ASSERT(im.width() == im.step()/sizeof(float), "Step size must be equal to width for now");
+    ComputePolarGradients(job->assignment->mGradients[band.image].get<float>(),
+                          im.get<float>(),
+                          im.width(),
+                          im.height(),
+                          band.begin,
+                          band.end);
+}
+
+void OrientationAssignment::compute(float* angles,
+                                    int& num_angles,
+                                    int octave,
+                                    int scale,
+                                    float x,
+                                    float y,
+                                    float sigma) {
+    compute(angles, num_angles, &mHistogram[0], octave, scale, x, y, sigma);
 }
 
 void OrientationAssignment::compute(float* angles,
                                     int& num_angles,
+                                    float* histogram,
                                     int octave,
                                     int scale,
                                     float x,
                                     float y,
-                                    float sigma) {  
+                                    float sigma) const {
     int xi, yi;
     float radius;
     float radius2;
@@ -160,7 +200,7 @@ void OrientationAssignment::compute(float* angles,
     y1 = min2<int>(y1, (int)g.height()-1);
     
     // Zero out the orientation histogram
-    ZeroVector(&mHistogram[0], mHistogram.size());
+    ZeroVector(histogram, mNumBins);
     
     // Build up the orientation histogram
     for(int yp = y0; yp <= y1; yp++) {
@@ -189,7 +229,7 @@ void OrientationAssignment::compute(float* angles,
             float fbin  = mNumBins*angle*ONE_OVER_2PI;
             
             // Vote to the orientation histogram with a bilinear update
-            bilinear_histogram_update(&mHistogram[0], fbin, w*mag, mNumBins);
+            bilinear_histogram_update(histogram, fbin, w*mag, mNumBins);
         }
     }
     
@@ -200,13 +240,13 @@ void OrientationAssignment::compute(float* angles,
             0.274068619061197f,
             0.451862761877606f,
             0.274068619061197f};
-        SmoothOrientationHistogram(&mHistogram[0], &mHistogram[0], mNumBins, kernel);
+        SmoothOrientationHistogram(histogram, histogram, mNumBins, kernel);
     }
     
     // Find the peak of the histogram.
     for(int i = 0; i < mNumBins; i++) {
-        if(mHistogram[i] > max_height) {
-            max_height = mHistogram[i];
+        if(histogram[i] > max_height) {
+            max_height = histogram[i];
         }
     }
     
@@ -219,12 +259,12 @@ void OrientationAssignment::compute(float* angles,
     
     // Find all the peaks.
     for(int i = 0; i < mNumBins; i++) {
-        const float p0[]  = {(float)i, mHistogram[i]};
-        const float pm1[] = {(float)(i-1), mHistogram[(i-1+mNumBins)%mNumBins]};
-        const float pp1[] = {(float)(i+1), mHistogram[(i+1+mNumBins)%mNumBins]};
+        const float p0[]  = {(float)i, histogram[i]};
+        const float pm1[] = {(float)(i-1), histogram[(i-1+mNumBins)%mNumBins]};
+        const float pp1[] = {(float)(i+1), histogram[(i+1+mNumBins)%mNumBins]};
         
         // Ensure that "p0" is a relative peak w.r.t. the two neighbors
-        if((mHistogram[i] > mPeakThreshold*max_height) && (p0[1] > pm1[1]) && (p0[1] > pp1[1])) {
+        if((histogram[i] > mPeakThreshold*max_height) && (p0[1] > pm1[1]) && (p0[1] > pp1[1])) {
             float A, B, C, fbin;
             
             // The default sub-pixel bin location is the discrete location if the quadratic
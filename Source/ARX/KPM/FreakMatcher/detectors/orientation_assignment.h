@@ -37,6 +37,7 @@
 
 #include <framework/image.h>
 #include <framework/error.h>
+#include <framework/worker_pool.h>
 #include <vector>
 
 #include "gaussian_scale_space_pyramid.h"
@@ -66,9 +67,9 @@ namespace vision {
                    float peak_threshold);
         
         /**
-         * Compute the gradients given a pyramid.
+         * Compute the gradients given a pyramid, on POOL if it is not NULL.
          */
-        void computeGradients(const GaussianScaleSpacePyramid* pyramid);
+        void computeGradients(const GaussianScaleSpacePyramid* pyramid, WorkerPool* pool = NULL);
         
         /**
          * Compute orientations for a keypont.
@@ -81,6 +82,24 @@ namespace vision {
                      float y,
                      float sigma);
         
+        /**
+         * Compute orientations for a keypont, using HISTOGRAM of numBins() bins as scratch
+         * memory. May be called from several threads at once with different histograms.
+         */
+        void compute(float* angles,
+                     int& num_angles,
+                     float* histogram,
+                     int octave,
+                     int scale,
+                     float x,
+                     float y,
+                     float sigma) const;
+        
+        /**
+         * @return Number of bins in the orientation histogram
+         */
+        inline int numBins() const { return mNumBins; }
+        
         /**
          * @return Vector of images.
          */
@@ -122,6 +141,17 @@ namespace vision {
         // Vector of gradient images
         std::vector<Image> mGradients;
         
+        // Bands of the pyramid images to compute the gradients of in parallel
+        std::vector<RowBand> mGradientBands;
+        
+        // Work shared between the threads computing the gradients
+        struct GradientJob {
+            OrientationAssignment* assignment;
+            const GaussianScaleSpacePyramid* pyramid;
+        };
+        
+        static void gradientTask(void* arg, int thread, size_t task);
+        
     }; // OrientationAssignment
     
     /**
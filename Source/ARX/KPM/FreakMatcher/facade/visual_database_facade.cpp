@@ -38,6 +38,7 @@
 #include <matchers/freak.h>
 #include <matchers/keyframe.h>
 #include <framework/image.h>
+#include <string.h>
 #include <matchers/visual_database-inline.h>
 
 namespace vision {
@@ -55,6 +56,9 @@ namespace vision {
         
         std::unique_ptr<vdb_t> mVdb;
         point3d_map_t mPoint3d;
+        
+        // Copy of the region of the image being queried
+        std::vector<unsigned char> mRegion;
     };
     
     VisualDatabaseFacade::VisualDatabaseFacade(){
@@ -73,12 +77,14 @@ namespace vision {
         mVisualDbImpl->mVdb->addImage(img, image_id);
     }
     
-    void VisualDatabaseFacade::addFreakFeaturesAndDescriptors(const std::vector<FeaturePoint>& featurePoints,
+    bool VisualDatabaseFacade::addFreakFeaturesAndDescriptors(const std::vector<FeaturePoint>& featurePoints,
                                                               const std::vector<unsigned char>& descriptors,
                                                               const std::vector<vision::Point3d<float> >& points3D,
                                                               size_t width,
                                                               size_t height,
-                                                              int image_id){
+                                                              int image_id,
+                                                              const unsigned char* index,
+                                                              size_t indexSize){
         std::shared_ptr<Keyframe<96> > keyframe(new Keyframe<96>());
         keyframe->setWidth((int)width);
         keyframe->setHeight((int)height);
@@ -87,9 +93,25 @@ namespace vision {
         keyframe->store().points() = featurePoints;
         keyframe->store().features().resize(descriptors.size());
         keyframe->store().features() = descriptors;
-        keyframe->buildIndex();
+        bool loaded = index && keyframe->loadIndex(index, indexSize);
+        if(!loaded) {
+            keyframe->buildIndex();
+        }
         mVisualDbImpl->mVdb->addKeyframe(keyframe, image_id);
         mVisualDbImpl->mPoint3d[image_id] = points3D;
+        return loaded;
+    }
+    
+    void VisualDatabaseFacade::saveIndex(int image_id, std::vector<unsigned char>& data) const{
+        mVisualDbImpl->mVdb->keyframe(image_id)->saveIndex(data);
+    }
+    
+    void VisualDatabaseFacade::shareDatabase(const VisualDatabaseFacade& other){
+        mVisualDbImpl->mVdb->shareKeyframes(*other.mVisualDbImpl->mVdb);
+        point3d_map_t::const_iterator it3 = other.mVisualDbImpl->mPoint3d.begin();
+        for(; it3 != other.mVisualDbImpl->mPoint3d.end(); it3++) {
+            mVisualDbImpl->mPoint3d[it3->first] = it3->second;
+        }
     }
     
     void VisualDatabaseFacade::computeFreakFeaturesAndDescriptors(unsigned char* grayImage,
@@ -111,6 +133,64 @@ namespace vision {
         return mVisualDbImpl->mVdb->query(img);
     }
     
+    bool VisualDatabaseFacade::query(unsigned char* grayImage,
+                                     size_t width,
+                                     size_t height,
+                                     size_t x,
+                                     size_t y,
+                                     size_t regionWidth,
+                                     size_t regionHeight){
+        ASSERT(x + regionWidth <= width && y + regionHeight <= height, "Region is outside the image");
+        if(regionWidth == width && regionHeight == height) {
+            return query(grayImage, width, height);
+        }
+        
+        // The pyramid needs contiguous rows
+        std::vector<unsigned char>& region = mVisualDbImpl->mRegion;
+        region.resize(regionWidth*regionHeight);
+        for(size_t i = 0; i < regionHeight; i++) {
+            memcpy(&region[i*regionWidth], grayImage + (y + i)*width + x, regionWidth);
+        }
+        Image img = Image(&region[0],IMAGE_UINT8,regionWidth,regionHeight,(int)regionWidth,1);
+        return mVisualDbImpl->mVdb->query(img, (int)x, (int)y);
+    }
+    
+    void VisualDatabaseFacade::setQueryImages(const std::vector<int>& image_ids){
+        mVisualDbImpl->mVdb->setQueryIds(image_ids);
+    }
+    
+    void VisualDatabaseFacade::setThreadNum(int threadNum){
+        mVisualDbImpl->mVdb->setThreadNum(threadNum);
+    }
+    
+    int VisualDatabaseFacade::threadNum() const{
+        return mVisualDbImpl->mVdb->threadNum();
+    }
+    
+    void VisualDatabaseFacade::setGlobalIndexCandidates(int n){
+        mVisualDbImpl->mVdb->setGlobalIndexCandidates(n > 0 ? (size_t)n : 0);
+    }
+    
+    int VisualDatabaseFacade::globalIndexCandidates() const{
+        return (int)mVisualDbImpl->mVdb->globalIndexCandidates();
+    }
+    
+    void VisualDatabaseFacade::buildGlobalIndex(){
+        mVisualDbImpl->mVdb->buildGlobalIndex();
+    }
+    
+    bool VisualDatabaseFacade::hasGlobalIndex() const{
+        return mVisualDbImpl->mVdb->hasGlobalIndex();
+    }
+    
+    void VisualDatabaseFacade::saveGlobalIndex(std::vector<unsigned char>& data){
+        mVisualDbImpl->mVdb->saveGlobalIndex(data);
+    }
+    
+    bool VisualDatabaseFacade::loadGlobalIndex(const unsigned char* data, size_t size){
+        return mVisualDbImpl->mVdb->loadGlobalIndex(data, size);
+    }
+    
     bool VisualDatabaseFacade::erase(int image_id){
         return mVisualDbImpl->mVdb->erase(image_id);
     }
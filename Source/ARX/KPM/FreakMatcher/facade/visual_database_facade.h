@@ -53,12 +53,31 @@ namespace vision {
         
         void addImage(unsigned char* grayImage, size_t width, size_t height, int image_id);
         
-        void addFreakFeaturesAndDescriptors(const std::vector<FeaturePoint>& featurePoints,
+        /**
+         * Add an image from its features. If INDEX is not NULL and holds a search index saved
+         * with SAVEINDEX for the same features, it is loaded rather than rebuilt.
+         * @return True if INDEX was loaded
+         */
+        bool addFreakFeaturesAndDescriptors(const std::vector<FeaturePoint>& featurePoints,
                                             const std::vector<unsigned char>& descriptors,
                                             const std::vector<vision::Point3d<float> >& points3D,
                                             size_t width,
                                             size_t height,
-                                            int image_id);
+                                            int image_id,
+                                            const unsigned char* index = NULL,
+                                            size_t indexSize = 0);
+        
+        /**
+         * Append the search index of an image to DATA, so that it can be passed back to
+         * ADDFREAKFEATURESANDDESCRIPTORS instead of being rebuilt.
+         */
+        void saveIndex(int image_id, std::vector<unsigned char>& data) const;
+        
+        /**
+         * Add all the images of OTHER to this database. Keyframes and their indices are shared
+         * rather than copied, so each database can then be queried from its own thread.
+         */
+        void shareDatabase(const VisualDatabaseFacade& other);
         
         void computeFreakFeaturesAndDescriptors(unsigned char* grayImage,
                                                 size_t width, size_t height,
@@ -67,6 +86,57 @@ namespace vision {
         
         bool query(unsigned char* grayImage, size_t width, size_t height) ;
         
+        /**
+         * Query with only the region of an image whose top-left corner is at (X,Y). The query
+         * feature points and the matched geometry are in the coordinates of the whole image.
+         */
+        bool query(unsigned char* grayImage, size_t width, size_t height,
+                   size_t x, size_t y, size_t regionWidth, size_t regionHeight);
+        
+        /**
+         * Match queries only against the images in IMAGE_IDS, in that order, so that on a tie
+         * the first listed wins. An empty list (the default) matches against every image.
+         */
+        void setQueryImages(const std::vector<int>& image_ids);
+        
+        /**
+         * Set/Get the number of threads used to find the features of an image and to match the
+         * query against the images of the database. Values < 1 select one thread per online CPU.
+         */
+        void setThreadNum(int threadNum);
+        int threadNum() const;
+        
+        /**
+         * Set/Get the number of images fully matched per query. With N > 0, the features of
+         * all images are indexed together and only the N images voted for by the query are
+         * verified. With N = 0, every image is verified.
+         */
+        void setGlobalIndexCandidates(int n);
+        int globalIndexCandidates() const;
+        
+        /**
+         * Build the global index now, rather than on the first query that needs it.
+         */
+        void buildGlobalIndex();
+        
+        /**
+         * @return True if the global index is built, or was loaded, for the current images
+         */
+        bool hasGlobalIndex() const;
+        
+        /**
+         * Append the global index to DATA, building it first if need be, so that it can be
+         * passed to LOADGLOBALINDEX instead of being rebuilt.
+         */
+        void saveGlobalIndex(std::vector<unsigned char>& data);
+        
+        /**
+         * Restore a global index saved with SAVEGLOBALINDEX for the same images, added in the
+         * same order.
+         * @return False if DATA is not a valid index for the current images
+         */
+        bool loadGlobalIndex(const unsigned char* data, size_t size);
+        
         
         bool erase(int image_id);
         
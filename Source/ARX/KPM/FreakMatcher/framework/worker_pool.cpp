@@ -0,0 +1,116 @@
+//
+//  worker_pool.cpp
+//  artoolkitX
+//
+//  This file is part of artoolkitX.
+//
+//  artoolkitX is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  artoolkitX is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules, and to
+//  copy and distribute the resulting executable under terms of your choice,
+//  provided that you also meet, for each linked independent module, the terms and
+//  conditions of the license of that module. An independent module is a module
+//  which is neither derived from nor based on this library. If you modify this
+//  library, you may extend this exception to your version of the library, but you
+//  are not obligated to do so. If you do not wish to do so, delete this exception
+//  statement from your version.
+//
+//  Copyright 2018 Realmax, Inc.
+//
+
+#include "worker_pool.h"
+#include "logger.h"
+
+using namespace vision;
+
+WorkerPool::WorkerPool() {}
+
+WorkerPool::~WorkerPool() {
+    setThreadNum(1);
+}
+
+void WorkerPool::setThreadNum(int threadNum) {
+    if(threadNum < 1) threadNum = threadGetCPU();
+    if(threadNum < 1) threadNum = 1;
+    if(threadNum > kMaxThreads) threadNum = kMaxThreads;
+    
+    while((int)mThreads.size() > threadNum - 1) {
+        threadWaitQuit(mThreads.back());
+        threadFree(&mThreads.back());
+        mThreads.pop_back();
+    }
+    while((int)mThreads.size() < threadNum - 1) {
+        int i = (int)mThreads.size() + 1;
+        THREAD_HANDLE_T* threadHandle = threadInit(i, &mJobs[i], worker);
+        if(!threadHandle) {
+            LOG_ERROR("Unable to start worker thread %d", i);
+            break;
+        }
+        mThreads.push_back(threadHandle);
+    }
+}
+
+int WorkerPool::run(job_t job, void* arg, int count) {
+    if(count > threadNum()) count = threadNum();
+    if(count < 1) return 0;
+    
+    for(int i = 1; i < count; i++) {
+        mJobs[i].job = job;
+        mJobs[i].arg = arg;
+        mJobs[i].index = i;
+        mJobs[i].count = count;
+        threadStartSignal(mThreads[i - 1]);
+    }
+    job(arg, 0, count);
+    for(int i = 1; i < count; i++) {
+        threadEndWait(mThreads[i - 1]);
+    }
+    
+    return count;
+}
+
+void WorkerPool::forEach(task_t task, void* arg, size_t count) {
+    if(threadNum() == 1 || count <= 1) {
+        for(size_t i = 0; i < count; i++) {
+            task(arg, 0, i);
+        }
+        return;
+    }
+    
+    ForEachJob job;
+    job.task = task;
+    job.arg = arg;
+    job.count = count;
+    job.next = 0;
+    run(forEachJob, &job, count < (size_t)kMaxThreads ? (int)count : kMaxThreads);
+}
+
+void WorkerPool::forEachJob(void* arg, int index, int count) {
+    ForEachJob* job = (ForEachJob*)arg;
+    for(size_t i = job->next++; i < job->count; i = job->next++) {
+        job->task(job->arg, index, i);
+    }
+}
+
+void* WorkerPool::worker(THREAD_HANDLE_T* threadHandle) {
+    Job* job = (Job*)threadGetArg(threadHandle);
+    
+    while(threadStartWait(threadHandle) == 0) {
+        job->job(job->arg, job->index, job->count);
+        threadEndSignal(threadHandle);
+    }
+    return NULL;
+}
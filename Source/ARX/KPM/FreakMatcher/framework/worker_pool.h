@@ -0,0 +1,135 @@
+//
+//  worker_pool.h
+//  artoolkitX
+//
+//  This file is part of artoolkitX.
+//
+//  artoolkitX is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  artoolkitX is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules, and to
+//  copy and distribute the resulting executable under terms of your choice,
+//  provided that you also meet, for each linked independent module, the terms and
+//  conditions of the license of that module. An independent module is a module
+//  which is neither derived from nor based on this library. If you modify this
+//  library, you may extend this exception to your version of the library, but you
+//  are not obligated to do so. If you do not wish to do so, delete this exception
+//  statement from your version.
+//
+//  Copyright 2018 Realmax, Inc.
+//
+
+#pragma once
+
+#include <ARX/ARUtil/thread_sub.h>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+namespace vision {
+    
+    /**
+     * Fork-join pool of worker threads.
+     */
+    class WorkerPool {
+    public:
+        
+        typedef void (*job_t)(void* arg, int index, int count);
+        typedef void (*task_t)(void* arg, int thread, size_t task);
+        
+        static const int kMaxThreads = 32;
+        
+        WorkerPool();
+        ~WorkerPool();
+        
+        /**
+         * Set the number of threads, including the calling thread. Values < 1 select one
+         * thread per online CPU. Must not be called while run() is in progress.
+         */
+        void setThreadNum(int threadNum);
+        
+        /**
+         * @return Number of threads, including the calling thread
+         */
+        inline int threadNum() const { return (int)mThreads.size() + 1; }
+        
+        /**
+         * Call job(arg, index, count) once for each index in [0, count) in parallel, and wait for
+         * all calls to complete. count is clamped to the thread count; the value actually used
+         * is passed to job and returned. Index 0 runs on the calling thread.
+         */
+        int run(job_t job, void* arg, int count);
+        
+        /**
+         * Call task(arg, thread, i) once for each task i in [0, count), and wait for all calls to
+         * complete. Tasks are handed out one at a time to whichever thread is free, so they may
+         * differ in cost. thread is the index of the thread running the task, for selecting
+         * per-thread scratch state. With one thread, the tasks run in order on the calling thread.
+         */
+        void forEach(task_t task, void* arg, size_t count);
+        
+    private:
+        
+        WorkerPool(const WorkerPool&);
+        WorkerPool& operator=(const WorkerPool&);
+        
+        struct Job {
+            job_t job;
+            void* arg;
+            int index;
+            int count;
+        };
+        
+        // Tasks shared between the threads of one forEach() call
+        struct ForEachJob {
+            task_t task;
+            void* arg;
+            size_t count;
+            std::atomic<size_t> next;
+        };
+        
+        static void forEachJob(void* arg, int index, int count);
+        
+        static void* worker(THREAD_HANDLE_T* threadHandle);
+        
+        // Worker threads, excluding the calling thread
+        std::vector<THREAD_HANDLE_T*> mThreads;
+        Job mJobs[kMaxThreads];
+        
+    }; // WorkerPool
+    
+    /**
+     * Rows [begin, end) of one image, as a task for WorkerPool::forEach().
+     */
+    struct RowBand {
+        size_t image;
+        size_t begin;
+        size_t end;
+    };
+    
+    /**
+     * Append bands of at most ROWS rows covering rows [begin, end) of IMAGE.
+     */
+    inline void AppendRowBands(std::vector<RowBand>& bands, size_t image, size_t begin, size_t end, size_t rows) {
+        for(; begin < end; begin += rows) {
+            RowBand band;
+            band.image = image;
+            band.begin = begin;
+            band.end = begin+rows < end ? begin+rows : end;
+            bands.push_back(band);
+        }
+    }
+    
+} // vision
@@ -39,6 +39,7 @@
 
 #include <unordered_map>
 #include <queue>
+#include <cstring>
 
 namespace vision {
     
@@ -115,6 +116,11 @@ namespace vision {
          */
         inline node_id_t id() const { return mId; }
         
+        /**
+         * @return Feature center
+         */
+        inline const unsigned char* center() const { return mCenter; }
+        
         /**
          * Set/Get leaf flag
          */
@@ -219,6 +225,23 @@ namespace vision {
         typedef PriorityQueueItem<NUM_BYTES_PER_FEATURE> queue_item_t;
         typedef std::priority_queue<queue_item_t> queue_t;
         
+        /**
+         * Scratch state for a QUERY. Callers that keep their own can query the same tree
+         * from several threads at once.
+         */
+        struct QueryState {
+            QueryState() : numNodesPopped(0) {}
+            
+            // Reverse index for query
+            std::vector<int> reverseIndex;
+            
+            // Node queue
+            queue_t queue;
+            
+            // Number of nodes popped off the priority queue
+            int numNodesPopped;
+        };
+        
         BinaryHierarchicalClustering();
         ~BinaryHierarchicalClustering() {}
         
@@ -232,10 +255,26 @@ namespace vision {
          */
         int query(const unsigned char* feature) const;
         
+        /**
+         * Query the tree for a reverse index, which is left in STATE.reverseIndex.
+         */
+        int query(const unsigned char* feature, QueryState& state) const;
+        
+        /**
+         * Append the tree to DATA, so that it can be restored with READ without rebuilding.
+         */
+        void write(std::vector<unsigned char>& data) const;
+        
+        /**
+         * Restore a tree appended to a buffer by WRITE.
+         * @return False if DATA does not hold a valid tree over NUM_FEATURES features
+         */
+        bool read(const unsigned char* data, size_t size, int num_features);
+        
         /**
          * @return Reverse index after a QUERY.
          */
-        inline const std::vector<int>& reverseIndex() const { return mQueryReverseIndex; }
+        inline const std::vector<int>& reverseIndex() const { return mQueryState.reverseIndex; }
 
         /**
          * Set/Get number of hypotheses
@@ -275,14 +314,8 @@ namespace vision {
         // Clustering algorithm
         kmedoids_t mBinarykMedoids;
         
-        // Reverse index for query
-        mutable std::vector<int> mQueryReverseIndex;
-        
-        // Node queue
-        mutable queue_t mQueue;
-        
-        // Number of nodes popped off the priority queue
-        mutable int mNumNodesPopped;
+        // State for queries made without one
+        mutable QueryState mQueryState;
         
         // Maximum nodes to pop off the priority queue
         int mMaxNodesToPop;
@@ -307,10 +340,16 @@ namespace vision {
          */
         void build(node_t* node, const unsigned char* features, int num_features, const int* indices, int num_indices);
         
+        /**
+         * Recursive functions to write and read the tree.
+         */
+        static void write(std::vector<unsigned char>& data, const node_t* node);
+        node_t* read(const unsigned char*& data, const unsigned char* end, int num_features, int depth);
+        
         /**
          * Recursive function query function.
          */
-        void query(queue_t& queue, const node_t* node, const unsigned char* feature) const;
+        void query(QueryState& state, const node_t* node, const unsigned char* feature) const;
         
     }; // BinaryHierarchicalClustering
 
@@ -319,7 +358,6 @@ namespace vision {
     : mRandSeed(1234)
     , mNextNodeId(0)
     , mBinarykMedoids(mRandSeed)
-    , mNumNodesPopped(0)
     , mMaxNodesToPop(0)
     , mMinFeaturePerNode(16) {
         mBinarykMedoids.setk(8);
@@ -400,45 +438,144 @@ namespace vision {
         }
     }
     
+    //
+    // Each node is written as its id, leaf flag, number of children and number of reverse
+    // index entries (all int32), then its center and reverse index, then its children.
+    //
+    
+    template<int NUM_BYTES_PER_FEATURE>
+    void BinaryHierarchicalClustering<NUM_BYTES_PER_FEATURE>::write(std::vector<unsigned char>& data) const {
+        ASSERT(mRoot.get(), "Root cannot be NULL");
+        write(data, mRoot.get());
+    }
+    
+    template<int NUM_BYTES_PER_FEATURE>
+    void BinaryHierarchicalClustering<NUM_BYTES_PER_FEATURE>::write(std::vector<unsigned char>& data, const node_t* node) {
+        int32_t header[4];
+        header[0] = node->id();
+        header[1] = node->leaf() ? 1 : 0;
+        header[2] = (int32_t)node->children().size();
+        header[3] = (int32_t)node->reverseIndex().size();
+        
+        size_t offset = data.size();
+        data.resize(offset + sizeof(header) + NUM_BYTES_PER_FEATURE + header[3]*sizeof(int32_t));
+        std::memcpy(&data[offset], header, sizeof(header));
+        offset += sizeof(header);
+        std::memcpy(&data[offset], node->center(), NUM_BYTES_PER_FEATURE);
+        offset += NUM_BYTES_PER_FEATURE;
+        for(int32_t i = 0; i < header[3]; i++) {
+            int32_t index = node->reverseIndex()[i];
+            std::memcpy(&data[offset], &index, sizeof(index));
+            offset += sizeof(index);
+        }
+        
+        for(size_t i = 0; i < node->children().size(); i++) {
+            write(data, node->children()[i]);
+        }
+    }
+    
+    template<int NUM_BYTES_PER_FEATURE>
+    bool BinaryHierarchicalClustering<NUM_BYTES_PER_FEATURE>::read(const unsigned char* data, size_t size, int num_features) {
+        mNextNodeId = 0;
+        mRoot.reset(read(data, data + size, num_features, 0));
+        return mRoot.get() != NULL;
+    }
+    
+    template<int NUM_BYTES_PER_FEATURE>
+    typename BinaryHierarchicalClustering<NUM_BYTES_PER_FEATURE>::node_t*
+    BinaryHierarchicalClustering<NUM_BYTES_PER_FEATURE>::read(const unsigned char*& data,
+                                                            const unsigned char* end,
+                                                            int num_features,
+                                                            int depth) {
+        // Deeper than any tree that BUILD produces, so the data must be corrupt
+        static const int kMaxDepth = 1024;
+        
+        int32_t header[4];
+        if(depth > kMaxDepth || (size_t)(end - data) < sizeof(header) + NUM_BYTES_PER_FEATURE) {
+            return NULL;
+        }
+        std::memcpy(header, data, sizeof(header));
+        data += sizeof(header);
+        if(header[2] < 0 || header[3] < 0 || (size_t)(end - data - NUM_BYTES_PER_FEATURE)/sizeof(int32_t) < (size_t)header[3]) {
+            return NULL;
+        }
+        
+        std::unique_ptr<node_t> node(new node_t(header[0], data));
+        node->leaf(header[1] != 0);
+        mNextNodeId = max2(mNextNodeId, header[0] + 1);
+        data += NUM_BYTES_PER_FEATURE;
+        
+        node->reverseIndex().resize(header[3]);
+        for(int32_t i = 0; i < header[3]; i++) {
+            int32_t index;
+            std::memcpy(&index, data, sizeof(index));
+            data += sizeof(index);
+            if(index < 0 || index >= num_features) {
+                return NULL;
+            }
+            node->reverseIndex()[i] = index;
+        }
+        
+        // Leaves answer queries from their reverse index, and inner nodes need a child to descend to
+        if(node->leaf() == (header[2] != 0)) {
+            return NULL;
+        }
+        node->children().reserve(header[2]);
+        for(int32_t i = 0; i < header[2]; i++) {
+            node_t* child = read(data, end, num_features, depth+1);
+            if(child == NULL) {
+                return NULL;
+            }
+            node->children().push_back(child);
+        }
+        
+        return node.release();
+    }
+    
     template<int NUM_BYTES_PER_FEATURE>
     int BinaryHierarchicalClustering<NUM_BYTES_PER_FEATURE>::query(const unsigned char* feature) const {
+        return query(feature, mQueryState);
+    }
+    
+    template<int NUM_BYTES_PER_FEATURE>
+    int BinaryHierarchicalClustering<NUM_BYTES_PER_FEATURE>::query(const unsigned char* feature, QueryState& state) const {
         ASSERT(mRoot.get(), "Root cannot be NULL");
         
-        mNumNodesPopped = 0;
-        mQueryReverseIndex.clear();
+        state.numNodesPopped = 0;
+        state.reverseIndex.clear();
         
-        while(!mQueue.empty()) {
-            mQueue.pop();
+        while(!state.queue.empty()) {
+            state.queue.pop();
         }
         
-        query(mQueue, mRoot.get(), feature);
+        query(state, mRoot.get(), feature);
         
-        return (int)mQueryReverseIndex.size();
+        return (int)state.reverseIndex.size();
     }
     
     template<int NUM_BYTES_PER_FEATURE>
-    void BinaryHierarchicalClustering<NUM_BYTES_PER_FEATURE>::query(queue_t& queue,
+    void BinaryHierarchicalClustering<NUM_BYTES_PER_FEATURE>::query(QueryState& state,
                                                                     const node_t* node,
                                                                     const unsigned char* feature) const {
         if(node->leaf()) {
             // Insert all the leaf indices into the query index
-            mQueryReverseIndex.insert(mQueryReverseIndex.end(),
+            state.reverseIndex.insert(state.reverseIndex.end(),
                                       node->reverseIndex().begin(),
                                       node->reverseIndex().end());
             return;
         } else {
             std::vector<const node_t*> nodes;
-            node->nearest(nodes, queue, feature);
+            node->nearest(nodes, state.queue, feature);
             for(size_t i = 0; i < nodes.size(); i++) {
-                query(queue, nodes[i], feature);
+                query(state, nodes[i], feature);
             }
             
             // Pop a node from the queue
-            if(mNumNodesPopped < mMaxNodesToPop && !queue.empty()) {
-                const node_t* q = queue.top().node();
-                queue.pop();
-                mNumNodesPopped++;
-                query(queue, q, feature);
+            if(state.numNodesPopped < mMaxNodesToPop && !state.queue.empty()) {
+                const node_t* q = state.queue.top().node();
+                state.queue.pop();
+                state.numNodesPopped++;
+                query(state, q, feature);
             }
         }
     }
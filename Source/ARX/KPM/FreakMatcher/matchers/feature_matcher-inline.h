@@ -73,22 +73,28 @@ namespace vision {
             unsigned int second_best = std::numeric_limits<unsigned int>::max();
             int best_index = std::numeric_limits<int>::max();
             
-            // Search for 1st and 2nd best match
+            // Both points should be a MINIMA or MAXIMA
             const unsigned char* f1 = features1->feature(i);
             const FeaturePoint& p1 = features1->point(i);
+            mCandidates.clear();
             for(size_t j = 0; j < features2->size(); j++) {
-                // Both points should be a MINIMA or MAXIMA
-                if(p1.maxima != features2->point(j).maxima) {
-                    continue;
+                if(p1.maxima == features2->point(j).maxima) {
+                    mCandidates.push_back((int)j);
                 }
-                
-                ASSERT(FEATURE_SIZE == 96, "Only 96 bytes supported now");
-                unsigned int d = HammingDistance<FEATURE_SIZE>(f1,
-                                                               (unsigned char*)features2->feature(j));
+            }
+            
+            // Search for 1st and 2nd best match
+            ASSERT(FEATURE_SIZE == 96, "Only 96 bytes supported now");
+            mDistances.resize(mCandidates.size());
+            if(!mCandidates.empty()) {
+                HammingDistance768Batch(f1, features2->feature(0), &mCandidates[0], mCandidates.size(), &mDistances[0]);
+            }
+            for(size_t j = 0; j < mCandidates.size(); j++) {
+                unsigned int d = mDistances[j];
                 if(d < first_best) {
                     second_best = first_best;
                     first_best = d;
-                    best_index = (int)j;
+                    best_index = mCandidates[j];
                 } else if(d < second_best) {
                     second_best = d;
                 }
@@ -132,24 +138,31 @@ namespace vision {
             
             // Perform an indexed nearest neighbor lookup
             const unsigned char* f1 = features1->feature(i);
-            index2.query(f1);
+            index2.query(f1, mIndexQueryState);
             
             const FeaturePoint& p1 = features1->point(i);
             
-            // Search for 1st and 2nd best match
-            const std::vector<int>& v = index2.reverseIndex();
+            // Both points should be a MINIMA or MAXIMA
+            const std::vector<int>& v = mIndexQueryState.reverseIndex;
+            mCandidates.clear();
             for(size_t j = 0; j < v.size(); j++) {
-                // Both points should be a MINIMA or MAXIMA
-                if(p1.maxima != features2->point(v[j]).maxima) {
-                    continue;
+                if(p1.maxima == features2->point(v[j]).maxima) {
+                    mCandidates.push_back(v[j]);
                 }
-                
-                ASSERT(FEATURE_SIZE == 96, "Only 96 bytes supported now");
-                unsigned int d = HammingDistance<FEATURE_SIZE>(f1, (unsigned char*)features2->feature(v[j]));
+            }
+            
+            // Search for 1st and 2nd best match
+            ASSERT(FEATURE_SIZE == 96, "Only 96 bytes supported now");
+            mDistances.resize(mCandidates.size());
+            if(!mCandidates.empty()) {
+                HammingDistance768Batch(f1, features2->feature(0), &mCandidates[0], mCandidates.size(), &mDistances[0]);
+            }
+            for(size_t j = 0; j < mCandidates.size(); j++) {
+                unsigned int d = mDistances[j];
                 if(d < first_best) {
                     second_best = first_best;
                     first_best = d;
-                    best_index = v[j];
+                    best_index = mCandidates[j];
                 } else if(d < second_best) {
                     second_best = d;
                 }
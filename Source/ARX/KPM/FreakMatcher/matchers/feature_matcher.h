@@ -108,6 +108,13 @@ namespace vision {
         // Threshold on the 1st and 2nd best matches
         float mThreshold;
         
+        // Scratch state for index queries, so that an index can be shared between matchers
+        typename index_t::QueryState mIndexQueryState;
+        
+        // Candidates for the current query feature and their distances, for batched distance computation
+        std::vector<int> mCandidates;
+        std::vector<unsigned int> mDistances;
+        
     }; // BinaryFeatureMatcher
     
     /**
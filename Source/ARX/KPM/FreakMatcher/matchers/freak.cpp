@@ -36,9 +36,13 @@
 #include "freak.h"
 #include <framework/error.h>
 #include "freak84-inline.h"
+#include <cstring>
 
 using namespace vision;
 
+// Number of points in each task handed to a thread when extracting on a worker pool
+static const size_t kPointsPerTask = 16;
+
 FREAKExtractor::FREAKExtractor() {
     CopyVector(mPointRing0, freak84_points_ring0, 12);
     CopyVector(mPointRing1, freak84_points_ring1, 12);
@@ -57,6 +61,8 @@ FREAKExtractor::FREAKExtractor() {
     
     mExpansionFactor = 7;
     
+    mWorkerPool = NULL;
+    
     ASSERT(sizeof(freak84_points_ring0) == 48, "Size should be 48 bytes");
     ASSERT(sizeof(freak84_points_ring1) == 48, "Size should be 48 bytes");
     ASSERT(sizeof(freak84_points_ring2) == 48, "Size should be 48 bytes");
@@ -153,6 +159,39 @@ void FREAKExtractor::extract(BinaryFeatureStore& store,
     
     store.setNumBytesPerFeature(96);
     store.resize(points.size());
+    
+#ifndef FREAK_DEBUG
+    if(mWorkerPool && mWorkerPool->threadNum() > 1) {
+        // Extract the descriptor of each point into its own slot, then close the gaps left by
+        // points without a descriptor, in order.
+        mExtracted.resize(points.size());
+        
+        ExtractJob job;
+        job.extractor = this;
+        job.store = &store;
+        job.pyramid = pyramid;
+        job.points = &points;
+        mWorkerPool->forEach(extractTask, &job, (points.size()+kPointsPerTask-1)/kPointsPerTask);
+        
+        size_t num_points = 0;
+        for(size_t i = 0; i < points.size(); i++) {
+            if(!mExtracted[i]) {
+                continue;
+            }
+            if(num_points != i) {
+                std::memcpy(store.feature(num_points), store.feature(i), store.numBytesPerFeature());
+            }
+            store.point(num_points) = points[i];
+            num_points++;
+        }
+        ASSERT(num_points == points.size(), "Should be same size");
+        
+        // Shrink store down to the number of valid points
+        store.resize(num_points);
+        return;
+    }
+#endif
+    
     ExtractFREAK84(store,
                    pyramid,
                    points,
@@ -188,4 +227,30 @@ void FREAKExtractor::extract(BinaryFeatureStore& store,
                    mMappedSC
 #endif
                    );
-}
\ No newline at end of file
+}
+
+void FREAKExtractor::extractTask(void* arg, int thread, size_t task) {
+    ExtractJob* job = (ExtractJob*)arg;
+    FREAKExtractor* e = job->extractor;
+    
+    size_t end = min2<size_t>((task+1)*kPointsPerTask, job->points->size());
+    for(size_t i = task*kPointsPerTask; i < end; i++) {
+        e->mExtracted[i] = ExtractFREAK84(job->store->feature(i),
+                                          job->pyramid,
+                                          (*job->points)[i],
+                                          e->mPointRing0,
+                                          e->mPointRing1,
+                                          e->mPointRing2,
+                                          e->mPointRing3,
+                                          e->mPointRing4,
+                                          e->mPointRing5,
+                                          e->mSigmaCenter,
+                                          e->mSigmaRing0,
+                                          e->mSigmaRing1,
+                                          e->mSigmaRing2,
+                                          e->mSigmaRing3,
+                                          e->mSigmaRing4,
+                                          e->mSigmaRing5,
+                                          e->mExpansionFactor);
+    }
+}
@@ -36,6 +36,7 @@
 #pragma once
 
 #include <detectors/gaussian_scale_space_pyramid.h>
+#include <framework/worker_pool.h>
 #include <math/indexing.h>
 #include <math/homography.h>
 #include <math/math_io.h>
@@ -78,6 +79,13 @@ namespace vision {
                      const GaussianScaleSpacePyramid* pyramid,
                      const std::vector<FeaturePoint>& points);
         
+        /**
+         * Get/Set the threads to extract with. NULL, the default, extracts on the calling thread.
+         * The descriptors are the same, and in the same order, for any number of threads.
+         */
+        WorkerPool* workerPool() const { return mWorkerPool; }
+        void setWorkerPool(WorkerPool* pool) { mWorkerPool = pool; }
+        
 #ifdef FREAK_DEBUG
         std::vector<Point2d<float> > mMappedPoints0;
         std::vector<Point2d<float> > mMappedPoints1;
@@ -118,6 +126,22 @@ namespace vision {
         // Scale expansion factor
         float mExpansionFactor;
         
+        // Threads to extract with, or NULL
+        WorkerPool* mWorkerPool;
+        
+        // Whether a descriptor could be extracted for each point
+        std::vector<unsigned char> mExtracted;
+        
+        // Work shared between the threads extracting descriptors
+        struct ExtractJob {
+            FREAKExtractor* extractor;
+            BinaryFeatureStore* store;
+            const GaussianScaleSpacePyramid* pyramid;
+            const std::vector<FeaturePoint>* points;
+        };
+        
+        static void extractTask(void* arg, int thread, size_t task);
+        
     }; // FREAKExtractor
 
     /**
@@ -0,0 +1,236 @@
+//
+//  global_keyframe_index.h
+//  artoolkitX
+//
+//  This file is part of artoolkitX.
+//
+//  artoolkitX is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  artoolkitX is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules, and to
+//  copy and distribute the resulting executable under terms of your choice,
+//  provided that you also meet, for each linked independent module, the terms and
+//  conditions of the license of that module. An independent module is a module
+//  which is neither derived from nor based on this library. If you modify this
+//  library, you may extend this exception to your version of the library, but you
+//  are not obligated to do so. If you do not wish to do so, delete this exception
+//  statement from your version.
+//
+//  Copyright 2018 Realmax, Inc.
+//
+
+#pragma once
+
+#include "keyframe.h"
+#include <math/hamming.h>
+#include <math/indexing.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace vision {
+    
+    /**
+     * A single index over the features of every keyframe in a database. A query
+     * votes for the keyframes holding the nearest neighbours of its features, so
+     * that only the best candidates need to be matched and verified individually.
+     */
+    template<int NUM_BYTES_PER_FEATURE>
+    class GlobalKeyframeIndex {
+    public:
+        
+        typedef Keyframe<NUM_BYTES_PER_FEATURE> keyframe_t;
+        typedef BinaryHierarchicalClustering<NUM_BYTES_PER_FEATURE> index_t;
+        
+        /**
+         * Scratch state for a VOTE, so that the same index can be used from several threads.
+         */
+        struct QueryState {
+            typename index_t::QueryState indexState;
+            std::vector<int> candidates;
+            std::vector<unsigned int> distances;
+            std::vector<int> votes;
+            std::vector<std::pair<int, int> > ranking;
+        };
+        
+        GlobalKeyframeIndex() : mNumKeyframes(0) {}
+        ~GlobalKeyframeIndex() {}
+        
+        /**
+         * Build the index. Keyframes are referred to by their position in KEYFRAMES.
+         */
+        void build(const std::vector<const keyframe_t*>& keyframes);
+        
+        /**
+         * Append the index to DATA, so that it can be restored with READ. The index must
+         * hold at least one feature.
+         */
+        void write(std::vector<unsigned char>& data) const {
+            mIndex.write(data);
+        }
+        
+        /**
+         * Restore an index saved with WRITE for the same features instead of building it.
+         * @return False if DATA is not a valid index for the features of KEYFRAMES
+         */
+        bool read(const std::vector<const keyframe_t*>& keyframes, const unsigned char* data, size_t size);
+        
+        /**
+         * @return Number of features in the index
+         */
+        inline size_t numFeatures() const { return mKeyframeOf.size(); }
+        
+        /**
+         * @return Number of keyframes in the index
+         */
+        inline int numKeyframes() const { return mNumKeyframes; }
+        
+        /**
+         * Find the keyframes with the most votes from the features in QUERY. At most
+         * MAX_KEYFRAMES keyframes with at least one vote are returned in KEYFRAMES,
+         * in ascending order.
+         */
+        void vote(std::vector<int>& keyframes,
+                  const BinaryFeatureStore& query,
+                  size_t max_keyframes,
+                  QueryState& state) const;
+        
+    private:
+        
+        // Gather the features of KEYFRAMES into mFeatures, and set up mIndex to index them
+        void gather(const std::vector<const keyframe_t*>& keyframes);
+        
+        // Features of all the keyframes, end to end
+        std::vector<unsigned char> mFeatures;
+        
+        // Extremum type and keyframe of each feature
+        std::vector<unsigned char> mMaxima;
+        std::vector<int> mKeyframeOf;
+        
+        int mNumKeyframes;
+        
+        // Index over mFeatures
+        index_t mIndex;
+        
+    }; // GlobalKeyframeIndex
+    
+    template<int NUM_BYTES_PER_FEATURE>
+    void GlobalKeyframeIndex<NUM_BYTES_PER_FEATURE>::build(const std::vector<const keyframe_t*>& keyframes) {
+        gather(keyframes);
+        if(mKeyframeOf.empty()) {
+            return;
+        }
+        mIndex.build(&mFeatures[0], (int)mKeyframeOf.size());
+    }
+    
+    template<int NUM_BYTES_PER_FEATURE>
+    bool GlobalKeyframeIndex<NUM_BYTES_PER_FEATURE>::read(const std::vector<const keyframe_t*>& keyframes, const unsigned char* data, size_t size) {
+        gather(keyframes);
+        if(mKeyframeOf.empty() || !mIndex.read(data, size, (int)mKeyframeOf.size())) {
+            mKeyframeOf.clear();
+            return false;
+        }
+        return true;
+    }
+    
+    template<int NUM_BYTES_PER_FEATURE>
+    void GlobalKeyframeIndex<NUM_BYTES_PER_FEATURE>::gather(const std::vector<const keyframe_t*>& keyframes) {
+        size_t num_features = 0;
+        for(size_t i = 0; i < keyframes.size(); i++) {
+            num_features += keyframes[i]->store().size();
+        }
+        
+        mNumKeyframes = (int)keyframes.size();
+        mFeatures.resize(num_features*NUM_BYTES_PER_FEATURE);
+        mMaxima.resize(num_features);
+        mKeyframeOf.resize(num_features);
+        
+        size_t n = 0;
+        for(size_t i = 0; i < keyframes.size(); i++) {
+            const BinaryFeatureStore& store = keyframes[i]->store();
+            if(store.size() == 0) {
+                continue;
+            }
+            CopyVector(&mFeatures[n*NUM_BYTES_PER_FEATURE], store.feature(0), store.size()*NUM_BYTES_PER_FEATURE);
+            for(size_t j = 0; j < store.size(); j++, n++) {
+                mMaxima[n] = store.point(j).maxima;
+                mKeyframeOf[n] = (int)i;
+            }
+        }
+        
+        // Same parameters as the per-keyframe index, so leaves hold a similar number of features.
+        mIndex.setNumHypotheses(128);
+        mIndex.setNumCenters(8);
+        mIndex.setMaxNodesToPop(8);
+        mIndex.setMinFeaturesPerNode(16);
+    }
+    
+    template<int NUM_BYTES_PER_FEATURE>
+    void GlobalKeyframeIndex<NUM_BYTES_PER_FEATURE>::vote(std::vector<int>& keyframes,
+                                                          const BinaryFeatureStore& query,
+                                                          size_t max_keyframes,
+                                                          QueryState& state) const {
+        keyframes.clear();
+        if(mKeyframeOf.empty()) {
+            return;
+        }
+        
+        // Each query feature votes for the keyframe of its nearest neighbour of the same extremum type
+        state.votes.assign(mNumKeyframes, 0);
+        for(size_t i = 0; i < query.size(); i++) {
+            const unsigned char* f = query.feature(i);
+            const unsigned char maxima = query.point(i).maxima;
+            
+            mIndex.query(f, state.indexState);
+            const std::vector<int>& v = state.indexState.reverseIndex;
+            state.candidates.clear();
+            for(size_t j = 0; j < v.size(); j++) {
+                if(mMaxima[v[j]] == maxima) {
+                    state.candidates.push_back(v[j]);
+                }
+            }
+            if(state.candidates.empty()) {
+                continue;
+            }
+            
+            state.distances.resize(state.candidates.size());
+            HammingDistance768Batch(f, &mFeatures[0], &state.candidates[0], state.candidates.size(), &state.distances[0]);
+            size_t best = 0;
+            for(size_t j = 1; j < state.distances.size(); j++) {
+                if(state.distances[j] < state.distances[best]) {
+                    best = j;
+                }
+            }
+            state.votes[mKeyframeOf[state.candidates[best]]]++;
+        }
+        
+        // Rank by votes, then by position so that ties are broken the same way every time
+        state.ranking.clear();
+        for(int i = 0; i < mNumKeyframes; i++) {
+            if(state.votes[i] > 0) {
+                state.ranking.push_back(std::make_pair(-state.votes[i], i));
+            }
+        }
+        if(state.ranking.size() > max_keyframes) {
+            std::partial_sort(state.ranking.begin(), state.ranking.begin() + max_keyframes, state.ranking.end());
+            state.ranking.resize(max_keyframes);
+        }
+        for(size_t i = 0; i < state.ranking.size(); i++) {
+            keyframes.push_back(state.ranking[i].second);
+        }
+        std::sort(keyframes.begin(), keyframes.end());
+    }
+    
+} // vision
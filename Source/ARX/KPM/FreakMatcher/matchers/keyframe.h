@@ -78,6 +78,19 @@ namespace vision {
          */
         void buildIndex();
         
+        /**
+         * Append the index to DATA, so that it can be restored with LOADINDEX.
+         */
+        void saveIndex(std::vector<unsigned char>& data) const {
+            mIndex.write(data);
+        }
+        
+        /**
+         * Restore an index saved with SAVEINDEX instead of building it.
+         * @return False if DATA is not a valid index for the features in the store
+         */
+        bool loadIndex(const unsigned char* data, size_t size);
+        
         /**
          * Copy a keyframe.
          */
@@ -121,4 +134,13 @@ namespace vision {
         mIndex.build(&mStore.features()[0], (int)mStore.size());
     }
     
+    template<int NUM_BYTES_PER_FEATURE>
+    bool Keyframe<NUM_BYTES_PER_FEATURE>::loadIndex(const unsigned char* data, size_t size) {
+        mIndex.setNumHypotheses(128);
+        mIndex.setNumCenters(8);
+        mIndex.setMaxNodesToPop(8);
+        mIndex.setMinFeaturesPerNode(16);
+        return mIndex.read(data, size, (int)mStore.size());
+    }
+    
 } // vision
\ No newline at end of file
@@ -66,15 +66,76 @@ namespace vision {
         mDetector.setEdgeThreshold(kEdgeThreshold);
         mDetector.setMaxNumFeaturePoints(kMaxNumFeatures);
         
+        // Feature detection and extraction share the threads used for matching
+        mDetector.setWorkerPool(&mWorkerPool);
+        mFeatureExtractor.setWorkerPool(&mWorkerPool);
+        
         mHomographyInlierThreshold = kHomographyInlierThreshold;
         mMinNumInliers = kMinNumInliers;
         
         mUseFeatureIndex = kUseFeatureIndex;
+        mGlobalIndexCandidates = 0;
+        
+        mQueryContexts.resize(1);
     }
     
     template<typename FEATURE_EXTRACTOR, typename STORE, typename MATCHER>
     VisualDatabase<FEATURE_EXTRACTOR, STORE, MATCHER>::~VisualDatabase() {}
     
+    template<typename FEATURE_EXTRACTOR, typename STORE, typename MATCHER>
+    void VisualDatabase<FEATURE_EXTRACTOR, STORE, MATCHER>::setThreadNum(int n) {
+        mWorkerPool.setThreadNum(n);
+        mQueryContexts.resize(mWorkerPool.threadNum());
+    }
+    
+    template<typename FEATURE_EXTRACTOR, typename STORE, typename MATCHER>
+    void VisualDatabase<FEATURE_EXTRACTOR, STORE, MATCHER>::setGlobalIndexCandidates(size_t n) {
+        mGlobalIndexCandidates = n;
+    }
+    
+    template<typename FEATURE_EXTRACTOR, typename STORE, typename MATCHER>
+    void VisualDatabase<FEATURE_EXTRACTOR, STORE, MATCHER>::buildGlobalIndex() {
+        std::shared_ptr<GlobalIndex> globalIndex(new GlobalIndex());
+        std::vector<const keyframe_t*> keyframes;
+        typename keyframe_map_t::const_iterator it = mKeyframeMap.begin();
+        for(; it != mKeyframeMap.end(); it++) {
+            globalIndex->ids.push_back(it->first);
+            globalIndex->keyframes.push_back(it->second);
+            keyframes.push_back(it->second.get());
+        }
+        TIMED("Build Global Index") {
+            globalIndex->index.build(keyframes);
+        }
+        mGlobalIndex = globalIndex;
+    }
+    
+    template<typename FEATURE_EXTRACTOR, typename STORE, typename MATCHER>
+    void VisualDatabase<FEATURE_EXTRACTOR, STORE, MATCHER>::saveGlobalIndex(std::vector<unsigned char>& data) {
+        if(!mGlobalIndex) {
+            buildGlobalIndex();
+        }
+        if(mGlobalIndex->index.numFeatures() > 0) {
+            mGlobalIndex->index.write(data);
+        }
+    }
+    
+    template<typename FEATURE_EXTRACTOR, typename STORE, typename MATCHER>
+    bool VisualDatabase<FEATURE_EXTRACTOR, STORE, MATCHER>::loadGlobalIndex(const unsigned char* data, size_t size) {
+        std::shared_ptr<GlobalIndex> globalIndex(new GlobalIndex());
+        std::vector<const keyframe_t*> keyframes;
+        typename keyframe_map_t::const_iterator it = mKeyframeMap.begin();
+        for(; it != mKeyframeMap.end(); it++) {
+            globalIndex->ids.push_back(it->first);
+            globalIndex->keyframes.push_back(it->second);
+            keyframes.push_back(it->second.get());
+        }
+        if(!globalIndex->index.read(keyframes, data, size)) {
+            return false;
+        }
+        mGlobalIndex = globalIndex;
+        return true;
+    }
+    
     template<typename FEATURE_EXTRACTOR, typename STORE, typename MATCHER>
     void VisualDatabase<FEATURE_EXTRACTOR, STORE, MATCHER>::addImage(const vision::Image& image, id_t id) throw(Exception) {
         if(mKeyframeMap.find(id) != mKeyframeMap.end()) {
@@ -126,6 +187,7 @@ namespace vision {
         
         // Store the keyframe
         mKeyframeMap[id] = keyframe;
+        mGlobalIndex.reset();
     }
     
     template<typename FEATURE_EXTRACTOR, typename STORE, typename MATCHER>
@@ -136,6 +198,18 @@ namespace vision {
         }
         
         mKeyframeMap[id] = keyframe;
+        mGlobalIndex.reset();
+    }
+    
+    template<typename FEATURE_EXTRACTOR, typename STORE, typename MATCHER>
+    void VisualDatabase<FEATURE_EXTRACTOR, STORE, MATCHER>::shareKeyframes(const VisualDatabase& other) throw(Exception) {
+        typename keyframe_map_t::const_iterator it = other.mKeyframeMap.begin();
+        for(; it != other.mKeyframeMap.end(); it++) {
+            addKeyframe(it->second, it->first);
+        }
+        if(mKeyframeMap.size() == other.mKeyframeMap.size()) {
+            mGlobalIndex = other.mGlobalIndex;
+        }
     }
     
     template<typename FEATURE_EXTRACTOR, typename STORE, typename MATCHER>
@@ -156,6 +230,27 @@ namespace vision {
         return query(&mPyramid);
     }
     
+    template<typename FEATURE_EXTRACTOR, typename STORE, typename MATCHER>
+    bool VisualDatabase<FEATURE_EXTRACTOR, STORE, MATCHER>::query(const vision::Image& image, int x, int y) throw(Exception) {
+        bool matched = query(image);
+        
+        // Move the query features into the larger image
+        std::vector<FeaturePoint>& points = mQueryKeyframe->store().points();
+        for(size_t i = 0; i < points.size(); i++) {
+            points[i].x += x;
+            points[i].y += y;
+        }
+        
+        // The matched geometry maps query points to the keyframe, so undo the move first
+        if(matched) {
+            for(int r = 0; r < 3; r++) {
+                mMatchedGeometry[r*3+2] -= mMatchedGeometry[r*3]*x + mMatchedGeometry[r*3+1]*y;
+            }
+        }
+        
+        return matched;
+    }
+    
     template<typename FEATURE_EXTRACTOR, typename STORE, typename MATCHER>
     bool VisualDatabase<FEATURE_EXTRACTOR, STORE, MATCHER>::query(const GaussianScaleSpacePyramid* pyramid) throw(Exception) {
         // Allocate detector
@@ -181,157 +276,224 @@ namespace vision {
         mMatchedInliers.clear();
         mMatchedId = -1;
         
-        const std::vector<FeaturePoint>& query_points = query_keyframe->store().points();
-        
-        // Loop over all the images in the database
-        typename keyframe_map_t::const_iterator it = mKeyframeMap.begin();
-        for(; it != mKeyframeMap.end(); it++) {
-            TIMED("Find Matches (1)") {
-                if(mUseFeatureIndex) {
-                    if(mMatcher.match(&query_keyframe->store(), &it->second->store(), it->second->index()) < mMinNumInliers) {
-                        continue;
-                    }
-                } else {
-                    if(mMatcher.match(&query_keyframe->store(), &it->second->store()) < mMinNumInliers) {
-                        continue;
-                    }
+        std::vector<id_t> ids;
+        QueryJob job;
+        job.vdb = this;
+        job.queryKeyframe = query_keyframe;
+        if(!mQueryIds.empty()) {
+            // Only match the keyframes asked for, in the order given
+            for(size_t i = 0; i < mQueryIds.size(); i++) {
+                typename keyframe_map_t::const_iterator it = mKeyframeMap.find(mQueryIds[i]);
+                if(it != mKeyframeMap.end()) {
+                    ids.push_back(it->first);
+                    job.keyframes.push_back(it->second.get());
                 }
             }
-            
-            const std::vector<FeaturePoint>& ref_points = it->second->store().points();
-            //std::cout<<"ref_points-"<<ref_points.size()<<std::endl;
-            //std::cout<<"query_points-"<<query_points.size()<<std::endl;
-            
-            //
-            // Vote for a transformation based on the correspondences
-            //
-            
-            int max_hough_index = -1;
-            TIMED("Hough Voting (1)") {
-                max_hough_index = FindHoughSimilarity(mHoughSimilarityVoting,
-                                                      query_points,
-                                                      ref_points,
-                                                      mMatcher.matches(),
-                                                      query_keyframe->width(),
-                                                      query_keyframe->height(),
-                                                      it->second->width(),
-                                                      it->second->height());
-                if(max_hough_index < 0) {
-                    continue;
-                }
+        } else if(mGlobalIndexCandidates > 0 && mKeyframeMap.size() > mGlobalIndexCandidates) {
+            // Only match the keyframes that most of the query features vote for
+            if(!mGlobalIndex) {
+                buildGlobalIndex();
             }
-            
-            matches_t hough_matches;
-            TIMED("Find Hough Matches (1)") {
-                FindHoughMatches(hough_matches,
-                                 mHoughSimilarityVoting,
-                                 mMatcher.matches(),
-                                 max_hough_index,
-                                 kHoughBinDelta);
+            TIMED("Vote Global Index") {
+                mGlobalIndex->index.vote(mGlobalIndexCandidateList,
+                                         query_keyframe->store(),
+                                         mGlobalIndexCandidates,
+                                         mGlobalIndexQueryState);
             }
-            
-            //
-            // Estimate the transformation between the two images
-            //
-            
-            float H[9];
-            TIMED("Estimate Homography (1)") {
-                if(!EstimateHomography(H,
-                                       query_points,
-                                       ref_points,
-                                       hough_matches,
-                                       mRobustHomography,
-                                       it->second->width(),
-                                       it->second->height())) {
-                    continue;
-                }
+            for(size_t i = 0; i < mGlobalIndexCandidateList.size(); i++) {
+                ids.push_back(mGlobalIndex->ids[mGlobalIndexCandidateList[i]]);
+                job.keyframes.push_back(mGlobalIndex->keyframes[mGlobalIndexCandidateList[i]].get());
             }
-            
-            //
-            // Find the inliers
-            //
-            
-            matches_t inliers;
-            TIMED("Find Inliers (1)") {
-                FindInliers(inliers, H, query_points, ref_points, hough_matches, mHomographyInlierThreshold);
-                if(inliers.size() < mMinNumInliers) {
-                    continue;
-                }
+        } else {
+            ids.reserve(mKeyframeMap.size());
+            job.keyframes.reserve(mKeyframeMap.size());
+            typename keyframe_map_t::const_iterator it = mKeyframeMap.begin();
+            for(; it != mKeyframeMap.end(); it++) {
+                ids.push_back(it->first);
+                job.keyframes.push_back(it->second.get());
             }
-            
-            //
-            // Use the estimated homography to find more inliers
-            //
-            
-            TIMED("Find Matches (2)") {
-                if(mMatcher.match(&query_keyframe->store(),
-                                  &it->second->store(),
-                                  H,
-                                  10) < mMinNumInliers) {
-                    continue;
-                }
+        }
+        job.results.resize(job.keyframes.size());
+        job.next = 0;
+        
+        // Match all the images in the database
+        if(mWorkerPool.threadNum() > 1 && job.keyframes.size() > 1) {
+            mWorkerPool.run(queryJob, &job, (int)job.keyframes.size());
+        } else {
+            queryJob(&job, 0, 1);
+        }
+        
+        // Pick the match with the most inliers, taking the first in matching order on a tie,
+        // so that the result does not depend on the number of threads.
+        for(size_t i = 0; i < job.results.size(); i++) {
+            KeyframeResult& result = job.results[i];
+            if(result.matched && result.inliers.size() > mMatchedInliers.size()) {
+                CopyVector9(mMatchedGeometry, result.H);
+                mMatchedInliers.swap(result.inliers);
+                mMatchedId = ids[i];
             }
-            
-            //
-            // Vote for a similarity with new matches
-            //
-            
-            TIMED("Hough Voting (2)") {
-                max_hough_index = FindHoughSimilarity(mHoughSimilarityVoting,
-                                                      query_points,
-                                                      ref_points,
-                                                      mMatcher.matches(),
-                                                      query_keyframe->width(),
-                                                      query_keyframe->height(),
-                                                      it->second->width(),
-                                                      it->second->height());
-                if(max_hough_index < 0) {
-                    continue;
+        }
+        
+        return mMatchedId >= 0;
+    }
+    
+    template<typename FEATURE_EXTRACTOR, typename STORE, typename MATCHER>
+    void VisualDatabase<FEATURE_EXTRACTOR, STORE, MATCHER>::queryJob(void* arg, int index, int count) {
+        QueryJob* job = (QueryJob*)arg;
+        QueryContext& context = job->vdb->mQueryContexts[index];
+        
+        // Keyframes are handed out one at a time, since most are rejected early and take little time.
+        for(size_t i = job->next++; i < job->keyframes.size(); i = job->next++) {
+            KeyframeResult& result = job->results[i];
+            result.matched = job->vdb->matchKeyframe(context, job->queryKeyframe, job->keyframes[i], result.H, result.inliers);
+        }
+    }
+    
+    template<typename FEATURE_EXTRACTOR, typename STORE, typename MATCHER>
+    bool VisualDatabase<FEATURE_EXTRACTOR, STORE, MATCHER>::matchKeyframe(QueryContext& context,
+                                                                           const keyframe_t* query_keyframe,
+                                                                           const keyframe_t* keyframe,
+                                                                           float H[9],
+                                                                           matches_t& inliers) const {
+        const std::vector<FeaturePoint>& query_points = query_keyframe->store().points();
+        
+        TIMED("Find Matches (1)") {
+            if(mUseFeatureIndex) {
+                if(context.matcher.match(&query_keyframe->store(), &keyframe->store(), keyframe->index()) < mMinNumInliers) {
+                    return false;
+                }
+            } else {
+                if(context.matcher.match(&query_keyframe->store(), &keyframe->store()) < mMinNumInliers) {
+                    return false;
                 }
             }
-            
-            TIMED("Find Hough Matches (2)") {
-                FindHoughMatches(hough_matches,
-                                 mHoughSimilarityVoting,
-                                 mMatcher.matches(),
-                                 max_hough_index,
-                                 kHoughBinDelta);
+        }
+        
+        const std::vector<FeaturePoint>& ref_points = keyframe->store().points();
+        //std::cout<<"ref_points-"<<ref_points.size()<<std::endl;
+        //std::cout<<"query_points-"<<query_points.size()<<std::endl;
+        
+        //
+        // Vote for a transformation based on the correspondences
+        //
+        
+        int max_hough_index = -1;
+        TIMED("Hough Voting (1)") {
+            max_hough_index = FindHoughSimilarity(context.houghSimilarityVoting,
+                                                  query_points,
+                                                  ref_points,
+                                                  context.matcher.matches(),
+                                                  query_keyframe->width(),
+                                                  query_keyframe->height(),
+                                                  keyframe->width(),
+                                                  keyframe->height());
+            if(max_hough_index < 0) {
+                return false;
             }
-            
-            //
-            // Re-estimate the homography
-            //
-            
-            TIMED("Estimate Homography (2)") {
-                if(!EstimateHomography(H,
-                                       query_points,
-                                       ref_points,
-                                       hough_matches,
-                                       mRobustHomography,
-                                       it->second->width(),
-                                       it->second->height())) {
-                    continue;
-                }
+        }
+        
+        matches_t hough_matches;
+        TIMED("Find Hough Matches (1)") {
+            FindHoughMatches(hough_matches,
+                             context.houghSimilarityVoting,
+                             context.matcher.matches(),
+                             max_hough_index,
+                             kHoughBinDelta);
+        }
+        
+        //
+        // Estimate the transformation between the two images
+        //
+        
+        TIMED("Estimate Homography (1)") {
+            if(!EstimateHomography(H,
+                                   query_points,
+                                   ref_points,
+                                   hough_matches,
+                                   context.robustHomography,
+                                   keyframe->width(),
+                                   keyframe->height())) {
+                return false;
             }
-            
-            //
-            // Check if this is the best match based on number of inliers
-            //
-            
-            inliers.clear();
-            TIMED("Find Inliers (2)") {
-                FindInliers(inliers, H, query_points, ref_points, hough_matches, mHomographyInlierThreshold);
+        }
+        
+        //
+        // Find the inliers
+        //
+        
+        inliers.clear();
+        TIMED("Find Inliers (1)") {
+            FindInliers(inliers, H, query_points, ref_points, hough_matches, mHomographyInlierThreshold);
+            if(inliers.size() < mMinNumInliers) {
+                return false;
             }
-            
-            //std::cout<<"inliers-"<<inliers.size()<<std::endl;
-            if(inliers.size() >= mMinNumInliers && inliers.size() > mMatchedInliers.size()) {
-                CopyVector9(mMatchedGeometry, H);
-                mMatchedInliers.swap(inliers);
-                mMatchedId = it->first;
+        }
+        
+        //
+        // Use the estimated homography to find more inliers
+        //
+        
+        TIMED("Find Matches (2)") {
+            if(context.matcher.match(&query_keyframe->store(),
+                                     &keyframe->store(),
+                                     H,
+                                     10) < mMinNumInliers) {
+                return false;
             }
         }
         
-        return mMatchedId >= 0;
+        //
+        // Vote for a similarity with new matches
+        //
+        
+        TIMED("Hough Voting (2)") {
+            max_hough_index = FindHoughSimilarity(context.houghSimilarityVoting,
+                                                  query_points,
+                                                  ref_points,
+                                                  context.matcher.matches(),
+                                                  query_keyframe->width(),
+                                                  query_keyframe->height(),
+                                                  keyframe->width(),
+                                                  keyframe->height());
+            if(max_hough_index < 0) {
+                return false;
+            }
+        }
+        
+        TIMED("Find Hough Matches (2)") {
+            FindHoughMatches(hough_matches,
+                             context.houghSimilarityVoting,
+                             context.matcher.matches(),
+                             max_hough_index,
+                             kHoughBinDelta);
+        }
+        
+        //
+        // Re-estimate the homography
+        //
+        
+        TIMED("Estimate Homography (2)") {
+            if(!EstimateHomography(H,
+                                   query_points,
+                                   ref_points,
+                                   hough_matches,
+                                   context.robustHomography,
+                                   keyframe->width(),
+                                   keyframe->height())) {
+                return false;
+            }
+        }
+        
+        //
+        // Find the inliers of the final homography
+        //
+        
+        inliers.clear();
+        TIMED("Find Inliers (2)") {
+            FindInliers(inliers, H, query_points, ref_points, hough_matches, mHomographyInlierThreshold);
+        }
+        
+        return inliers.size() >= mMinNumInliers;
     }
     
     template<typename FEATURE_EXTRACTOR, typename STORE, typename MATCHER>
@@ -341,6 +503,7 @@ namespace vision {
             return false;
         }
         mKeyframeMap.erase(it);
+        mGlobalIndex.reset();
         return true;
     }
     
@@ -37,8 +37,10 @@
 
 #include <framework/image.h>
 #include <framework/exception.h>
+#include <framework/worker_pool.h>
 #include <detectors/DoG_scale_invariant_detector.h>
 #include <matchers/keyframe.h>
+#include <matchers/global_keyframe_index.h>
 #include <matchers/feature_matcher-inline.h>
 #include <matchers/hough_similarity_voting.h>
 #include <homography_estimation/robust_homography.h>
@@ -49,6 +51,7 @@
 #include <vector>
 #include <memory>
 #include <unordered_map>
+#include <atomic>
 
 #include "feature_point.h"
 
@@ -71,6 +74,8 @@ namespace vision {
         typedef std::shared_ptr<keyframe_t> keyframe_ptr_t;
         typedef std::unordered_map<id_t, keyframe_ptr_t> keyframe_map_t;
         
+        typedef GlobalKeyframeIndex<96> global_index_t;
+        
         typedef BinomialPyramid32f pyramid_t;
         typedef DoGScaleInvariantDetector detector_t;
         
@@ -91,12 +96,25 @@ namespace vision {
          * Add a keyframe to the database.
          */
         void addKeyframe(keyframe_ptr_t keyframe , id_t id) throw(Exception);
+        
+        /**
+         * Add all the keyframes of OTHER, and its global index if it has one.
+         * Keyframes and index are shared rather than copied.
+         */
+        void shareKeyframes(const VisualDatabase& other) throw(Exception);
     
         /**
          * Query the visual database.
          */
         bool query(const Image& image) throw(Exception);
         
+        /**
+         * Query the visual database with a region of a larger image, whose top-left corner is at
+         * (X,Y) in the larger image. The query feature points and the matched geometry are given
+         * in the coordinates of the larger image.
+         */
+        bool query(const Image& image, int x, int y) throw(Exception);
+        
         /**
          * Query the visual database.
          */
@@ -120,6 +138,11 @@ namespace vision {
             }
         }
         
+        /**
+         * @return Map of all keyframes
+         */
+        const keyframe_map_t& keyframes() const { return mKeyframeMap; }
+        
         /**
          * @return Query store
          */
@@ -130,7 +153,7 @@ namespace vision {
         /**
          * @return Matcher
          */
-        const MATCHER& matcher() const { return mMatcher; }
+        const MATCHER& matcher() const { return mQueryContexts[0].matcher; }
         
         /**
          * @return Feature extractor
@@ -164,14 +187,116 @@ namespace vision {
         inline void setMinNumInliers(size_t n) { mMinNumInliers = n; }
         inline size_t minNumInliers() const { return mMinNumInliers; }
         
+        /**
+         * Set/Get number of threads used to find features and to match keyframes during a
+         * query. Values < 1 select one thread per online CPU. The default is 1.
+         */
+        void setThreadNum(int n);
+        inline int threadNum() const { return mWorkerPool.threadNum(); }
+        
+        /**
+         * Set/Get the number of keyframes fully matched per query when using the global index.
+         * With N > 0, the features of all keyframes are indexed together, and only the N
+         * keyframes that receive the most votes from the query are matched and verified.
+         * With N = 0 (the default), every keyframe is matched.
+         */
+        void setGlobalIndexCandidates(size_t n);
+        inline size_t globalIndexCandidates() const { return mGlobalIndexCandidates; }
+        
+        /**
+         * Build the global index now, rather than on the first query after the keyframes change.
+         */
+        void buildGlobalIndex();
+        
+        /**
+         * @return True if the global index is built, or was loaded, for the current keyframes
+         */
+        inline bool hasGlobalIndex() const { return mGlobalIndex.get() != NULL; }
+        
+        /**
+         * Append the global index to DATA, building it first if need be, so that it can be
+         * restored with LOADGLOBALINDEX. Nothing is appended if the keyframes have no features.
+         */
+        void saveGlobalIndex(std::vector<unsigned char>& data);
+        
+        /**
+         * Restore a global index saved with SAVEGLOBALINDEX for the same keyframes, in the same
+         * order, instead of building it.
+         * @return False if DATA is not a valid index for the current keyframes
+         */
+        bool loadGlobalIndex(const unsigned char* data, size_t size);
+        
+        /**
+         * Set/Get the keyframes matched by queries. With a non-empty list, only the listed
+         * keyframes are matched, and on a tie the first listed wins. With an empty list (the
+         * default), every keyframe is matched.
+         */
+        inline void setQueryIds(const std::vector<id_t>& ids) { mQueryIds = ids; }
+        inline const std::vector<id_t>& queryIds() const { return mQueryIds; }
+        
     private:
         
+        // Per-thread state for matching the query against a keyframe
+        struct QueryContext {
+            MATCHER matcher;
+            HoughSimilarityVoting houghSimilarityVoting;
+            RobustHomography<float> robustHomography;
+        };
+        
+        // Outcome of matching the query against one keyframe
+        struct KeyframeResult {
+            bool matched;
+            float H[9];
+            matches_t inliers;
+        };
+        
+        // Work shared between the threads of one query
+        struct QueryJob {
+            VisualDatabase* vdb;
+            const keyframe_t* queryKeyframe;
+            std::vector<const keyframe_t*> keyframes;
+            std::vector<KeyframeResult> results;
+            std::atomic<size_t> next;
+        };
+        
+        static void queryJob(void* arg, int index, int count);
+        
+        /**
+         * Match the query against one keyframe.
+         * @return True if the keyframe matched with at least the minimum number of inliers
+         */
+        bool matchKeyframe(QueryContext& context,
+                           const keyframe_t* query_keyframe,
+                           const keyframe_t* keyframe,
+                           float H[9],
+                           matches_t& inliers) const;
+        
         size_t mMinNumInliers;
         float mHomographyInlierThreshold;
         
         // Set to true if the feature index is enabled
         bool mUseFeatureIndex;
         
+        // Number of keyframes to verify after voting with the global index, or 0 to verify all
+        size_t mGlobalIndexCandidates;
+        
+        // Index over the features of all keyframes, and the keyframes in the order it refers to them
+        struct GlobalIndex {
+            global_index_t index;
+            std::vector<id_t> ids;
+            std::vector<keyframe_ptr_t> keyframes;
+        };
+        
+        // Built on demand, and dropped whenever the keyframes change
+        std::shared_ptr<const GlobalIndex> mGlobalIndex;
+        
+        // Scratch state for voting, and the keyframes voted for
+        typename global_index_t::QueryState mGlobalIndexQueryState;
+        std::vector<int> mGlobalIndexCandidateList;
+        
+        // Keyframes to match, in order, or empty to match all
+        std::vector<id_t> mQueryIds;
+        
         matches_t mMatchedInliers;
         id_t mMatchedId;
         float mMatchedGeometry[9];
@@ -190,14 +315,11 @@ namespace vision {
         // Feature Extractor (FREAK, etc).
         FEATURE_EXTRACTOR mFeatureExtractor;
         
-        // Feature matcher
-        MATCHER mMatcher;
-        
-        // Similarity voter
-        HoughSimilarityVoting mHoughSimilarityVoting;
+        // Feature matcher, similarity voter and robust homography estimation, one set per thread
+        std::vector<QueryContext> mQueryContexts;
         
-        // Robust homography estimation
-        RobustHomography<float> mRobustHomography;
+        // Threads for finding features and matching keyframes in parallel
+        WorkerPool mWorkerPool;
         
     }; // VisualDatabase
     
@@ -0,0 +1,364 @@
+//
+//  hamming.cpp
+//  artoolkitX
+//
+//  This file is part of artoolkitX.
+//
+//  artoolkitX is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  artoolkitX is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules, and to
+//  copy and distribute the resulting executable under terms of your choice,
+//  provided that you also meet, for each linked independent module, the terms and
+//  conditions of the license of that module. An independent module is a module
+//  which is neither derived from nor based on this library. If you modify this
+//  library, you may extend this exception to your version of the library, but you
+//  are not obligated to do so. If you do not wish to do so, delete this exception
+//  statement from your version.
+//
+//  Copyright 2018 Realmax, Inc.
+//
+
+#include "hamming.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#  define HAMMING_X86 1
+#  include <immintrin.h>
+#  if defined(_MSC_VER) && !defined(__clang__)
+#    include <intrin.h>
+#    define HAMMING_TARGET(t)
+#  else
+#    define HAMMING_TARGET(t) __attribute__((target(t)))
+#  endif
+#  if defined(__x86_64__) || defined(_M_X64)
+#    define HAMMING_HAVE_POPCNT 1
+#  endif
+#  define HAMMING_HAVE_AVX2 1
+#  if (defined(__clang__) && __clang_major__ >= 6) || (!defined(__clang__) && defined(__GNUC__) && __GNUC__ >= 8) || (defined(_MSC_VER) && _MSC_VER >= 1920)
+#    define HAMMING_HAVE_AVX512 1
+#  endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#  define HAMMING_HAVE_NEON 1
+#  include <arm_neon.h>
+#endif
+
+namespace vision {
+    
+    static inline const unsigned char* BatchFeature(const unsigned char* features, const int* indices, size_t k) {
+        return features + 96*(indices ? (size_t)indices[k] : k);
+    }
+    
+    static unsigned int HammingDistance768GenericFunc(const unsigned int a[24], const unsigned int b[24]) {
+        return HammingDistance768Generic(a, b);
+    }
+    
+    static void HammingDistance768BatchGeneric(const unsigned char query[96],
+                                               const unsigned char* features,
+                                               const int* indices,
+                                               size_t count,
+                                               unsigned int* distances) {
+        for(size_t k = 0; k < count; k++) {
+            distances[k] = HammingDistance768Generic((const unsigned int*)query,
+                                                     (const unsigned int*)BatchFeature(features, indices, k));
+        }
+    }
+    
+#if HAMMING_HAVE_POPCNT
+    HAMMING_TARGET("popcnt")
+    static inline unsigned int HammingDistance768PopcntInline(const unsigned char* a, const unsigned char* b) {
+        unsigned long long x, y;
+        long long d = 0;
+        for(int i = 0; i < 96; i += 8) {
+            memcpy(&x, a + i, 8);
+            memcpy(&y, b + i, 8);
+            d += _mm_popcnt_u64(x^y);
+        }
+        return (unsigned int)d;
+    }
+    
+    HAMMING_TARGET("popcnt")
+    static unsigned int HammingDistance768Popcnt(const unsigned int a[24], const unsigned int b[24]) {
+        return HammingDistance768PopcntInline((const unsigned char*)a, (const unsigned char*)b);
+    }
+    
+    HAMMING_TARGET("popcnt")
+    static void HammingDistance768BatchPopcnt(const unsigned char query[96],
+                                              const unsigned char* features,
+                                              const int* indices,
+                                              size_t count,
+                                              unsigned int* distances) {
+        for(size_t k = 0; k < count; k++) {
+            distances[k] = HammingDistance768PopcntInline(query, BatchFeature(features, indices, k));
+        }
+    }
+#endif // HAMMING_HAVE_POPCNT
+    
+#if HAMMING_HAVE_AVX2
+    // Per-byte bit counts of x, by looking up each nibble.
+    HAMMING_TARGET("avx2")
+    static inline __m256i PopcntBytesAVX2(__m256i x) {
+        const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                             0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i nibble = _mm256_set1_epi8(0x0f);
+        __m256i lo = _mm256_and_si256(x, nibble);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), nibble);
+        return _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo), _mm256_shuffle_epi8(lut, hi));
+    }
+    
+    HAMMING_TARGET("avx2")
+    static inline unsigned int HammingDistance768AVX2Inline(__m256i q0, __m256i q1, __m256i q2, const unsigned char* b) {
+        // At most 24 per byte, so the byte sums cannot overflow.
+        __m256i c = _mm256_add_epi8(_mm256_add_epi8(PopcntBytesAVX2(_mm256_xor_si256(q0, _mm256_loadu_si256((const __m256i*)b))),
+                                                    PopcntBytesAVX2(_mm256_xor_si256(q1, _mm256_loadu_si256((const __m256i*)(b + 32))))),
+                                    PopcntBytesAVX2(_mm256_xor_si256(q2, _mm256_loadu_si256((const __m256i*)(b + 64)))));
+        __m256i s = _mm256_sad_epu8(c, _mm256_setzero_si256());
+        __m128i t = _mm_add_epi64(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+        return (unsigned int)_mm_cvtsi128_si32(_mm_add_epi64(t, _mm_unpackhi_epi64(t, t)));
+    }
+    
+    HAMMING_TARGET("avx2")
+    static unsigned int HammingDistance768AVX2(const unsigned int a[24], const unsigned int b[24]) {
+        return HammingDistance768AVX2Inline(_mm256_loadu_si256((const __m256i*)a),
+                                            _mm256_loadu_si256((const __m256i*)(a + 8)),
+                                            _mm256_loadu_si256((const __m256i*)(a + 16)),
+                                            (const unsigned char*)b);
+    }
+    
+    HAMMING_TARGET("avx2")
+    static void HammingDistance768BatchAVX2(const unsigned char query[96],
+                                            const unsigned char* features,
+                                            const int* indices,
+                                            size_t count,
+                                            unsigned int* distances) {
+        const __m256i q0 = _mm256_loadu_si256((const __m256i*)query);
+        const __m256i q1 = _mm256_loadu_si256((const __m256i*)(query + 32));
+        const __m256i q2 = _mm256_loadu_si256((const __m256i*)(query + 64));
+        for(size_t k = 0; k < count; k++) {
+            distances[k] = HammingDistance768AVX2Inline(q0, q1, q2, BatchFeature(features, indices, k));
+        }
+    }
+#endif // HAMMING_HAVE_AVX2
+    
+#if HAMMING_HAVE_AVX512
+    // The last 32 bytes are read with a masked load, which never touches memory past the feature.
+    HAMMING_TARGET("avx512f,avx512vpopcntdq")
+    static inline unsigned int HammingDistance768AVX512Inline(__m512i q0, __m512i q1, const unsigned char* b) {
+        __m512i x0 = _mm512_xor_si512(q0, _mm512_loadu_si512((const void*)b));
+        __m512i x1 = _mm512_xor_si512(q1, _mm512_maskz_loadu_epi64(0x0f, (const void*)(b + 64)));
+        // Summed through memory: _mm512_reduce_add_epi64 is missing from some compilers, and GCC 12's
+        // _mm512_extracti64x4_epi64 trips -Wmaybe-uninitialized.
+        unsigned long long c[8];
+        _mm512_storeu_si512((void*)c, _mm512_add_epi64(_mm512_popcnt_epi64(x0), _mm512_popcnt_epi64(x1)));
+        return (unsigned int)(c[0] + c[1] + c[2] + c[3] + c[4] + c[5] + c[6] + c[7]);
+    }
+    
+    HAMMING_TARGET("avx512f,avx512vpopcntdq")
+    static unsigned int HammingDistance768AVX512(const unsigned int a[24], const unsigned int b[24]) {
+        return HammingDistance768AVX512Inline(_mm512_loadu_si512((const void*)a),
+                                              _mm512_maskz_loadu_epi64(0x0f, (const void*)(a + 16)),
+                                              (const unsigned char*)b);
+    }
+    
+    HAMMING_TARGET("avx512f,avx512vpopcntdq")
+    static void HammingDistance768BatchAVX512(const unsigned char query[96],
+                                              const unsigned char* features,
+                                              const int* indices,
+                                              size_t count,
+                                              unsigned int* distances) {
+        const __m512i q0 = _mm512_loadu_si512((const void*)query);
+        const __m512i q1 = _mm512_maskz_loadu_epi64(0x0f, (const void*)(query + 64));
+        for(size_t k = 0; k < count; k++) {
+            distances[k] = HammingDistance768AVX512Inline(q0, q1, BatchFeature(features, indices, k));
+        }
+    }
+#endif // HAMMING_HAVE_AVX512
+    
+#if HAMMING_HAVE_NEON
+    static inline unsigned int HammingDistance768NEONInline(const unsigned char* a, const unsigned char* b) {
+        // At most 48 per byte, so the byte sums cannot overflow.
+        uint8x16_t c = vcntq_u8(veorq_u8(vld1q_u8(a), vld1q_u8(b)));
+        for(int i = 16; i < 96; i += 16) {
+            c = vaddq_u8(c, vcntq_u8(veorq_u8(vld1q_u8(a + i), vld1q_u8(b + i))));
+        }
+        uint64x2_t s = vpaddlq_u32(vpaddlq_u16(vpaddlq_u8(c)));
+        return (unsigned int)(vgetq_lane_u64(s, 0) + vgetq_lane_u64(s, 1));
+    }
+    
+    static unsigned int HammingDistance768NEON(const unsigned int a[24], const unsigned int b[24]) {
+        return HammingDistance768NEONInline((const unsigned char*)a, (const unsigned char*)b);
+    }
+    
+    static void HammingDistance768BatchNEON(const unsigned char query[96],
+                                            const unsigned char* features,
+                                            const int* indices,
+                                            size_t count,
+                                            unsigned int* distances) {
+        for(size_t k = 0; k < count; k++) {
+            distances[k] = HammingDistance768NEONInline(query, BatchFeature(features, indices, k));
+        }
+    }
+#endif // HAMMING_HAVE_NEON
+    
+    struct HammingKernelEntry {
+        const char* name;
+        HammingDistance768Func distance;
+        HammingDistance768BatchFunc distanceBatch;
+    };
+    
+    static const HammingKernelEntry gHammingKernels[HAMMING_KERNEL_COUNT] = {
+        {"generic", HammingDistance768GenericFunc, HammingDistance768BatchGeneric},
+#if HAMMING_HAVE_POPCNT
+        {"popcnt", HammingDistance768Popcnt, HammingDistance768BatchPopcnt},
+#else
+        {"popcnt", NULL, NULL},
+#endif
+#if HAMMING_HAVE_AVX2
+        {"avx2", HammingDistance768AVX2, HammingDistance768BatchAVX2},
+#else
+        {"avx2", NULL, NULL},
+#endif
+#if HAMMING_HAVE_AVX512
+        {"avx512", HammingDistance768AVX512, HammingDistance768BatchAVX512},
+#else
+        {"avx512", NULL, NULL},
+#endif
+#if HAMMING_HAVE_NEON
+        {"neon", HammingDistance768NEON, HammingDistance768BatchNEON},
+#else
+        {"neon", NULL, NULL},
+#endif
+    };
+    
+    static bool HammingCPUSupports(HammingKernel kernel) {
+        switch(kernel) {
+            case HAMMING_KERNEL_GENERIC:
+            case HAMMING_KERNEL_NEON:
+                return true;
+#if HAMMING_X86
+#  if defined(_MSC_VER) && !defined(__clang__)
+            default: {
+                int r[4];
+                __cpuid(r, 0);
+                int maxLeaf = r[0];
+                __cpuid(r, 1);
+                bool popcnt = (r[2] & (1 << 23)) != 0;
+                unsigned long long xcr0 = (r[2] & (1 << 27)) ? _xgetbv(0) : 0; // OSXSAVE.
+                if(kernel == HAMMING_KERNEL_POPCNT) return popcnt;
+                if(maxLeaf < 7) return false;
+                __cpuidex(r, 7, 0);
+                if(kernel == HAMMING_KERNEL_AVX2) return (r[1] & (1 << 5)) && (xcr0 & 0x06) == 0x06;
+                return (r[1] & (1 << 16)) && (r[2] & (1 << 14)) && (xcr0 & 0xe6) == 0xe6; // AVX512F, AVX512_VPOPCNTDQ.
+            }
+#  else
+            case HAMMING_KERNEL_POPCNT:
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("popcnt");
+            case HAMMING_KERNEL_AVX2:
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("avx2");
+            case HAMMING_KERNEL_AVX512:
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq");
+#  endif
+#endif
+            default:
+                return false;
+        }
+    }
+    
+    bool HammingKernelSupported(HammingKernel kernel) {
+        if(kernel < 0 || kernel >= HAMMING_KERNEL_COUNT || !gHammingKernels[kernel].distance) {
+            return false;
+        }
+        return HammingCPUSupports(kernel);
+    }
+    
+    const char* HammingKernelName(HammingKernel kernel) {
+        if(kernel < 0 || kernel >= HAMMING_KERNEL_COUNT) {
+            return "unknown";
+        }
+        return gHammingKernels[kernel].name;
+    }
+    
+    static unsigned int HammingDistance768Resolve(const unsigned int a[24], const unsigned int b[24]);
+    static void HammingDistance768BatchResolve(const unsigned char query[96],
+                                               const unsigned char* features,
+                                               const int* indices,
+                                               size_t count,
+                                               unsigned int* distances);
+    
+    HammingDistance768Func gHammingDistance768 = HammingDistance768Resolve;
+    static HammingDistance768BatchFunc gHammingDistance768Batch = HammingDistance768BatchResolve;
+    static HammingKernel gHammingKernel = HAMMING_KERNEL_GENERIC;
+    
+    bool HammingSetKernel(HammingKernel kernel) {
+        if(!HammingKernelSupported(kernel)) {
+            return false;
+        }
+        gHammingKernel = kernel;
+        gHammingDistance768 = gHammingKernels[kernel].distance;
+        gHammingDistance768Batch = gHammingKernels[kernel].distanceBatch;
+        return true;
+    }
+    
+    static bool HammingSelectKernel() {
+        static const HammingKernel preferred[] = {
+            HAMMING_KERNEL_AVX512,
+            HAMMING_KERNEL_AVX2,
+            HAMMING_KERNEL_POPCNT,
+            HAMMING_KERNEL_NEON,
+            HAMMING_KERNEL_GENERIC
+        };
+        for(size_t i = 0; i < sizeof(preferred)/sizeof(preferred[0]); i++) {
+            if(HammingSetKernel(preferred[i])) return true;
+        }
+        return false;
+    }
+    
+    // Resolve during static initialisation, before any matching thread can start. The resolvers
+    // only cover calls made from other static initialisers.
+    static const bool gHammingKernelSelected = HammingSelectKernel();
+    
+    static unsigned int HammingDistance768Resolve(const unsigned int a[24], const unsigned int b[24]) {
+        HammingSelectKernel();
+        return gHammingDistance768(a, b);
+    }
+    
+    static void HammingDistance768BatchResolve(const unsigned char query[96],
+                                               const unsigned char* features,
+                                               const int* indices,
+                                               size_t count,
+                                               unsigned int* distances) {
+        HammingSelectKernel();
+        gHammingDistance768Batch(query, features, indices, count, distances);
+    }
+    
+    HammingKernel HammingGetKernel() {
+        if(gHammingDistance768 == HammingDistance768Resolve) {
+            HammingSelectKernel();
+        }
+        return gHammingKernel;
+    }
+    
+    void HammingDistance768Batch(const unsigned char query[96],
+                                 const unsigned char* features,
+                                 const int* indices,
+                                 size_t count,
+                                 unsigned int* distances) {
+        gHammingDistance768Batch(query, features, indices, count, distances);
+    }
+    
+} // vision
@@ -35,6 +35,9 @@
 
 #pragma once
 
+#include <cstddef>
+#include <limits>
+
 namespace vision {
     
     /**
@@ -57,9 +60,9 @@ namespace vision {
     }
     
     /**
-     * Hamming distance for 768 bits (96 bytes)
+     * Hamming distance for 768 bits (96 bytes), portable version.
      */
-    inline unsigned int HammingDistance768(const unsigned int a[24], const unsigned int b[24]) {
+    inline unsigned int HammingDistance768Generic(const unsigned int a[24], const unsigned int b[24]) {
         return  HammingDistance32(a[0],  b[0]) +
                 HammingDistance32(a[1],  b[1]) +
                 HammingDistance32(a[2],  b[2]) +
@@ -86,6 +89,71 @@ namespace vision {
                 HammingDistance32(a[23], b[23]);
     }
     
+    /**
+     * Implementations of the 768 bit Hamming distance. The fastest one supported by the
+     * CPU is selected at runtime, on first use.
+     */
+    enum HammingKernel {
+        HAMMING_KERNEL_GENERIC = 0, // Portable 32 bit SWAR.
+        HAMMING_KERNEL_POPCNT,      // x86-64 POPCNT instruction.
+        HAMMING_KERNEL_AVX2,        // AVX2 nibble lookup table.
+        HAMMING_KERNEL_AVX512,      // AVX-512 VPOPCNTQ.
+        HAMMING_KERNEL_NEON,        // ARM NEON VCNT.
+        HAMMING_KERNEL_COUNT
+    };
+    
+    typedef unsigned int (*HammingDistance768Func)(const unsigned int a[24], const unsigned int b[24]);
+    typedef void (*HammingDistance768BatchFunc)(const unsigned char query[96],
+                                                const unsigned char* features,
+                                                const int* indices,
+                                                size_t count,
+                                                unsigned int* distances);
+    
+    /**
+     * Selected single-pair kernel. Starts out pointing at a resolver which replaces it.
+     */
+    extern HammingDistance768Func gHammingDistance768;
+    
+    /**
+     * Hamming distance for 768 bits (96 bytes).
+     */
+    inline unsigned int HammingDistance768(const unsigned int a[24], const unsigned int b[24]) {
+        return gHammingDistance768(a, b);
+    }
+    
+    /**
+     * Hamming distance from one 96 byte query to many 96 byte features.
+     *
+     * distances[k] is set to the distance from query to the feature starting at
+     * features + 96*indices[k], or at features + 96*k if indices is NULL.
+     */
+    void HammingDistance768Batch(const unsigned char query[96],
+                                 const unsigned char* features,
+                                 const int* indices,
+                                 size_t count,
+                                 unsigned int* distances);
+    
+    /**
+     * Selected kernel.
+     */
+    HammingKernel HammingGetKernel();
+    
+    /**
+     * Human readable name of a kernel.
+     */
+    const char* HammingKernelName(HammingKernel kernel);
+    
+    /**
+     * Whether the CPU and the build support a kernel.
+     */
+    bool HammingKernelSupported(HammingKernel kernel);
+    
+    /**
+     * Force a kernel, e.g. for benchmarking. Returns false, leaving the selection
+     * unchanged, if the kernel is not supported. Not safe to call while matching.
+     */
+    bool HammingSetKernel(HammingKernel kernel);
+    
     template<int NUM_BYTES>
     inline unsigned int HammingDistance(const unsigned char a[NUM_BYTES], const unsigned char b[NUM_BYTES]) {
         switch(NUM_BYTES) {
@@ -0,0 +1,141 @@
+//
+//  hamming_bench.cpp
+//  artoolkitX
+//
+//  This file is part of artoolkitX.
+//
+//  artoolkitX is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  artoolkitX is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules, and to
+//  copy and distribute the resulting executable under terms of your choice,
+//  provided that you also meet, for each linked independent module, the terms and
+//  conditions of the license of that module. An independent module is a module
+//  which is neither derived from nor based on this library. If you modify this
+//  library, you may extend this exception to your version of the library, but you
+//  are not obligated to do so. If you do not wish to do so, delete this exception
+//  statement from your version.
+//
+//  Copyright 2018 Realmax, Inc.
+
+// Times each Hamming kernel the CPU supports, one pair at a time and batched, and
+// BinaryFeatureMatcher with each kernel. Not run by ctest; run it by hand on a quiet
+// machine with a Release build.
+
+#include <math/hamming.h>
+#include <matchers/feature_matcher-inline.h>
+#include <matchers/binary_hierarchical_clustering.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+using namespace vision;
+
+static const int kFeatureCount = 4096;
+static const int kQueryCount = 256;
+static const int kRepeats = 10;
+
+static double secondsSince(const std::chrono::steady_clock::time_point& t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(void) {
+    std::vector<unsigned char> features(96*kFeatureCount), queries(96*kQueryCount);
+    std::vector<int> indices(kFeatureCount);
+    std::vector<unsigned int> distances(kFeatureCount);
+    const double comparisons = (double)kRepeats*kQueryCount*kFeatureCount;
+    unsigned int sum = 0;
+    
+    srand(1);
+    for(size_t i = 0; i < features.size(); i++) features[i] = (unsigned char)(rand() & 0xff);
+    for(size_t i = 0; i < queries.size(); i++) queries[i] = (unsigned char)(rand() & 0xff);
+    for(int i = 0; i < kFeatureCount; i++) indices[i] = (int)((i*2654435761u) % kFeatureCount);
+    
+    printf("Descriptor comparisons per second, default kernel %s:\n", HammingKernelName(HammingGetKernel()));
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    for(int r = 0; r < kRepeats; r++) {
+        for(int q = 0; q < kQueryCount; q++) {
+            for(int i = 0; i < kFeatureCount; i++) {
+                sum += HammingDistance768Generic((const unsigned int*)&queries[96*q], (const unsigned int*)&features[96*indices[i]]);
+            }
+        }
+    }
+    printf("  inline SWAR  pair %6.0f M\n", comparisons/secondsSince(t0)/1e6);
+    
+    for(int kernel = 0; kernel < HAMMING_KERNEL_COUNT; kernel++) {
+        if(!HammingSetKernel((HammingKernel)kernel)) continue;
+        t0 = std::chrono::steady_clock::now();
+        for(int r = 0; r < kRepeats; r++) {
+            for(int q = 0; q < kQueryCount; q++) {
+                for(int i = 0; i < kFeatureCount; i++) {
+                    sum += HammingDistance768((const unsigned int*)&queries[96*q], (const unsigned int*)&features[96*indices[i]]);
+                }
+            }
+        }
+        const double pairSeconds = secondsSince(t0);
+        t0 = std::chrono::steady_clock::now();
+        for(int r = 0; r < kRepeats; r++) {
+            for(int q = 0; q < kQueryCount; q++) {
+                HammingDistance768Batch(&queries[96*q], &features[0], &indices[0], kFeatureCount, &distances[0]);
+                sum += distances[q];
+            }
+        }
+        const double batchSeconds = secondsSince(t0);
+        printf("  %-12s pair %6.0f M  batch %6.0f M\n", HammingKernelName((HammingKernel)kernel), comparisons/pairSeconds/1e6, comparisons/batchSeconds/1e6);
+    }
+    
+    // Matching, 500 query features against 3000 reference features.
+    BinaryFeatureStore query, reference;
+    query.setNumBytesPerFeature(96);
+    reference.setNumBytesPerFeature(96);
+    query.resize(500);
+    reference.resize(3000);
+    for(size_t i = 0; i < reference.features().size(); i++) reference.features()[i] = (unsigned char)(rand() & 0xff);
+    for(size_t i = 0; i < reference.size(); i++) reference.point(i).maxima = rand() & 1;
+    // Each query is a reference feature with about 5% of its bits flipped, so that most have a match.
+    for(size_t i = 0; i < query.size(); i++) {
+        const size_t j = i*6;
+        for(int b = 0; b < 96; b++) {
+            unsigned char flip = 0;
+            for(int bit = 0; bit < 8; bit++) if(rand()%20 == 0) flip |= (unsigned char)(1 << bit);
+            query.feature(i)[b] = reference.feature(j)[b] ^ flip;
+        }
+        query.point(i).maxima = reference.point(j).maxima;
+    }
+    BinaryHierarchicalClustering<96> index;
+    index.setNumHypotheses(128);
+    index.setNumCenters(8);
+    index.setMaxNodesToPop(8);
+    index.setMinFeaturesPerNode(16);
+    index.build(&reference.features()[0], (int)reference.size());
+    
+    printf("BinaryFeatureMatcher, %d query and %d reference features:\n", (int)query.size(), (int)reference.size());
+    for(int kernel = 0; kernel < HAMMING_KERNEL_COUNT; kernel++) {
+        if(!HammingSetKernel((HammingKernel)kernel)) continue;
+        BinaryFeatureMatcher<96> matcher;
+        size_t bruteMatches = 0, indexedMatches = 0;
+        t0 = std::chrono::steady_clock::now();
+        for(int r = 0; r < 5; r++) bruteMatches = matcher.match(&query, &reference);
+        const double bruteSeconds = secondsSince(t0)/5;
+        t0 = std::chrono::steady_clock::now();
+        for(int r = 0; r < 20; r++) indexedMatches = matcher.match(&query, &reference, index);
+        const double indexedSeconds = secondsSince(t0)/20;
+        printf("  %-12s brute-force %6.2f ms (%d matches)  indexed %6.2f ms (%d matches)\n", HammingKernelName((HammingKernel)kernel),
+               bruteSeconds*1e3, (int)bruteMatches, indexedSeconds*1e3, (int)indexedMatches);
+    }
+    
+    return (sum == 0xffffffff ? 1 : 0); // Keeps the sums from being optimised away.
+}
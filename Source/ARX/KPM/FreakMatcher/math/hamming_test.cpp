@@ -0,0 +1,88 @@
+//
+//  hamming_test.cpp
+//  artoolkitX
+//
+//  This file is part of artoolkitX.
+//
+//  artoolkitX is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU Lesser General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  artoolkitX is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU Lesser General Public License for more details.
+//
+//  You should have received a copy of the GNU Lesser General Public License
+//  along with artoolkitX.  If not, see <http://www.gnu.org/licenses/>.
+//
+//  As a special exception, the copyright holders of this library give you
+//  permission to link this library with independent modules to produce an
+//  executable, regardless of the license terms of these independent modules, and to
+//  copy and distribute the resulting executable under terms of your choice,
+//  provided that you also meet, for each linked independent module, the terms and
+//  conditions of the license of that module. An independent module is a module
+//  which is neither derived from nor based on this library. If you modify this
+//  library, you may extend this exception to your version of the library, but you
+//  are not obligated to do so. If you do not wish to do so, delete this exception
+//  statement from your version.
+//
+//  Copyright 2018 Realmax, Inc.
+//
+
+// Checks every Hamming kernel the CPU supports against the portable one, over random descriptors.
+
+#include <math/hamming.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace vision;
+
+static const int kFeatureCount = 1000;
+
+int main(void) {
+    std::vector<unsigned char> features(96*kFeatureCount);
+    std::vector<int> indices(kFeatureCount);
+    std::vector<unsigned int> expected(kFeatureCount), expectedIndexed(kFeatureCount), distances(kFeatureCount);
+    unsigned int query[24];
+    int failures = 0;
+    
+    srand(1);
+    for(size_t i = 0; i < features.size(); i++) features[i] = (unsigned char)(rand() & 0xff);
+    // Include the extremes: identical to the query, and its complement.
+    memcpy(query, &features[96*1], 96);
+    for(int i = 0; i < 96; i++) features[96*2 + i] = (unsigned char)~features[96*1 + i];
+    for(int k = 0; k < kFeatureCount; k++) indices[k] = rand() % kFeatureCount;
+    
+    for(int k = 0; k < kFeatureCount; k++) {
+        expected[k] = HammingDistance768Generic(query, (const unsigned int*)&features[96*k]);
+    }
+    for(int k = 0; k < kFeatureCount; k++) expectedIndexed[k] = expected[indices[k]];
+    if(expected[1] != 0 || expected[2] != 768) {
+        printf("generic: wrong distance for the identical or complementary feature\n");
+        return 1;
+    }
+    
+    for(int kernel = 0; kernel < HAMMING_KERNEL_COUNT; kernel++) {
+        const char* name = HammingKernelName((HammingKernel)kernel);
+        if(!HammingSetKernel((HammingKernel)kernel)) {
+            printf("%s: not supported, skipped\n", name);
+            continue;
+        }
+        int bad = 0;
+        for(int k = 0; k < kFeatureCount; k++) {
+            if(HammingDistance768(query, (const unsigned int*)&features[96*k]) != expected[k]) bad++;
+        }
+        HammingDistance768Batch((const unsigned char*)query, &features[0], NULL, kFeatureCount, &distances[0]);
+        for(int k = 0; k < kFeatureCount; k++) if(distances[k] != expected[k]) bad++;
+        HammingDistance768Batch((const unsigned char*)query, &features[0], &indices[0], kFeatureCount, &distances[0]);
+        for(int k = 0; k < kFeatureCount; k++) if(distances[k] != expectedIndexed[k]) bad++;
+        printf("%s: %d mismatches\n", name, bad);
+        failures += bad;
+    }
+    
+    return (failures ? 1 : 0);
+}
@@ -89,6 +89,14 @@ typedef enum {
 
 #define   KpmChangePageNoAllPages (-1)
 
+#define   KpmMatchingThreadNumDefault  1     // Reference pages are matched serially.
+#define   KpmMatchingThreadNumAuto   (-1)    // One matching thread per online CPU.
+
+#define   KpmGlobalIndexCandidatesDefault  0 // Every reference image is matched.
+
+#define   KpmRefDataSetVersion         2     // Version of the dataset format written by kpmSaveRefDataSetV2.
+#define   KpmRefDataSetAlignment      64     // Alignment in bytes of each section of a saved dataset.
+
 typedef struct {
     float             x;
     float             y;
@@ -127,12 +135,18 @@ typedef struct _KpmRefData {
 	@field		num Number of refPoints in the dataset.
 	@field		pageInfo Array of info about each page in the dataset. One entry per page.
 	@field		pageNum Number of pages in the dataset (i.e. a count, not an index).
+	@field		fileMap If non-NULL, refPoint points into this memory-mapped dataset file
+        rather than into an allocated array. Managed by kpmLoadRefDataSet and kpmDeleteRefDataSet.
+	@field		indexSet If non-NULL, prebuilt search indices for the reference images, as loaded
+        from the dataset file. Used by kpmSetRefDataSet in place of building the indices.
  */
 typedef struct {
     KpmRefData       *refPoint;
     int               num;
     KpmPageInfo      *pageInfo;
     int               pageNum;
+    void             *fileMap;
+    void             *indexSet;
 } KpmRefDataSet;
 
 /*!
@@ -230,6 +244,47 @@ KPM_EXTERN int         kpmSetDetectedFeatureMax( KpmHandle *kpmHandle, int  dete
 KPM_EXTERN int         kpmGetDetectedFeatureMax( KpmHandle *kpmHandle, int *detectedMaxFeature );
 KPM_EXTERN int         kpmSetSurfThreadNum( KpmHandle *kpmHandle, int surfThreadNum );
 
+/*!
+    @brief Set the number of threads used to match a frame against the reference pages.
+    @details
+        kpmMatching compares the features of each frame against every page (and every
+        image of each page) in the reference data set. With more than one thread, the
+        pages are matched in parallel, so that matching time grows with the number of
+        pages divided by the number of threads. The same threads also detect the features
+        of the frame and extract their descriptors. The result does not depend on the
+        number of threads.
+    @param kpmHandle Handle to the current KPM tracker instance, as generated by kpmCreateHandle or kpmCreateHandleHomography.
+    @param matchingThreadNum Number of threads, including the calling thread, or
+        KpmMatchingThreadNumAuto to use one thread per online CPU. The default is
+        KpmMatchingThreadNumDefault.
+    @result 0 if successful, or value &lt;0 in case of error.
+    @see kpmGetMatchingThreadNum kpmGetMatchingThreadNum
+ */
+KPM_EXTERN int         kpmSetMatchingThreadNum( KpmHandle *kpmHandle, int matchingThreadNum );
+KPM_EXTERN int         kpmGetMatchingThreadNum( KpmHandle *kpmHandle, int *matchingThreadNum );
+
+/*!
+    @brief Set the number of reference images fully matched against each input image.
+    @details
+        With a non-zero value, the features of all reference images are indexed together, and
+        each input image first votes for the reference images holding the nearest neighbours
+        of its features. Only the globalIndexCandidates reference images with the most votes
+        are then matched and verified individually, so that matching time grows much more
+        slowly with the number of pages loaded. With a value of 0, every reference image is
+        matched, as in earlier versions.
+ 
+        The global index is built when the reference data set is loaded, or immediately if
+        the reference data set is already loaded, unless the dataset file holds one for the
+        same reference images (see kpmSaveRefDataSet), in which case that is used instead.
+    @param kpmHandle Handle to the current KPM tracker instance, as generated by kpmCreateHandle or kpmCreateHandleHomography.
+    @param globalIndexCandidates Number of reference images to verify per input image, or 0
+        to verify all of them. The default is KpmGlobalIndexCandidatesDefault.
+    @result 0 if successful, or value &lt;0 in case of error.
+    @see kpmGetGlobalIndexCandidates kpmGetGlobalIndexCandidates
+ */
+KPM_EXTERN int         kpmSetGlobalIndexCandidates( KpmHandle *kpmHandle, int globalIndexCandidates );
+KPM_EXTERN int         kpmGetGlobalIndexCandidates( KpmHandle *kpmHandle, int *globalIndexCandidates );
+
 /*!
     @brief Load a reference data set into the key point matcher for tracking.
     @details
@@ -247,12 +302,49 @@ KPM_EXTERN int         kpmSetSurfThreadNum( KpmHandle *kpmHandle, int surfThread
  */
 KPM_EXTERN int         kpmSetRefDataSet( KpmHandle *kpmHandle, KpmRefDataSet *refDataSet );
 
+/*!
+    @brief Load a reference data set into the key point matcher for tracking, without copying it.
+    @details
+        As kpmSetRefDataSet, but the KPM handle takes over the dataset rather than copying it,
+        so a memory-mapped dataset as loaded by kpmLoadRefDataSet stays mapped and is used in
+        place. Handles created from kpmHandle by kpmCreateHandleShared also reference it, and
+        it is disposed of when the last of these handles is deleted.
+    @param kpmHandle Handle to the current KPM tracker instance, as generated by kpmCreateHandle or kpmCreateHandleHomography.
+    @param refDataSetPtr Pointer to a location which points to the reference data set to load.
+        On success, this location will be set to NULL, and the dataset must not be used further
+        by the caller. On failure, the dataset remains the caller's.
+    @result 0 if successful, or value &lt;0 in case of error.
+    @see kpmSetRefDataSet kpmSetRefDataSet
+    @see kpmCreateHandleShared kpmCreateHandleShared
+ */
+KPM_EXTERN int         kpmSetRefDataSetOwned( KpmHandle *kpmHandle, KpmRefDataSet **refDataSetPtr );
+
+/*!
+    @brief Create a new KPM handle that matches against the same reference data as an existing one.
+    @details
+        The new handle has the same camera parameters (or homography size), processing mode
+        and maximum detected feature count as kpmHandle, and its reference data set loaded.
+        The reference data set is referenced rather than copied, and the keyframes and search
+        indices are shared with kpmHandle rather than rebuilt, so creation is cheap, while all
+        per-query state is private to the new handle.
+        This allows kpmMatching to be run on kpmHandle and on handles created from it on
+        different threads at the same time.
+    @param kpmHandle Handle to an existing KPM tracker instance, with its reference data set
+        already loaded by kpmSetRefDataSet or kpmSetRefDataSetOwned. It must outlive the new
+        handle, and its reference data set must not be changed while the new handle exists.
+    @result The new handle, which should be disposed of via kpmDeleteHandle() when no longer
+        needed, or NULL in case of error.
+    @see kpmSetRefDataSet kpmSetRefDataSet
+    @see kpmDeleteHandle kpmDeleteHandle
+ */
+KPM_EXTERN KpmHandle  *kpmCreateHandleShared( KpmHandle *kpmHandle );
+
 /*!
     @brief
         Loads a reference data set from a file into the KPM tracker.
     @details
-        This is a convenience method which performs a sequence of kpmLoadRefDataSet, followed
-        by kpmSetRefDataSet and finally kpmDeleteRefDataSet. When tracking from a single
+        This is a convenience method which performs kpmLoadRefDataSet, followed by
+        kpmSetRefDataSetOwned. When tracking from a single
         reference dataset file, this is the simplest means to start.
     @param kpmHandle Handle to the current KPM tracker instance, as generated by kpmCreateHandle or kpmCreateHandleHomography.
     @param filename Path to the dataset. Either full path, or a relative path if supported by
@@ -281,6 +373,48 @@ KPM_EXTERN int         kpmSetRefDataSetFileOld( KpmHandle *kpmHandle, const char
 KPM_EXTERN int         kpmMatching(KpmHandle *kpmHandle, ARUint8 *inImageLuma);
 
 KPM_EXTERN int         kpmSetMatchingSkipPage( KpmHandle *kpmHandle, int *skipPages, int num );
+
+/*!
+    @brief Restrict the next key-point matching to some pages.
+    @details
+        The next call to kpmMatching only matches the image against the listed pages, which
+        is faster than matching against all of them when a page is expected to reappear, e.g.
+        shortly after tracking of it was lost. If more than one of the listed pages matches
+        equally well, the one listed first is taken. Like kpmSetMatchingSkipPage, this
+        applies to the next call to kpmMatching only.
+    @param kpmHandle Handle to the current KPM tracker instance, with its reference data set loaded.
+    @param pages Page numbers, most likely first.
+    @param num Number of page numbers in pages.
+    @result 0 if successful, or value &lt;0 in case of error, e.g. if a page is not in the
+        reference data set.
+    @see kpmSetMatchingSkipPage kpmSetMatchingSkipPage
+    @see kpmMatching kpmMatching
+ */
+KPM_EXTERN int         kpmSetMatchingPages( KpmHandle *kpmHandle, int *pages, int num );
+
+#if BINARY_FEATURE
+/*!
+    @brief Restrict the next key-point matching to a region of the image.
+    @details
+        The next call to kpmMatching only looks for features inside the given rectangle of
+        the image, which is faster than searching the whole image when the position of a page
+        can be predicted, e.g. from its pose when tracking of it was lost. Poses are still
+        relative to the whole image. The region is scaled to the processing mode, clipped to
+        the image, and may be grown a little so that it is not too small to match in and so
+        that similar regions share the same size. Like kpmSetMatchingSkipPage, this applies to
+        the next call to kpmMatching only.
+    @param kpmHandle Handle to the current KPM tracker instance.
+    @param x Left edge of the region, in pixels.
+    @param y Top edge of the region, in pixels.
+    @param width Width of the region, in pixels.
+    @param height Height of the region, in pixels.
+    @result 0 if successful, or value &lt;0 in case of error, e.g. if the region lies outside
+        the image. In case of error, the whole image is searched.
+    @see kpmSetProcMode kpmSetProcMode
+    @see kpmMatching kpmMatching
+ */
+KPM_EXTERN int         kpmSetMatchingRegion( KpmHandle *kpmHandle, int x, int y, int width, int height );
+#endif
 #if !BINARY_FEATURE
 KPM_EXTERN int         kpmSetMatchingSkipRegion( KpmHandle *kpmHandle, SurfSubRect *skipRegion, int regionNum);
 #endif
@@ -328,14 +462,41 @@ KPM_EXTERN int         kpmMergeRefDataSet  ( KpmRefDataSet **refDataSetPtr1, Kpm
 KPM_EXTERN int         kpmDeleteRefDataSet ( KpmRefDataSet **refDataSetPtr );
 
 /*!
-    @brief 
-    @param filename
-    @param ext
-    @param refDataSet
-    @result 
+    @brief Save a reference data set to the filesystem.
+    @details
+        The dataset is written in the version 1 format, which all versions of this library
+        can read. kpmSaveRefDataSetV2 writes datasets that are much faster to load, but only
+        with this or later versions of the library.
+    @param filename Path to the dataset.
+    @param ext If non-NULL, a '.' charater and this string will be appended to 'filename'.
+    @param refDataSet The reference data set to save.
+    @result 0 if the save succeeded, or a value &lt; 0 in case of error.
+    @see kpmLoadRefDataSet kpmLoadRefDataSet
+    @see kpmSaveRefDataSetV2 kpmSaveRefDataSetV2
  */
 KPM_EXTERN int         kpmSaveRefDataSet   ( const char *filename, const char *ext, KpmRefDataSet  *refDataSet );
 
+/*!
+    @brief Save a reference data set to the filesystem in the version 2 format.
+    @details
+        The dataset is written with a versioned header (KpmRefDataSetVersion) followed by the
+        reference points, page and image info, the search index for each reference image and
+        the global index over all of them (see kpmSetGlobalIndexCandidates), each section
+        aligned to KpmRefDataSetAlignment bytes so that kpmLoadRefDataSet can use the file
+        contents in place and kpmSetRefDataSet need not rebuild the indices. Indices not
+        already held by refDataSet are built here, which may take some seconds. The format is
+        specific to the byte order and feature type of the platform that wrote it, and
+        versions of this library earlier than the one adding this function cannot read it.
+        NFT bundles (see ar2WriteBundle) require KPM data in this format.
+    @param filename Path to the dataset.
+    @param ext If non-NULL, a '.' charater and this string will be appended to 'filename'.
+    @param refDataSet The reference data set to save.
+    @result 0 if the save succeeded, or a value &lt; 0 in case of error.
+    @see kpmLoadRefDataSet kpmLoadRefDataSet
+    @see kpmSaveRefDataSet kpmSaveRefDataSet
+ */
+KPM_EXTERN int         kpmSaveRefDataSetV2 ( const char *filename, const char *ext, KpmRefDataSet  *refDataSet );
+
 /*!
     @brief Load a reference data set from the filesystem into memory.
     @details
@@ -343,11 +504,15 @@ KPM_EXTERN int         kpmSaveRefDataSet   ( const char *filename, const char *e
         kpmSetRefDataSet after this load completes. Alternately, the loaded set can be
         merged with another loaded set by calling kpmMergeRefDataSet. To dispose of the
         loaded dataset, call kpmDeleteRefDataSet.
+ 
+        Datasets in the version 2 format (as written by kpmSaveRefDataSetV2) are memory-mapped
+        and the reference points used in place, so loading costs little more than opening
+        the file, and unmodified pages are shared between processes loading the same file.
+        Datasets in the earlier format are read into memory.
     @param filename Path to the dataset. Either full path, or a relative path if supported by
         the operating system.
     @param ext If non-NULL, a '.' charater and this string will be appended to 'filename'.
         Often, this parameter is a pointer to the string "fset3".
-    @result Returns 0 if successful, or value &lt;0 in case of error.
     @param refDataSetPtr Pointer to a location which after loading will point to the loaded
         reference data set.
     @result 0 if the load succeeded, or a value &lt; 0 in case of error.
@@ -357,6 +522,25 @@ KPM_EXTERN int         kpmSaveRefDataSet   ( const char *filename, const char *e
  */
 KPM_EXTERN int         kpmLoadRefDataSet   ( const char *filename, const char *ext, KpmRefDataSet **refDataSetPtr );
 
+/*!
+    @brief Load a reference data set embedded in another file into memory.
+    @details
+        As kpmLoadRefDataSet, but for a dataset in the current format that starts part-way
+        into a file, such as the KPM data in an NFT bundle (see ar2ReadBundleKpmLocation). The
+        dataset is memory-mapped and used in place.
+    @param filename Path to the file.
+    @param ext If non-NULL, a '.' charater and this string will be appended to 'filename'.
+    @param offset Offset in bytes of the dataset from the start of the file. Must be a
+        multiple of KpmRefDataSetAlignment.
+    @param size Size in bytes of the space the dataset occupies in the file. The load fails
+        if the dataset claims to be larger. 0 allows it to extend to the end of the file.
+    @param refDataSetPtr Pointer to a location which after loading will point to the loaded
+        reference data set.
+    @result 0 if the load succeeded, or a value &lt; 0 in case of error.
+    @see kpmLoadRefDataSet kpmLoadRefDataSet
+ */
+KPM_EXTERN int         kpmLoadRefDataSetAt ( const char *filename, const char *ext, uint64_t offset, uint64_t size, KpmRefDataSet **refDataSetPtr );
+
 KPM_EXTERN int         kpmLoadRefDataSetOld( const char *filename, const char *ext, KpmRefDataSet **refDataSetPtr );
 
 /*!
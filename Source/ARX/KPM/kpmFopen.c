@@ -40,27 +40,154 @@
 #include <ARX/KPM/kpm.h>
 #include "kpmFopen.h"
 #ifdef _WIN32
+#  include <windows.h>
 #  define MAXPATHLEN MAX_PATH
 #else
 #  include <sys/param.h> // MAXPATHLEN
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <fcntl.h>
+#  include <unistd.h>
 #endif
 
-FILE *kpmFopen( const char *filename, const char *ext, const char *mode )
+struct _KpmFileMap {
+    void   *data;
+    size_t  size;
+    int     mapped; // If 0, data was allocated with malloc().
+};
+
+static char *kpmFilePath( const char *filename, const char *ext )
 {
-    FILE   *fp;
     char   *buf;
     size_t  len;
     
-    if (!filename) return (NULL);
     if (ext) {
         len = strlen(filename) + strlen(ext) + 2; // space for '.' and '\0'.
         arMalloc(buf, char, len)
         sprintf(buf, "%s.%s", filename, ext);
-        fp = fopen(buf, mode);
-        free(buf);
     } else {
-        fp = fopen(filename, mode);
+        arMalloc(buf, char, strlen(filename) + 1)
+        strcpy(buf, filename);
     }
+    return buf;
+}
+
+FILE *kpmFopen( const char *filename, const char *ext, const char *mode )
+{
+    FILE   *fp;
+    char   *buf;
+    
+    if (!filename) return (NULL);
+    buf = kpmFilePath(filename, ext);
+    fp = fopen(buf, mode);
+    free(buf);
 
     return fp;
 }
+
+static int kpmFileMapRead( const char *path, KpmFileMap *fileMap )
+{
+    FILE   *fp;
+    long    len;
+    
+    fp = fopen(path, "rb");
+    if (!fp) return (-1);
+    if (fseek(fp, 0, SEEK_END) != 0 || (len = ftell(fp)) <= 0 || fseek(fp, 0, SEEK_SET) != 0) {
+        fclose(fp);
+        return (-1);
+    }
+    arMalloc(fileMap->data, unsigned char, len);
+    if (fread(fileMap->data, 1, len, fp) != (size_t)len) {
+        free(fileMap->data);
+        fclose(fp);
+        return (-1);
+    }
+    fclose(fp);
+    fileMap->size = (size_t)len;
+    fileMap->mapped = 0;
+    return (0);
+}
+
+static int kpmFileMapMap( const char *path, KpmFileMap *fileMap )
+{
+#ifdef _WIN32
+    HANDLE          file, mapping;
+    LARGE_INTEGER   len;
+    
+    file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return (-1);
+    if (!GetFileSizeEx(file, &len) || len.QuadPart <= 0 || (ULONGLONG)len.QuadPart > (SIZE_T)-1) {
+        CloseHandle(file);
+        return (-1);
+    }
+    mapping = CreateFileMappingA(file, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping) return (-1);
+    fileMap->data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    CloseHandle(mapping); // The view keeps the mapping alive.
+    if (!fileMap->data) return (-1);
+    fileMap->size = (size_t)len.QuadPart;
+#else
+    int             fd;
+    struct stat     st;
+    void           *data;
+    
+    fd = open(path, O_RDONLY);
+    if (fd < 0) return (-1);
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return (-1);
+    }
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps the file open.
+    if (data == MAP_FAILED) return (-1);
+    fileMap->data = data;
+    fileMap->size = (size_t)st.st_size;
+#endif
+    fileMap->mapped = 1;
+    return (0);
+}
+
+KpmFileMap *kpmFileMapOpen( const char *filename, const char *ext )
+{
+    KpmFileMap *fileMap;
+    char       *path;
+    
+    if (!filename) return (NULL);
+    path = kpmFilePath(filename, ext);
+    arMallocClear(fileMap, KpmFileMap, 1);
+    if (kpmFileMapMap(path, fileMap) < 0 && kpmFileMapRead(path, fileMap) < 0) {
+        free(fileMap);
+        fileMap = NULL;
+    }
+    free(path);
+    
+    return fileMap;
+}
+
+void *kpmFileMapGetData( KpmFileMap *fileMap )
+{
+    return (fileMap ? fileMap->data : NULL);
+}
+
+size_t kpmFileMapGetSize( const KpmFileMap *fileMap )
+{
+    return (fileMap ? fileMap->size : 0);
+}
+
+void kpmFileMapClose( KpmFileMap **fileMapPtr )
+{
+    if (!fileMapPtr || !*fileMapPtr) return;
+    
+    if ((*fileMapPtr)->mapped) {
+#ifdef _WIN32
+        UnmapViewOfFile((*fileMapPtr)->data);
+#else
+        munmap((*fileMapPtr)->data, (*fileMapPtr)->size);
+#endif
+    } else {
+        free((*fileMapPtr)->data);
+    }
+    free(*fileMapPtr);
+    *fileMapPtr = NULL;
+}
@@ -45,6 +45,16 @@ extern "C" {
 
 FILE *kpmFopen( const char *filename, const char *ext, const char *mode );
 
+// A read-only file mapped into memory. Pages are copy-on-write, so the data may be
+// modified in place without affecting the file or other processes mapping it.
+// Where mapping is unavailable, the file is read into an allocated buffer instead.
+typedef struct _KpmFileMap KpmFileMap;
+
+KpmFileMap *kpmFileMapOpen( const char *filename, const char *ext );
+void       *kpmFileMapGetData( KpmFileMap *fileMap );
+size_t      kpmFileMapGetSize( const KpmFileMap *fileMap );
+void        kpmFileMapClose( KpmFileMap **fileMapPtr );
+
 #ifdef __cplusplus
 }
 #endif
@@ -84,11 +84,16 @@ static KpmHandle *kpmCreateHandleCore( ARParamLT *cparamLT, int xsize, int ysize
 #if !BINARY_FEATURE
     kpmHandle->surfThreadNum           = -1;
 #endif
+    kpmHandle->matchingThreadNum       = KpmMatchingThreadNumDefault;
+    kpmHandle->globalIndexCandidates   = KpmGlobalIndexCandidatesDefault;
     
+    kpmHandle->refDataSetRef           = NULL;
     kpmHandle->refDataSet.refPoint     = NULL;
     kpmHandle->refDataSet.num          = 0;
     kpmHandle->refDataSet.pageInfo     = NULL;
     kpmHandle->refDataSet.pageNum      = 0;
+    kpmHandle->refDataSet.fileMap      = NULL;
+    kpmHandle->refDataSet.indexSet     = NULL;
 
     kpmHandle->inDataSet.coord         = NULL;
     kpmHandle->inDataSet.num           = 0;
@@ -106,6 +111,11 @@ static KpmHandle *kpmCreateHandleCore( ARParamLT *cparamLT, int xsize, int ysize
 
     kpmHandle->result                  = NULL;
     kpmHandle->resultNum               = 0;
+    
+    kpmHandle->matchingPageNum         = 0;
+#if BINARY_FEATURE
+    kpmHandle->matchingRegion[2]       = 0;
+#endif
 
 #if !BINARY_FEATURE
     switch (kpmHandle->procMode) {
@@ -223,6 +233,41 @@ int kpmSetSurfThreadNum( KpmHandle *kpmHandle, int surfThreadNum )
     return 0;
 }
 
+int kpmSetMatchingThreadNum( KpmHandle *kpmHandle, int matchingThreadNum )
+{
+    if (!kpmHandle) return -1;
+    kpmHandle->matchingThreadNum = matchingThreadNum;
+#if BINARY_FEATURE
+    kpmHandle->freakMatcher->setThreadNum(matchingThreadNum);
+#endif
+    return 0;
+}
+
+int kpmGetMatchingThreadNum( KpmHandle *kpmHandle, int *matchingThreadNum )
+{
+    if (!kpmHandle || !matchingThreadNum) return -1;
+    *matchingThreadNum = kpmHandle->matchingThreadNum;
+    return 0;
+}
+
+int kpmSetGlobalIndexCandidates( KpmHandle *kpmHandle, int globalIndexCandidates )
+{
+    if (!kpmHandle || globalIndexCandidates < 0) return -1;
+    kpmHandle->globalIndexCandidates = globalIndexCandidates;
+#if BINARY_FEATURE
+    kpmHandle->freakMatcher->setGlobalIndexCandidates(globalIndexCandidates);
+    if (globalIndexCandidates > 0 && kpmHandle->refDataSet.num > 0 && !kpmHandle->freakMatcher->hasGlobalIndex()) kpmHandle->freakMatcher->buildGlobalIndex();
+#endif
+    return 0;
+}
+
+int kpmGetGlobalIndexCandidates( KpmHandle *kpmHandle, int *globalIndexCandidates )
+{
+    if (!kpmHandle || !globalIndexCandidates) return -1;
+    *globalIndexCandidates = kpmHandle->globalIndexCandidates;
+    return 0;
+}
+
 
 
 int kpmDeleteHandle( KpmHandle **kpmHandle )
@@ -239,12 +284,7 @@ int kpmDeleteHandle( KpmHandle **kpmHandle )
     
 #endif
     
-    if( (*kpmHandle)->refDataSet.refPoint != NULL ) {
-        free( (*kpmHandle)->refDataSet.refPoint );
-    }
-    if( (*kpmHandle)->refDataSet.pageInfo != NULL ) {
-        free( (*kpmHandle)->refDataSet.pageInfo );
-    }
+    kpmRefDataSetRefRelease( &((*kpmHandle)->refDataSetRef) );
 #if !BINARY_FEATURE
     if( (*kpmHandle)->preRANSAC.match != NULL ) {
         free( (*kpmHandle)->preRANSAC.match );
@@ -168,84 +168,87 @@ int kpmLoadImageDb(KpmHandle *kpmHandle, const char *filename)
     return 1;
 }
         
-int kpmSetRefDataSet( KpmHandle *kpmHandle, KpmRefDataSet *refDataSet )
+// Returns a copy of the refPoints and pageInfo of refDataSet.
+static KpmRefDataSet *kpmCopyRefDataSet( const KpmRefDataSet *refDataSet )
 {
-#if !BINARY_FEATURE
-    CAnnMatch2         *ann2;
-#endif
-    
-    FeatureVector       featureVector;
+    KpmRefDataSet      *copy;
     int                 i, j;
     
-    if (!kpmHandle || !refDataSet) {
-        ARLOGe("kpmSetRefDataSet(): NULL kpmHandle/refDataSet.\n");
-        return -1;
-    }
-    if (!refDataSet->num) {
-        ARLOGe("kpmSetRefDataSet(): refDataSet.\n");
-        return -1;
-    }
+    arMallocClear( copy, KpmRefDataSet, 1 );
     
-    // Copy the refPoints into the kpmHandle's dataset.
-    if( kpmHandle->refDataSet.refPoint != NULL ) {
-        // Discard any old points first.
-        free( kpmHandle->refDataSet.refPoint );
-    }
     if( refDataSet->num != 0 ) {
-        arMalloc( kpmHandle->refDataSet.refPoint, KpmRefData, refDataSet->num );
+        arMalloc( copy->refPoint, KpmRefData, refDataSet->num );
         for( i = 0; i < refDataSet->num; i++ ) {
-            kpmHandle->refDataSet.refPoint[i] = refDataSet->refPoint[i];
+            copy->refPoint[i] = refDataSet->refPoint[i];
         }
     }
-    else {
-        kpmHandle->refDataSet.refPoint = NULL;
-    }
-    kpmHandle->refDataSet.num = refDataSet->num;
+    copy->num = refDataSet->num;
 
-    // Copy the pageInfo into the kpmHandle's dataset.
-    if( kpmHandle->refDataSet.pageInfo != NULL ) {
-        // Discard any old pageInfo (and imageInfo) first.
-        for( i = 0; i < kpmHandle->refDataSet.pageNum; i++ ) {
-            if( kpmHandle->refDataSet.pageInfo[i].imageInfo != NULL ) {
-                free( kpmHandle->refDataSet.pageInfo[i].imageInfo );
-            }
-        }
-        free( kpmHandle->refDataSet.pageInfo );
-    }
     if( refDataSet->pageNum != 0 ) {
-        arMalloc( kpmHandle->refDataSet.pageInfo, KpmPageInfo, refDataSet->pageNum );
+        arMalloc( copy->pageInfo, KpmPageInfo, refDataSet->pageNum );
         for( i = 0; i < refDataSet->pageNum; i++ ) {
-            kpmHandle->refDataSet.pageInfo[i].pageNo = refDataSet->pageInfo[i].pageNo;
-            kpmHandle->refDataSet.pageInfo[i].imageNum = refDataSet->pageInfo[i].imageNum;
+            copy->pageInfo[i].pageNo = refDataSet->pageInfo[i].pageNo;
+            copy->pageInfo[i].imageNum = refDataSet->pageInfo[i].imageNum;
             if( refDataSet->pageInfo[i].imageNum != 0 ) {
-                arMalloc( kpmHandle->refDataSet.pageInfo[i].imageInfo, KpmImageInfo, refDataSet->pageInfo[i].imageNum );
+                arMalloc( copy->pageInfo[i].imageInfo, KpmImageInfo, refDataSet->pageInfo[i].imageNum );
                 for( j = 0; j < refDataSet->pageInfo[i].imageNum; j++ ) {
-                    kpmHandle->refDataSet.pageInfo[i].imageInfo[j] = refDataSet->pageInfo[i].imageInfo[j];
+                    copy->pageInfo[i].imageInfo[j] = refDataSet->pageInfo[i].imageInfo[j];
                 }
             }
             else {
-                refDataSet->pageInfo[i].imageInfo = NULL;
+                copy->pageInfo[i].imageInfo = NULL;
             }
         }
     }
+    copy->pageNum = refDataSet->pageNum;
+
+    return (copy);
+}
+
+// Makes the reference data set held by ref (which kpmHandle takes over) kpmHandle's dataset,
+// releasing any previous one, and sizes its results to match.
+static void kpmAttachRefDataSet( KpmHandle *kpmHandle, KpmRefDataSetRef *ref )
+{
+    KpmRefDataSetRef   *oldRef = kpmHandle->refDataSetRef;
+    
+    kpmHandle->refDataSetRef = ref;
+    if( ref != NULL ) {
+        kpmHandle->refDataSet = *ref->refDataSet;
+    }
     else {
+        kpmHandle->refDataSet.refPoint = NULL;
+        kpmHandle->refDataSet.num      = 0;
         kpmHandle->refDataSet.pageInfo = NULL;
+        kpmHandle->refDataSet.pageNum  = 0;
     }
-    kpmHandle->refDataSet.pageNum = refDataSet->pageNum;
-
+    kpmHandle->refDataSet.fileMap  = NULL; // Owned by ref.
+    kpmHandle->refDataSet.indexSet = NULL;
+    kpmRefDataSetRefRelease(&oldRef);
     
     if( kpmHandle->result != NULL ) {
         free( kpmHandle->result );
         kpmHandle->result = NULL;
         kpmHandle->resultNum = 0;
     }
-    if( refDataSet->pageNum > 0 ) {
-        kpmHandle->resultNum = refDataSet->pageNum;
-        arMalloc( kpmHandle->result, KpmResult, refDataSet->pageNum );
-		for (int i = 0; i < refDataSet->pageNum;i++){
+    if( kpmHandle->refDataSet.pageNum > 0 ) {
+        kpmHandle->resultNum = kpmHandle->refDataSet.pageNum;
+        arMalloc( kpmHandle->result, KpmResult, kpmHandle->refDataSet.pageNum );
+		for (int i = 0; i < kpmHandle->refDataSet.pageNum;i++){
 			kpmHandle->result[i].skipF = 0;
 		}        
     }
+}
+
+// Sets the reference data set held by ref, which kpmHandle takes over, and builds the matcher
+// for it, using the prebuilt search indices in indexSet where possible.
+static int kpmSetRefDataSetRef( KpmHandle *kpmHandle, KpmRefDataSetRef *ref, const void *indexSet )
+{
+#if !BINARY_FEATURE
+    CAnnMatch2         *ann2;
+    FeatureVector       featureVector;
+#endif
+    
+    kpmAttachRefDataSet(kpmHandle, ref);
 
     // Create feature vectors.
 #if !BINARY_FEATURE
@@ -266,39 +269,120 @@ int kpmSetRefDataSet( KpmHandle *kpmHandle, KpmRefDataSet *refDataSet )
     }
 #else
     if (kpmHandle->refDataSet.num != 0) {
-        featureVector.num = kpmHandle->refDataSet.num;
-        
         int db_id = 0;
+        int indexLoadedNum = 0;
+        int featureNum = 0;
+        std::vector<vision::FeaturePoint> points;
+        std::vector<vision::Point3d<float> > points_3d;
+        std::vector<unsigned char> descriptors;
+        std::vector<uint64_t> imageHashes;
         for (int k = 0; k < kpmHandle->refDataSet.pageNum; k++) {
             for (int m = 0; m < kpmHandle->refDataSet.pageInfo[k].imageNum; m++) {
-                std::vector<vision::FeaturePoint> points;
-                std::vector<vision::Point3d<float> > points_3d;
-                std::vector<unsigned char> descriptors;
-            
-                for (int i = 0; i < featureVector.num; i++) {
-                    if (kpmHandle->refDataSet.refPoint[i].refImageNo == kpmHandle->refDataSet.pageInfo[k].imageInfo[m].imageNo
-                    && kpmHandle->refDataSet.refPoint[i].pageNo == kpmHandle->refDataSet.pageInfo[k].pageNo) {
-                        points.push_back(vision::FeaturePoint(kpmHandle->refDataSet.refPoint[i].coord2D.x,
-                                                          kpmHandle->refDataSet.refPoint[i].coord2D.y,
-                                                          kpmHandle->refDataSet.refPoint[i].featureVec.angle,
-                                                          kpmHandle->refDataSet.refPoint[i].featureVec.scale,
-                                                          kpmHandle->refDataSet.refPoint[i].featureVec.maxima));
-                        points_3d.push_back(vision::Point3d<float>(kpmHandle->refDataSet.refPoint[i].coord3D.x,
-                                                                   kpmHandle->refDataSet.refPoint[i].coord3D.y,                                                                  0));
-                        for (int j = 0; j < FREAK_SUB_DIMENSION; j++)
-                            descriptors.push_back(kpmHandle->refDataSet.refPoint[i].featureVec.v[j]);
-                    }
-                }
+                kpmRefDataSetGetImage(&kpmHandle->refDataSet, k, m, points, points_3d, descriptors);
                 ARLOGi("points-%d\n", points.size());
-               kpmHandle->pageIDs[db_id] = kpmHandle->refDataSet.pageInfo[k].pageNo; kpmHandle->freakMatcher->addFreakFeaturesAndDescriptors(points,descriptors,points_3d,kpmHandle->refDataSet.pageInfo[k].imageInfo[m].width,kpmHandle->refDataSet.pageInfo[k].imageInfo[m].height,db_id++);
+                
+                // Use the search index saved with the dataset, if there is one for these features.
+                uint64_t hash = kpmRefIndexHash(descriptors);
+                const KpmRefIndex *index = kpmRefIndexSetFind((const KpmRefIndexSet *)indexSet, hash, (int)points.size());
+                if (!points.empty()) {
+                    imageHashes.push_back(hash);
+                    featureNum += (int)points.size();
+                }
+                kpmHandle->pageIDs[db_id] = kpmHandle->refDataSet.pageInfo[k].pageNo;
+                if (kpmHandle->freakMatcher->addFreakFeaturesAndDescriptors(points, descriptors, points_3d,
+                                                                            kpmHandle->refDataSet.pageInfo[k].imageInfo[m].width,
+                                                                            kpmHandle->refDataSet.pageInfo[k].imageInfo[m].height,
+                                                                            db_id++,
+                                                                            (index ? index->data : NULL),
+                                                                            (index ? index->size : 0))) {
+                    indexLoadedNum++;
+                }
             }
         }
+        if (indexLoadedNum > 0) ARLOGi("Loaded prebuilt search indices for %d of %d images.\n", indexLoadedNum, db_id);
+        
+        // Likewise the global index, which is otherwise only built if it will be used.
+        const KpmRefIndex *globalIndex = kpmRefIndexSetFindGlobal((const KpmRefIndexSet *)indexSet, kpmRefGlobalIndexHash(imageHashes), featureNum);
+        if (globalIndex && kpmHandle->freakMatcher->loadGlobalIndex(globalIndex->data, globalIndex->size)) {
+            ARLOGi("Loaded prebuilt global search index.\n");
+        } else if (kpmHandle->globalIndexCandidates > 0) {
+            kpmHandle->freakMatcher->buildGlobalIndex();
+        }
     }
 #endif
     
     return 0;
 }
 
+int kpmSetRefDataSet( KpmHandle *kpmHandle, KpmRefDataSet *refDataSet )
+{
+    if (!kpmHandle || !refDataSet) {
+        ARLOGe("kpmSetRefDataSet(): NULL kpmHandle/refDataSet.\n");
+        return -1;
+    }
+    if (!refDataSet->num) {
+        ARLOGe("kpmSetRefDataSet(): refDataSet.\n");
+        return -1;
+    }
+    
+    return (kpmSetRefDataSetRef(kpmHandle, kpmRefDataSetRefCreate(kpmCopyRefDataSet(refDataSet)), refDataSet->indexSet));
+}
+
+int kpmSetRefDataSetOwned( KpmHandle *kpmHandle, KpmRefDataSet **refDataSetPtr )
+{
+    KpmRefDataSet      *refDataSet;
+    
+    if (!kpmHandle || !refDataSetPtr || !*refDataSetPtr) {
+        ARLOGe("kpmSetRefDataSetOwned(): NULL kpmHandle/refDataSetPtr/*refDataSetPtr.\n");
+        return -1;
+    }
+    if (!(*refDataSetPtr)->num) {
+        ARLOGe("kpmSetRefDataSetOwned(): refDataSet.\n");
+        return -1;
+    }
+    
+    refDataSet = *refDataSetPtr;
+    *refDataSetPtr = NULL;
+    return (kpmSetRefDataSetRef(kpmHandle, kpmRefDataSetRefCreate(refDataSet), refDataSet->indexSet));
+}
+
+KpmHandle *kpmCreateHandleShared( KpmHandle *kpmHandle )
+{
+    KpmHandle          *shared;
+    KPM_PROC_MODE       procMode;
+    
+    if (!kpmHandle) {
+        ARLOGe("kpmCreateHandleShared(): NULL kpmHandle.\n");
+        return (NULL);
+    }
+    
+    if (kpmHandle->poseMode == KpmPoseHomography) shared = kpmCreateHandleHomography(kpmHandle->xsize, kpmHandle->ysize);
+    else                                          shared = kpmCreateHandle(kpmHandle->cparamLT);
+    if (!shared) return (NULL);
+    
+    kpmGetProcMode(kpmHandle, &procMode);
+    kpmSetProcMode(shared, procMode);
+    kpmSetDetectedFeatureMax(shared, kpmHandle->detectedMaxFeature);
+    kpmSetMatchingThreadNum(shared, kpmHandle->matchingThreadNum);
+    kpmSetGlobalIndexCandidates(shared, kpmHandle->globalIndexCandidates);
+    if (kpmHandle->refDataSet.num == 0) return (shared);
+    
+    // The reference data is read-only once set, so reference it rather than copying it.
+#if BINARY_FEATURE
+    // Likewise the keyframes and their indices, so share them rather than rebuilding.
+    kpmAttachRefDataSet(shared, kpmRefDataSetRefRetain(kpmHandle->refDataSetRef));
+    shared->freakMatcher->shareDatabase(*kpmHandle->freakMatcher);
+    for (int i = 0; i < DB_IMAGE_MAX; i++) shared->pageIDs[i] = kpmHandle->pageIDs[i];
+#else
+    if (kpmSetRefDataSetRef(shared, kpmRefDataSetRefRetain(kpmHandle->refDataSetRef), NULL) < 0) {
+        kpmDeleteHandle(&shared);
+        return (NULL);
+    }
+#endif
+    
+    return (shared);
+}
+
 int kpmSetRefDataSetFile( KpmHandle *kpmHandle, const char *filename, const char *ext )
 {
     KpmRefDataSet   *refDataSet;
@@ -309,11 +393,10 @@ int kpmSetRefDataSetFile( KpmHandle *kpmHandle, const char *filename, const char
     }
     
     if( kpmLoadRefDataSet(filename, ext, &refDataSet) < 0 ) return -1;
-    if( kpmSetRefDataSet(kpmHandle, refDataSet) < 0 ) {
+    if( kpmSetRefDataSetOwned(kpmHandle, &refDataSet) < 0 ) {
         kpmDeleteRefDataSet(&refDataSet);
         return -1;
     }
-    kpmDeleteRefDataSet(&refDataSet);
     
     return 0;
 }
@@ -325,11 +408,10 @@ int kpmSetRefDataSetFileOld( KpmHandle *kpmHandle, const char *filename, const c
     if( kpmHandle == NULL )  return -1;
     
     if( kpmLoadRefDataSetOld(filename, ext, &refDataSet) < 0 ) return -1;
-    if( kpmSetRefDataSet(kpmHandle, refDataSet) < 0 ) {
+    if( kpmSetRefDataSetOwned(kpmHandle, &refDataSet) < 0 ) {
         kpmDeleteRefDataSet(&refDataSet);
         return -1;
     }
-    kpmDeleteRefDataSet(&refDataSet);
     
     return 0;
 }
@@ -356,6 +438,141 @@ int kpmSetMatchingSkipPage( KpmHandle *kpmHandle, int skipPages[], int num )
     return 0;
 }
 
+int kpmSetMatchingPages( KpmHandle *kpmHandle, int pages[], int num )
+{
+    int    i, j;
+    
+    if (!kpmHandle || (num > 0 && !pages)) {
+        ARLOGe("kpmSetMatchingPages(): NULL kpmHandle/pages.\n");
+        return -1;
+    }
+    if (num > DB_IMAGE_MAX) num = DB_IMAGE_MAX;
+    
+    for( i = 0; i < num; i++ ) {
+        for( j = 0; j < kpmHandle->refDataSet.pageNum; j++ ) {
+            if( pages[i] == kpmHandle->refDataSet.pageInfo[j].pageNo ) break;
+        }
+        if( j == kpmHandle->refDataSet.pageNum ) {
+            ARLOGe("Cannot find the page for matching.\n");
+            return -1;
+        }
+    }
+    
+    // Skip the pages not listed, and remember the order of those that are.
+    for( j = 0; j < kpmHandle->refDataSet.pageNum; j++ ) {
+        for( i = 0; i < num; i++ ) {
+            if( pages[i] == kpmHandle->refDataSet.pageInfo[j].pageNo ) break;
+        }
+        if( i == num ) kpmHandle->result[j].skipF = 1;
+    }
+    for( i = 0; i < num; i++ ) kpmHandle->matchingPages[i] = pages[i];
+    kpmHandle->matchingPageNum = num;
+    
+    return 0;
+}
+
+#if BINARY_FEATURE
+int kpmSetMatchingRegion( KpmHandle *kpmHandle, int x, int y, int width, int height )
+{
+    if (!kpmHandle) {
+        ARLOGe("kpmSetMatchingRegion(): NULL kpmHandle.\n");
+        return -1;
+    }
+    
+    kpmHandle->matchingRegion[2] = 0;
+    if (x < 0) { width += x; x = 0; }
+    if (y < 0) { height += y; y = 0; }
+    if (x + width > kpmHandle->xsize) width = kpmHandle->xsize - x;
+    if (y + height > kpmHandle->ysize) height = kpmHandle->ysize - y;
+    if (width <= 0 || height <= 0) {
+        ARLOGe("kpmSetMatchingRegion(): Region is outside the image.\n");
+        return -1;
+    }
+    
+    kpmHandle->matchingRegion[0] = x;
+    kpmHandle->matchingRegion[1] = y;
+    kpmHandle->matchingRegion[2] = width;
+    kpmHandle->matchingRegion[3] = height;
+    return 0;
+}
+
+// Matching regions are rounded up to a multiple of this many pixels of the processed image, so
+// that the matcher only has to reallocate its pyramid when the region size changes markedly. It
+// is also the smallest region matched, below which the pyramid would have too few octaves.
+#define KPM_MATCHING_REGION_STEP 64
+
+// Maps the region set by kpmSetMatchingRegion() into the image of XSIZE2 by YSIZE2 pixels that
+// is matched for procMode, grown to a multiple of KPM_MATCHING_REGION_STEP pixels each way and
+// clipped to the image. Returns false if there is no region set.
+static bool kpmGetMatchingRegion( const KpmHandle *kpmHandle, int procMode, int xsize2, int ysize2, int region[4] )
+{
+    float  scale;
+    int    i, size[2] = {xsize2, ysize2};
+    
+    if( kpmHandle->matchingRegion[2] <= 0 ) return false;
+    
+    if( procMode == KpmProcFullSize )          scale = 1.0f;
+    else if( procMode == KpmProcTwoThirdSize ) scale = 1.5f;
+    else if( procMode == KpmProcHalfSize )     scale = 2.0f;
+    else if( procMode == KpmProcOneThirdSize ) scale = 3.0f;
+    else                                       scale = 4.0f;
+    
+    for( i = 0; i < 2; i++ ) {
+        int x0 = (int)(kpmHandle->matchingRegion[i] / scale);
+        int x1 = (int)((kpmHandle->matchingRegion[i] + kpmHandle->matchingRegion[i + 2]) / scale + 0.999f);
+        int width = (x1 - x0 + KPM_MATCHING_REGION_STEP - 1) / KPM_MATCHING_REGION_STEP * KPM_MATCHING_REGION_STEP;
+        if( width >= size[i] ) {
+            region[i] = 0;
+            region[i + 2] = size[i];
+        } else {
+            x0 -= (width - (x1 - x0)) / 2; // Grow evenly on both sides.
+            if( x0 < 0 ) x0 = 0;
+            if( x0 + width > size[i] ) x0 = size[i] - width;
+            region[i] = x0;
+            region[i + 2] = width;
+        }
+    }
+    return true;
+}
+
+// Returns true if only some images are to be matched, and the IDs of those images, the images of
+// the pages set by kpmSetMatchingPages() first, in that order.
+static bool kpmGetMatchingImageIDs( const KpmHandle *kpmHandle, std::vector<int>& imageIDs )
+{
+    std::vector<int> pageOrder;
+    int    imageNum = 0;
+    bool   restricted = (kpmHandle->matchingPageNum > 0);
+    int    i, j, k;
+    
+    for( k = 0; k < kpmHandle->refDataSet.pageNum; k++ ) {
+        imageNum += kpmHandle->refDataSet.pageInfo[k].imageNum;
+        if( kpmHandle->result[k].skipF ) restricted = true;
+    }
+    if( !restricted ) return false;
+    if( imageNum > DB_IMAGE_MAX ) imageNum = DB_IMAGE_MAX;
+    
+    for( i = 0; i < kpmHandle->matchingPageNum; i++ ) {
+        for( k = 0; k < kpmHandle->refDataSet.pageNum; k++ ) {
+            if( kpmHandle->matchingPages[i] == kpmHandle->refDataSet.pageInfo[k].pageNo ) break;
+        }
+        if( k < kpmHandle->refDataSet.pageNum && !kpmHandle->result[k].skipF ) pageOrder.push_back(kpmHandle->matchingPages[i]);
+    }
+    if( kpmHandle->matchingPageNum == 0 ) {
+        for( k = 0; k < kpmHandle->refDataSet.pageNum; k++ ) {
+            if( !kpmHandle->result[k].skipF ) pageOrder.push_back(kpmHandle->refDataSet.pageInfo[k].pageNo);
+        }
+    }
+    
+    imageIDs.clear();
+    for( i = 0; i < (int)pageOrder.size(); i++ ) {
+        for( j = 0; j < imageNum; j++ ) {
+            if( kpmHandle->pageIDs[j] == pageOrder[i] ) imageIDs.push_back(j);
+        }
+    }
+    return true;
+}
+#endif
+
 #if !BINARY_FEATURE
 int kpmSetMatchingSkipRegion( KpmHandle *kpmHandle, SurfSubRect *skipRegion, int regionNum)
 {
@@ -411,6 +628,8 @@ int kpmMatching(KpmHandle *kpmHandle, ARUint8 *inImageLuma)
     if (procMode == KpmProcFullSize) {
         imageLuma = inImageLuma;
         imageLumaWasAllocated = 0;
+        xsize2 = xsize;
+        ysize2 = ysize;
     } else {
         imageLuma = kpmUtilResizeImage(inImageLuma, xsize, ysize, procMode, &xsize2, &ysize2);
         if (!imageLuma) return -1;
@@ -418,8 +637,20 @@ int kpmMatching(KpmHandle *kpmHandle, ARUint8 *inImageLuma)
     }
 
 #if BINARY_FEATURE
-    kpmHandle->freakMatcher->query(imageLuma, xsize ,ysize);
-    kpmHandle->inDataSet.num = (int)kpmHandle->freakMatcher->getQueryFeaturePoints().size();
+    std::vector<int> imageIDs;
+    if (kpmGetMatchingImageIDs(kpmHandle, imageIDs) && imageIDs.empty()) {
+        kpmHandle->inDataSet.num = 0; // All pages skipped.
+    } else {
+        int region[4];
+        kpmHandle->freakMatcher->setQueryImages(imageIDs);
+        if (kpmGetMatchingRegion(kpmHandle, procMode, xsize2, ysize2, region)) {
+            kpmHandle->freakMatcher->query(imageLuma, xsize2, ysize2, region[0], region[1], region[2], region[3]);
+        } else {
+            kpmHandle->freakMatcher->query(imageLuma, xsize2, ysize2);
+        }
+        kpmHandle->inDataSet.num = (int)kpmHandle->freakMatcher->getQueryFeaturePoints().size();
+    }
+    kpmHandle->matchingRegion[2] = 0;
 #else
     surfSubExtractFeaturePoint( kpmHandle->surfHandle, inImageBW, kpmHandle->skipRegion.region, kpmHandle->skipRegion.regionNum );
     kpmHandle->skipRegion.regionNum = 0;
@@ -672,6 +903,7 @@ int kpmMatching(KpmHandle *kpmHandle, ARUint8 *inImageLuma)
     }
     
     for( i = 0; i < kpmHandle->resultNum; i++ ) kpmHandle->result[i].skipF = 0;
+    kpmHandle->matchingPageNum = 0;
 
     if (imageLumaWasAllocated) free(imageLuma);
     
@@ -36,6 +36,8 @@
 #ifndef __kpmPrivate_h__
 #define __kpmPrivate_h__
 
+#include <stdint.h>
+#include <atomic>
 #if BINARY_FEATURE
 #include <facade/visual_database_facade.h>
 #else
@@ -57,6 +59,17 @@ typedef struct {
 } KpmAnnInfo;
 #endif
 
+// A reference data set held, read-only, by one or more handles (see kpmCreateHandleShared()).
+// The set is deleted when the last handle releases it.
+typedef struct {
+    KpmRefDataSet            *refDataSet;
+    std::atomic<int>          refCount;
+} KpmRefDataSetRef;
+
+KpmRefDataSetRef *kpmRefDataSetRefCreate( KpmRefDataSet *refDataSet ); // Takes ownership of refDataSet.
+KpmRefDataSetRef *kpmRefDataSetRefRetain( KpmRefDataSetRef *ref );
+void              kpmRefDataSetRefRelease( KpmRefDataSetRef **refPtr );
+
 struct _KpmHandle {
 #if !BINARY_FEATURE
     SurfSubHandleT           *surfHandle;
@@ -73,8 +86,11 @@ struct _KpmHandle {
 #if !BINARY_FEATURE
     int                       surfThreadNum;
 #endif
+    int                       matchingThreadNum;
+    int                       globalIndexCandidates;
     
-    KpmRefDataSet             refDataSet;
+    KpmRefDataSetRef         *refDataSetRef;
+    KpmRefDataSet             refDataSet;               // Shallow copy of *refDataSetRef->refDataSet, or empty. Owns nothing.
     KpmInputDataSet           inDataSet;
 #if !BINARY_FEATURE
     KpmMatchResult            preRANSAC;
@@ -88,6 +104,47 @@ struct _KpmHandle {
     KpmResult                *result;
     int                       resultNum;
     int                       pageIDs[DB_IMAGE_MAX];
+    
+    // Set by kpmSetMatchingPages() and kpmSetMatchingRegion() for the next kpmMatching() only.
+    int                       matchingPages[DB_IMAGE_MAX];
+    int                       matchingPageNum;
+#if BINARY_FEATURE
+    int                       matchingRegion[4];        // x, y, width, height, or width 0 for the whole image.
+#endif
 };
 
+#if BINARY_FEATURE
+// Prebuilt search index for one reference image, identified by its features.
+typedef struct {
+    uint64_t                  hash;           // kpmRefIndexHash() of the image's descriptors.
+    int                       featureNum;
+    unsigned char            *data;
+    size_t                    size;
+} KpmRefIndex;
+
+// Held by KpmRefDataSet.indexSet.
+typedef struct {
+    KpmRefIndex              *index;
+    int                       num;
+    KpmRefIndex               global;         // Index over all the images together, keyed by kpmRefGlobalIndexHash(), or data NULL.
+} KpmRefIndexSet;
+
+// Gather the features of image m of page k of refDataSet, in the order they are indexed.
+void kpmRefDataSetGetImage( const KpmRefDataSet *refDataSet, int k, int m,
+                            std::vector<vision::FeaturePoint>& points,
+                            std::vector<vision::Point3d<float> >& points3D,
+                            std::vector<unsigned char>& descriptors );
+
+uint64_t kpmRefIndexHash( const std::vector<unsigned char>& descriptors );
+
+// Hash of the kpmRefIndexHash() values of the images with features, in the order they are indexed.
+uint64_t kpmRefGlobalIndexHash( const std::vector<uint64_t>& imageHashes );
+
+// Returns NULL if indexSet holds no index for the given features.
+const KpmRefIndex *kpmRefIndexSetFind( const KpmRefIndexSet *indexSet, uint64_t hash, int featureNum );
+
+// Returns NULL if indexSet holds no global index for the given images.
+const KpmRefIndex *kpmRefIndexSetFindGlobal( const KpmRefIndexSet *indexSet, uint64_t hash, int featureNum );
+#endif
+
 #endif // !__kpmPrivate_h__
@@ -37,6 +37,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <ARX/AR/ar.h>
 #include <ARX/KPM/kpm.h>
 #include <ARX/KPM/kpmType.h>
@@ -49,6 +50,173 @@
 #include <ARX/KPM/surfSub.h>
 #endif
 
+//
+// Dataset file format, version 2 (KpmRefDataSetVersion).
+//
+// A KpmRefDataSetHeader, followed by three sections each starting at a multiple of
+// KpmRefDataSetAlignment bytes from the start of the file:
+//   refPoint:  num KpmRefData records, exactly as laid out in memory.
+//   page:      pageNum KpmRefDataSetPage records.
+//   imageInfo: KpmImageInfo records for all pages, in page order.
+// and, in binary feature builds, optional sections:
+//   index:       an int32 count and int32 zero, then count KpmRefDataSetIndex records,
+//                then the search index data they refer to.
+//   globalIndex: one KpmRefDataSetIndex record, keyed by kpmRefGlobalIndexHash() and the total
+//                feature count, then the data of the index over all the images together.
+// All values are in the byte order of the writer, which is recorded in byteOrder.
+// Version 1 files (no header) start directly with the int count of reference points.
+//
+#define KPM_REF_DATA_SET_MAGIC       "KPM3"
+#define KPM_REF_DATA_SET_BYTE_ORDER  0x01020304u
+
+typedef struct {
+    char        magic[4];
+    uint32_t    version;
+    uint32_t    byteOrder;
+    uint32_t    refDataSize;        // sizeof(KpmRefData) of the writer.
+    uint32_t    binaryFeature;      // BINARY_FEATURE of the writer.
+    int32_t     num;
+    int32_t     pageNum;
+    int32_t     imageInfoNum;
+    uint64_t    refPointOffset;
+    uint64_t    pageOffset;
+    uint64_t    imageInfoOffset;
+    uint64_t    fileSize;
+    uint64_t    indexOffset;        // Zero if there is no index section.
+    uint64_t    indexSize;
+    uint64_t    globalIndexOffset;  // Zero if there is no global index section.
+    uint64_t    globalIndexSize;
+} KpmRefDataSetHeader;
+
+typedef struct {
+    int32_t     pageNo;
+    int32_t     imageNum;
+    int32_t     imageInfoIndex;     // Index of the page's first record in the imageInfo section.
+    int32_t     reserved;
+} KpmRefDataSetPage;
+
+static uint64_t kpmRefDataSetAlign( uint64_t offset )
+{
+    return ((offset + KpmRefDataSetAlignment - 1) / KpmRefDataSetAlignment * KpmRefDataSetAlignment);
+}
+
+#if BINARY_FEATURE
+typedef struct {
+    uint64_t    hash;
+    int32_t     featureNum;
+    int32_t     reserved;
+    uint64_t    offset;             // From the start of the index section.
+    uint64_t    size;
+} KpmRefDataSetIndex;
+
+void kpmRefDataSetGetImage( const KpmRefDataSet *refDataSet, int k, int m,
+                            std::vector<vision::FeaturePoint>& points,
+                            std::vector<vision::Point3d<float> >& points3D,
+                            std::vector<unsigned char>& descriptors )
+{
+    const int pageNo  = refDataSet->pageInfo[k].pageNo;
+    const int imageNo = refDataSet->pageInfo[k].imageInfo[m].imageNo;
+    
+    points.clear();
+    points3D.clear();
+    descriptors.clear();
+    for (int i = 0; i < refDataSet->num; i++) {
+        const KpmRefData *ref = &refDataSet->refPoint[i];
+        if (ref->refImageNo != imageNo || ref->pageNo != pageNo) continue;
+        points.push_back(vision::FeaturePoint(ref->coord2D.x, ref->coord2D.y, ref->featureVec.angle, ref->featureVec.scale, ref->featureVec.maxima));
+        points3D.push_back(vision::Point3d<float>(ref->coord3D.x, ref->coord3D.y, 0));
+        descriptors.insert(descriptors.end(), ref->featureVec.v, ref->featureVec.v + FREAK_SUB_DIMENSION);
+    }
+}
+
+uint64_t kpmRefIndexHash( const std::vector<unsigned char>& descriptors )
+{
+    // 64-bit FNV-1a, a word at a time.
+    uint64_t hash = 14695981039346656037ULL;
+    uint64_t word;
+    size_t   i;
+    
+    for (i = 0; i + sizeof(word) <= descriptors.size(); i += sizeof(word)) {
+        memcpy(&word, &descriptors[i], sizeof(word));
+        hash = (hash ^ word) * 1099511628211ULL;
+    }
+    for (; i < descriptors.size(); i++) {
+        hash = (hash ^ descriptors[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+uint64_t kpmRefGlobalIndexHash( const std::vector<uint64_t>& imageHashes )
+{
+    uint64_t hash = 14695981039346656037ULL;
+    
+    for (size_t i = 0; i < imageHashes.size(); i++) {
+        hash = (hash ^ imageHashes[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+const KpmRefIndex *kpmRefIndexSetFind( const KpmRefIndexSet *indexSet, uint64_t hash, int featureNum )
+{
+    if (!indexSet) return (NULL);
+    for (int i = 0; i < indexSet->num; i++) {
+        if (indexSet->index[i].hash == hash && indexSet->index[i].featureNum == featureNum) return (&indexSet->index[i]);
+    }
+    return (NULL);
+}
+
+const KpmRefIndex *kpmRefIndexSetFindGlobal( const KpmRefIndexSet *indexSet, uint64_t hash, int featureNum )
+{
+    if (!indexSet || !indexSet->global.data) return (NULL);
+    if (indexSet->global.hash != hash || indexSet->global.featureNum != featureNum) return (NULL);
+    return (&indexSet->global);
+}
+#endif
+
+static void kpmRefIndexSetDelete( void **indexSetPtr )
+{
+#if BINARY_FEATURE
+    KpmRefIndexSet *indexSet = (KpmRefIndexSet *)*indexSetPtr;
+    
+    if (!indexSet) return;
+    for (int i = 0; i < indexSet->num; i++) free(indexSet->index[i].data);
+    free(indexSet->index);
+    free(indexSet->global.data);
+    free(indexSet);
+#endif
+    *indexSetPtr = NULL;
+}
+
+// Moves the indices of indexSetPtr2 into indexSetPtr1.
+static void kpmRefIndexSetMerge( void **indexSetPtr1, void **indexSetPtr2 )
+{
+#if BINARY_FEATURE
+    KpmRefIndexSet *indexSet1 = (KpmRefIndexSet *)*indexSetPtr1;
+    KpmRefIndexSet *indexSet2 = (KpmRefIndexSet *)*indexSetPtr2;
+    KpmRefIndex    *index;
+    
+    if (!indexSet1) {
+        *indexSetPtr1 = indexSet1 = indexSet2;
+        *indexSetPtr2 = indexSet2 = NULL;
+        if (!indexSet1) return;
+    }
+    if (indexSet2) {
+        arMalloc(index, KpmRefIndex, indexSet1->num + indexSet2->num);
+        memcpy(index, indexSet1->index, sizeof(KpmRefIndex) * indexSet1->num);
+        memcpy(index + indexSet1->num, indexSet2->index, sizeof(KpmRefIndex) * indexSet2->num);
+        free(indexSet1->index);
+        indexSet1->index = index;
+        indexSet1->num  += indexSet2->num;
+        indexSet2->num   = 0;
+    }
+    
+    // The merged set holds different images, so no global index applies to it.
+    free(indexSet1->global.data);
+    indexSet1->global.data = NULL;
+#endif
+    kpmRefIndexSetDelete(indexSetPtr2);
+}
+
 
 
 int kpmGenRefDataSet ( ARUint8 *refImage, int xsize, int ysize, float dpi, int procMode, int compMode, int maxFeatureNum,
@@ -69,6 +237,8 @@ int kpmGenRefDataSet ( ARUint8 *refImage, int xsize, int ysize, float dpi, int p
     }
 
     arMalloc( refDataSet, KpmRefDataSet, 1 );
+    refDataSet->fileMap  = NULL;
+    refDataSet->indexSet = NULL;
     
     refDataSet->pageNum = 1; // I.e. number of pages = 1.
     arMalloc( refDataSet->pageInfo, KpmPageInfo, 1 );
@@ -325,9 +495,19 @@ int kpmMergeRefDataSet ( KpmRefDataSet **refDataSetPtr1, KpmRefDataSet **refData
         (*refDataSetPtr1)->refPoint     = NULL;
         (*refDataSetPtr1)->pageNum      = 0;
         (*refDataSetPtr1)->pageInfo     = NULL;
+        (*refDataSetPtr1)->fileMap      = NULL;
+        (*refDataSetPtr1)->indexSet     = NULL;
     }
     if (!*refDataSetPtr2) return 0;
     
+    // Merging into an empty set, so just take over the second set rather than copying it.
+    if ((*refDataSetPtr1)->num == 0 && (*refDataSetPtr1)->pageNum == 0) {
+        kpmDeleteRefDataSet(refDataSetPtr1);
+        *refDataSetPtr1 = *refDataSetPtr2;
+        *refDataSetPtr2 = NULL;
+        return 0;
+    }
+    
     // Merge KpmRefData.
     num1 = (*refDataSetPtr1)->num;
     num2 = (*refDataSetPtr2)->num;
@@ -338,7 +518,8 @@ int kpmMergeRefDataSet ( KpmRefDataSet **refDataSetPtr1, KpmRefDataSet **refData
     for( i = 0; i < num2; i++ ) {
         refPoint[num1+i] = (*refDataSetPtr2)->refPoint[i];
     }
-    if( (*refDataSetPtr1)->refPoint != NULL ) free((*refDataSetPtr1)->refPoint);
+    if ((*refDataSetPtr1)->fileMap) kpmFileMapClose((KpmFileMap **)&((*refDataSetPtr1)->fileMap));
+    else if( (*refDataSetPtr1)->refPoint != NULL ) free((*refDataSetPtr1)->refPoint);
     (*refDataSetPtr1)->refPoint = refPoint;
     (*refDataSetPtr1)->num      = num1 + num2;
     
@@ -415,6 +596,8 @@ int kpmMergeRefDataSet ( KpmRefDataSet **refDataSetPtr1, KpmRefDataSet **refData
     (*refDataSetPtr1)->pageInfo = pageInfo;
     (*refDataSetPtr1)->pageNum  = pageNum;
 
+    kpmRefIndexSetMerge(&((*refDataSetPtr1)->indexSet), &((*refDataSetPtr2)->indexSet));
+
     kpmDeleteRefDataSet(refDataSetPtr2);
 
     return 0;
@@ -428,19 +611,252 @@ int kpmDeleteRefDataSet( KpmRefDataSet **refDataSetPtr )
     }
     if (!*refDataSetPtr) return 0; // OK to call on already deleted handle.
 
-    if ((*refDataSetPtr)->refPoint) free((*refDataSetPtr)->refPoint);
+    if ((*refDataSetPtr)->fileMap) kpmFileMapClose((KpmFileMap **)&((*refDataSetPtr)->fileMap)); // refPoint points into the mapping.
+    else if ((*refDataSetPtr)->refPoint) free((*refDataSetPtr)->refPoint);
     
     for(int i = 0; i < (*refDataSetPtr)->pageNum; i++ ) {
         free( (*refDataSetPtr)->pageInfo[i].imageInfo );
     }
     free( (*refDataSetPtr)->pageInfo );
+    kpmRefIndexSetDelete(&((*refDataSetPtr)->indexSet));
     free( *refDataSetPtr );
     *refDataSetPtr = NULL;
 
     return 0;
 }
 
+KpmRefDataSetRef *kpmRefDataSetRefCreate( KpmRefDataSet *refDataSet )
+{
+    KpmRefDataSetRef *ref = new KpmRefDataSetRef;
+    ref->refDataSet = refDataSet;
+    ref->refCount = 1;
+    return (ref);
+}
+
+KpmRefDataSetRef *kpmRefDataSetRefRetain( KpmRefDataSetRef *ref )
+{
+    if (ref) ref->refCount++;
+    return (ref);
+}
+
+void kpmRefDataSetRefRelease( KpmRefDataSetRef **refPtr )
+{
+    if (!refPtr || !*refPtr) return;
+    if (--((*refPtr)->refCount) == 0) {
+        kpmDeleteRefDataSet(&((*refPtr)->refDataSet));
+        delete *refPtr;
+    }
+    *refPtr = NULL;
+}
+
+
+#if BINARY_FEATURE
+// Lay out the index and global index sections of a saved dataset, building any indices refDataSet
+// doesn't already hold.
+static void kpmRefDataSetGetIndexSections( const KpmRefDataSet *refDataSet, std::vector<unsigned char>& section, std::vector<unsigned char>& globalSection )
+{
+    std::vector<KpmRefDataSetIndex>         records;
+    std::vector<unsigned char>              data;
+    std::vector<vision::FeaturePoint>       points;
+    std::vector<vision::Point3d<float> >    points3D;
+    std::vector<unsigned char>              descriptors;
+    std::vector<uint64_t>                   imageHashes;
+    vision::VisualDatabaseFacade            freakMatcher;
+    KpmRefDataSetIndex                      record;
+    const KpmRefIndex                      *index;
+    int32_t                                 count[2];
+    int                                     featureNum = 0;
+    int                                     imageID = 0;
+    
+    // Every image goes into freakMatcher, in the order kpmSetRefDataSet adds them, for the global index.
+    for (int k = 0; k < refDataSet->pageNum; k++) {
+        for (int m = 0; m < refDataSet->pageInfo[k].imageNum; m++) {
+            kpmRefDataSetGetImage(refDataSet, k, m, points, points3D, descriptors);
+            if (points.empty()) continue;
+            
+            record.hash       = kpmRefIndexHash(descriptors);
+            record.featureNum = (int32_t)points.size();
+            record.reserved   = 0;
+            record.offset     = data.size();
+            index = kpmRefIndexSetFind((const KpmRefIndexSet *)refDataSet->indexSet, record.hash, record.featureNum);
+            freakMatcher.addFreakFeaturesAndDescriptors(points, descriptors, points3D,
+                                                        refDataSet->pageInfo[k].imageInfo[m].width,
+                                                        refDataSet->pageInfo[k].imageInfo[m].height, imageID,
+                                                        (index ? index->data : NULL), (index ? index->size : 0));
+            freakMatcher.saveIndex(imageID++, data);
+            record.size = data.size() - record.offset;
+            data.resize((data.size() + 7) & ~(size_t)7);
+            records.push_back(record);
+            imageHashes.push_back(record.hash);
+            featureNum += record.featureNum;
+        }
+    }
+    
+    count[0] = (int32_t)records.size();
+    count[1] = 0;
+    for (size_t i = 0; i < records.size(); i++) records[i].offset += sizeof(count) + sizeof(KpmRefDataSetIndex) * records.size();
+    section.resize(sizeof(count) + sizeof(KpmRefDataSetIndex) * records.size());
+    memcpy(&section[0], count, sizeof(count));
+    if (!records.empty()) memcpy(&section[sizeof(count)], &records[0], sizeof(KpmRefDataSetIndex) * records.size());
+    section.insert(section.end(), data.begin(), data.end());
+    
+    globalSection.clear();
+    if (featureNum == 0) return;
+    record.hash       = kpmRefGlobalIndexHash(imageHashes);
+    record.featureNum = featureNum;
+    record.reserved   = 0;
+    record.offset     = sizeof(record);
+    globalSection.resize(sizeof(record));
+    index = kpmRefIndexSetFindGlobal((const KpmRefIndexSet *)refDataSet->indexSet, record.hash, record.featureNum);
+    if (index) globalSection.insert(globalSection.end(), index->data, index->data + index->size);
+    else       freakMatcher.saveGlobalIndex(globalSection);
+    record.size = globalSection.size() - sizeof(record);
+    memcpy(&globalSection[0], &record, sizeof(record));
+}
+
+// Copy the indices out of the index section of a loaded dataset. Returns NULL if the section is invalid.
+static KpmRefIndexSet *kpmRefDataSetReadIndexSection( const unsigned char *section, uint64_t size )
+{
+    KpmRefIndexSet           *indexSet;
+    KpmRefDataSetIndex        record;
+    int32_t                   count[2];
+    
+    if (size < sizeof(count)) return (NULL);
+    memcpy(count, section, sizeof(count));
+    if (count[0] < 0 || (size - sizeof(count)) / sizeof(KpmRefDataSetIndex) < (uint64_t)count[0]) return (NULL);
+    
+    arMallocClear(indexSet, KpmRefIndexSet, 1);
+    arMallocClear(indexSet->index, KpmRefIndex, count[0] > 0 ? count[0] : 1);
+    for (int i = 0; i < count[0]; i++) {
+        memcpy(&record, section + sizeof(count) + sizeof(KpmRefDataSetIndex) * i, sizeof(record));
+        if (record.offset > size || record.size > size - record.offset || record.size == 0) {
+            void *p = indexSet;
+            kpmRefIndexSetDelete(&p);
+            return (NULL);
+        }
+        indexSet->index[i].hash       = record.hash;
+        indexSet->index[i].featureNum = record.featureNum;
+        indexSet->index[i].size       = (size_t)record.size;
+        arMalloc(indexSet->index[i].data, unsigned char, indexSet->index[i].size);
+        memcpy(indexSet->index[i].data, section + record.offset, indexSet->index[i].size);
+        indexSet->num = i + 1;
+    }
+    return (indexSet);
+}
+
+// Copy the index out of the global index section of a loaded dataset into indexSet. Returns false if the section is invalid.
+static bool kpmRefDataSetReadGlobalIndexSection( const unsigned char *section, uint64_t size, KpmRefIndexSet *indexSet )
+{
+    KpmRefDataSetIndex        record;
+    
+    if (size < sizeof(record)) return (false);
+    memcpy(&record, section, sizeof(record));
+    if (record.featureNum <= 0 || record.offset > size || record.size > size - record.offset || record.size == 0) return (false);
+    
+    indexSet->global.hash       = record.hash;
+    indexSet->global.featureNum = record.featureNum;
+    indexSet->global.size       = (size_t)record.size;
+    arMalloc(indexSet->global.data, unsigned char, indexSet->global.size);
+    memcpy(indexSet->global.data, section + record.offset, indexSet->global.size);
+    return (true);
+}
+#endif
+
+int kpmSaveRefDataSetV2( const char *filename, const char *ext, KpmRefDataSet  *refDataSet )
+{
+    FILE                *fp;
+    char                 fmode[] = "wb";
+    KpmRefDataSetHeader  header;
+    KpmRefDataSetPage    page;
+    static const char    zeros[KpmRefDataSetAlignment] = {0};
+#if BINARY_FEATURE
+    std::vector<unsigned char> indexSection;
+    std::vector<unsigned char> globalIndexSection;
+#endif
+    int                  i, j;
+
+    if (!filename || !refDataSet) {
+        ARLOGe("kpmSaveRefDataSetV2(): NULL filename/refDataSet.\n");
+        return (-1);
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, KPM_REF_DATA_SET_MAGIC, 4);
+    header.version         = KpmRefDataSetVersion;
+    header.byteOrder       = KPM_REF_DATA_SET_BYTE_ORDER;
+    header.refDataSize     = sizeof(KpmRefData);
+    header.binaryFeature   = BINARY_FEATURE;
+    header.num             = refDataSet->num;
+    header.pageNum         = refDataSet->pageNum;
+    header.imageInfoNum    = 0;
+    for( i = 0; i < refDataSet->pageNum; i++ ) header.imageInfoNum += refDataSet->pageInfo[i].imageNum;
+    header.refPointOffset  = kpmRefDataSetAlign(sizeof(header));
+    header.pageOffset      = kpmRefDataSetAlign(header.refPointOffset + (uint64_t)header.num * sizeof(KpmRefData));
+    header.imageInfoOffset = kpmRefDataSetAlign(header.pageOffset + (uint64_t)header.pageNum * sizeof(KpmRefDataSetPage));
+    header.fileSize        = header.imageInfoOffset + (uint64_t)header.imageInfoNum * sizeof(KpmImageInfo);
+#if BINARY_FEATURE
+    kpmRefDataSetGetIndexSections(refDataSet, indexSection, globalIndexSection);
+    header.indexOffset     = kpmRefDataSetAlign(header.fileSize);
+    header.indexSize       = indexSection.size();
+    header.fileSize        = header.indexOffset + header.indexSize;
+    if (!globalIndexSection.empty()) {
+        header.globalIndexOffset = kpmRefDataSetAlign(header.fileSize);
+        header.globalIndexSize   = globalIndexSection.size();
+        header.fileSize          = header.globalIndexOffset + header.globalIndexSize;
+    }
+#endif
+
+    fp = kpmFopen(filename, ext, fmode);
+    if( fp == NULL ) {
+        ARLOGe("Error saving KPM data: unable to open file '%s%s%s' for writing.\n", filename, (ext ? "." : ""), (ext ? ext : ""));
+        return -1;
+    }
+
+    if( fwrite(&header, sizeof(header), 1, fp) != 1 ) goto bailBadWrite;
+    
+    j = (int)(header.refPointOffset - sizeof(header));
+    if( fwrite(zeros, 1, j, fp) != j ) goto bailBadWrite;
+    if( fwrite(refDataSet->refPoint, sizeof(KpmRefData), refDataSet->num, fp) != refDataSet->num ) goto bailBadWrite;
+
+    j = (int)(header.pageOffset - header.refPointOffset - (uint64_t)header.num * sizeof(KpmRefData));
+    if( fwrite(zeros, 1, j, fp) != j ) goto bailBadWrite;
+    page.imageInfoIndex = 0;
+    page.reserved       = 0;
+    for( i = 0; i < refDataSet->pageNum; i++ ) {
+        page.pageNo   = refDataSet->pageInfo[i].pageNo;
+        page.imageNum = refDataSet->pageInfo[i].imageNum;
+        if( fwrite(&page, sizeof(page), 1, fp) != 1 ) goto bailBadWrite;
+        page.imageInfoIndex += page.imageNum;
+    }
+
+    j = (int)(header.imageInfoOffset - header.pageOffset - (uint64_t)header.pageNum * sizeof(KpmRefDataSetPage));
+    if( fwrite(zeros, 1, j, fp) != j ) goto bailBadWrite;
+    for( i = 0; i < refDataSet->pageNum; i++ ) {
+        j = refDataSet->pageInfo[i].imageNum;
+        if( fwrite(  refDataSet->pageInfo[i].imageInfo,  sizeof(KpmImageInfo), j, fp) != j ) goto bailBadWrite;
+    }
 
+#if BINARY_FEATURE
+    j = (int)(header.indexOffset - header.imageInfoOffset - (uint64_t)header.imageInfoNum * sizeof(KpmImageInfo));
+    if( fwrite(zeros, 1, j, fp) != j ) goto bailBadWrite;
+    if( fwrite(&indexSection[0], 1, indexSection.size(), fp) != indexSection.size() ) goto bailBadWrite;
+    if (header.globalIndexOffset != 0) {
+        j = (int)(header.globalIndexOffset - header.indexOffset - header.indexSize);
+        if( fwrite(zeros, 1, j, fp) != j ) goto bailBadWrite;
+        if( fwrite(&globalIndexSection[0], 1, globalIndexSection.size(), fp) != globalIndexSection.size() ) goto bailBadWrite;
+    }
+#endif
+
+    fclose(fp);
+    return 0;
+    
+bailBadWrite:
+    ARLOGe("Error saving KPM data: error writing data.\n");
+    fclose(fp);
+    return -1;
+}
+
+// Writes the version 1 format: fields one by one, no header.
 int kpmSaveRefDataSet( const char *filename, const char *ext, KpmRefDataSet  *refDataSet )
 {
     FILE   *fp;
@@ -490,11 +906,110 @@ bailBadWrite:
     return -1;
 }
 
+// Load the dataset which starts 'offset' bytes into the file and occupies at most 'maxSize' bytes
+// of it (0 for the rest of the file), using it in place.
+static int kpmLoadRefDataSetMapped( const char *filename, const char *ext, uint64_t offset, uint64_t maxSize, KpmRefDataSet **refDataSetPtr )
+{
+    KpmRefDataSet             *refDataSet;
+    KpmFileMap                *fileMap;
+    unsigned char             *data;
+    size_t                     size;
+    const KpmRefDataSetHeader *header;
+    const KpmRefDataSetPage   *page;
+    const KpmImageInfo        *imageInfo;
+#if BINARY_FEATURE
+    KpmRefIndexSet            *indexSet = NULL;
+#endif
+    int                        i, j;
+
+    fileMap = kpmFileMapOpen(filename, ext);
+    if (!fileMap) {
+        ARLOGe("Error loading KPM data: unable to map file '%s%s%s'.\n", filename, (ext ? "." : ""), (ext ? ext : ""));
+        return (-1);
+    }
+    data = (unsigned char *)kpmFileMapGetData(fileMap);
+    size = kpmFileMapGetSize(fileMap);
+    if (offset > size) goto bailBadFormat;
+    data += offset; // Sections are aligned relative to the start of the dataset.
+    size -= (size_t)offset;
+    if (maxSize && maxSize < size) size = (size_t)maxSize;
+    header = (const KpmRefDataSetHeader *)data;
+    
+    if (size < sizeof(KpmRefDataSetHeader) || memcmp(header->magic, KPM_REF_DATA_SET_MAGIC, 4) != 0) goto bailBadFormat;
+    if (header->version != KpmRefDataSetVersion) {
+        ARLOGe("Error loading KPM data: unsupported version %u.\n", header->version);
+        goto bail;
+    }
+    if (header->byteOrder != KPM_REF_DATA_SET_BYTE_ORDER || header->refDataSize != sizeof(KpmRefData) || header->binaryFeature != BINARY_FEATURE) {
+        ARLOGe("Error loading KPM data: dataset was written on an incompatible platform or with a different feature type.\n");
+        goto bail;
+    }
+    if (header->num <= 0 || header->pageNum <= 0 || header->imageInfoNum < 0 || header->fileSize > size) goto bailBadFormat;
+    if (header->refPointOffset % KpmRefDataSetAlignment != 0 || header->pageOffset % KpmRefDataSetAlignment != 0 || header->imageInfoOffset % KpmRefDataSetAlignment != 0) goto bailBadFormat;
+    if (header->refPointOffset + (uint64_t)header->num * sizeof(KpmRefData) > header->fileSize ||
+        header->pageOffset + (uint64_t)header->pageNum * sizeof(KpmRefDataSetPage) > header->fileSize ||
+        header->imageInfoOffset + (uint64_t)header->imageInfoNum * sizeof(KpmImageInfo) > header->fileSize) goto bailBadFormat;
+    
+    page      = (const KpmRefDataSetPage *)(data + header->pageOffset);
+    imageInfo = (const KpmImageInfo *)(data + header->imageInfoOffset);
+    for( i = 0; i < header->pageNum; i++ ) {
+        if (page[i].imageNum <= 0 || page[i].imageInfoIndex < 0 || page[i].imageInfoIndex > header->imageInfoNum - page[i].imageNum) goto bailBadFormat;
+    }
+
+#if BINARY_FEATURE
+    if (header->indexOffset != 0) {
+        if (header->indexOffset % KpmRefDataSetAlignment != 0 || header->indexOffset > header->fileSize || header->indexSize > header->fileSize - header->indexOffset) goto bailBadFormat;
+    }
+    if (header->globalIndexOffset != 0) {
+        if (header->globalIndexOffset % KpmRefDataSetAlignment != 0 || header->globalIndexOffset > header->fileSize || header->globalIndexSize > header->fileSize - header->globalIndexOffset) goto bailBadFormat;
+    }
+    if (header->indexOffset != 0) {
+        // A bad index section only costs rebuilding the indices, so don't fail the load.
+        indexSet = kpmRefDataSetReadIndexSection(data + header->indexOffset, header->indexSize);
+        if (!indexSet) ARLOGw("Ignoring invalid search indices in KPM data '%s%s%s'.\n", filename, (ext ? "." : ""), (ext ? ext : ""));
+    }
+    if (header->globalIndexOffset != 0) {
+        if (!indexSet) arMallocClear(indexSet, KpmRefIndexSet, 1);
+        if (!kpmRefDataSetReadGlobalIndexSection(data + header->globalIndexOffset, header->globalIndexSize, indexSet)) {
+            ARLOGw("Ignoring invalid global search index in KPM data '%s%s%s'.\n", filename, (ext ? "." : ""), (ext ? ext : ""));
+        }
+    }
+#endif
+
+    arMallocClear(refDataSet, KpmRefDataSet, 1);
+#if BINARY_FEATURE
+    refDataSet->indexSet = indexSet;
+#endif
+    refDataSet->refPoint = (KpmRefData *)(data + header->refPointOffset);
+    refDataSet->num      = header->num;
+    refDataSet->fileMap  = fileMap;
+    
+    // Page info is small and its records hold pointers, so it is copied out of the file.
+    refDataSet->pageNum  = header->pageNum;
+    arMalloc(refDataSet->pageInfo, KpmPageInfo, refDataSet->pageNum);
+    for( i = 0; i < refDataSet->pageNum; i++ ) {
+        refDataSet->pageInfo[i].pageNo   = page[i].pageNo;
+        refDataSet->pageInfo[i].imageNum = j = page[i].imageNum;
+        arMalloc(refDataSet->pageInfo[i].imageInfo, KpmImageInfo, j);
+        memcpy(refDataSet->pageInfo[i].imageInfo, imageInfo + page[i].imageInfoIndex, sizeof(KpmImageInfo) * j);
+    }
+
+    *refDataSetPtr = refDataSet;
+    return 0;
+
+bailBadFormat:
+    ARLOGe("Error loading KPM data: file '%s%s%s' is truncated or corrupt.\n", filename, (ext ? "." : ""), (ext ? ext : ""));
+bail:
+    kpmFileMapClose(&fileMap);
+    return (-1);
+}
+
 int kpmLoadRefDataSet( const char *filename, const char *ext, KpmRefDataSet **refDataSetPtr )
 {
     KpmRefDataSet  *refDataSet;
     FILE           *fp;
     char            fmode[] = "rb";
+    char            magic[4];
     int             i, j;
 
     if (!filename || !refDataSetPtr) {
@@ -507,6 +1022,13 @@ int kpmLoadRefDataSet( const char *filename, const char *ext, KpmRefDataSet **re
         ARLOGe("Error loading KPM data: unable to open file '%s%s%s' for reading.\n", filename, (ext ? "." : ""), (ext ? ext : ""));
         return (-1);
     }
+    
+    // Current format files are used in place. Otherwise fall through to reading version 1.
+    if (fread(magic, 1, 4, fp) == 4 && memcmp(magic, KPM_REF_DATA_SET_MAGIC, 4) == 0) {
+        fclose(fp);
+        return (kpmLoadRefDataSetMapped(filename, ext, 0, 0, refDataSetPtr));
+    }
+    rewind(fp);
 
     arMallocClear(refDataSet, KpmRefDataSet, 1);
     
@@ -557,6 +1079,19 @@ bailBadRead:
     return (-1);
 }
 
+int kpmLoadRefDataSetAt( const char *filename, const char *ext, uint64_t offset, uint64_t size, KpmRefDataSet **refDataSetPtr )
+{
+    if (!filename || !refDataSetPtr) {
+        ARLOGe("kpmLoadRefDataSetAt(): NULL filename/refDataSetPtr.\n");
+        return (-1);
+    }
+    if (offset % KpmRefDataSetAlignment != 0) {
+        ARLOGe("kpmLoadRefDataSetAt(): offset %llu is not a multiple of %d.\n", (unsigned long long)offset, KpmRefDataSetAlignment);
+        return (-1);
+    }
+    return (kpmLoadRefDataSetMapped(filename, ext, offset, size, refDataSetPtr));
+}
+
 int kpmLoadRefDataSetOld( const char *filename, const char *ext, KpmRefDataSet **refDataSetPtr )
 {
 #if !BINARY_FEATURE
@@ -644,6 +1179,7 @@ int kpmChangePageNoOfRefDataSet ( KpmRefDataSet *refDataSet, int oldPageNo, int
     }
 
     for(int i = 0; i < refDataSet->num; i++ ) {
+        if( refDataSet->refPoint[i].pageNo == newPageNo ) continue; // Don't dirty mapped pages needlessly.
         if( refDataSet->refPoint[i].pageNo == oldPageNo || (oldPageNo == KpmChangePageNoAllPages && refDataSet->refPoint[i].pageNo >= 0) ) {
             refDataSet->refPoint[i].pageNo = newPageNo;
         }
@@ -52,6 +52,9 @@
 
 #define PAGES_MAX 64
 
+typedef struct _TrackingInitPool TrackingInitPool;
+typedef struct _TrackingInitHint TrackingInitHint;
+
 class ARTrackerNFT : public ARTrackerVideo {
 public:
     ARTrackerNFT();
@@ -72,6 +75,15 @@ public:
     void setNFTMultiMode(bool on);
     bool NFTMultiMode() const;
     
+    /// Sets the number of threads used for KPM page detection. Values < 1 select a count based on the number of CPUs.
+    void setKPMThreadCount(int count);
+    /// Number of KPM threads requested, or running if NFT data is loaded.
+    int KPMThreadCount() const;
+    
+    /// Sets for how long, in seconds, after tracking of pages is lost KPM only looks for those pages, and only near where they were last tracked, before searching whole frames for all pages again. 0 disables this.
+    void setKPMRecoveryTimeout(float seconds);
+    float KPMRecoveryTimeout() const;
+    
     bool start(ARParamLT *paramLT, AR_PIXEL_FORMAT pixelFormat) override;
     bool start(ARParamLT *paramLT0, AR_PIXEL_FORMAT pixelFormat0, ARParamLT *paramLT1, AR_PIXEL_FORMAT pixelFormat1, const ARdouble transL2R[3][4]) override;
     bool isRunning() override;
@@ -87,15 +99,19 @@ private:
     bool m_videoSourceIsStereo;
     bool m_nftMultiMode;
     bool m_kpmRequired;
-    bool m_kpmBusy;
+    int m_kpmThreadCount;
+    float m_kpmRecoveryTimeout;
     // NFT data.
-    THREAD_HANDLE_T     *trackingThreadHandle;
+    TrackingInitPool    *trackingThreadHandle;
     AR2HandleT          *m_ar2Handle;
     KpmHandle           *m_kpmHandle;
     AR2SurfaceSetT      *m_surfaceSet[PAGES_MAX]; // Weak-reference. Strong reference is now in ARTrackableNFT class.
     ARdouble m_transL2R[3][4];          ///< For stereo tracking, transformation matrix from left camera to right camera.
+    float m_pageTrans[PAGES_MAX][3][4]; ///< Pose of each page when last tracked or detected.
+    double m_pageLostTime[PAGES_MAX];   ///< Time tracking of each page was lost, or <0 if tracked or not lost recently.
 
     bool unloadNFTData();
+    bool getKPMHint(TrackingInitHint *hint, double now);
     bool loadNFTData(std::vector<ARTrackable *>& trackables);
 };
 
@@ -49,96 +49,201 @@ typedef struct {
     KpmHandle              *kpmHandle;      // KPM-related data.
     ARUint8                *imageLumaPtr;   // Pointer to image being tracked.
     int                     imageSize;      // Bytes per image.
+    TrackingInitHint        hint;           // Where to search the image.
     float                   trans[3][4];    // Transform containing pose of tracked image.
     int                     page;           // Assigned page number of tracked image.
     int                     flag;           // Tracked successfully.
 } TrackingInitHandle;
 
+struct _TrackingInitPool {
+    int                     threadNum;
+    int                     matchingThreadNum;              // The first worker's own kpmSetMatchingThreadNum() setting, restored on quit.
+    THREAD_HANDLE_T        *threadHandle[TRACKING_INIT_THREAD_MAX];
+    int                     busy[TRACKING_INIT_THREAD_MAX];
+    unsigned long           seq[TRACKING_INIT_THREAD_MAX];  // Sequence number of the frame each worker was given.
+    unsigned long           seqNext;                        // Sequence number of the next frame submitted.
+    unsigned long           seqValid;                       // Results from frames before this are stale.
+};
+
 static void *trackingInitMain( THREAD_HANDLE_T *threadHandle );
 
 
-int trackingInitQuit( THREAD_HANDLE_T **threadHandle_p )
+static void trackingInitFreeWorker( THREAD_HANDLE_T **threadHandle_p, int ownsKpmHandle )
 {
     TrackingInitHandle  *trackingInitHandle;
-
-    if (!threadHandle_p)  {
-        ARLOGe("trackingInitQuit(): Error: NULL threadHandle_p.\n");
-        return (-1);
-    }
-    if (!*threadHandle_p) return 0;
     
     threadWaitQuit( *threadHandle_p );
     trackingInitHandle = (TrackingInitHandle *)threadGetArg(*threadHandle_p);
     if (trackingInitHandle) {
+        if (ownsKpmHandle) kpmDeleteHandle( &trackingInitHandle->kpmHandle );
         free( trackingInitHandle->imageLumaPtr );
         free( trackingInitHandle );
     }
     threadFree( threadHandle_p );
+}
+
+int trackingInitQuit( TrackingInitPool **pool_p )
+{
+    int                  i;
+
+    if (!pool_p)  {
+        ARLOGe("trackingInitQuit(): Error: NULL pool_p.\n");
+        return (-1);
+    }
+    if (!*pool_p) return 0;
+    
+    kpmSetMatchingThreadNum( ((TrackingInitHandle *)threadGetArg((*pool_p)->threadHandle[0]))->kpmHandle, (*pool_p)->matchingThreadNum );
+    for (i = 0; i < (*pool_p)->threadNum; i++) {
+        trackingInitFreeWorker( &((*pool_p)->threadHandle[i]), i > 0 );
+    }
+    free( *pool_p );
+    *pool_p = NULL;
     return 0;
 }
 
-THREAD_HANDLE_T *trackingInitInit( KpmHandle *kpmHandle )
+TrackingInitPool *trackingInitInit( KpmHandle *kpmHandle, int threadNum )
 {
+    TrackingInitPool    *pool;
     TrackingInitHandle  *trackingInitHandle;
-    THREAD_HANDLE_T     *threadHandle;
+    KpmHandle           *workerKpmHandle;
+    int                  matchingThreadNum;
+    int                  i;
 
     if (!kpmHandle) {
         ARLOGe("trackingInitInit(): Error: NULL KpmHandle.\n");
         return (NULL);
     }
     
-    trackingInitHandle = (TrackingInitHandle *)malloc(sizeof(TrackingInitHandle));
-    if( trackingInitHandle == NULL ) return NULL;
-    trackingInitHandle->kpmHandle = kpmHandle;
-    trackingInitHandle->imageSize = kpmHandleGetXSize(kpmHandle) * kpmHandleGetYSize(kpmHandle);
-    trackingInitHandle->imageLumaPtr  = (ARUint8 *)malloc(trackingInitHandle->imageSize);
-    trackingInitHandle->flag      = 0;
-
-    threadHandle = threadInit(0, trackingInitHandle, trackingInitMain);
-    return threadHandle;
+    if (threadNum < 1) {
+        // Leave at least half the CPUs for video capture, AR2 tracking and rendering.
+        threadNum = threadGetCPU() / 2;
+        if (threadNum < 1) threadNum = 1;
+    }
+    if (threadNum > TRACKING_INIT_THREAD_MAX) threadNum = TRACKING_INIT_THREAD_MAX;
+    
+    pool = (TrackingInitPool *)calloc(1, sizeof(TrackingInitPool));
+    if( pool == NULL ) return NULL;
+    
+    // Divide the CPUs between the workers rather than giving each a matching thread per CPU.
+    // Set before the other workers' handles are created, as they take their setting from kpmHandle.
+    kpmGetMatchingThreadNum(kpmHandle, &pool->matchingThreadNum);
+    if (pool->matchingThreadNum == KpmMatchingThreadNumAuto && threadNum > 1) {
+        matchingThreadNum = threadGetCPU() / threadNum;
+        if (matchingThreadNum < 1) matchingThreadNum = 1;
+        kpmSetMatchingThreadNum(kpmHandle, matchingThreadNum);
+    }
+    
+    for (i = 0; i < threadNum; i++) {
+        if (i == 0) workerKpmHandle = kpmHandle;
+        else if (!(workerKpmHandle = kpmCreateHandleShared(kpmHandle))) {
+            ARLOGe("trackingInitInit(): Unable to create KPM handle for worker %d.\n", i);
+            break;
+        }
+        trackingInitHandle = (TrackingInitHandle *)malloc(sizeof(TrackingInitHandle));
+        if( trackingInitHandle == NULL ) {
+            if (i > 0) kpmDeleteHandle(&workerKpmHandle);
+            break;
+        }
+        trackingInitHandle->kpmHandle = workerKpmHandle;
+        trackingInitHandle->imageSize = kpmHandleGetXSize(kpmHandle) * kpmHandleGetYSize(kpmHandle);
+        trackingInitHandle->imageLumaPtr  = (ARUint8 *)malloc(trackingInitHandle->imageSize);
+        trackingInitHandle->flag      = 0;
+        trackingInitHandle->hint.region[2] = 0;
+        trackingInitHandle->hint.pageNum   = 0;
+
+        pool->threadHandle[i] = threadInit(i, trackingInitHandle, trackingInitMain);
+        if (!pool->threadHandle[i]) {
+            if (i > 0) kpmDeleteHandle(&workerKpmHandle);
+            free(trackingInitHandle->imageLumaPtr);
+            free(trackingInitHandle);
+            break;
+        }
+        pool->threadNum = i + 1;
+    }
+    if (pool->threadNum == 0) {
+        kpmSetMatchingThreadNum(kpmHandle, pool->matchingThreadNum);
+        free(pool);
+        return (NULL);
+    }
+    ARLOGi("Started %d KPM tracking thread(s).\n", pool->threadNum);
+    
+    return pool;
 }
 
-int trackingInitStart( THREAD_HANDLE_T *threadHandle, ARUint8 *imageLumaPtr )
+int trackingInitGetThreadNum( TrackingInitPool *pool )
+{
+    if (!pool) return 0;
+    return pool->threadNum;
+}
+
+int trackingInitStart( TrackingInitPool *pool, ARUint8 *imageLumaPtr, const TrackingInitHint *hint )
 {
     TrackingInitHandle     *trackingInitHandle;
+    int                     i;
 
-    if (!threadHandle || !imageLumaPtr) {
-        ARLOGe("trackingInitStart(): Error: NULL threadHandle or imagePtr.\n");
+    if (!pool || !imageLumaPtr) {
+        ARLOGe("trackingInitStart(): Error: NULL pool or imagePtr.\n");
         return (-1);
     }
     
-    trackingInitHandle = (TrackingInitHandle *)threadGetArg(threadHandle);
+    for (i = 0; i < pool->threadNum; i++) {
+        if (!pool->busy[i]) break;
+    }
+    if (i == pool->threadNum) return 1;
+    
+    trackingInitHandle = (TrackingInitHandle *)threadGetArg(pool->threadHandle[i]);
     if (!trackingInitHandle) {
         ARLOGe("trackingInitStart(): Error: NULL trackingInitHandle.\n");
         return (-1);
     }
     memcpy( trackingInitHandle->imageLumaPtr, imageLumaPtr, trackingInitHandle->imageSize );
-    threadStartSignal( threadHandle );
+    if (hint) {
+        trackingInitHandle->hint = *hint;
+        if (trackingInitHandle->hint.pageNum > TRACKING_INIT_HINT_PAGE_MAX) trackingInitHandle->hint.pageNum = TRACKING_INIT_HINT_PAGE_MAX;
+    } else {
+        trackingInitHandle->hint.region[2] = 0;
+        trackingInitHandle->hint.pageNum = 0;
+    }
+    pool->busy[i] = 1;
+    pool->seq[i] = pool->seqNext++;
+    threadStartSignal( pool->threadHandle[i] );
 
     return 0;
 }
 
-int trackingInitGetResult( THREAD_HANDLE_T *threadHandle, float trans[3][4], int *page )
+int trackingInitGetResult( TrackingInitPool *pool, float trans[3][4], int *page )
 {
     TrackingInitHandle     *trackingInitHandle;
-    int  i, j;
+    TrackingInitHandle     *best = NULL;
+    unsigned long           bestSeq = 0;
+    int                     finished = 0;
+    int  i, j, k;
 
-    if (!threadHandle || !trans || !page)  {
-        ARLOGe("trackingInitGetResult(): Error: NULL threadHandle or trans or page.\n");
+    if (!pool || !trans || !page)  {
+        ARLOGe("trackingInitGetResult(): Error: NULL pool or trans or page.\n");
         return (-1);
     }
     
-    if( threadGetStatus( threadHandle ) == 0 ) return 0;
-    threadEndWait( threadHandle );
-    trackingInitHandle = (TrackingInitHandle *)threadGetArg(threadHandle);
-    if (!trackingInitHandle) return (-1);
-    if( trackingInitHandle->flag ) {
-        for (j = 0; j < 3; j++) for (i = 0; i < 4; i++) trans[j][i] = trackingInitHandle->trans[j][i];
-        *page = trackingInitHandle->page;
-        return 1;
+    for (k = 0; k < pool->threadNum; k++) {
+        if (!pool->busy[k] || threadGetStatus( pool->threadHandle[k] ) == 0) continue;
+        threadEndWait( pool->threadHandle[k] );
+        pool->busy[k] = 0;
+        finished = 1;
+        trackingInitHandle = (TrackingInitHandle *)threadGetArg(pool->threadHandle[k]);
+        if (!trackingInitHandle || !trackingInitHandle->flag || pool->seq[k] < pool->seqValid) continue;
+        if (!best || pool->seq[k] > bestSeq) {
+            best = trackingInitHandle;
+            bestSeq = pool->seq[k];
+        }
     }
-
-    return -1;
+    if (!finished) return 0;
+    if (!best) return -1;
+    
+    for (j = 0; j < 3; j++) for (i = 0; i < 4; i++) trans[j][i] = best->trans[j][i];
+    *page = best->page;
+    // Frames still in flight are older than the one the caller is about to track from.
+    pool->seqValid = pool->seqNext;
+    return 1;
 }
 
 static void *trackingInitMain( THREAD_HANDLE_T *threadHandle )
@@ -166,13 +271,22 @@ static void *trackingInitMain( THREAD_HANDLE_T *threadHandle )
         ARLOGe("Error starting tracking thread: empty kpmHandle/imageLumaPtr.\n");
         return (NULL);
     }
-    ARLOGi("Start tracking thread.\n");
+    ARLOGi("Start tracking thread %d.\n", threadGetID(threadHandle));
     
     kpmGetResult( kpmHandle, &kpmResult, &kpmResultNum );
 
     for(;;) {
         if( threadStartWait(threadHandle) < 0 ) break;
 
+        if (trackingInitHandle->hint.pageNum > 0) {
+            kpmSetMatchingPages(kpmHandle, trackingInitHandle->hint.pages, trackingInitHandle->hint.pageNum);
+        }
+#if BINARY_FEATURE
+        if (trackingInitHandle->hint.region[2] > 0) {
+            kpmSetMatchingRegion(kpmHandle, trackingInitHandle->hint.region[0], trackingInitHandle->hint.region[1],
+                                 trackingInitHandle->hint.region[2], trackingInitHandle->hint.region[3]);
+        }
+#endif
         kpmMatching(kpmHandle, imageLumaPtr);
         trackingInitHandle->flag = 0;
         for( i = 0; i < kpmResultNum; i++ ) {
@@ -189,7 +303,7 @@ static void *trackingInitMain( THREAD_HANDLE_T *threadHandle )
         threadEndSignal(threadHandle);
     }
 
-    ARLOGi("End tracking thread.\n");
+    ARLOGi("End tracking thread %d.\n", threadGetID(threadHandle));
     return (NULL);
 }
 
@@ -49,10 +49,37 @@
 extern "C" {
 #endif
 
-THREAD_HANDLE_T *trackingInitInit( KpmHandle *kpmHandle );
-int trackingInitStart( THREAD_HANDLE_T *threadHandle, ARUint8 *imagePtrLuma );
-int trackingInitGetResult( THREAD_HANDLE_T *threadHandle, float trans[3][4], int *page );
-int trackingInitQuit( THREAD_HANDLE_T **threadHandle_p );
+// Maximum number of KPM worker threads in a tracking init pool.
+#define TRACKING_INIT_THREAD_MAX     4
+// Pass as threadNum to trackingInitInit() to size the pool from the number of CPUs.
+#define TRACKING_INIT_THREAD_AUTO   -1
+
+// Maximum number of pages in a TrackingInitHint.
+#define TRACKING_INIT_HINT_PAGE_MAX 64
+
+typedef struct _TrackingInitPool TrackingInitPool;
+
+// Where to look for pages in a frame, e.g. near where tracking of them was lost.
+typedef struct _TrackingInitHint {
+    int                     region[4];      // x, y, width, height of the part of the frame to search, or width 0 for all of it.
+    int                     pages[TRACKING_INIT_HINT_PAGE_MAX]; // Pages to look for, most likely first.
+    int                     pageNum;        // 0 to look for all pages.
+} TrackingInitHint;
+
+// Creates a pool of threadNum KPM worker threads. The first worker matches with kpmHandle,
+// the others with handles created by kpmCreateHandleShared(kpmHandle), so the reference
+// data set must already be loaded, and kpmHandle must outlive the pool. If kpmHandle's matching
+// thread count is KpmMatchingThreadNumAuto, each worker is given an equal share of the CPUs instead.
+TrackingInitPool *trackingInitInit( KpmHandle *kpmHandle, int threadNum );
+// Hands a copy of the frame to an idle worker, which searches it as hinted, or fully if hint is NULL.
+// Returns 0 if started, 1 if all workers are busy, or -1 on error.
+int trackingInitStart( TrackingInitPool *pool, ARUint8 *imagePtrLuma, const TrackingInitHint *hint );
+// Collects finished workers. Returns 1 and the pose from the most recently submitted frame
+// that was matched, -1 if workers finished but none matched, or 0 if none have finished.
+// Once a result has been returned, results from frames submitted before it are discarded.
+int trackingInitGetResult( TrackingInitPool *pool, float trans[3][4], int *page );
+int trackingInitGetThreadNum( TrackingInitPool *pool );
+int trackingInitQuit( TrackingInitPool **pool_p );
 
 #ifdef __cplusplus
 }
@@ -45,22 +45,30 @@
 #  define truncf(x) floorf(x) // These are the same for positive numbers.
 #endif
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <ARX/AR/ar.h>
 #include <ARX/AR2/config.h>
 #include <ARX/AR2/imageFormat.h>
 #include <ARX/AR2/imageSet.h>
 #include <ARX/AR2/featureSet.h>
 #include <ARX/AR2/util.h>
+#include <ARX/AR2/bundle.h>
 #include <ARX/KPM/kpm.h>
+#include <ARX/ARUtil/file_utils.h>
+#include <ARX/ARUtil/thread_sub.h>
 #ifdef _WIN32
 #  define MAXPATHLEN MAX_PATH
 #else
 #  include <sys/param.h> // MAXPATHLEN
+#  include <unistd.h> // getpid()
 #endif
 #if defined(__APPLE__) || defined(__linux__)
 #  define HAVE_DAEMON_FUNC 1
+#  define HAVE_FORK_FUNC 1
 #  include <unistd.h>
+#  include <sys/wait.h> // wait()
 #endif
 #include <time.h> // time(), localtime(), strftime()
 
@@ -72,6 +80,9 @@
 #define          TRACKING_EXTRACTION_LEVEL_DEFAULT 2
 #define          INITIALIZATION_EXTRACTION_LEVEL_DEFAULT 1
 #define KPM_MINIMUM_IMAGE_SIZE 28 // Filter size for 1 octaves plus 1.
+#define CACHE_VERSION 1 // Increment when generated data changes for the same image and parameters.
+#define CACHE_DIR_DEFAULT "genTexDataCache"
+#define CACHE_EXT_NUM 4
 //#define KPM_MINIMUM_IMAGE_SIZE 196 // Filter size for 4 octaves plus 1.
 
 #ifndef MIN
@@ -91,6 +102,8 @@ enum {
 
 static int                  genfset = 1;
 static int                  genfset3 = 1;
+static int                  fset3v2 = 0;   // Write .fset3 in the version 2 format.
+static int                  genBundle = 0;
 
 static char                 filename[MAXPATHLEN] = "";
 static AR2JpegImageT       *jpegImage;
@@ -112,6 +125,14 @@ static int                  occ_size = -1;
 static int                  tracking_extraction_level = -1; // Allows specification from command-line.
 static int                  initialization_extraction_level = -1;
 
+static int                  batch = 0;
+static char                 batchfile[MAXPATHLEN] = "";
+static int                  batchIndex = 0;
+static int                  jobs = -1;
+static int                  featureMapThreadNum = AR2_GEN_FEATURE_MAP_DEFAULT_THREAD_NUM;
+static char                 cacheDir[MAXPATHLEN] = "";
+static const char          *cacheExt[CACHE_EXT_NUM] = {"iset", "fset", "fset3", AR2_BUNDLE_EXT};
+
 static int                  background = 0;
 static char                 logfile[MAXPATHLEN] = "";
 static char                 exitcodefile[MAXPATHLEN] = "";
@@ -120,26 +141,21 @@ static char                 exitcode = -1;
 
 
 static void  usage( char *com );
+static int   isJPEGFilename(const char *path);
+static int   genTexData( void );
+static int   genTexDataBatch( void );
+static uint64_t hashInputs(const ARUint8 *image);
+static int   readCache(const char *cacheBase, const char *outBase);
+static int   writeCache(const char *cacheBase, const char *outBase);
 static int   readImageFromFile(const char *filename, ARUint8 **image_p, int *xsize_p, int *ysize_p, int *nc_p, float *dpi_p);
 static int   setDPI( void );
 static void  write_exitcode(void);
 
 int main( int argc, char *argv[] )
 {
-    AR2JpegImageT       *jpegImage = NULL;
-    ARUint8             *image = NULL;
-    AR2ImageSetT        *imageSet = NULL;
-    AR2FeatureMapT      *featureMap = NULL;
-    AR2FeatureSetT      *featureSet = NULL;
-    KpmRefDataSet       *refDataSet = NULL;
-    float                scale1, scale2;
-    int                  procMode;
     char                 buf[1024];
-    int                  num;
-    int                  i, j;
-    char                *sep = NULL;
+    int                  i;
 	time_t				 clock;
-    int                  maxFeatureNum;
     int                  err;
 
     for( i = 1; i < argc; i++ ) {
@@ -161,6 +177,15 @@ int main( int argc, char *argv[] )
             if( sscanf(&argv[i][9], "%f", &dpiMax) != 1 ) usage(argv[0]);
         } else if( strncmp(argv[i], "-min_dpi=", 9) == 0 ) {
             if( sscanf(&argv[i][9], "%f", &dpiMin) != 1 ) usage(argv[0]);
+        } else if( strncmp(argv[i], "-batch=", 7) == 0 ) {
+            strncpy(batchfile, &(argv[i][7]), sizeof(batchfile) - 1);
+            batchfile[sizeof(batchfile) - 1] = '\0'; // Ensure NULL termination.
+            batch = 1;
+        } else if( strncmp(argv[i], "-jobs=", 6) == 0 ) {
+            if( sscanf(&argv[i][6], "%d", &jobs) != 1 || jobs < 1 ) usage(argv[0]);
+        } else if( strncmp(argv[i], "-cache=", 7) == 0 ) {
+            strncpy(cacheDir, &(argv[i][7]), sizeof(cacheDir) - 1);
+            cacheDir[sizeof(cacheDir) - 1] = '\0'; // Ensure NULL termination.
         } else if( strcmp(argv[i], "-background") == 0 ) {
             background = 1;
         } else if( strcmp(argv[i], "-nofset") == 0 ) {
@@ -177,6 +202,11 @@ int main( int argc, char *argv[] )
             genfset3 = 0;
         } else if( strcmp(argv[i], "-fset3") == 0 ) {
             genfset3 = 1;
+        } else if( strcmp(argv[i], "-fset3v2") == 0 ) {
+            genfset3 = 1;
+            fset3v2 = 1;
+        } else if( strcmp(argv[i], "-bundle") == 0 ) {
+            genBundle = 1;
         } else if( strncmp(argv[i], "-log=", 5) == 0 ) {
             strncpy(logfile, &(argv[i][5]), sizeof(logfile) - 1);
             logfile[sizeof(logfile) - 1] = '\0'; // Ensure NULL termination.
@@ -204,18 +234,39 @@ int main( int argc, char *argv[] )
     }
     
     // Do some checks on the input.
-    if (filename[0] == '\0') {
-        ARPRINTE("Error: no input file specified. Exiting.\n");
+    if (genBundle && (!genfset || !genfset3)) {
+        ARPRINTE("Error: -bundle requires the .fset and .fset3 data to be generated. Exiting.\n");
         usage(argv[0]);
     }
-    sep = strrchr(filename, '.');
-    if (!sep || (strcmp(sep, ".jpeg") && strcmp(sep, ".jpg") && strcmp(sep, ".jpe") && strcmp(sep, ".JPEG") && strcmp(sep, ".JPE") && strcmp(sep, ".JPG"))) {
-        ARPRINTE("Error: input file must be a JPEG image (with suffix .jpeg/.jpg/.jpe). Exiting.\n");
-        usage(argv[0]);
+    if (genBundle) fset3v2 = 1; // Bundles embed the .fset3 data, which must be in the version 2 format.
+    if (batch) {
+        if (filename[0] != '\0') {
+            ARPRINTE("Error: -batch cannot be combined with an input file. Exiting.\n");
+            usage(argv[0]);
+        }
+        // There is no one to ask, so unset extraction levels take their defaults.
+        if (tracking_extraction_level == -1) tracking_extraction_level = TRACKING_EXTRACTION_LEVEL_DEFAULT;
+        if (initialization_extraction_level == -1 && featureDensity == -1) initialization_extraction_level = INITIALIZATION_EXTRACTION_LEVEL_DEFAULT;
+        if (cacheDir[0] == '\0') {
+            strncpy(cacheDir, batchfile, sizeof(cacheDir) - 1);
+            cacheDir[sizeof(cacheDir) - 1] = '\0';
+            for (i = (int)strlen(cacheDir); i > 0 && cacheDir[i - 1] != '/' && cacheDir[i - 1] != '\\'; i--);
+            cacheDir[i] = '\0';
+            strncat(cacheDir, CACHE_DIR_DEFAULT, sizeof(cacheDir) - strlen(cacheDir) - 1);
+        }
+    } else {
+        if (filename[0] == '\0') {
+            ARPRINTE("Error: no input file specified. Exiting.\n");
+            usage(argv[0]);
+        }
+        if (!isJPEGFilename(filename)) {
+            ARPRINTE("Error: input file must be a JPEG image (with suffix .jpeg/.jpg/.jpe). Exiting.\n");
+            usage(argv[0]);
+        }
     }
     if (background) {
 #if HAVE_DAEMON_FUNC
-        if (filename[0] != '/' || logfile[0] != '/' || exitcodefile[0] != '/') {
+        if ((batch ? batchfile[0] : filename[0]) != '/' || logfile[0] != '/' || exitcodefile[0] != '/') {
             ARPRINTE("Error: -background flag requires full pathname of files (input, -log or -exitcode) to be specified. Exiting.\n");
             EXIT(E_BAD_PARAMETER);
         }
@@ -349,6 +400,47 @@ int main( int argc, char *argv[] )
         ARPRINT("SURF_FEATURE = %d\n", featureDensity);
     }
 
+    if (cacheDir[0] && mkdir_p(cacheDir) < 0) {
+        ARPRINTE("Error: unable to create cache directory '%s'.\n", cacheDir);
+        EXIT(E_BAD_PARAMETER);
+    }
+
+    if (batch) err = genTexDataBatch();
+    else       err = genTexData();
+
+    // Print the start date and time.
+    clock = time(NULL);
+    if (clock != (time_t)-1) {
+        struct tm *timeptr = localtime(&clock);
+        if (timeptr) {
+            char stime[26+8] = "";
+            if (strftime(stime, sizeof(stime), "%Y-%m-%d %H:%M:%S %z", timeptr)) // e.g. "1999-12-31 23:59:59 NZDT".
+                ARPRINT("Generator finished at %s\n--\n", stime);
+        }
+    }
+
+    exitcode = err;
+    return (exitcode);
+}
+
+// Generates the data set for the image 'filename'. With a cache directory set, data generated
+// before from the same pixels and parameters is copied from the cache instead.
+static int genTexData( void )
+{
+    ARUint8             *image = NULL;
+    AR2ImageSetT        *imageSet = NULL;
+    AR2FeatureMapT      *featureMap = NULL;
+    AR2FeatureSetT      *featureSet = NULL;
+    KpmRefDataSet       *refDataSet = NULL;
+    float                scale1, scale2;
+    int                  procMode;
+    int                  num;
+    int                  i, j;
+    int                  maxFeatureNum;
+    int                  err;
+    char                 cacheBase[MAXPATHLEN];
+    char                 outBase[MAXPATHLEN];
+
     if ((err = readImageFromFile(filename, &image, &xsize, &ysize, &nc, &dpi)) != 0) {
         ARPRINTE("Error reading image from file '%s'.\n", filename);
         EXIT(err);
@@ -356,6 +448,25 @@ int main( int argc, char *argv[] )
 
     setDPI();
 
+    if (cacheDir[0]) {
+        if (snprintf(cacheBase, sizeof(cacheBase), "%s/%016llx", cacheDir, (unsigned long long)hashInputs(image)) >= (int)sizeof(cacheBase)) {
+            ARPRINTE("Error: cache path too long.\n");
+            EXIT(E_INPUT_DATA_ERROR);
+        }
+        strncpy(outBase, filename, sizeof(outBase) - 1);
+        outBase[sizeof(outBase) - 1] = '\0';
+        ar2UtilRemoveExt( outBase );
+        if ((err = readCache(cacheBase, outBase)) == 0) {
+            ARPRINT("%s: unchanged, copied from cache %s.\n", filename, cacheBase);
+            ar2FreeJpegImage(&jpegImage);
+            free(dpi_list);
+            dpi_list = NULL;
+            return (E_NO_ERROR);
+        } else if (err == -2) {
+            EXIT(E_INPUT_DATA_ERROR);
+        }
+    }
+
     ARPRINT("Generating ImageSet...\n");
     ARPRINT("   (Source image xsize=%d, ysize=%d, channels=%d, dpi=%.1f).\n", xsize, ysize, nc, dpi);
     imageSet = ar2GenImageSet( image, xsize, ysize, nc, dpi, dpi_list, dpi_num );
@@ -382,10 +493,10 @@ int main( int argc, char *argv[] )
         for( i = 0; i < imageSet->num; i++ ) {
             ARPRINT("Start for %f dpi image.\n", imageSet->scale[i]->dpi);
             
-            featureMap = ar2GenFeatureMap( imageSet->scale[i],
+            featureMap = ar2GenFeatureMap2( imageSet->scale[i],
                                           AR2_DEFAULT_TS1*AR2_TEMP_SCALE, AR2_DEFAULT_TS2*AR2_TEMP_SCALE,
                                           AR2_DEFAULT_GEN_FEATURE_MAP_SEARCH_SIZE1, AR2_DEFAULT_GEN_FEATURE_MAP_SEARCH_SIZE2,
-                                          AR2_DEFAULT_MAX_SIM_THRESH2, AR2_DEFAULT_SD_THRESH2 );
+                                          AR2_DEFAULT_MAX_SIM_THRESH2, AR2_DEFAULT_SD_THRESH2, featureMapThreadNum );
             if( featureMap == NULL ) {
                 ARPRINTE("Error!!\n");
                 EXIT(E_DATA_PROCESSING_ERROR);
@@ -448,7 +559,6 @@ int main( int argc, char *argv[] )
             EXIT(E_DATA_PROCESSING_ERROR);
         }
         ARPRINT("  Done.\n");
-        ar2FreeFeatureSet( &featureSet );
     }
     
     if (genfset3) {
@@ -476,32 +586,277 @@ int main( int argc, char *argv[] )
         }
         ARPRINT("  Done.\n");
         ARPRINT("Saving FeatureSet3...\n");
-        if( kpmSaveRefDataSet(filename, "fset3", refDataSet) != 0 ) {
+        if( (fset3v2 ? kpmSaveRefDataSetV2(filename, "fset3", refDataSet) : kpmSaveRefDataSet(filename, "fset3", refDataSet)) != 0 ) {
             ARPRINTE("Save error: %s.fset2\n", filename );
             EXIT(E_DATA_PROCESSING_ERROR);
         }
         ARPRINT("  Done.\n");
         kpmDeleteRefDataSet( &refDataSet );
     }
-    
+
+    if (genBundle) {
+        char   *kpmData;
+        size_t  kpmDataSize;
+        char    kpmPath[MAXPATHLEN];
+
+        ARPRINT("Saving NFT bundle...\n");
+        if (snprintf(kpmPath, sizeof(kpmPath), "%s.fset3", filename) >= (int)sizeof(kpmPath)) {
+            ARPRINTE("Error: path too long: %s.fset3\n", filename);
+            EXIT(E_INPUT_DATA_ERROR);
+        }
+        if (!(kpmData = cat(kpmPath, &kpmDataSize))) {
+            ARPRINTE("Error reading %s.\n", kpmPath);
+            EXIT(E_DATA_PROCESSING_ERROR);
+        }
+        if (ar2WriteBundle(filename, AR2_BUNDLE_EXT, imageSet, featureSet, kpmData, kpmDataSize) < 0) {
+            ARPRINTE("Save error: %s.%s\n", filename, AR2_BUNDLE_EXT);
+            EXIT(E_DATA_PROCESSING_ERROR);
+        }
+        free(kpmData);
+        ARPRINT("  Done.\n");
+    }
+
+    ar2FreeFeatureSet( &featureSet );
     ar2FreeImageSet( &imageSet );
 
-    // Print the start date and time.
-    clock = time(NULL);
-    if (clock != (time_t)-1) {
-        struct tm *timeptr = localtime(&clock);
-        if (timeptr) {
-            char stime[26+8] = "";
-            if (strftime(stime, sizeof(stime), "%Y-%m-%d %H:%M:%S %z", timeptr)) // e.g. "1999-12-31 23:59:59 NZDT".
-                ARPRINT("Generator finished at %s\n--\n", stime);
+    if (cacheDir[0] && writeCache(cacheBase, filename) < 0) EXIT(E_INPUT_DATA_ERROR);
+    free(dpi_list);
+    dpi_list = NULL;
+
+    return (E_NO_ERROR);
+}
+
+// Generates the data sets for the images listed in 'batchfile', up to 'jobs' at a time, each
+// in its own process. Returns E_NO_ERROR if all succeeded.
+static int genTexDataBatch( void )
+{
+    char                *manifest;
+    char                *line, *next, *end;
+    char               **entries;
+    char                 dir[MAXPATHLEN];
+    int                  entryNum, entryMax;
+    int                  failed, invalid;
+    int                  i;
+#if HAVE_FORK_FUNC
+    pid_t               *pids;
+    pid_t                pid;
+    int                  running;
+    int                  status;
+    int                  k;
+#else
+    float                dpiArg = dpi, dpiMinArg = dpiMin, dpiMaxArg = dpiMax;
+#endif
+
+    manifest = cat(batchfile, NULL);
+    if (!manifest) {
+        ARPRINTE("Error: unable to read batch file '%s'.\n", batchfile);
+        return (E_INPUT_DATA_ERROR);
+    }
+
+    // Relative paths in the batch file are relative to the batch file.
+    strncpy(dir, batchfile, sizeof(dir) - 1);
+    dir[sizeof(dir) - 1] = '\0';
+    for (i = (int)strlen(dir); i > 0 && dir[i - 1] != '/' && dir[i - 1] != '\\'; i--);
+    dir[i] = '\0';
+
+    entryMax = 1;
+    for (line = manifest; *line; line++) if (*line == '\n') entryMax++;
+    arMalloc(entries, char *, entryMax);
+    entryNum = 0;
+    failed = 0;
+    invalid = 0;
+    for (line = manifest; line; line = next) {
+        next = strchr(line, '\n');
+        if (next) *(next++) = '\0';
+        while (*line == ' ' || *line == '\t') line++;
+        end = line + strlen(line);
+        while (end > line && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) *(--end) = '\0';
+        if (*line == '\0' || *line == '#') continue; // Blank lines and comments.
+        if (!isJPEGFilename(line)) {
+            ARPRINTE("Error: '%s' is not a JPEG image (with suffix .jpeg/.jpg/.jpe). Skipping.\n", line);
+            invalid++;
+            continue;
         }
+        arMalloc(entries[entryNum], char, strlen(dir) + strlen(line) + 1);
+        if (line[0] == '/' || line[0] == '\\' || (line[0] && line[1] == ':')) strcpy(entries[entryNum], line);
+        else sprintf(entries[entryNum], "%s%s", dir, line);
+        entryNum++;
     }
+    free(manifest);
+    ARPRINT("Batch of %d images, cache in %s.\n", entryNum, cacheDir);
 
-    exitcode = E_NO_ERROR;
-    return (exitcode);
+#if HAVE_FORK_FUNC
+    if (jobs < 1) jobs = threadGetCPU();
+    if (jobs < 1) jobs = 1;
+    // Each job's feature map generation gets its share of the CPUs, rather than all of them.
+    featureMapThreadNum = threadGetCPU() / jobs;
+    if (featureMapThreadNum < 1) featureMapThreadNum = 1;
+    arMallocClear(pids, pid_t, jobs);
+    running = 0;
+    i = 0;
+    while (i < entryNum || running > 0) {
+        if (i < entryNum && running < jobs) {
+            for (k = 0; pids[k] != 0; k++);
+            fflush(NULL); // Don't let the child inherit buffered output.
+            pid = fork();
+            if (pid == 0) {
+                exitcodefile[0] = '\0'; // Only the parent reports the batch's exit code.
+                batchIndex = i;
+                strncpy(filename, entries[i], sizeof(filename) - 1);
+                filename[sizeof(filename) - 1] = '\0';
+                exit(genTexData());
+            }
+            if (pid < 0) {
+                ARPRINTE("Error: unable to start job for '%s'.\n", entries[i]);
+                failed++;
+            } else {
+                pids[k] = pid;
+                running++;
+            }
+            i++;
+            continue;
+        }
+        pid = wait(&status);
+        if (pid < 0) break;
+        for (k = 0; k < jobs && pids[k] != pid; k++);
+        if (k == jobs) continue;
+        pids[k] = 0;
+        running--;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != E_NO_ERROR) failed++;
+    }
+    free(pids);
+#else
+    // Without fork(), images are generated one after the other, and the first error ends the batch.
+    for (i = 0; i < entryNum; i++) {
+        batchIndex = i;
+        strncpy(filename, entries[i], sizeof(filename) - 1);
+        filename[sizeof(filename) - 1] = '\0';
+        dpi = dpiArg;
+        dpiMin = dpiMinArg;
+        dpiMax = dpiMaxArg;
+        if (genTexData() != E_NO_ERROR) failed++;
+    }
+#endif
+
+    for (i = 0; i < entryNum; i++) free(entries[i]);
+    free(entries);
+
+    ARPRINT("Batch done: %d of %d images failed, %d invalid entries skipped.\n", failed, entryNum, invalid);
+    return (failed || invalid ? E_DATA_PROCESSING_ERROR : E_NO_ERROR);
+}
+
+static int isJPEGFilename(const char *path)
+{
+    const char *sep = strrchr(path, '.');
+    return (sep && (!strcmp(sep, ".jpeg") || !strcmp(sep, ".jpg") || !strcmp(sep, ".jpe") || !strcmp(sep, ".JPEG") || !strcmp(sep, ".JPE") || !strcmp(sep, ".JPG")));
+}
+
+// FNV-1a hash of everything that determines the generated data set.
+static uint64_t hashBytes(uint64_t h, const void *data, size_t size)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    size_t               i;
+
+    for (i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return (h);
+}
+
+static uint64_t hashInputs(const ARUint8 *image)
+{
+    uint64_t    h = 0xcbf29ce484222325ULL;
+    int         version = CACHE_VERSION;
+
+    h = hashBytes(h, AR_HEADER_VERSION_STRING, strlen(AR_HEADER_VERSION_STRING));
+    h = hashBytes(h, &version, sizeof(version));
+    h = hashBytes(h, &xsize, sizeof(xsize));
+    h = hashBytes(h, &ysize, sizeof(ysize));
+    h = hashBytes(h, &nc, sizeof(nc));
+    h = hashBytes(h, image, (size_t)xsize*ysize*nc);
+    h = hashBytes(h, &dpi, sizeof(dpi));
+    h = hashBytes(h, &dpi_num, sizeof(dpi_num));
+    h = hashBytes(h, dpi_list, sizeof(float)*dpi_num);
+    h = hashBytes(h, &genfset, sizeof(genfset));
+    h = hashBytes(h, &genfset3, sizeof(genfset3));
+    h = hashBytes(h, &fset3v2, sizeof(fset3v2));
+    h = hashBytes(h, &genBundle, sizeof(genBundle));
+    if (genfset) {
+        h = hashBytes(h, &sd_thresh, sizeof(sd_thresh));
+        h = hashBytes(h, &min_thresh, sizeof(min_thresh));
+        h = hashBytes(h, &max_thresh, sizeof(max_thresh));
+        h = hashBytes(h, &occ_size, sizeof(occ_size));
+    }
+    if (genfset3) {
+        h = hashBytes(h, &featureDensity, sizeof(featureDensity));
+    }
+    return (h);
+}
+
+static int cacheExtWanted(int k)
+{
+    return (k == 0 || (k == 1 && genfset) || (k == 2 && genfset3) || (k == 3 && genBundle));
+}
+
+// Copies the cached files 'cacheBase'.* to 'outBase'.*. Returns 0 if all were in the cache,
+// -1 if not, or -2 if a path is too long.
+static int readCache(const char *cacheBase, const char *outBase)
+{
+    char        src[CACHE_EXT_NUM][MAXPATHLEN], dst[CACHE_EXT_NUM][MAXPATHLEN];
+    int         k;
+
+    for (k = 0; k < CACHE_EXT_NUM; k++) {
+        if (!cacheExtWanted(k)) continue;
+        if (snprintf(src[k], sizeof(src[k]), "%s.%s", cacheBase, cacheExt[k]) >= (int)sizeof(src[k])
+         || snprintf(dst[k], sizeof(dst[k]), "%s.%s", outBase, cacheExt[k]) >= (int)sizeof(dst[k])) {
+            ARPRINTE("Error: path too long: %s.%s\n", outBase, cacheExt[k]);
+            return (-2);
+        }
+        if (test_f(src[k], NULL) != 1) return (-1);
+    }
+    for (k = 0; k < CACHE_EXT_NUM; k++) {
+        if (!cacheExtWanted(k)) continue;
+        if (cp_f(src[k], dst[k]) < 0) {
+            ARPRINTE("Error copying '%s' to '%s'.\n", src[k], dst[k]);
+            return (-1);
+        }
+    }
+    return (0);
 }
 
-// Reads dpiMinAllowable, xsize, ysize, dpi, background, dpiMin, dpiMax.
+// Copies the generated files 'outBase'.* into the cache as 'cacheBase'.*. Each is written under a
+// temporary name and then renamed, so that other jobs never see a partly written file.
+// Failing to copy is only a warning. Returns -1 if a path is too long, otherwise 0.
+static int writeCache(const char *cacheBase, const char *outBase)
+{
+    char        src[MAXPATHLEN], tmp[MAXPATHLEN], dst[MAXPATHLEN];
+    int         k;
+    // Separate genTexData runs may share the cache, so the temporary name includes the process ID.
+#ifdef _WIN32
+    const long  pid = (long)GetCurrentProcessId();
+#else
+    const long  pid = (long)getpid();
+#endif
+
+    for (k = 0; k < CACHE_EXT_NUM; k++) {
+        if (!cacheExtWanted(k)) continue;
+        if (snprintf(src, sizeof(src), "%s.%s", outBase, cacheExt[k]) >= (int)sizeof(src)
+         || snprintf(tmp, sizeof(tmp), "%s.%s.%ld.%d", cacheBase, cacheExt[k], pid, batchIndex) >= (int)sizeof(tmp)
+         || snprintf(dst, sizeof(dst), "%s.%s", cacheBase, cacheExt[k]) >= (int)sizeof(dst)) {
+            ARPRINTE("Error: path too long caching %s.%s\n", outBase, cacheExt[k]);
+            return (-1);
+        }
+        if (test_f(dst, NULL) == 1) continue; // Another job got there first.
+        if (cp_f(src, tmp) < 0 || rename(tmp, dst) != 0) {
+            remove(tmp);
+            ARPRINTE("Warning: unable to cache '%s'.\n", src);
+        }
+    }
+    return (0);
+}
+
+// Reads dpiMinAllowable, xsize, ysize, dpi, background, batch, dpiMin, dpiMax.
 // Sets dpiMin, dpiMax, dpi_num, dpi_list.
 static int setDPI( void )
 {
@@ -512,7 +867,7 @@ static int setDPI( void )
     // Determine minimum allowable DPI, truncated to 3 decimal places.
     dpiMinAllowable = truncf(((float)KPM_MINIMUM_IMAGE_SIZE / (float)(MIN(xsize, ysize))) * dpi * 1000.0) / 1000.0f;
     
-    if (background) {
+    if (background || batch) {
         if (dpiMin == -1.0f) dpiMin = dpiMinAllowable;
         if (dpiMax == -1.0f) dpiMax = dpi;
     }
@@ -584,6 +939,22 @@ static void usage( char *com )
         ARPRINT("    -dpi=f: Override embedded JPEG DPI value.\n");
         ARPRINT("    -max_dpi=<max_dpi>\n");
         ARPRINT("    -min_dpi=<min_dpi>\n");
+        ARPRINT("    -fset3v2\n");
+        ARPRINT("         Write the .fset3 data in the version 2 format, with prebuilt search indices, which loads\n"
+                "         much faster but cannot be read by versions of artoolkitX before %s.\n", AR_HEADER_VERSION_STRING);
+        ARPRINT("    -bundle\n");
+        ARPRINT("         Also write the .iset, .fset and .fset3 data to a single bundle file (.%s),\n"
+                "         which loads much faster and is used in their place when present. Implies -fset3v2.\n", AR2_BUNDLE_EXT);
+        ARPRINT("    -batch=<path>\n");
+        ARPRINT("         Generate data for each JPEG image listed, one per line, in the file at <path>, instead\n"
+                "         of for <filename>. Relative paths are relative to <path>; lines starting with # are ignored.\n"
+                "         Unset extraction levels take their defaults.\n");
+        ARPRINT("    -jobs=n\n");
+        ARPRINT("         With -batch, generate data for n images at a time. Default is the number of CPUs. Each job\n"
+                "         generates feature maps on its share of the CPUs. (macOS and Linux only.)\n");
+        ARPRINT("    -cache=<dir>\n");
+        ARPRINT("         Copy data generated before from the same image pixels and parameters from <dir>, and\n"
+                "         add newly generated data to it. With -batch, defaults to '%s' beside the batch file.\n", CACHE_DIR_DEFAULT);
         ARPRINT("    -background\n");
         ARPRINT("         Run in background, i.e. as daemon detached from controlling terminal. (macOS and Linux only.)\n");
         ARPRINT("    -log=<path>\n");
@@ -635,6 +1006,10 @@ static int readImageFromFile(const char *filename, ARUint8 **image_p, int *xsize
         *ysize_p = jpegImage->ysize;
         if (*dpi_p == -1.0) {
             if( jpegImage->dpi == 0.0f ) {
+                if (batch) {
+                    ARPRINTE("Error: JPEG image '%s' does not contain embedded resolution data, and no resolution specified on command-line. Exiting.\n", filename);
+                    EXIT(E_INPUT_DATA_ERROR);
+                }
                 for (;;) {
                     printf("JPEG image '%s' does not contain embedded resolution data, and no resolution specified on command-line.\nEnter resolution to use (in decimal DPI): ", filename);
                     if( fgets( buf, 256, stdin ) == NULL ) {